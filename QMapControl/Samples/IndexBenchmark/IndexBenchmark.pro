@@ -0,0 +1,16 @@
+# Include sample configurations.
+include(../Samples.pri)
+
+# Target name.
+TARGET = IndexBenchmark
+
+# Target version.
+VERSION = 0.1
+
+# Build a console application.
+TEMPLATE = app
+CONFIG += console
+
+# Add source files.
+SOURCES +=                  \
+    src/main.cpp            \
@@ -0,0 +1,360 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+// Qt includes.
+#include <QtCore/QElapsedTimer>
+
+// STL includes.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// QMapControl includes.
+#include <QMapControl/LinearQuadTreeContainer.h>
+#include <QMapControl/QuadTreeContainer.h>
+
+using namespace qmapcontrol;
+
+namespace
+{
+    /// The objects stored in the containers (the same as LayerGeometry stores).
+    typedef std::shared_ptr<int> Object;
+
+    /// The points to load, and where to move them to.
+    struct Points
+    {
+        std::vector<PointWorldCoord> points_coord;
+        std::vector<PointWorldCoord> points_moved_coord;
+        std::vector<RectWorldCoord> ranges_coord;
+        std::vector<PointWorldCoord> nearest_coord;
+    };
+
+    /// A digest of the objects each query found, so the containers' results can be compared.
+    struct Results
+    {
+        std::vector<std::uint64_t> queries;
+        std::vector<std::uint64_t> nearest;
+        std::vector<std::uint64_t> queries_moved;
+    };
+
+    /*!
+     * Calculates a digest of the objects a query found (in any order, as the containers visit them in a different order).
+     * @param found The objects found.
+     * @return the digest.
+     */
+    std::uint64_t digest(const std::vector<Object>& found)
+    {
+        // Sort the objects' values.
+        std::vector<int> values;
+        values.reserve(found.size());
+        for(const auto& object : found)
+        {
+            values.push_back(*object);
+        }
+        std::sort(values.begin(), values.end());
+
+        // Hash the values (FNV-1a).
+        std::uint64_t return_digest(14695981039346656037ULL);
+        for(const auto& value : values)
+        {
+            return_digest = (return_digest ^ std::uint64_t(std::uint32_t(value))) * 1099511628211ULL;
+        }
+
+        // Return the digest.
+        return return_digest;
+    }
+
+    /*!
+     * Runs each range query on a container (untimed), and records a digest of what it found.
+     * @param return_digests The digest of each query is added to this.
+     * @param container The container to query.
+     * @param points The points to use.
+     */
+    template <class Container>
+    void digestQueries(std::vector<std::uint64_t>& return_digests, const Container& container, const Points& points)
+    {
+        // Loop through each range.
+        std::vector<Object> found;
+        for(const auto& range_coord : points.ranges_coord)
+        {
+            found.clear();
+            container.query(found, range_coord);
+            return_digests.push_back(digest(found));
+        }
+    }
+
+    /*!
+     * Checks that both containers found the same objects.
+     * @param name The name of the operation.
+     * @param digests The digests of what the QuadTreeContainer found.
+     * @param linear_digests The digests of what the LinearQuadTreeContainer found.
+     * @return whether every query found the same objects.
+     */
+    bool checkResults(const std::string& name, const std::vector<std::uint64_t>& digests, const std::vector<std::uint64_t>& linear_digests)
+    {
+        // Compare the digests.
+        const bool success(digests == linear_digests);
+
+        // Print the result.
+        std::printf("%-24s results match check %s\n", name.c_str(), success ? "passed" : "FAILED");
+        return success;
+    }
+
+    /*!
+     * Generates random points (clustered, like AIS or sensor tracks), moves and queries.
+     * @param count The number of points to generate.
+     * @return the points.
+     */
+    Points generatePoints(const size_t& count)
+    {
+        // The points to return.
+        Points return_points;
+
+        // Use a fixed seed, so each run is comparable.
+        std::mt19937 random(42);
+        std::uniform_real_distribution<double> longitude(-180.0, 180.0);
+        std::uniform_real_distribution<double> latitude(-85.0, 85.0);
+        std::normal_distribution<double> spread(0.0, 2.0);
+        std::normal_distribution<double> step(0.0, 0.01);
+
+        // Generate cluster centres.
+        std::vector<PointWorldCoord> centres;
+        for(size_t i = 0; i < 500; ++i)
+        {
+            centres.emplace_back(longitude(random), latitude(random));
+        }
+
+        // Generate the points around the centres, and a small move for each.
+        for(size_t i = 0; i < count; ++i)
+        {
+            const PointWorldCoord& centre(centres[i % centres.size()]);
+            const PointWorldCoord point_coord(std::max(-180.0, std::min(180.0, centre.longitude() + spread(random))), std::max(-90.0, std::min(90.0, centre.latitude() + spread(random))));
+            return_points.points_coord.push_back(point_coord);
+            return_points.points_moved_coord.emplace_back(point_coord.longitude() + step(random), point_coord.latitude() + step(random));
+        }
+
+        // Generate the query ranges (roughly a screen at a regional zoom) and nearest points.
+        for(size_t i = 0; i < 2000; ++i)
+        {
+            const PointWorldCoord& centre(centres[i % centres.size()]);
+            const PointWorldCoord top_left_coord(centre.longitude() + spread(random), centre.latitude() + spread(random));
+            return_points.ranges_coord.emplace_back(top_left_coord, PointWorldCoord(top_left_coord.longitude() + 10.0, top_left_coord.latitude() - 5.0));
+            return_points.nearest_coord.emplace_back(centre.longitude() + spread(random), centre.latitude() + spread(random));
+        }
+
+        // Return the points.
+        return return_points;
+    }
+
+    /*!
+     * Checks a container keeps every object when single inserts are followed by a small bulk insert (which links each
+     * object individually, and must not re-pack the entry buffer until the whole batch is linked).
+     * @param name The name of the container.
+     * @param container The (empty) container to check.
+     * @return whether every object can be found by its handle and by a query.
+     */
+    template <class Container>
+    bool checkBatchInsert(const std::string& name, Container& container)
+    {
+        // The boundary to query (the whole world).
+        const RectWorldCoord world_coord(PointWorldCoord(-180.0, 90.0), PointWorldCoord(180.0, -90.0));
+
+        // Spread the points across the world with a fixed seed.
+        std::mt19937 random(7);
+        std::uniform_real_distribution<double> longitude(-180.0, 180.0);
+        std::uniform_real_distribution<double> latitude(-85.0, 85.0);
+
+        // Insert the points one at a time.
+        std::vector<typename Container::Handle> handles;
+        for(int i = 0; i < 190; ++i)
+        {
+            handles.push_back(container.insert(PointWorldCoord(longitude(random), latitude(random)), std::make_shared<int>(i)));
+        }
+
+        // Insert a smaller batch of points in bulk.
+        std::vector<std::pair<RectWorldCoord, Object>> entries;
+        for(int i = 190; i < 290; ++i)
+        {
+            const PointWorldCoord point_coord(longitude(random), latitude(random));
+            entries.emplace_back(RectWorldCoord(point_coord, point_coord), std::make_shared<int>(i));
+        }
+        const auto batch_handles = container.insert(entries);
+        handles.insert(handles.end(), batch_handles.begin(), batch_handles.end());
+
+        // Check each handle still finds its object.
+        bool success(true);
+        for(size_t i = 0; i < handles.size(); ++i)
+        {
+            const Object* object(container.find(handles[i]));
+            success = success && object != nullptr && **object == int(i);
+        }
+
+        // Check a query finds every object.
+        std::vector<Object> found;
+        container.query(found, world_coord);
+        success = success && found.size() == handles.size();
+
+        // Print the result.
+        std::printf("%-24s batch insert check %s\n", name.c_str(), success ? "passed" : "FAILED");
+        return success;
+    }
+
+    /*!
+     * Benchmarks a container, printing the time of each operation.
+     * @param name The name of the container.
+     * @param container The (empty) container to benchmark.
+     * @param points The points to use.
+     * @return a digest of what each query found (gathered outside of the timings).
+     */
+    template <class Container>
+    Results benchmark(const std::string& name, Container& container, const Points& points)
+    {
+        // The digests to return.
+        Results return_results;
+
+        // Timer for each operation.
+        QElapsedTimer timer;
+
+        // Bulk load the points.
+        std::vector<std::pair<RectWorldCoord, Object>> entries;
+        entries.reserve(points.points_coord.size());
+        for(size_t i = 0; i < points.points_coord.size(); ++i)
+        {
+            entries.emplace_back(RectWorldCoord(points.points_coord[i], points.points_coord[i]), std::make_shared<int>(int(i)));
+        }
+        timer.start();
+        const auto handles = container.insert(entries);
+        const qint64 bulk_load_ms(timer.elapsed());
+
+        // Query the ranges.
+        size_t query_found(0);
+        std::vector<Object> found;
+        timer.start();
+        for(const auto& range_coord : points.ranges_coord)
+        {
+            found.clear();
+            container.query(found, range_coord);
+            query_found += found.size();
+        }
+        const qint64 query_ms(timer.elapsed());
+        digestQueries(return_results.queries, container, points);
+
+        // Fetch the 10 nearest points to each nearest point.
+        timer.start();
+        for(const auto& point_coord : points.nearest_coord)
+        {
+            found.clear();
+            container.queryNearest(found, point_coord, 10);
+        }
+        const qint64 nearest_ms(timer.elapsed());
+        for(const auto& point_coord : points.nearest_coord)
+        {
+            found.clear();
+            container.queryNearest(found, point_coord, 10);
+            return_results.nearest.push_back(digest(found));
+        }
+
+        // Move every point (like a live feed update).
+        timer.start();
+        for(size_t i = 0; i < handles.size(); ++i)
+        {
+            container.relocate(handles[i], RectWorldCoord(points.points_moved_coord[i], points.points_moved_coord[i]));
+        }
+        const qint64 relocate_ms(timer.elapsed());
+
+        // Query the ranges again (after the moves).
+        timer.start();
+        for(const auto& range_coord : points.ranges_coord)
+        {
+            found.clear();
+            container.query(found, range_coord);
+        }
+        const qint64 query_moved_ms(timer.elapsed());
+        digestQueries(return_results.queries_moved, container, points);
+
+        // Print the results.
+        std::printf("%-24s bulk load %6lld ms | %zu queries %6lld ms (%zu found) | %zu nearest %6lld ms | relocate %6lld ms | queries after relocate %6lld ms\n",
+                    name.c_str(), (long long)bulk_load_ms, points.ranges_coord.size(), (long long)query_ms, query_found,
+                    points.nearest_coord.size(), (long long)nearest_ms, (long long)relocate_ms, (long long)query_moved_ms);
+
+        // Return the digests.
+        return return_results;
+    }
+}
+
+/*!
+ * This sample application compares the QuadTreeContainer and LinearQuadTreeContainer index strategies
+ * (see LayerGeometry::setIndexStrategy) on a point-heavy data set (after checking each keeps every object across single and bulk inserts),
+ * and checks that both find the same objects for every range query, nearest query and range query after the points move.
+ *
+ * Usage: IndexBenchmark [number of points]
+ */
+int main(int argc, char *argv[])
+{
+    // Fetch the number of points to use.
+    const size_t count(argc > 1 ? size_t(std::strtoul(argv[1], nullptr, 10)) : 1000000);
+
+    // The boundary both containers cover (the whole world, as LayerGeometry uses).
+    const RectWorldCoord world_coord(PointWorldCoord(-180.0, 90.0), PointWorldCoord(180.0, -90.0));
+
+    // Check the containers keep every object across single and bulk inserts (with a small capacity, so nodes split often).
+    {
+        QuadTreeContainer<Object> container(4, world_coord);
+        LinearQuadTreeContainer<Object> linear_container(world_coord);
+        if(checkBatchInsert("QuadTreeContainer", container) == false || checkBatchInsert("LinearQuadTreeContainer", linear_container) == false)
+        {
+            return 1;
+        }
+    }
+
+    // Generate the points.
+    const Points points(generatePoints(count));
+    std::printf("Benchmarking %zu points...\n", count);
+
+    // Benchmark the quad tree.
+    Results results;
+    {
+        QuadTreeContainer<Object> container(50, world_coord);
+        results = benchmark("QuadTreeContainer", container, points);
+    }
+
+    // Benchmark the linear quad tree.
+    Results linear_results;
+    {
+        LinearQuadTreeContainer<Object> container(world_coord);
+        linear_results = benchmark("LinearQuadTreeContainer", container, points);
+    }
+
+    // Check both containers found the same objects (checking each, so every mismatch is printed).
+    bool success(checkResults("Range queries", results.queries, linear_results.queries));
+    success = checkResults("Nearest queries", results.nearest, linear_results.nearest) && success;
+    success = checkResults("Queries after relocate", results.queries_moved, linear_results.queries_moved) && success;
+
+    // Finished.
+    return success ? 0 : 1;
+}
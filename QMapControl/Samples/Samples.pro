@@ -5,6 +5,7 @@ TEMPLATE = subdirs
 SUBDIRS +=                  \
     Citymap                 \
     GPS                     \
+    IndexBenchmark          \
     LinesAndPoints          \
     Mapviewer               \
     Multidemo               \
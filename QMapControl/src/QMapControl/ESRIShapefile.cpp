@@ -25,13 +25,91 @@
 
 #include "ESRIShapefile.h"
 
+// Qt includes.
+#include <QtCore/QMutexLocker>
+
+// STL includes.
+#include <algorithm>
+#include <vector>
+
 // Local includes.
+#include "ImageManager.h"
 #include "Projection.h"
-
-#include <QDebug>
+#include "ProjectionCache.h"
 
 namespace qmapcontrol
 {
+    namespace
+    {
+        /// The maximum number of projected features to cache at each zoom.
+        const std::size_t features_px_maximum(25000);
+
+        /// The number of projections/zooms to cache the projected features at (the current zoom, and those zoomed from).
+        const std::size_t features_px_zooms_maximum(4);
+
+        /// The tolerance to simplify the projected features to (pixels).
+        const qreal features_px_simplify_tolerance_px(0.5);
+
+        /*!
+         * Projects the points of a line string (or ring) into pixels, simplified to what is visible at the zoom.
+         * @param ogr_line_string The line string to project.
+         * @param controller_zoom The current controller zoom.
+         * @return the projected (and simplified) points.
+         */
+        QPolygonF toPolygonPx(OGRLineString* ogr_line_string, const int& controller_zoom)
+        {
+            // Create a polygon of the points.
+            QPolygonF polygon_px;
+            polygon_px.reserve(ogr_line_string->getNumPoints());
+
+            // Loop through the points.
+            for(int i = 0; i < ogr_line_string->getNumPoints(); ++i)
+            {
+                // Add the point to be drawn.
+                polygon_px.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_line_string->getX(i), ogr_line_string->getY(i)), controller_zoom).rawPoint());
+            }
+
+            // Return the simplified points.
+            return ProjectionCache::simplifyPx(polygon_px, features_px_simplify_tolerance_px);
+        }
+
+        /*!
+         * Adds a projected polygon to a path, with its interior rings subtracted.
+         * @param path_px The path to add the polygon to.
+         * @param ogr_polygon The polygon to project.
+         * @param controller_zoom The current controller zoom.
+         */
+        void addPolygonPx(QPainterPath& path_px, OGRPolygon* ogr_polygon, const int& controller_zoom)
+        {
+            // Fetch the exterior ring.
+            const auto ogr_exterior_ring(ogr_polygon->getExteriorRing());
+            if(ogr_exterior_ring == nullptr)
+            {
+                // No exterior ring!
+            }
+            else
+            {
+                // Add the exterior ring.
+                path_px.addPolygon(toPolygonPx(ogr_exterior_ring, controller_zoom));
+
+                // Do we have any interior rings?
+                if(ogr_polygon->getNumInteriorRings() > 0)
+                {
+                    // Add each interior ring.
+                    QPainterPath interior_path_px;
+                    for(int i = 0; i < ogr_polygon->getNumInteriorRings(); ++i)
+                    {
+                        // Add the interior ring.
+                        interior_path_px.addPolygon(toPolygonPx(ogr_polygon->getInteriorRing(i), controller_zoom));
+                    }
+
+                    // Subtract the interior rings (holes).
+                    path_px = path_px.subtracted(interior_path_px);
+                }
+            }
+        }
+    }
+
     ESRIShapefile::ESRIShapefile(const std::string& file_path, const std::string& layer_name, const int& zoom_minimum, const int& zoom_maximum)
         : m_layer_name(layer_name), m_zoom_minimum(zoom_minimum), m_zoom_maximum(zoom_maximum)
     {
@@ -59,15 +137,11 @@ namespace qmapcontrol
 
     const QPen& ESRIShapefile::getPenPolygon() const
     {
-        // Do we have a pen?
-        if(m_pen_polygon == nullptr)
-        {
-            // Create a default pen.
-            m_pen_polygon = std::make_shared<QPen>();
-        }
+        // The default pen, for when none has been set (shared, so drawing never modifies us and is safe from several render threads).
+        static const QPen default_pen;
 
         // Get the pen to draw with.
-        return *(m_pen_polygon.get());
+        return m_pen_polygon == nullptr ? default_pen : *(m_pen_polygon.get());
     }
 
     void ESRIShapefile::setPenPolygon(const std::shared_ptr<QPen>& pen)
@@ -90,15 +164,11 @@ namespace qmapcontrol
 
     const QBrush& ESRIShapefile::getBrushPolygon() const
     {
-        // Do we have a brush?
-        if(m_brush_polygon == nullptr)
-        {
-            // Create a default brush.
-            m_brush_polygon = std::make_shared<QBrush>();
-        }
+        // The default brush, for when none has been set (shared, so drawing never modifies us and is safe from several render threads).
+        static const QBrush default_brush;
 
         // Get the brush to draw with.
-        return *(m_brush_polygon.get());
+        return m_brush_polygon == nullptr ? default_brush : *(m_brush_polygon.get());
     }
 
     void ESRIShapefile::setBrushPolygon(const std::shared_ptr<QBrush>& brush)
@@ -121,15 +191,11 @@ namespace qmapcontrol
 
     const QPen& ESRIShapefile::getPenLineString() const
     {
-        // Do we have a pen?
-        if(m_pen_linestring == nullptr)
-        {
-            // Create a default pen.
-            m_pen_linestring = std::make_shared<QPen>();
-        }
+        // The default pen, for when none has been set (shared, so drawing never modifies us and is safe from several render threads).
+        static const QPen default_pen;
 
         // Get the pen to draw with.
-        return *(m_pen_linestring.get());
+        return m_pen_linestring == nullptr ? default_pen : *(m_pen_linestring.get());
     }
 
     void ESRIShapefile::setPenLineString(const std::shared_ptr<QPen>& pen)
@@ -162,233 +228,217 @@ namespace qmapcontrol
             // Calculate the world coordinates.
             const RectWorldCoord backbuffer_rect_coord(projection::get().toPointWorldCoord(backbuffer_rect_px.topLeftPx(), controller_zoom), projection::get().toPointWorldCoord(backbuffer_rect_px.bottomRightPx(), controller_zoom));
 
-            // Do we have a data set open?
-            if(m_ogr_data_set != nullptr)
+            // The features within the backbuffer rect (read under the lock, but drawn after it is released, so other render
+            // threads only wait for the features to be read rather than drawn).
+            std::vector<OGRFeature*> ogr_features;
+
+            // Scope the locker to ensure the mutex is release as soon as possible.
             {
-                // Do we have a layer name set?
-                if(m_layer_name.empty() == false)
+                // Gain a lock to protect the OGR data set's reading state.
+                QMutexLocker locker(&m_ogr_data_set_mutex);
+
+                // Do we have a data set open?
+                if(m_ogr_data_set != nullptr)
                 {
-                    // Get layer.
-                    const auto ogr_layer(m_ogr_data_set->GetLayerByName(m_layer_name.c_str()));
-                    if(ogr_layer == nullptr)
-                    {
-                        // Invalid layer name!
-                    }
-                    else
+                    // Do we have a layer name set?
+                    if(m_layer_name.empty() == false)
                     {
-                        // Reset reading.
-                        ogr_layer->ResetReading();
-
-                        // Set the Spatial Filter.
-                        ogr_layer->SetSpatialFilterRect(backbuffer_rect_coord.rawRect().left(), backbuffer_rect_coord.rawRect().top(), backbuffer_rect_coord.rawRect().right(), backbuffer_rect_coord.rawRect().bottom());
-
-                        // Loop through features.
-                        OGRFeature* ogr_feature;
-                        while((ogr_feature = ogr_layer->GetNextFeature()) != nullptr)
+                        // Get layer.
+                        const auto ogr_layer(m_ogr_data_set->GetLayerByName(m_layer_name.c_str()));
+                        if(ogr_layer == nullptr)
                         {
-                            // Draw the feature.
-                            drawFeature(ogr_feature, painter, controller_zoom);
-
-                            // Destroy the feature.
-                            OGRFeature::DestroyFeature(ogr_feature);
+                            // Invalid layer name!
+                        }
+                        else
+                        {
+                            // Read the layer's features.
+                            readFeatures(ogr_features, ogr_layer, backbuffer_rect_coord);
                         }
                     }
-                }
-                else
-                {
-                    // Loop through and draw each layer.
-                    for(int i = 0; i < m_ogr_data_set->GetLayerCount(); ++i)
+                    else
                     {
-                        // Get layer.
-                        const auto ogr_layer(m_ogr_data_set->GetLayer(i));
-                        if(ogr_layer != nullptr)
+                        // Loop through and read each layer.
+                        for(int i = 0; i < m_ogr_data_set->GetLayerCount(); ++i)
                         {
-                            // Reset reading.
-                            ogr_layer->ResetReading();
-
-                            // Set the Spatial Filter.
-                            ogr_layer->SetSpatialFilterRect(backbuffer_rect_coord.rawRect().left(), backbuffer_rect_coord.rawRect().top(), backbuffer_rect_coord.rawRect().right(), backbuffer_rect_coord.rawRect().bottom());
-
-                            // Loop through features.
-                            OGRFeature* ogr_feature;
-                            while((ogr_feature = ogr_layer->GetNextFeature()) != nullptr)
+                            // Get layer.
+                            const auto ogr_layer(m_ogr_data_set->GetLayer(i));
+                            if(ogr_layer != nullptr)
                             {
-                                // Draw the feature.
-                                drawFeature(ogr_feature, painter, controller_zoom);
-
-                                // Destroy the feature.
-                                OGRFeature::DestroyFeature(ogr_feature);
+                                // Read the layer's features.
+                                readFeatures(ogr_features, ogr_layer, backbuffer_rect_coord);
                             }
                         }
                     }
                 }
             }
+
+            // Loop through features (each is a copy owned by us).
+            for(const auto& ogr_feature : ogr_features)
+            {
+                // Draw the feature.
+                drawFeature(ogr_feature, painter, controller_zoom);
+
+                // Destroy the feature.
+                OGRFeature::DestroyFeature(ogr_feature);
+            }
         }
     }
 
-    void ESRIShapefile::drawFeature(OGRFeature* ogr_feature, QPainter& painter, const int& controller_zoom) const
+    void ESRIShapefile::readFeatures(std::vector<OGRFeature*>& return_features, OGRLayer* ogr_layer, const RectWorldCoord& rect_coord) const
     {
-        // Fetch geometries.
-        const auto ogr_geometry(ogr_feature->GetGeometryRef());
-        if(ogr_geometry == nullptr)
+        // Reset reading.
+        ogr_layer->ResetReading();
+
+        // Set the Spatial Filter.
+        ogr_layer->SetSpatialFilterRect(rect_coord.rawRect().left(), rect_coord.rawRect().top(), rect_coord.rawRect().right(), rect_coord.rawRect().bottom());
+
+        // Loop through features.
+        OGRFeature* ogr_feature;
+        while((ogr_feature = ogr_layer->GetNextFeature()) != nullptr)
         {
-            // No geometry to fetch!
+            // Add the feature.
+            return_features.push_back(ogr_feature);
         }
-        // Is it a polygon.
-        else if(wkbFlatten(ogr_geometry->getGeometryType()) == wkbPolygon)
-        {
-            // Cast to a polygon.
-            const auto ogr_polygon(static_cast<OGRPolygon*>(ogr_geometry));
-
-            // Fetch the exterior ring.
-            const auto ogr_exterior_ring(ogr_polygon->getExteriorRing());
-            if(ogr_exterior_ring == nullptr)
-            {
-                // No exterior ring!
-            }
-            else
-            {
-                QPainterPath path;
+    }
 
-                // Prepare storage for point.
-                OGRPoint ogr_point;
+    void ESRIShapefile::drawFeature(OGRFeature* ogr_feature, QPainter& painter, const int& controller_zoom) const
+    {
+        // Fetch the projected shape of the feature.
+        const FeaturePx feature_px(featurePx(ogr_feature, controller_zoom));
 
-                // Create a polygon of the points.
-                QPolygonF polygon_px;
+        // Do we have polygons to draw?
+        if(feature_px.polygons_px.isEmpty() == false)
+        {
+            // Set the pen to use.
+            painter.setPen(getPenPolygon());
 
-                // Loop through the points.
-                for(int i = 0; i < ogr_exterior_ring->getNumPoints(); ++i)
-                {
-                    // Fetch the point.
-                    ogr_exterior_ring->getPoint(i, &ogr_point);
+            // Set the brush to use.
+            painter.setBrush(getBrushPolygon());
 
-                    // Add the point to be drawn.
-                    polygon_px.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_point.getX(), ogr_point.getY()), controller_zoom).rawPoint());
-                }
+            // Draw the polygons.
+            painter.drawPath(feature_px.polygons_px);
+        }
+        // Do we have a line string to draw?
+        else if(feature_px.line_string_px.isEmpty() == false)
+        {
+            // Set the pen to use.
+            painter.setPen(getPenLineString());
 
-                path.addPolygon(polygon_px);
+            // Draw the polygon line.
+            painter.drawPolyline(feature_px.line_string_px);
+        }
+    }
 
-                QPainterPath inp;
-                for (int i = 0; i < ogr_polygon->getNumInteriorRings(); ++i) {
-                    auto inn = ogr_polygon->getInteriorRing(i);
-                    QPolygonF pf;
-                    for (int j = 0; j < inn->getNumPoints(); ++j) {
-                        inn->getPoint(j, &ogr_point);
-                        pf.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_point.getX(), ogr_point.getY()), controller_zoom).rawPoint());
-                    }
-                    inp.addPolygon(pf);
-                }
+    ESRIShapefile::FeaturePx ESRIShapefile::featurePx(OGRFeature* ogr_feature, const int& controller_zoom) const
+    {
+        // The projected shape to return.
+        FeaturePx return_feature_px;
 
-                path = path.subtracted(inp);
+        // Build the cache key (FIDs are only unique within a layer).
+        const std::pair<const OGRFeatureDefn*, GIntBig> key(ogr_feature->GetDefnRef(), ogr_feature->GetFID());
+        const bool cacheable(key.second != OGRNullFID);
 
-                // Set the pen to use.
-                painter.setPen(getPenPolygon());
+        // Fetch what the feature will be projected with.
+        const int epsg(projection::get().epsg());
+        const int tile_size_px(ImageManager::get().tileSizePx());
 
-                // Set the brush to use.
-                painter.setBrush(getBrushPolygon());
+        // Scope the lock to the cache look-up.
+        {
+            // Gain a lock to protect the cache.
+            QMutexLocker locker(&m_features_px_mutex);
 
-                // Draw the polygon line.
-                painter.drawPath(path);
+            // Do we have the feature cached at this zoom/projection?
+            if(cacheable)
+            {
+                // Find the feature in the cache.
+                const FeaturesPx& features_px(featuresPxAt(epsg, tile_size_px, controller_zoom));
+                const auto itr_find(features_px.features.find(key));
+                if(itr_find != features_px.features.end())
+                {
+                    // Return the cached shape (implicitly shared, so no copy takes place).
+                    return itr_find->second;
+                }
             }
         }
+
+        // Fetch geometries.
+        const auto ogr_geometry(ogr_feature->GetGeometryRef());
+        if(ogr_geometry == nullptr)
+        {
+            // No geometry to fetch!
+        }
+        // Is it a polygon.
+        else if(wkbFlatten(ogr_geometry->getGeometryType()) == wkbPolygon)
+        {
+            // Add the polygon.
+            addPolygonPx(return_feature_px.polygons_px, static_cast<OGRPolygon*>(ogr_geometry), controller_zoom);
+        }
+        // Is it a multi polygon.
         else if(wkbFlatten(ogr_geometry->getGeometryType()) == wkbMultiPolygon)
         {
-            qDebug() << "MultiPoly";
             // Cast to a multi polygon.
             const auto ogr_multi_polygon(static_cast<OGRMultiPolygon*>(ogr_geometry));
-            if(ogr_multi_polygon == nullptr)
+
+            // Loop through each polygon.
+            for(int i = 0; i < ogr_multi_polygon->getNumGeometries(); ++i)
             {
-                // No multi polygons!
+                // Add the polygon.
+                addPolygonPx(return_feature_px.polygons_px, static_cast<OGRPolygon*>(ogr_multi_polygon->getGeometryRef(i)), controller_zoom);
             }
-            else
-            {
-                QPainterPath path;
-
-                // Loop through each polygon.
-                for(int i = 0; i < ogr_multi_polygon->getNumGeometries(); ++i)
-                {
-                    // Cast to a polygon.
-                    const auto ogr_polygon(static_cast<OGRPolygon*>(ogr_multi_polygon->getGeometryRef(i)));
-
-                    // Fetch the exterior ring.
-                    const auto ogr_exterior_ring(ogr_polygon->getExteriorRing());
-                    if(ogr_exterior_ring == nullptr)
-                    {
-                        // No exterior ring!
-                    }
-                    else
-                    {
-                        // Prepare storage for point.
-                        OGRPoint ogr_point;
-
-                        // Create a polygon of the points.
-                        QPolygonF polygon_px;
-
-                        // Loop through the points.
-                        for(int i = 0; i < ogr_exterior_ring->getNumPoints(); ++i)
-                        {
-                            // Fetch the point.
-                            ogr_exterior_ring->getPoint(i, &ogr_point);
-
-                            // Add the point to be drawn.
-                            polygon_px.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_point.getX(), ogr_point.getY()), controller_zoom).rawPoint());
-                        }
-
-                        path.addPolygon(polygon_px);
-
-                        QPainterPath inp;
-                        for (int i = 0; i < ogr_polygon->getNumInteriorRings(); ++i) {
-                            auto inn = ogr_polygon->getInteriorRing(i);
-                            QPolygonF pf;
-                            for (int j = 0; j < inn->getNumPoints(); ++j) {
-                                inn->getPoint(j, &ogr_point);
-                                pf.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_point.getX(), ogr_point.getY()), controller_zoom).rawPoint());
-                            }
-                            inp.addPolygon(pf);
-                        }
-
-                        path = path.subtracted(inp);
-
-                    }
-                }
-
-                // Set the pen to use.
-                painter.setPen(getPenPolygon());
-
-                // Set the brush to use.
-                painter.setBrush(getBrushPolygon());
+        }
+        // Is it a line string.
+        else if(wkbFlatten(ogr_geometry->getGeometryType()) == wkbLineString)
+        {
+            // Project the line string.
+            return_feature_px.line_string_px = toPolygonPx(static_cast<OGRLineString*>(ogr_geometry), controller_zoom);
+        }
 
-                // Draw the polygon line.
-                painter.drawPath(path);
+        // Can the feature be cached?
+        if(cacheable)
+        {
+            // Gain a lock to protect the cache.
+            QMutexLocker locker(&m_features_px_mutex);
 
+            // Bound the cache, in case of a very large data set at a high zoom.
+            FeaturesPx& features_px(featuresPxAt(epsg, tile_size_px, controller_zoom));
+            if(features_px.features.size() >= features_px_maximum)
+            {
+                // Start again.
+                features_px.features.clear();
             }
-        }
-        else if(wkbFlatten(ogr_geometry->getGeometryType()) == wkbLineString) // wkbLineString
-        {
-            // Cast to a line string.
-            const auto ogr_line_string(static_cast<OGRLineString*>(ogr_geometry));
 
-            // Prepare storage for point.
-            OGRPoint ogr_point;
+            // Cache the projected shape.
+            features_px.features[key] = return_feature_px;
+        }
 
-            // Create a polygon of the points.
-            QPolygonF polygon_line_px;
+        // Return the projected shape.
+        return return_feature_px;
+    }
 
-            // Loop through the points.
-            for(int i = 0; i < ogr_line_string->getNumPoints(); ++i)
+    ESRIShapefile::FeaturesPx& ESRIShapefile::featuresPxAt(const int& epsg, const int& tile_size_px, const int& controller_zoom) const
+    {
+        // Find the features projected with this projection/zoom.
+        auto itr_find = std::find_if(m_features_px.begin(), m_features_px.end(), [&](const FeaturesPx& features_px) { return features_px.epsg == epsg && features_px.tile_size_px == tile_size_px && features_px.zoom == controller_zoom; });
+        if(itr_find == m_features_px.end())
+        {
+            // Evict the least recently used projection/zoom, if we have reached the maximum.
+            if(m_features_px.size() >= features_px_zooms_maximum)
             {
-                // Fetch the point.
-                ogr_line_string->getPoint(i, &ogr_point);
-
-                // Add the point to be drawn.
-                polygon_line_px.append(projection::get().toPointWorldPx(PointWorldCoord(ogr_point.getX(), ogr_point.getY()), controller_zoom).rawPoint());
+                m_features_px.pop_back();
             }
 
-            // Set the pen to use.
-            painter.setPen(getPenLineString());
-
-            // Draw the polygon line.
-            painter.drawPolyline(polygon_line_px);
+            // Add an empty cache for the projection/zoom.
+            FeaturesPx features_px;
+            features_px.epsg = epsg;
+            features_px.tile_size_px = tile_size_px;
+            features_px.zoom = controller_zoom;
+            itr_find = m_features_px.insert(m_features_px.end(), std::move(features_px));
         }
+
+        // Mark it as the most recently used.
+        std::rotate(m_features_px.begin(), itr_find, itr_find + 1);
+
+        // Return the projected features.
+        return m_features_px.front();
     }
 }
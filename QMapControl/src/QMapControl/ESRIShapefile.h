@@ -26,17 +26,23 @@
 #pragma once
 
 // Qt includes.
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtGui/QBrush>
 #include <QtGui/QPainter>
+#include <QtGui/QPainterPath>
 #include <QtGui/QPen>
+#include <QtGui/QPolygonF>
 
 // GDAL includes.
 #include <gdal/ogrsf_frmts.h>
 
 // STL includes.
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 // Local includes.
 #include "qmapcontrol_global.h"
@@ -141,6 +147,59 @@ namespace qmapcontrol
          */
         virtual void drawFeature(OGRFeature* ogr_feature, QPainter& painter, const int& controller_zoom) const;
 
+    private:
+        /*!
+         * Reads the features of an OGR layer within a rect (the OGR data set mutex must be held).
+         * @param return_features The features read are added to this (the caller must destroy them).
+         * @param ogr_layer The layer to read.
+         * @param rect_coord The rect to read features within (world coordinates).
+         */
+        void readFeatures(std::vector<OGRFeature*>& return_features, OGRLayer* ogr_layer, const RectWorldCoord& rect_coord) const;
+
+        /// The projected shape of a feature (only one of the polygons/line string is set).
+        struct FeaturePx
+        {
+            /// The polygons (including holes) to draw (pixels).
+            QPainterPath polygons_px;
+
+            /// The line string to draw (pixels).
+            QPolygonF line_string_px;
+        };
+
+        /*!
+         * Fetches the projected shape of a feature, from the cache if it has already been projected at this zoom.
+         * @param ogr_feature The feature to project.
+         * @param controller_zoom The current controller zoom.
+         * @return the projected shape of the feature.
+         */
+        FeaturePx featurePx(OGRFeature* ogr_feature, const int& controller_zoom) const;
+
+        /// The features projected at one zoom, keyed by the feature's layer definition and FID.
+        struct FeaturesPx
+        {
+            /// The EPSG of the projection the features were projected with.
+            int epsg;
+
+            /// The tile size the features were projected with.
+            int tile_size_px;
+
+            /// The zoom the features were projected at.
+            int zoom;
+
+            /// The projected features.
+            std::map<std::pair<const OGRFeatureDefn*, GIntBig>, FeaturePx> features;
+        };
+
+        /*!
+         * Fetches the projected features cache for a projection and zoom, marking it as the most recently used (the
+         * features mutex must be held).
+         * @param epsg The EPSG of the projection.
+         * @param tile_size_px The tile size.
+         * @param controller_zoom The zoom.
+         * @return the projected features cache.
+         */
+        FeaturesPx& featuresPxAt(const int& epsg, const int& tile_size_px, const int& controller_zoom) const;
+
     signals:
         /*!
          * Signal emitted when a change has occurred that requires the layer to be redrawn.
@@ -161,12 +220,21 @@ namespace qmapcontrol
         int m_zoom_maximum;
 
         /// The pen to use when drawing a polygon.
-        mutable std::shared_ptr<QPen> m_pen_polygon;
+        std::shared_ptr<QPen> m_pen_polygon;
 
         /// The brush to use when drawing a polygon.
-        mutable std::shared_ptr<QBrush> m_brush_polygon;
+        std::shared_ptr<QBrush> m_brush_polygon;
 
         /// The pen to use when drawing a linestring.
-        mutable std::shared_ptr<QPen> m_pen_linestring;
+        std::shared_ptr<QPen> m_pen_linestring;
+
+        /// Mutex to protect the OGR data set (OGR layers keep their reading state, so only one render thread can read them at a time).
+        mutable QMutex m_ogr_data_set_mutex;
+
+        /// Mutex to protect the projected features cache.
+        mutable QMutex m_features_px_mutex;
+
+        /// The projected features cache for the last few projections/zooms drawn, most recently used first.
+        mutable std::vector<FeaturesPx> m_features_px;
     };
 }
@@ -25,6 +25,10 @@
 
 #include "Geometry.h"
 
+// Local includes.
+#include "LayerGeometry.h"
+#include "StyleRegistry.h"
+
 namespace qmapcontrol
 {
     Geometry::Geometry(const GeometryType& geometry_type, const int& zoom_minimum, const int& zoom_maximum)
@@ -33,6 +37,12 @@ namespace qmapcontrol
           m_zoom_maximum(zoom_maximum),
           m_z_index(0),
           m_visible(true),
+          m_layer_handle(QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle()),
+          m_layer_z_index(0),
+          m_layer_damaged_rect_coord(),
+          m_layer_damaged_margin_px(-1.0),
+          m_layer_places_label(false),
+          mLayer(nullptr),
           m_metadata_displayed_key(""),
           m_metadata_displayed_zoom_minimum(10),
           m_metadata_displayed_alignment_type(AlignmentType::TopRight),
@@ -44,7 +54,21 @@ namespace qmapcontrol
 
     int Geometry::zIndex() const { return m_z_index; }
 
-    void Geometry::setZIndex(int z_index) { m_z_index = z_index; }
+    void Geometry::setZIndex(int z_index)
+    {
+        // Has the z-index changed?
+        if(m_z_index != z_index)
+        {
+            // Set the new z-index.
+            m_z_index = z_index;
+
+            // Re-order the geometry on its layer.
+            updateLayerIndex();
+
+            // Emit that we need to redraw to display this change.
+            emit requestRedraw();
+        }
+    }
 
     const Geometry::GeometryType& Geometry::geometryType() const
     {
@@ -81,23 +105,20 @@ namespace qmapcontrol
         }
     }
 
-    const QPen& Geometry::pen()
+    const QPen& Geometry::pen() const
     {
-        // Do we have a pen?
-        if(m_pen == nullptr)
-        {
-            // Create a default pen.
-            m_pen = std::make_shared<QPen>();
-        }
+        // The default pen, for when none has been set (shared, so drawing never modifies us and is safe from several render threads).
+        static const QPen default_pen;
 
         // Get the pen to draw with.
-        return *(m_pen.get());
+        return m_pen == nullptr ? default_pen : *(m_pen.get());
     }
 
     void Geometry::setPen(const std::shared_ptr<QPen>& pen)
     {
-        // Set the pen to draw with.
-        m_pen = pen;
+        // Set the pen to draw with (an interned copy, as drawing from several render threads must not see the caller's
+        // pen change, or the default pen if none is given).
+        m_pen = pen == nullptr ? nullptr : StyleRegistry::get().pen(*pen);
 
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
@@ -106,29 +127,26 @@ namespace qmapcontrol
     void Geometry::setPen(const QPen& pen)
     {
         // Set the pen to draw with.
-        m_pen = std::make_shared<QPen>(pen);
+        m_pen = StyleRegistry::get().pen(pen);
 
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
     }
 
-    const QBrush& Geometry::brush()
+    const QBrush& Geometry::brush() const
     {
-        // Do we have a brush?
-        if(m_brush == nullptr)
-        {
-            // Create a default brush.
-            m_brush = std::make_shared<QBrush>();
-        }
+        // The default brush, for when none has been set (shared, so drawing never modifies us and is safe from several render threads).
+        static const QBrush default_brush;
 
         // Get the brush to draw with.
-        return *(m_brush.get());
+        return m_brush == nullptr ? default_brush : *(m_brush.get());
     }
 
     void Geometry::setBrush(const std::shared_ptr<QBrush>& brush)
     {
-        // Set the brush to draw with.
-        m_brush = brush;
+        // Set the brush to draw with (an interned copy, as drawing from several render threads must not see the caller's
+        // brush change, or the default brush if none is given).
+        m_brush = brush == nullptr ? nullptr : StyleRegistry::get().brush(*brush);
 
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
@@ -137,22 +155,68 @@ namespace qmapcontrol
     void Geometry::setBrush(const QBrush& brush)
     {
         // Set the brush to draw with.
-        m_brush = std::make_shared<QBrush>(brush);
+        m_brush = StyleRegistry::get().brush(brush);
 
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
     }
 
-    QVariant& Geometry::metadata(const std::string& key) const
+    void Geometry::style(const int& controller_zoom, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush) const
     {
-        // Return the value for the key.
-        return m_metadata[key];
+        // The default pen and brush, for when none has been set (interned, so they group with any equal style).
+        static const std::shared_ptr<const QPen> default_pen(StyleRegistry::get().pen(QPen()));
+        static const std::shared_ptr<const QBrush> default_brush(StyleRegistry::get().brush(QBrush()));
+
+        // Default to the geometry's own pen and brush.
+        return_pen = m_pen == nullptr ? default_pen : m_pen;
+        return_brush = m_brush == nullptr ? default_brush : m_brush;
+
+        // Fetch the owning layer's style rules that matched the geometry.
+        const std::shared_ptr<const std::vector<StyleRule>> style_rules(std::atomic_load(&m_layer_style_rules));
+        if(style_rules != nullptr)
+        {
+            // Find the first rule that applies at this zoom.
+            for(const auto& style_rule : *style_rules)
+            {
+                if(style_rule.appliesAt(controller_zoom))
+                {
+                    // Use the rule's pen and brush (where it has them).
+                    if(style_rule.pen != nullptr)
+                    {
+                        return_pen = style_rule.pen;
+                    }
+                    if(style_rule.brush != nullptr)
+                    {
+                        return_brush = style_rule.brush;
+                    }
+
+                    // Finished.
+                    break;
+                }
+            }
+        }
+    }
+
+    QVariant Geometry::metadata(const std::string& key) const
+    {
+        // Find the value for the key (without inserting it, so this is safe from several render threads).
+        const auto itr_find = m_metadata.find(key);
+
+        // Return the value for the key, or a null value if it has not been set.
+        return itr_find == m_metadata.end() ? QVariant() : itr_find->second;
     }
 
     void Geometry::setMetadata(const std::string& key, const QVariant& value)
     {
         // Set the meta-data.
         m_metadata[key] = value;
+
+        // Is this the meta-data value displayed?
+        if(key == m_metadata_displayed_key)
+        {
+            // Emit that we need to redraw to display this change.
+            emit requestRedraw();
+        }
     }
 
     void Geometry::setMetadataDisplayed(const std::string& key, const int& zoom_minimum, const AlignmentType& alignment_type, const double& alignment_offset_px)
@@ -167,6 +231,34 @@ namespace qmapcontrol
         emit requestRedraw();
     }
 
+    void Geometry::updateLayerIndex()
+    {
+        // Are we on a layer?
+        if(mLayer != nullptr)
+        {
+            // Re-index this geometry on the layer.
+            mLayer->relocateGeometry(this);
+        }
+    }
+
+    bool Geometry::metadataDisplayed(const int& controller_zoom) const
+    {
+        // Do we have a meta-data value, should we display it at this zoom, and is it not placed by the layer?
+        return controller_zoom >= m_metadata_displayed_zoom_minimum && m_layer_places_label == false && metadata(m_metadata_displayed_key).isNull() == false;
+    }
+
+    bool Geometry::atlasFragment(QPainter::PixmapFragment& /*return_fragment*/, std::shared_ptr<const QImage>& /*return_atlas*/, const RectWorldCoord& /*backbuffer_rect_coord*/, const int& /*controller_zoom*/) const
+    {
+        // By default, geometries draw themselves.
+        return false;
+    }
+
+    bool Geometry::stylePolygons(std::vector<QPolygonF>& /*return_polygons_px*/, bool& /*return_closed*/, std::shared_ptr<const QPen>& /*return_pen*/, std::shared_ptr<const QBrush>& /*return_brush*/, const RectWorldCoord& /*backbuffer_rect_coord*/, const int& /*controller_zoom*/)
+    {
+        // By default, geometries draw themselves.
+        return false;
+    }
+
     PointWorldPx Geometry::calculateTopLeftPoint(const PointWorldPx& point_px, const AlignmentType& alignment_type, const QSizeF& geometry_size_px) const
     {
         // Default world point to return.
@@ -29,13 +29,17 @@
 #include <QtCore/QObject>
 #include <QtCore/QVariant>
 #include <QtGui/QBrush>
+#include <QtGui/QImage>
 #include <QtGui/QPainter>
 #include <QtGui/QPen>
+#include <QtGui/QPolygonF>
 
 // STL includes.
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 // Local includes.
 #include "qmapcontrol_global.h"
@@ -44,6 +48,7 @@
 namespace qmapcontrol
 {
     class LayerGeometry;
+    struct StyleRule;
 
     //! Main class for objects that should be painted in maps.
     /*!
@@ -125,7 +130,7 @@ namespace qmapcontrol
         int zIndex() const;
 
         /*!
-         * Set the ZIndex of this geometry
+         * Set the ZIndex of this geometry (geometries with a higher z-index are drawn on top).
          * \param z_index
          */
         void setZIndex(int z_index);
@@ -151,13 +156,14 @@ namespace qmapcontrol
 
         /*!
          * Fetches the pen to draw the geometry with (outline).
-         * @return the QPen to used for drawing.
+         * @return the QPen to used for drawing (a default pen if none has been set).
          */
-        const QPen& pen();
+        const QPen& pen() const;
 
         /*!
          * Sets the pen to draw the geometry with (outline).
-         * @param pen The QPen to used for drawing.
+         * @note A copy of the pen is kept, so later changes to it are not drawn until it is set again.
+         * @param pen The QPen to used for drawing (or nullptr for the default pen).
          */
         virtual void setPen(const std::shared_ptr<QPen>& pen);
 
@@ -169,13 +175,14 @@ namespace qmapcontrol
 
         /*!
          * Fetches the brush to draw the geometry with (fill).
-         * @return the QBrush to used for drawing.
+         * @return the QBrush to used for drawing (a default brush if none has been set).
          */
-        const QBrush& brush();
+        const QBrush& brush() const;
 
         /*!
          * Sets the brush to draw the geometry with (fill).
-         * @param brush The QBrush to used for drawing.
+         * @note A copy of the brush is kept, so later changes to it are not drawn until it is set again.
+         * @param brush The QBrush to used for drawing (or nullptr for the default brush).
          */
         virtual void setBrush(const std::shared_ptr<QBrush>& brush);
 
@@ -185,12 +192,22 @@ namespace qmapcontrol
          */
         virtual void setBrush(const QBrush& brush);
 
+        /*!
+         * Fetches the pen and brush to draw the geometry with at a zoom.
+         * The first of the owning layer's style rules (that matched the geometry when it was added) that applies at
+         * the zoom is used, otherwise the geometry's own pen and brush.
+         * @param controller_zoom The current controller zoom.
+         * @param return_pen The interned pen to draw with.
+         * @param return_brush The interned brush to draw with.
+         */
+        void style(const int& controller_zoom, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush) const;
+
         /*!
          * Fetches a meta-data value.
          * @param key The meta-data key.
-         * @return the meta-data value.
+         * @return the meta-data value (null if it has not been set).
          */
-        QVariant& metadata(const std::string& key) const;
+        QVariant metadata(const std::string& key) const;
 
         /*!
          * Set a meta-data key/value.
@@ -217,8 +234,20 @@ namespace qmapcontrol
          */
         PointWorldPx calculateTopLeftPoint(const PointWorldPx& point_px, const AlignmentType& alignment_type, const QSizeF& geometry_size_px) const;
 
+        /*!
+         * Checks whether the geometry should draw its meta-data value at the zoom (it does not if its layer places the label instead).
+         * @param controller_zoom The current controller zoom.
+         * @return whether to draw the meta-data value.
+         */
+        bool metadataDisplayed(const int& controller_zoom) const;
+
         LayerGeometry *layer() const { return mLayer; }
 
+        /*!
+         * Notifies the owning layer that the geometry's position or extent has changed, so it can be re-indexed.
+         */
+        void updateLayerIndex();
+
         AncillaryData *ancillaryData() const { return mAncillaryData; }
         void setAncillaryData(AncillaryData *ptr) {
             mAncillaryData = ptr;
@@ -261,6 +290,28 @@ namespace qmapcontrol
          */
         virtual void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) = 0;
 
+        /*!
+         * Fetches the geometry as a fragment of an atlas image, so the layer can draw it in a batch with others.
+         * @param return_fragment The fragment to draw (pixels).
+         * @param return_atlas The atlas image to draw the fragment from (null if there is nothing to draw).
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the geometry can be drawn as a fragment (otherwise draw() is used).
+         */
+        virtual bool atlasFragment(QPainter::PixmapFragment& return_fragment, std::shared_ptr<const QImage>& return_atlas, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) const;
+
+        /*!
+         * Fetches the geometry as (clipped) pixel polygons, so the layer can draw it in a batch with others of the same style.
+         * @param return_polygons_px The polygons to draw, appended to (pixels).
+         * @param return_closed Whether the polygons are closed and filled with the brush (otherwise they are drawn as polylines).
+         * @param return_pen The pen to draw the polygons with.
+         * @param return_brush The brush to fill closed polygons with.
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the geometry can be drawn in a style batch (otherwise draw() is used).
+         */
+        virtual bool stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom);
+
     signals:
         /*!
          * Signal emitted when a geometry is clicked.
@@ -303,13 +354,31 @@ namespace qmapcontrol
         bool m_visible;
 
         /// The pen to use when drawing a geometry.
-        std::shared_ptr<QPen> m_pen;
+        std::shared_ptr<const QPen> m_pen;
 
         /// The brush to use when drawing a geometry.
-        std::shared_ptr<QBrush> m_brush;
+        std::shared_ptr<const QBrush> m_brush;
 
         /// Meta-data storage.
-        mutable std::map<std::string, QVariant> m_metadata;
+        std::map<std::string, QVariant> m_metadata;
+
+        /// The handle of this geometry in the owning layer's geometries container (protected by the layer's geometries mutex).
+        size_t m_layer_handle;
+
+        /// The z-index of the owning layer's geometries container this geometry is in (protected by the layer's geometries mutex).
+        int m_layer_z_index;
+
+        /// The bounding box the owning layer last reported this geometry as drawn over (protected by the layer's damaged mutex).
+        RectWorldCoord m_layer_damaged_rect_coord;
+
+        /// The margin around that bounding box the geometry was drawn with in pixels (negative if it has not been reported).
+        qreal m_layer_damaged_margin_px;
+
+        /// Whether the owning layer places the meta-data value label (so the geometry does not draw it).
+        std::atomic<bool> m_layer_places_label;
+
+        /// The owning layer's style rules that matched the geometry, in order (accessed atomically, as the layer may replace them while drawing).
+        std::shared_ptr<const std::vector<StyleRule>> m_layer_style_rules;
 
     protected:
         LayerGeometry *mLayer;
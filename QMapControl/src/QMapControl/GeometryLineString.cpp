@@ -25,8 +25,11 @@
 
 #include "GeometryLineString.h"
 
+// STL includes.
+#include <algorithm>
+
 // Local includes.
-#include "Projection.h"
+#include "GeometryUtils.h"
 
 namespace qmapcontrol
 {
@@ -53,6 +56,12 @@ namespace qmapcontrol
         // Add the point.
         m_points.push_back(point);
 
+        // Invalidate the cached bounding box and projected points.
+        m_projection_cache.invalidate();
+
+        // Re-index the geometry on its layer.
+        updateLayerIndex();
+
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
     }
@@ -62,24 +71,35 @@ namespace qmapcontrol
         // Set the new points.
         m_points = points;
 
+        // Invalidate the cached bounding box and projected points.
+        m_projection_cache.invalidate();
+
+        // Re-index the geometry on its layer.
+        updateLayerIndex();
+
         // Emit that we need to redraw to display this change.
         emit requestRedraw();
     }
 
-    RectWorldCoord GeometryLineString::boundingBox(const int& /*controller_zoom*/) const
+    qreal GeometryLineString::simplifyTolerancePx() const
     {
-        // Create a polygon of the points.
-        QPolygonF polygon_line;
+        // Return the tolerance.
+        return m_projection_cache.simplifyTolerancePx();
+    }
 
-        // Loop through each point to add to the polygon.
-        for(const auto& point : m_points)
-        {
-            // Add the point to be drawn.
-            polygon_line.append(point.rawPoint());
-        }
+    void GeometryLineString::setSimplifyTolerancePx(const qreal& simplify_tolerance_px)
+    {
+        // Set the tolerance.
+        m_projection_cache.setSimplifyTolerancePx(simplify_tolerance_px);
+
+        // Emit that we need to redraw to display this change.
+        emit requestRedraw();
+    }
 
-        // Return the bounding box.
-        return RectWorldCoord::fromQRectF(polygon_line.boundingRect());
+    RectWorldCoord GeometryLineString::boundingBox(const int& /*controller_zoom*/) const
+    {
+        // Return the (cached) bounding box.
+        return m_projection_cache.boundingBox(m_points);
     }
 
     bool GeometryLineString::touches(const Geometry* geometry, const int& controller_zoom) const
@@ -126,35 +146,73 @@ namespace qmapcontrol
         // Check the geometry is visible.
         if(isVisible(controller_zoom))
         {
-            // Create a polygon of the points.
-            QPolygonF polygon_line;
-
-            // Loop through each point to add to the polygon.
-            for(const auto& point : m_points)
+            // Does the bounding box intersect with the backbuffer rect?
+            if(m_projection_cache.intersects(m_points, backbuffer_rect_coord))
             {
-                // Add the point to be drawn.
-                polygon_line.append(point.rawPoint());
-            }
+                // Fetch the (cached) projected points, simplified to this zoom.
+                const QPolygonF polygon_line_px(m_projection_cache.toPolygonPx(m_points, controller_zoom));
 
-            // Does the polygon intersect with the backbuffer rect?
-            if(QPolygonF(backbuffer_rect_coord.rawRect()).intersected(polygon_line).empty() == false)
-            {
-                // Create a polygon of the points.
-                QPolygonF polygon_line_px;
+                // Fetch the style to draw with at this zoom.
+                std::shared_ptr<const QPen> style_pen;
+                std::shared_ptr<const QBrush> style_brush;
+                style(controller_zoom, style_pen, style_brush);
 
-                // Loop through each point to add to the polygon.
-                for(const auto& point : m_points)
-                {
-                    // Add the point to be drawn.
-                    polygon_line_px.append(projection::get().toPointWorldPx(point, controller_zoom).rawPoint());
-                }
+                // Clip the line to the backbuffer rect, with a guard band so the pen's caps/joins are not clipped (this avoids rasterising the parts that are off-screen).
+                const QPen& line_pen(*style_pen);
+                const QRectF clip_rect_px(geometry_utils::clipRectPx(backbuffer_rect_coord, controller_zoom, line_pen.widthF() * std::max(line_pen.miterLimit(), qreal(1.0)) + 2.0));
+                thread_local std::vector<QPolygonF> t_lines_px;
+                thread_local std::vector<qreal> t_offsets_px;
+                geometry_utils::clipLinePx(polygon_line_px, clip_rect_px, t_lines_px, t_offsets_px);
 
                 // Set the pen to use.
-                painter.setPen(pen());
+                painter.setPen(line_pen);
 
-                // Draw the polygon line.
-                painter.drawPolyline(polygon_line_px);
+                // Draw each part of the line that is within the backbuffer rect.
+                for(std::size_t i = 0; i < t_lines_px.size(); ++i)
+                {
+                    // Is the line dashed, and the part does not start at the beginning of the line?
+                    if(line_pen.style() != Qt::SolidLine && t_offsets_px[i] > 0.0)
+                    {
+                        // Continue the dash pattern from where the part starts (the dash offset is in units of the pen width).
+                        QPen dashed_pen(line_pen);
+                        dashed_pen.setDashOffset(line_pen.dashOffset() + t_offsets_px[i] / std::max(line_pen.widthF(), qreal(1.0)));
+                        painter.setPen(dashed_pen);
+                    }
+
+                    // Draw the polygon line.
+                    painter.drawPolyline(t_lines_px[i]);
+                }
             }
         }
     }
+
+    bool GeometryLineString::stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom)
+    {
+        // Fetch the style to draw with at this zoom.
+        style(controller_zoom, return_pen, return_brush);
+        return_closed = false;
+
+        // Is the line dashed (so each part needs its own dash offset)?
+        if(return_pen->style() != Qt::SolidLine && return_pen->style() != Qt::NoPen)
+        {
+            // Draw the line individually.
+            return false;
+        }
+
+        // Check the geometry is visible, and its bounding box intersects with the backbuffer rect.
+        if(isVisible(controller_zoom) && return_pen->style() != Qt::NoPen && m_projection_cache.intersects(m_points, backbuffer_rect_coord))
+        {
+            // Clip the (cached) projected points, simplified to this zoom, to the backbuffer rect (with a guard band for the pen's caps/joins).
+            const QRectF clip_rect_px(geometry_utils::clipRectPx(backbuffer_rect_coord, controller_zoom, return_pen->widthF() * std::max(return_pen->miterLimit(), qreal(1.0)) + 2.0));
+            thread_local std::vector<QPolygonF> t_lines_px;
+            thread_local std::vector<qreal> t_offsets_px;
+            geometry_utils::clipLinePx(m_projection_cache.toPolygonPx(m_points, controller_zoom), clip_rect_px, t_lines_px, t_offsets_px);
+
+            // Add each part of the line that is within the backbuffer rect.
+            return_polygons_px.insert(return_polygons_px.end(), t_lines_px.begin(), t_lines_px.end());
+        }
+
+        // The line can be drawn in a style batch.
+        return true;
+    }
 }
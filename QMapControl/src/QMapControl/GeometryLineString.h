@@ -32,6 +32,7 @@
 #include "qmapcontrol_global.h"
 #include "Geometry.h"
 #include "Point.h"
+#include "ProjectionCache.h"
 
 namespace qmapcontrol
 {
@@ -84,6 +85,18 @@ namespace qmapcontrol
          */
         void setPoints(const std::vector<PointWorldCoord>& points);
 
+        /*!
+         * Fetches the tolerance the projected points are simplified to when drawn.
+         * @return the tolerance (pixels, 0 if disabled).
+         */
+        qreal simplifyTolerancePx() const;
+
+        /*!
+         * Sets the tolerance to simplify the projected points to when drawn (defaults to half a pixel).
+         * @param simplify_tolerance_px The tolerance (pixels, 0 to draw every point).
+         */
+        void setSimplifyTolerancePx(const qreal& simplify_tolerance_px);
+
     public:
         /*!
          * Fetches the bounding box (world coordinates).
@@ -108,6 +121,18 @@ namespace qmapcontrol
          */
         void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom);
 
+        /*!
+         * Fetches the geometry as (clipped) pixel polygons, so the layer can draw it in a batch with others of the same style.
+         * @param return_polygons_px The polygons to draw, appended to (pixels).
+         * @param return_closed Whether the polygons are closed and filled with the brush (otherwise they are drawn as polylines).
+         * @param return_pen The pen to draw the polygons with.
+         * @param return_brush The brush to fill closed polygons with.
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the geometry can be drawn in a style batch (dashed lines are drawn individually, to continue their dash pattern).
+         */
+        bool stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) final;
+
     private:
         //! Disable copy constructor.
         GeometryLineString(const GeometryLineString&); /// @todo remove once MSVC supports default/delete syntax.
@@ -118,5 +143,8 @@ namespace qmapcontrol
     private:
         /// The points that the linestring is made up of.
         std::vector<PointWorldCoord> m_points;
+
+        /// The cached bounding box and projected points.
+        mutable ProjectionCache m_projection_cache;
     };
 }
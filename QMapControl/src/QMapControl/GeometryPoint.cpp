@@ -2,6 +2,7 @@
 
 // Local includes.
 #include "GeometryPolygon.h"
+#include "GeometryUtils.h"
 #include "Projection.h"
 
 namespace qmapcontrol
@@ -34,6 +35,9 @@ namespace qmapcontrol
             // Set the new point.
             m_point_coord = point;
 
+            // Re-index the geometry on its layer.
+            updateLayerIndex();
+
             // Emit that we need to redraw to display this change.
             emit requestRedraw();
 
@@ -61,6 +65,12 @@ namespace qmapcontrol
         return RectWorldCoord(projection::get().toPointWorldCoord(top_left_point_px, controller_zoom), projection::get().toPointWorldCoord(bottom_right_point_px, controller_zoom));
     }
 
+    QSizeF GeometryPoint::symbolSizePx(const int& /*controller_zoom*/) const
+    {
+        // A plain point is drawn as a single pixel.
+        return QSizeF(1.0, 1.0);
+    }
+
     bool GeometryPoint::touches(const Geometry* geometry, const int& controller_zoom) const
     {
         // Default return success.
@@ -95,7 +105,7 @@ namespace qmapcontrol
                 case GeometryType::GeometryPolygon:
                 {
                     // Check if the poylgon intersects with our bounding box.
-                    if(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF().intersected(boundingBox(controller_zoom).rawRect()).empty() == false)
+                    if(geometry_utils::polygonIntersectsRect(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF(), boundingBox(controller_zoom).rawRect()))
                     {
                         // Set that we have touched.
                         return_touches = true;
@@ -136,7 +146,7 @@ namespace qmapcontrol
                 painter.drawPoint(point_px.rawPoint());
 
                 // Do we have a meta-data value and should we display it at this zoom?
-                if(controller_zoom >= m_metadata_displayed_zoom_minimum && metadata(m_metadata_displayed_key).isNull() == false)
+                if(metadataDisplayed(controller_zoom))
                 {
                     /// @todo calculate correct alignment for metadata displayed offset.
 
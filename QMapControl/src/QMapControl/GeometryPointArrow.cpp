@@ -1,7 +1,41 @@
 #include "GeometryPointArrow.h"
 
+// Local includes.
+#include "ImageAtlas.h"
+#include "Projection.h"
+#include "ShapeCache.h"
+
 namespace qmapcontrol
 {
+    namespace
+    {
+        /*!
+         * Draws an arrow (pointing up) centred on the painter's origin.
+         * @param painter The painter to draw with.
+         * @param pen The pen to draw the arrow with (outline).
+         * @param brush The brush to draw the arrow with (fill).
+         * @param size_px The size of the arrow (pixels).
+         */
+        void drawArrow(QPainter& painter, const QPen& pen, const QBrush& brush, const QSize& size_px)
+        {
+            // Set the pen and brush.
+            painter.setPen(pen);
+            painter.setBrush(brush);
+
+            // Add points to create arrow shape.
+            const qreal half_width_px(size_px.width() / 2.0);
+            const qreal half_height_px(size_px.height() / 2.0);
+            QPolygonF arrow;
+            arrow << PointPx(0.0, -half_height_px).rawPoint();
+            arrow << PointPx(half_width_px, half_height_px).rawPoint();
+            arrow << PointPx(0.0, 0.0).rawPoint();
+            arrow << PointPx(-half_width_px, half_height_px).rawPoint();
+
+            // Draw the arrow.
+            painter.drawPolygon(arrow);
+        }
+    }
+
     GeometryPointArrow::GeometryPointArrow(const PointWorldCoord& point_coord, const QSizeF& size_px, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointImage(point_coord, QPixmap(size_px.toSize()), zoom_minimum, zoom_maximum)
     {
@@ -9,35 +43,114 @@ namespace qmapcontrol
         updateShape();
     }
 
-    void GeometryPointArrow::updateShape()
+    void GeometryPointArrow::draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom)
+    {
+        // Fetch the arrow already rotated (which is not possible for some styles, or with meta-data text to draw).
+        ShapeCache::Key key;
+        const std::shared_ptr<const QImage> rotated_image(rotatedImage(key, controller_zoom));
+        if(rotated_image == nullptr)
+        {
+            // Draw the image pixmap rotated as it is drawn.
+            GeometryPointImage::draw(painter, backbuffer_rect_coord, controller_zoom);
+        }
+        // Check the geometry is visible.
+        else if(isVisible(controller_zoom))
+        {
+            // Check if the bounding boxes intersect.
+            const RectWorldCoord pixmap_rect_coord(boundingBox(controller_zoom));
+            if(backbuffer_rect_coord.rawRect().intersects(pixmap_rect_coord.rawRect()))
+            {
+                // Calculate the pixmap rect to draw within.
+                const RectWorldPx pixmap_rect_px(projection::get().toPointWorldPx(pixmap_rect_coord.topLeftCoord(), controller_zoom), projection::get().toPointWorldPx(pixmap_rect_coord.bottomRightCoord(), controller_zoom));
+
+                // Draw the rotated image at the center point (without transforming the painter).
+                painter.drawImage(pixmap_rect_px.centerPx().rawPoint() - QPointF(rotated_image->width() / 2.0, rotated_image->height() / 2.0), *rotated_image);
+            }
+        }
+    }
+
+    bool GeometryPointArrow::atlasFragment(QPainter::PixmapFragment& return_fragment, std::shared_ptr<const QImage>& return_atlas, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) const
     {
-        // Create a pixmap of the required size.
-        QPixmap image_pixmap(sizePx().toSize());
+        // Fetch the arrow already rotated (which is not possible for some styles, or with meta-data text to draw).
+        ShapeCache::Key key;
+        const std::shared_ptr<const QImage> rotated_image(rotatedImage(key, controller_zoom));
+        if(rotated_image == nullptr)
+        {
+            // Use the image pixmap rotated as it is drawn.
+            return GeometryPointImage::atlasFragment(return_fragment, return_atlas, backbuffer_rect_coord, controller_zoom);
+        }
+
+        // Check if the bounding boxes intersect.
+        const RectWorldCoord pixmap_rect_coord(boundingBox(controller_zoom));
+        if(backbuffer_rect_coord.rawRect().intersects(pixmap_rect_coord.rawRect()) == false)
+        {
+            // There is nothing to draw.
+            return_atlas.reset();
+            return true;
+        }
+
+        // Fetch where the rotated arrow is packed, by its style (this fails if the atlases are full).
+        QRectF source_rect;
+        if(ImageAtlas::get().sprite(key, rotated_image, return_atlas, source_rect) == false)
+        {
+            // Draw the arrow individually.
+            return false;
+        }
+
+        // Calculate the pixmap rect to draw within.
+        const RectWorldPx pixmap_rect_px(projection::get().toPointWorldPx(pixmap_rect_coord.topLeftCoord(), controller_zoom), projection::get().toPointWorldPx(pixmap_rect_coord.bottomRightCoord(), controller_zoom));
+
+        // Draw the packed arrow at the center point (it is already rotated).
+        return_fragment = QPainter::PixmapFragment::create(pixmap_rect_px.centerPx().rawPoint(), source_rect);
 
-        // Reset the image pixmap.
-        image_pixmap.fill(Qt::transparent);
+        // The arrow can be drawn as a fragment.
+        return true;
+    }
 
-        // Create a painter for the image pixmap.
-        QPainter painter(&image_pixmap);
+    void GeometryPointArrow::updateShape()
+    {
+        // Fetch the pen, brush and size to draw with.
+        const QPen arrow_pen(pen());
+        const QBrush arrow_brush(brush());
+        const QSize size_px(sizePx().toSize());
+        const auto draw_shape = [&](QPainter& painter) { drawArrow(painter, arrow_pen, arrow_brush, size_px); };
 
-        // Ensure antialiasing is enabled.
-        painter.setRenderHints(QPainter::Antialiasing, true);
+        // Can the arrow be cached (unrotated, as the rotation is applied when the image pixmap is drawn)?
+        ShapeCache::Key key;
+        if(ShapeCache::get().key(key, "arrow", 0, arrow_pen, arrow_brush, sizePx(), 1.0, 0.0))
+        {
+            // Set the image pixmap, shared with every identically styled arrow.
+            setImage(ShapeCache::get().pixmap(key, draw_shape), false);
+        }
+        else
+        {
+            // Set the image pixmap, drawn just for this arrow.
+            setImage(std::make_shared<QPixmap>(QPixmap::fromImage(ShapeCache::render(key, draw_shape))), false);
+        }
+    }
 
-        // Set the pen and brush.
-        painter.setPen(pen());
-        painter.setBrush(brush());
+    std::shared_ptr<const QImage> GeometryPointArrow::rotatedImage(ShapeCache::Key& return_key, const int& controller_zoom) const
+    {
+        // Do we have a meta-data value and should we display it at this zoom?
+        if(metadataDisplayed(controller_zoom))
+        {
+            // Draw the arrow (and its text) as an image pixmap.
+            return nullptr;
+        }
 
-        // Add points to create arrow shape.
-        QPolygonF arrow;
-        arrow << PointPx((image_pixmap.width() / 2.0), 0.0).rawPoint();
-        arrow << PointPx(image_pixmap.width(), image_pixmap.height()).rawPoint();
-        arrow << PointPx((image_pixmap.width() / 2.0), (image_pixmap.height() / 2.0)).rawPoint();
-        arrow << PointPx(0.0, image_pixmap.height()).rawPoint();
+        // Fetch the pen, brush and size to draw with.
+        const QPen arrow_pen(pen());
+        const QBrush arrow_brush(brush());
+        const QSize size_px(sizePx().toSize());
 
-        // Draw the arrow.
-        painter.drawPolygon(arrow);
+        // Can the rotated arrow be cached?
+        if(ShapeCache::get().key(return_key, "arrow", 0, arrow_pen, arrow_brush, sizePx(), 1.0, rotation()) == false)
+        {
+            // Draw the arrow as an image pixmap.
+            return nullptr;
+        }
 
-        // Set the image pixmap.
-        setImage(image_pixmap, false);
+        // Return the rotated arrow, shared with every identically styled arrow at this rotation.
+        return ShapeCache::get().image(return_key, [&](QPainter& painter) { drawArrow(painter, arrow_pen, arrow_brush, size_px); });
     }
 }
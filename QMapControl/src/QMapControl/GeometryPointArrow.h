@@ -27,6 +27,7 @@
 // Local includes.
 #include "qmapcontrol_global.h"
 #include "GeometryPointImage.h"
+#include "ShapeCache.h"
 
 namespace qmapcontrol
 {
@@ -66,10 +67,38 @@ namespace qmapcontrol
         //! Disable copy assignment.
         GeometryPointArrow& operator=(const GeometryPointArrow&); /// @todo remove once MSVC supports default/delete syntax.
 
+    public:
+        /*!
+         * Draws the geometry to a pixmap using the provided painter.
+         * @param painter The painter that will draw to the pixmap.
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         */
+        void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) final;
+
+        /*!
+         * Fetches the arrow (already rotated) as a fragment of a shared atlas image.
+         * @param return_fragment The fragment to draw (pixels).
+         * @param return_atlas The atlas image to draw the fragment from (null if there is nothing to draw).
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the arrow can be drawn as a fragment.
+         */
+        bool atlasFragment(QPainter::PixmapFragment& return_fragment, std::shared_ptr<const QImage>& return_atlas, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) const final;
+
     protected:
         /*!
          * Updates the shape (draws an arrow on to the image pixmap).
          */
         void updateShape() final;
+
+    private:
+        /*!
+         * Fetches the arrow rasterised at its rotation (rounded to the shape cache's rotation step).
+         * @param return_key The style the rotated arrow is cached with.
+         * @param controller_zoom The current controller zoom.
+         * @return the rotated arrow, or null if it must be drawn from the image pixmap instead.
+         */
+        std::shared_ptr<const QImage> rotatedImage(ShapeCache::Key& return_key, const int& controller_zoom) const;
     };
 }
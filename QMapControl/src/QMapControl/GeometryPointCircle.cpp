@@ -1,7 +1,31 @@
 #include "GeometryPointCircle.h"
 
+// Local includes.
+#include "ShapeCache.h"
+
 namespace qmapcontrol
 {
+    namespace
+    {
+        /*!
+         * Draws a circle centred on the painter's origin.
+         * @param painter The painter to draw with.
+         * @param pen The pen to draw the circle with (outline).
+         * @param brush The brush to draw the circle with (fill).
+         * @param size_px The size of the circle (pixels).
+         */
+        void drawCircle(QPainter& painter, const QPen& pen, const QBrush& brush, const QSize& size_px)
+        {
+            // Set the pen and brush.
+            painter.setPen(pen);
+            painter.setBrush(brush);
+
+            // Draw the ellipse.
+            const double center_px(size_px.width() / 2.0);
+            painter.drawEllipse(QPointF(0.0, 0.0), center_px - pen.widthF(), center_px - pen.widthF());
+        }
+    }
+
     GeometryPointCircle::GeometryPointCircle(const PointWorldCoord& point_coord, const QSizeF& size_px, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointImage(point_coord, QPixmap(size_px.toSize()), zoom_minimum, zoom_maximum)
     {
@@ -11,27 +35,23 @@ namespace qmapcontrol
 
     void GeometryPointCircle::updateShape()
     {
-        // Create a pixmap of the required size.
-        QPixmap image_pixmap(sizePx().toSize());
-
-        // Reset the image pixmap.
-        image_pixmap.fill(Qt::transparent);
-
-        // Create a painter for the image pixmap.
-        QPainter painter(&image_pixmap);
-
-        // Ensure antialiasing is enabled.
-        painter.setRenderHints(QPainter::Antialiasing, true);
-
-        // Set the pen and brush.
-        painter.setPen(pen());
-        painter.setBrush(brush());
-
-        // Draw the ellipse.
-        const double center_px(image_pixmap.width() / 2.0);
-        painter.drawEllipse(PointWorldPx(center_px, center_px).rawPoint(), center_px - pen().widthF(), center_px - pen().widthF());
-
-        // Set the image pixmap.
-        setImage(image_pixmap, false);
+        // Fetch the pen, brush and size to draw with.
+        const QPen circle_pen(pen());
+        const QBrush circle_brush(brush());
+        const QSize size_px(sizePx().toSize());
+        const auto draw_shape = [&](QPainter& painter) { drawCircle(painter, circle_pen, circle_brush, size_px); };
+
+        // Can the circle be cached (the rotation is applied when the image pixmap is drawn)?
+        ShapeCache::Key key;
+        if(ShapeCache::get().key(key, "circle", 0, circle_pen, circle_brush, sizePx(), 1.0, 0.0))
+        {
+            // Set the image pixmap, shared with every identically styled circle.
+            setImage(ShapeCache::get().pixmap(key, draw_shape), false);
+        }
+        else
+        {
+            // Set the image pixmap, drawn just for this circle.
+            setImage(std::make_shared<QPixmap>(QPixmap::fromImage(ShapeCache::render(key, draw_shape))), false);
+        }
     }
 }
@@ -1,16 +1,11 @@
 #include "GeometryPointImage.h"
 
 // Local includes.
+#include "ImageAtlas.h"
 #include "Projection.h"
 
 namespace qmapcontrol
 {
-    namespace
-    {
-        /// Default empty image pixmap.
-        std::unique_ptr<QPixmap> m_image_null = nullptr;
-    }
-
     GeometryPointImage::GeometryPointImage(const PointWorldCoord& point_coord, const std::shared_ptr<QPixmap>& image, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointShape(point_coord, image->size(), zoom_minimum, zoom_maximum),
           m_image(image)
@@ -27,7 +22,7 @@ namespace qmapcontrol
 
     GeometryPointImage::GeometryPointImage(const PointWorldCoord& point_coord, const std::string& filename, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointShape(point_coord, QSizeF(0, 0), zoom_minimum, zoom_maximum),
-          m_image(std::make_shared<QPixmap>(filename.c_str()))
+          m_image(ImageAtlas::get().pixmapFromFile(filename))
     {
         // Update the image size (as we have to wait for it to be loaded in the constructor).
         setSizePx(m_image->size());
@@ -38,15 +33,11 @@ namespace qmapcontrol
         // Is the image pixmap currently null?
         if(m_image == nullptr)
         {
-            // Have we already constructed the null image pixmap?
-            if(m_image_null == nullptr)
-            {
-                // Construct the null image pixmap.
-                m_image_null.reset(new QPixmap);
-            }
+            // Default empty image pixmap (constructed once, so this is safe from several render threads).
+            static const QPixmap image_null;
 
             // Return the null image pixmap.
-            return *(m_image_null.get());
+            return image_null;
         }
         else
         {
@@ -99,7 +90,7 @@ namespace qmapcontrol
                 painter.translate(-pixmap_rect_px.centerPx().rawPoint());
 
                 // Do we have a meta-data value and should we display it at this zoom?
-                if(controller_zoom >= m_metadata_displayed_zoom_minimum && metadata(m_metadata_displayed_key).isNull() == false)
+                if(metadataDisplayed(controller_zoom))
                 {
                     /// @todo calculate correct alignment for metadata displayed offset.
 
@@ -109,4 +100,50 @@ namespace qmapcontrol
             }
         }
     }
+
+    bool GeometryPointImage::atlasFragment(QPainter::PixmapFragment& return_fragment, std::shared_ptr<const QImage>& return_atlas, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) const
+    {
+        // Fetch the image pixmap (the atlas holds on to where it is packed until it is released).
+        const std::shared_ptr<QPixmap> pixmap(m_image);
+
+        // Is the image drawn at a different size to the pixmap (or is there no image)?
+        if(pixmap == nullptr || pixmap->isNull() || sizePx() != QSizeF(pixmap->size()))
+        {
+            // Draw the image individually.
+            return false;
+        }
+
+        // Do we have a meta-data value and should we display it at this zoom?
+        if(metadataDisplayed(controller_zoom))
+        {
+            // Draw the image (and its text) individually.
+            return false;
+        }
+
+        // Check if the bounding boxes intersect.
+        const RectWorldCoord pixmap_rect_coord(boundingBox(controller_zoom));
+        if(backbuffer_rect_coord.rawRect().intersects(pixmap_rect_coord.rawRect()) == false)
+        {
+            // There is nothing to draw.
+            return_atlas.reset();
+            return true;
+        }
+
+        // Fetch where the image is packed (this fails if the atlases are full).
+        QRectF source_rect;
+        if(ImageAtlas::get().sprite(pixmap, return_atlas, source_rect) == false)
+        {
+            // Draw the image individually.
+            return false;
+        }
+
+        // Calculate the pixmap rect to draw within.
+        const RectWorldPx pixmap_rect_px(projection::get().toPointWorldPx(pixmap_rect_coord.topLeftCoord(), controller_zoom), projection::get().toPointWorldPx(pixmap_rect_coord.bottomRightCoord(), controller_zoom));
+
+        // Draw the packed image at the center point with the required rotation.
+        return_fragment = QPainter::PixmapFragment::create(pixmap_rect_px.centerPx().rawPoint(), source_rect, 1.0, 1.0, rotation(), 1.0);
+
+        // The image can be drawn as a fragment.
+        return true;
+    }
 }
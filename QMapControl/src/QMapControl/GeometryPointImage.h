@@ -116,7 +116,17 @@ namespace qmapcontrol
          * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
          * @param controller_zoom The current controller zoom.
          */
-        void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) final;
+        void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) override;
+
+        /*!
+         * Fetches the image as a fragment of a shared atlas image (when it is drawn unscaled without meta-data).
+         * @param return_fragment The fragment to draw (pixels).
+         * @param return_atlas The atlas image to draw the fragment from (null if there is nothing to draw).
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the image can be drawn as a fragment.
+         */
+        bool atlasFragment(QPainter::PixmapFragment& return_fragment, std::shared_ptr<const QImage>& return_atlas, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) const override;
 
     private:
         /// The image pixmap to draw.
@@ -1,16 +1,11 @@
 #include "GeometryPointImageScaled.h"
 
 // Local includes.
+#include "ImageAtlas.h"
 #include "Projection.h"
 
 namespace qmapcontrol
 {
-    namespace
-    {
-        /// Default empty image pixmap.
-        std::unique_ptr<QPixmap> m_image_null = nullptr;
-    }
-
     GeometryPointImageScaled::GeometryPointImageScaled(const PointWorldCoord& point_coord, const std::shared_ptr<QPixmap>& image, const int& base_zoom, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointShapeScaled(point_coord, image->size(), base_zoom, zoom_minimum, zoom_maximum),
           m_image(image)
@@ -27,7 +22,7 @@ namespace qmapcontrol
 
     GeometryPointImageScaled::GeometryPointImageScaled(const PointWorldCoord& point_coord, const std::string& filename, const int& base_zoom, const int& zoom_minimum, const int& zoom_maximum)
         : GeometryPointShapeScaled(point_coord, QSizeF(0, 0), base_zoom, zoom_minimum, zoom_maximum),
-          m_image(std::make_shared<QPixmap>(filename.c_str()))
+          m_image(ImageAtlas::get().pixmapFromFile(filename))
     {
         // Update the image size (as we have to wait for it to be loaded in the constructor).
         setSizePx(m_image->size());
@@ -38,15 +33,11 @@ namespace qmapcontrol
         // Is the image pixmap currently null?
         if(m_image == nullptr)
         {
-            // Have we already constructed the null image pixmap?
-            if(m_image_null == nullptr)
-            {
-                // Construct the null image pixmap.
-                m_image_null.reset(new QPixmap);
-            }
+            // Default empty image pixmap (constructed once, so this is safe from several render threads).
+            static const QPixmap image_null;
 
             // Return the null image pixmap.
-            return *(m_image_null.get());
+            return image_null;
         }
         else
         {
@@ -75,9 +66,20 @@ namespace qmapcontrol
         setSizePx(m_image->size(), update_shape);
     }
 
-    void GeometryPointImageScaled::drawShape(QPainter &painter, const RectWorldPx &rect)
+    void GeometryPointImageScaled::drawShape(QPainter &painter, const RectWorldPx& /*rect*/)
     {
-        painter.drawPixmap(-rect.rawRect().width() / 2.0, -rect.rawRect().height() / 2.0, image());
+        // Draw the pixmap centred (the painter is already scaled to the current zoom).
+        painter.drawPixmap(QPointF(-image().width() / 2.0, -image().height() / 2.0), image());
+    }
+
+    bool GeometryPointImageScaled::shapeCacheKey(std::string& return_shape, qint64& return_shape_data) const
+    {
+        // The shape is identified by the image pixmap.
+        return_shape = "image_scaled";
+        return_shape_data = image().cacheKey();
+
+        // The scaled image can be cached.
+        return true;
     }
 
 }
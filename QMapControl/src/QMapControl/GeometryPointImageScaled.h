@@ -120,6 +120,14 @@ namespace qmapcontrol
          */
         virtual void drawShape(QPainter &painter, const RectWorldPx &rect);
 
+        /*!
+         * Fetches what identifies the scaled image, so it can be rasterised once and cached.
+         * @param return_shape The shape type.
+         * @param return_shape_data The cache key of the image pixmap.
+         * @return whether the shape can be cached.
+         */
+        bool shapeCacheKey(std::string& return_shape, qint64& return_shape_data) const override;
+
     private:
         /// The image pixmap to draw.
         std::shared_ptr<QPixmap> m_image;
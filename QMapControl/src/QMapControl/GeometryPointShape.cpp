@@ -70,6 +70,9 @@ namespace qmapcontrol
         // Set the size of the shape (pixels).
         m_size_px = size_px;
 
+        // Re-index the geometry on its layer (its symbol size has changed).
+        updateLayerIndex();
+
         // Should we updated the shape?
         if(update_shape)
         {
@@ -146,6 +149,12 @@ namespace qmapcontrol
         return RectWorldCoord(projection::get().toPointWorldCoord(top_left_point_px, controller_zoom), projection::get().toPointWorldCoord(bottom_right_point_px, controller_zoom));
     }
 
+    QSizeF GeometryPointShape::symbolSizePx(const int& /*controller_zoom*/) const
+    {
+        // Return the size of the shape (pixels).
+        return m_size_px;
+    }
+
     void GeometryPointShape::updateShape()
     {
         // Emit that we need to redraw to display this change.
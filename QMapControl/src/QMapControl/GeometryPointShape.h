@@ -151,6 +151,13 @@ namespace qmapcontrol
          */
         virtual RectWorldCoord boundingBox(const int& controller_zoom) const override;
 
+        /*!
+         * Fetches the size of the symbol drawn at the point (pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return the size of the symbol drawn at the point (pixels).
+         */
+        virtual QSizeF symbolSizePx(const int& controller_zoom) const override;
+
     protected:
         /*!
          * Updates the shape.
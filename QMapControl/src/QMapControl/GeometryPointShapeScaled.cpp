@@ -5,6 +5,7 @@
 
 // Local includes.
 #include "Projection.h"
+#include "ShapeCache.h"
 
 namespace qmapcontrol
 {
@@ -101,6 +102,12 @@ namespace qmapcontrol
         return RectWorldCoord(projection::get().toPointWorldCoord(top_left_point_px, controller_zoom), projection::get().toPointWorldCoord(bottom_right_point_px, controller_zoom));
     }
 
+    QSizeF GeometryPointShapeScaled::symbolSizePx(const int& controller_zoom) const
+    {
+        // Return the current size for this controller zoom.
+        return calculateGeometrySizePx(controller_zoom);
+    }
+
     void GeometryPointShapeScaled::draw(QPainter &painter, const RectWorldCoord &backbuffer_rect_coord, const int &controller_zoom)
     {
         // Check the geometry is visible.
@@ -116,20 +123,35 @@ namespace qmapcontrol
 
                 qreal scale = pow(2.0, m_nonlinear_zoom * (controller_zoom - baseZoom()));
 
-                // Translate to center point with required rotation.
-                painter.translate(pixmap_rect_px.centerPx().rawPoint());
-                painter.rotate(rotation());
-                painter.scale(scale, scale);
+                // Can the shape be drawn from the shape cache (rasterised once for its style, size, scale and rotation)?
+                std::string shape;
+                qint64 shape_data(0);
+                ShapeCache::Key key;
+                if(shapeCacheKey(shape, shape_data) && ShapeCache::get().key(key, shape, shape_data, pen(), brush(), pixmap_rect_px.rawRect().size(), scale, rotation()))
+                {
+                    // Fetch the rasterised shape.
+                    const std::shared_ptr<const QImage> shape_image(ShapeCache::get().image(key, [&](QPainter& shape_painter) { drawShape(shape_painter, pixmap_rect_px); }));
 
-                drawShape(painter, pixmap_rect_px);
+                    // Draw the rasterised shape at the center point (without transforming the painter).
+                    painter.drawImage(pixmap_rect_px.centerPx().rawPoint() - QPointF(shape_image->width() / 2.0, shape_image->height() / 2.0), *shape_image);
+                }
+                else
+                {
+                    // Translate to center point with required rotation.
+                    painter.translate(pixmap_rect_px.centerPx().rawPoint());
+                    painter.rotate(rotation());
+                    painter.scale(scale, scale);
 
-                // Un-translate.
-                painter.scale(1.0/scale, 1.0/scale);
-                painter.rotate(-rotation());
-                painter.translate(-pixmap_rect_px.centerPx().rawPoint());
+                    drawShape(painter, pixmap_rect_px);
+
+                    // Un-translate.
+                    painter.scale(1.0/scale, 1.0/scale);
+                    painter.rotate(-rotation());
+                    painter.translate(-pixmap_rect_px.centerPx().rawPoint());
+                }
 
                 // Do we have a meta-data value and should we display it at this zoom?
-                if(controller_zoom >= m_metadata_displayed_zoom_minimum && metadata(m_metadata_displayed_key).isNull() == false)
+                if(metadataDisplayed(controller_zoom))
                 {
                     /// @todo calculate correct alignment for metadata displayed offset.
 
@@ -140,6 +162,12 @@ namespace qmapcontrol
         }
     }
 
+    bool GeometryPointShapeScaled::shapeCacheKey(std::string& /*return_shape*/, qint64& /*return_shape_data*/) const
+    {
+        // By default, shapes are drawn directly (as drawShape() may depend on more than the pen, brush, size and rotation).
+        return false;
+    }
+
     const QSizeF GeometryPointShapeScaled::calculateGeometrySizePx(const int& controller_zoom) const
     {
         // Get the object size (default to base size).
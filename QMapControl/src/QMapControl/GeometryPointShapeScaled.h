@@ -152,6 +152,13 @@ namespace qmapcontrol
          */
         RectWorldCoord boundingBox(const int& controller_zoom) const final;
 
+        /*!
+         * Fetches the size of the symbol drawn at the point (pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return the size of the symbol drawn at the point (pixels).
+         */
+        QSizeF symbolSizePx(const int& controller_zoom) const final;
+
         /*!
          * Draws the geometry to a pixmap using the provided painter.
          * @param painter The painter that will draw to the pixmap.
@@ -177,6 +184,15 @@ namespace qmapcontrol
          */
         virtual void drawShape(QPainter &painter, const RectWorldPx &rect) = 0;
 
+        /*!
+         * Fetches what identifies the shape drawn by drawShape(), so it can be rasterised once and cached.
+         * A derived class should implement this method if drawShape() only depends on the pen, brush, size, rotation and the returned data.
+         * @param return_shape The shape type.
+         * @param return_shape_data Any extra data the shape is drawn with (ie: the cache key of an image pixmap).
+         * @return whether the shape can be cached.
+         */
+        virtual bool shapeCacheKey(std::string& return_shape, qint64& return_shape_data) const;
+
     private:
         /// The base zoom level.
         int m_base_zoom;
@@ -1,7 +1,10 @@
 #include "GeometryPolygon.h"
 
+// STL includes.
+#include <algorithm>
+
 // Local includes.
-#include "Projection.h"
+#include "GeometryUtils.h"
 
 namespace qmapcontrol
 {
@@ -23,6 +26,12 @@ namespace qmapcontrol
         // Set the new points.
         m_points = points;
 
+        // Invalidate the cached bounding box and projected points.
+        m_projection_cache.invalidate();
+
+        // Re-index the geometry on its layer.
+        updateLayerIndex();
+
         // Should we redraw?
         if(disable_redraw == false)
         {
@@ -31,6 +40,21 @@ namespace qmapcontrol
         }
     }
 
+    qreal GeometryPolygon::simplifyTolerancePx() const
+    {
+        // Return the tolerance.
+        return m_projection_cache.simplifyTolerancePx();
+    }
+
+    void GeometryPolygon::setSimplifyTolerancePx(const qreal& simplify_tolerance_px)
+    {
+        // Set the tolerance.
+        m_projection_cache.setSimplifyTolerancePx(simplify_tolerance_px);
+
+        // Emit that we need to redraw to display this change.
+        emit requestRedraw();
+    }
+
     const QPolygonF GeometryPolygon::toQPolygonF() const
     {
         // The QPolygonF to return.
@@ -49,18 +73,8 @@ namespace qmapcontrol
 
     RectWorldCoord GeometryPolygon::boundingBox(const int& /*controller_zoom*/) const
     {
-        // Create a polygon of the points.
-        QPolygonF polygon;
-
-        // Loop through each point to add to the polygon.
-        for(const auto& point : m_points)
-        {
-            // Add the point to be drawn.
-            polygon.append(point.rawPoint());
-        }
-
-        // Return the bounding box.
-        return RectWorldCoord::fromQRectF(polygon.boundingRect());
+        // Return the (cached) bounding box.
+        return m_projection_cache.boundingBox(m_points);
     }
 
     bool GeometryPolygon::touches(const Geometry* geometry, const int& controller_zoom) const
@@ -85,7 +99,7 @@ namespace qmapcontrol
                 case GeometryType::GeometryWidget:
                 {
                     // Check if the polygon (bounding box) intersects with our polygon.
-                    if(QPolygonF(geometry->boundingBox(controller_zoom).rawRect()).intersected(toQPolygonF()).empty() == false)
+                    if(geometry_utils::polygonIntersectsRect(toQPolygonF(), geometry->boundingBox(controller_zoom).rawRect()))
                     {
                         // Set that we have touched.
                         return_touches = true;
@@ -97,7 +111,7 @@ namespace qmapcontrol
                 case GeometryType::GeometryPolygon:
                 {
                     // Check if the poylgons intersect.
-                    if(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF().intersected(toQPolygonF()).empty() == false)
+                    if(geometry_utils::polygonsIntersect(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF(), toQPolygonF()))
                     {
                         // Set that we have touched.
                         return_touches = true;
@@ -125,28 +139,97 @@ namespace qmapcontrol
         // Check the geometry is visible.
         if(isVisible(controller_zoom))
         {
-            // Does the polygon intersect with the backbuffer rect?
-            if(QPolygonF(backbuffer_rect_coord.rawRect()).intersected(toQPolygonF()).empty() == false)
+            // Does the bounding box intersect with the backbuffer rect?
+            if(m_projection_cache.intersects(m_points, backbuffer_rect_coord))
             {
-                // Create a polygon of the points.
-                QPolygonF polygon;
+                // Fetch the (cached) projected points, simplified to this zoom.
+                const QPolygonF polygon(m_projection_cache.toPolygonPx(m_points, controller_zoom));
 
-                // Loop through each point to add to the polygon.
-                for(const auto& point : m_points)
+                // Fetch the style to draw with at this zoom.
+                std::shared_ptr<const QPen> style_pen;
+                std::shared_ptr<const QBrush> style_brush;
+                style(controller_zoom, style_pen, style_brush);
+
+                // Clip the polygon to the backbuffer rect, with a guard band so the edges added along it (and the pen's joins) are never visible.
+                const QPen& polygon_pen(*style_pen);
+                const QRectF clip_rect_px(geometry_utils::clipRectPx(backbuffer_rect_coord, controller_zoom, polygon_pen.widthF() * std::max(polygon_pen.miterLimit(), qreal(1.0)) + 2.0));
+                const QPolygonF polygon_clipped(geometry_utils::clipPolygonPx(polygon, clip_rect_px));
+
+                // Is the outline dashed, and the polygon clipped (which would restart the dash pattern along the new edges)?
+                if(polygon_clipped.empty() == false && polygon_pen.style() != Qt::SolidLine && polygon_pen.style() != Qt::NoPen && polygon_clipped != polygon)
                 {
-                    // Add the point to be drawn.
-                    polygon.append(projection::get().toPointWorldPx(point, controller_zoom).rawPoint());
+                    // Fill the clipped polygon without an outline.
+                    painter.setPen(Qt::NoPen);
+                    painter.setBrush(*style_brush);
+                    painter.drawPolygon(polygon_clipped);
+
+                    // Close the outline.
+                    QPolygonF outline_px(polygon);
+                    if(outline_px.empty() == false && outline_px.first() != outline_px.last())
+                    {
+                        outline_px.append(outline_px.first());
+                    }
+
+                    // Clip the outline as a line instead, so the dash pattern is continued across each part.
+                    thread_local std::vector<QPolygonF> t_lines_px;
+                    thread_local std::vector<qreal> t_offsets_px;
+                    geometry_utils::clipLinePx(outline_px, clip_rect_px, t_lines_px, t_offsets_px);
+
+                    // Draw each part of the outline that is within the backbuffer rect.
+                    for(std::size_t i = 0; i < t_lines_px.size(); ++i)
+                    {
+                        // Continue the dash pattern from where the part starts (the dash offset is in units of the pen width).
+                        QPen dashed_pen(polygon_pen);
+                        dashed_pen.setDashOffset(polygon_pen.dashOffset() + t_offsets_px[i] / std::max(polygon_pen.widthF(), qreal(1.0)));
+                        painter.setPen(dashed_pen);
+                        painter.drawPolyline(t_lines_px[i]);
+                    }
                 }
+                // Is any of the polygon within the backbuffer rect?
+                else if(polygon_clipped.empty() == false)
+                {
+                    // Set the pen to use.
+                    painter.setPen(polygon_pen);
+
+                    // Set the brush to use.
+                    painter.setBrush(*style_brush);
+
+                    // Draw the polygon line.
+                    painter.drawPolygon(polygon_clipped);
+                }
+            }
+        }
+    }
 
-                // Set the pen to use.
-                painter.setPen(pen());
+    bool GeometryPolygon::stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom)
+    {
+        // Fetch the style to draw with at this zoom.
+        style(controller_zoom, return_pen, return_brush);
+        return_closed = true;
 
-                // Set the brush to use.
-                painter.setBrush(brush());
+        // Is the outline dashed (so a clipped outline needs its own dash offsets)?
+        if(return_pen->style() != Qt::SolidLine && return_pen->style() != Qt::NoPen)
+        {
+            // Draw the polygon individually.
+            return false;
+        }
 
-                // Draw the polygon line.
-                painter.drawPolygon(polygon);
+        // Check the geometry is visible, and its bounding box intersects with the backbuffer rect.
+        if(isVisible(controller_zoom) && m_projection_cache.intersects(m_points, backbuffer_rect_coord))
+        {
+            // Clip the (cached) projected points, simplified to this zoom, to the backbuffer rect (with a guard band so the edges added along it are never visible).
+            const QRectF clip_rect_px(geometry_utils::clipRectPx(backbuffer_rect_coord, controller_zoom, return_pen->widthF() * std::max(return_pen->miterLimit(), qreal(1.0)) + 2.0));
+            const QPolygonF polygon_clipped(geometry_utils::clipPolygonPx(m_projection_cache.toPolygonPx(m_points, controller_zoom), clip_rect_px));
+
+            // Is any of the polygon within the backbuffer rect?
+            if(polygon_clipped.empty() == false)
+            {
+                // Add the clipped polygon.
+                return_polygons_px.push_back(polygon_clipped);
             }
         }
+
+        // The polygon can be drawn in a style batch.
+        return true;
     }
 }
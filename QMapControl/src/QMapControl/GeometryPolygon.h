@@ -29,6 +29,7 @@
 #include "qmapcontrol_global.h"
 #include "Geometry.h"
 #include "Point.h"
+#include "ProjectionCache.h"
 
 namespace qmapcontrol
 {
@@ -83,6 +84,18 @@ namespace qmapcontrol
          */
         void setPoints(const std::vector<PointWorldCoord>& points, const bool& disable_redraw = false);
 
+        /*!
+         * Fetches the tolerance the projected points are simplified to when drawn.
+         * @return the tolerance (pixels, 0 if disabled).
+         */
+        qreal simplifyTolerancePx() const;
+
+        /*!
+         * Sets the tolerance to simplify the projected points to when drawn (defaults to half a pixel).
+         * @param simplify_tolerance_px The tolerance (pixels, 0 to draw every point).
+         */
+        void setSimplifyTolerancePx(const qreal& simplify_tolerance_px);
+
         /*!
          * Fetches the QPolygonF representation of the polygon.
          * @return the QPolygonF representation of the polygon.
@@ -113,8 +126,23 @@ namespace qmapcontrol
          */
         virtual void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) override;
 
+        /*!
+         * Fetches the geometry as (clipped) pixel polygons, so the layer can draw it in a batch with others of the same style.
+         * @param return_polygons_px The polygons to draw, appended to (pixels).
+         * @param return_closed Whether the polygons are closed and filled with the brush (otherwise they are drawn as polylines).
+         * @param return_pen The pen to draw the polygons with.
+         * @param return_brush The brush to fill closed polygons with.
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the geometry can be drawn in a style batch (dashed outlines are drawn individually, to continue their dash pattern).
+         */
+        virtual bool stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) override;
+
     private:
         /// The points that the polygon is made up of.
         std::vector<PointWorldCoord> m_points;
+
+        /// The cached bounding box and projected points.
+        mutable ProjectionCache m_projection_cache;
     };
 }
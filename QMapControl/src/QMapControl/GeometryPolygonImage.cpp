@@ -38,4 +38,10 @@ namespace qmapcontrol
             }
         }
     }
+
+    bool GeometryPolygonImage::stylePolygons(std::vector<QPolygonF>& /*return_polygons_px*/, bool& /*return_closed*/, std::shared_ptr<const QPen>& /*return_pen*/, std::shared_ptr<const QBrush>& /*return_brush*/, const RectWorldCoord& /*backbuffer_rect_coord*/, const int& /*controller_zoom*/)
+    {
+        // The image is always drawn individually.
+        return false;
+    }
 }
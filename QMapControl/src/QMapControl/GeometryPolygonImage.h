@@ -90,6 +90,18 @@ namespace qmapcontrol
          */
         void draw(QPainter& painter, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) final;
 
+        /*!
+         * Fetches the geometry as (clipped) pixel polygons, so the layer can draw it in a batch with others of the same style.
+         * @param return_polygons_px The polygons to draw, appended to (pixels).
+         * @param return_closed Whether the polygons are closed and filled with the brush.
+         * @param return_pen The pen to draw the polygons with.
+         * @param return_brush The brush to fill closed polygons with.
+         * @param backbuffer_rect_coord Only draw geometries that are contained in the backbuffer rect (world coordinates).
+         * @param controller_zoom The current controller zoom.
+         * @return false, as the image is always drawn individually.
+         */
+        bool stylePolygons(std::vector<QPolygonF>& return_polygons_px, bool& return_closed, std::shared_ptr<const QPen>& return_pen, std::shared_ptr<const QBrush>& return_brush, const RectWorldCoord& backbuffer_rect_coord, const int& controller_zoom) final;
+
     private:
         /// The image pixmap to draw.
         QPixmap m_image;
@@ -0,0 +1,413 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "GeometryUtils.h"
+
+// STL includes.
+#include <cmath>
+
+// Local includes.
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    namespace geometry_utils
+    {
+        namespace
+        {
+            /// The sides of a rect that a point is beyond (Cohen-Sutherland out codes).
+            enum OutCode
+            {
+                Inside = 0,
+                Left = 1,
+                Right = 2,
+                Top = 4,
+                Bottom = 8
+            };
+
+            /*!
+             * Calculates which sides of a rect a point is beyond.
+             * @param point The point to check.
+             * @param rect The rect to check against (normalised).
+             * @return the out code (Inside if the point is within the rect, inclusive).
+             */
+            inline int outCode(const QPointF& point, const QRectF& rect)
+            {
+                int code(Inside);
+                if(point.x() < rect.left())
+                {
+                    code |= Left;
+                }
+                else if(point.x() > rect.right())
+                {
+                    code |= Right;
+                }
+                if(point.y() < rect.top())
+                {
+                    code |= Top;
+                }
+                else if(point.y() > rect.bottom())
+                {
+                    code |= Bottom;
+                }
+                return code;
+            }
+
+            /*!
+             * Checks whether two rects overlap (inclusive, so zero-width/height rects are still considered).
+             * @param rect_a The first rect (normalised).
+             * @param rect_b The second rect (normalised).
+             * @return whether the rects overlap.
+             */
+            inline bool rectsOverlap(const QRectF& rect_a, const QRectF& rect_b)
+            {
+                return rect_a.left() <= rect_b.right() && rect_b.left() <= rect_a.right() && rect_a.top() <= rect_b.bottom() && rect_b.top() <= rect_a.bottom();
+            }
+
+            /*!
+             * Clips a line segment to a rect (Cohen-Sutherland).
+             * @param start The start of the segment, moved onto the rect's edge if it is outside.
+             * @param end The end of the segment, moved onto the rect's edge if it is outside.
+             * @param rect The rect to clip to (normalised).
+             * @return whether any of the segment is within the rect.
+             */
+            bool clipSegment(QPointF& start, QPointF& end, const QRectF& rect)
+            {
+                // Calculate which sides each end is beyond.
+                int code_start(outCode(start, rect));
+                int code_end(outCode(end, rect));
+
+                // Keep moving an outside end onto the rect's edges (at most once per side).
+                while(true)
+                {
+                    // Are both ends within the rect?
+                    if((code_start | code_end) == Inside)
+                    {
+                        return true;
+                    }
+
+                    // Are both ends beyond the same side (so the segment cannot cross the rect)?
+                    if((code_start & code_end) != Inside)
+                    {
+                        return false;
+                    }
+
+                    // Move the end that is outside onto the side it is beyond (the ends are on opposite sides of it, so there is no division by zero).
+                    const int code_outside(code_start != Inside ? code_start : code_end);
+                    const QPointF delta(end - start);
+                    QPointF point;
+                    if(code_outside & Top)
+                    {
+                        point = QPointF(start.x() + delta.x() * (rect.top() - start.y()) / delta.y(), rect.top());
+                    }
+                    else if(code_outside & Bottom)
+                    {
+                        point = QPointF(start.x() + delta.x() * (rect.bottom() - start.y()) / delta.y(), rect.bottom());
+                    }
+                    else if(code_outside & Right)
+                    {
+                        point = QPointF(rect.right(), start.y() + delta.y() * (rect.right() - start.x()) / delta.x());
+                    }
+                    else
+                    {
+                        point = QPointF(rect.left(), start.y() + delta.y() * (rect.left() - start.x()) / delta.x());
+                    }
+
+                    // Replace the end that was outside.
+                    if(code_outside == code_start)
+                    {
+                        start = point;
+                        code_start = outCode(start, rect);
+                    }
+                    else
+                    {
+                        end = point;
+                        code_end = outCode(end, rect);
+                    }
+                }
+            }
+
+            /*!
+             * Calculates the cross product (z component) of two vectors.
+             * @param a The first vector.
+             * @param b The second vector.
+             * @return the cross product.
+             */
+            inline qreal crossProduct(const QPointF& a, const QPointF& b)
+            {
+                return (a.x() * b.y()) - (a.y() * b.x());
+            }
+
+            /*!
+             * Checks whether two line segments intersect (including touching and overlapping collinear segments).
+             * @param start_a The start of the first segment.
+             * @param end_a The end of the first segment.
+             * @param start_b The start of the second segment.
+             * @param end_b The end of the second segment.
+             * @return whether the segments intersect.
+             */
+            bool segmentsIntersect(const QPointF& start_a, const QPointF& end_a, const QPointF& start_b, const QPointF& end_b)
+            {
+                // Which side of each segment are the other segment's ends on?
+                const qreal side_start_a(crossProduct(end_b - start_b, start_a - start_b));
+                const qreal side_end_a(crossProduct(end_b - start_b, end_a - start_b));
+                const qreal side_start_b(crossProduct(end_a - start_a, start_b - start_a));
+                const qreal side_end_b(crossProduct(end_a - start_a, end_b - start_a));
+
+                // Do the segments cross properly?
+                if(((side_start_a > 0.0 && side_end_a < 0.0) || (side_start_a < 0.0 && side_end_a > 0.0)) && ((side_start_b > 0.0 && side_end_b < 0.0) || (side_start_b < 0.0 && side_end_b > 0.0)))
+                {
+                    return true;
+                }
+
+                // Does an end lie on the other segment (collinear, within its bounding box)?
+                const QRectF rect_a(QRectF(start_a, end_a).normalized());
+                const QRectF rect_b(QRectF(start_b, end_b).normalized());
+                return (side_start_a == 0.0 && rectsOverlap(QRectF(start_a, start_a), rect_b))
+                        || (side_end_a == 0.0 && rectsOverlap(QRectF(end_a, end_a), rect_b))
+                        || (side_start_b == 0.0 && rectsOverlap(QRectF(start_b, start_b), rect_a))
+                        || (side_end_b == 0.0 && rectsOverlap(QRectF(end_b, end_b), rect_a));
+            }
+        }
+
+        QRectF clipRectPx(const RectWorldCoord& rect_coord, const int& controller_zoom, const qreal& guard_px)
+        {
+            // Project the corners of the rect.
+            const QRectF rect_px(QRectF(projection::get().toPointWorldPx(rect_coord.topLeftCoord(), controller_zoom).rawPoint(), projection::get().toPointWorldPx(rect_coord.bottomRightCoord(), controller_zoom).rawPoint()).normalized());
+
+            // Return the rect, expanded by the guard band.
+            return rect_px.adjusted(-guard_px, -guard_px, guard_px, guard_px);
+        }
+
+        void clipLinePx(const QPolygonF& points_px, const QRectF& rect_px, std::vector<QPolygonF>& return_lines_px, std::vector<qreal>& return_offsets_px)
+        {
+            // Reset the parts to return.
+            return_lines_px.clear();
+            return_offsets_px.clear();
+
+            // Is there a line to clip?
+            if(points_px.empty())
+            {
+                return;
+            }
+
+            // Is the whole line within the rect (the common case when zoomed out)?
+            const QRectF bounding_rect_px(points_px.boundingRect());
+            if(outCode(bounding_rect_px.topLeft(), rect_px) == Inside && outCode(bounding_rect_px.bottomRight(), rect_px) == Inside)
+            {
+                // Return the line unclipped.
+                return_lines_px.push_back(points_px);
+                return_offsets_px.push_back(0.0);
+                return;
+            }
+
+            // Is the whole line outside of the rect?
+            if(rectsOverlap(bounding_rect_px, rect_px) == false)
+            {
+                return;
+            }
+
+            // Clip each segment, joining the consecutive segments that are within the rect into parts.
+            qreal distance_px(0.0);
+            QPolygonF line_px;
+            for(int i = 1; i < points_px.size(); ++i)
+            {
+                // Clip the segment.
+                QPointF start_px(points_px[i - 1]);
+                QPointF end_px(points_px[i]);
+                if(clipSegment(start_px, end_px, rect_px))
+                {
+                    // Does the segment start a new part (the line has entered the rect)?
+                    if(line_px.empty())
+                    {
+                        // Start the part, and record how far along the line it starts.
+                        const QPointF entry_px(start_px - points_px[i - 1]);
+                        line_px.append(start_px);
+                        return_offsets_px.push_back(distance_px + std::hypot(entry_px.x(), entry_px.y()));
+                    }
+
+                    // Add the end of the segment.
+                    line_px.append(end_px);
+
+                    // Has the line left the rect?
+                    if(end_px != points_px[i])
+                    {
+                        // Finish the part.
+                        return_lines_px.push_back(line_px);
+                        line_px.clear();
+                    }
+                }
+
+                // Keep track of the distance along the line.
+                const QPointF segment_px(points_px[i] - points_px[i - 1]);
+                distance_px += std::hypot(segment_px.x(), segment_px.y());
+            }
+
+            // Finish the last part.
+            if(line_px.empty() == false)
+            {
+                return_lines_px.push_back(line_px);
+            }
+        }
+
+        QPolygonF clipPolygonPx(const QPolygonF& points_px, const QRectF& rect_px)
+        {
+            // Is there a polygon to clip?
+            if(points_px.empty())
+            {
+                return points_px;
+            }
+
+            // Is the whole polygon within the rect (the common case when zoomed out)?
+            const QRectF bounding_rect_px(points_px.boundingRect());
+            if(outCode(bounding_rect_px.topLeft(), rect_px) == Inside && outCode(bounding_rect_px.bottomRight(), rect_px) == Inside)
+            {
+                // Return the polygon unclipped.
+                return points_px;
+            }
+
+            // Is the whole polygon outside of the rect?
+            if(rectsOverlap(bounding_rect_px, rect_px) == false)
+            {
+                return QPolygonF();
+            }
+
+            // Clip the polygon against each side of the rect in turn (left, right, top, bottom).
+            QPolygonF input_px;
+            QPolygonF output_px(points_px);
+            for(int side = 0; side < 4 && output_px.empty() == false; ++side)
+            {
+                // The previous side's output is this side's input.
+                input_px.swap(output_px);
+                output_px.clear();
+
+                // Whether a point is inside this side.
+                const auto inside = [&](const QPointF& point_px) -> bool
+                {
+                    return side == 0 ? point_px.x() >= rect_px.left() : side == 1 ? point_px.x() <= rect_px.right() : side == 2 ? point_px.y() >= rect_px.top() : point_px.y() <= rect_px.bottom();
+                };
+
+                // Where an edge crosses this side (the edge's ends are on either side of it, so there is no division by zero).
+                const auto crossing = [&](const QPointF& start_px, const QPointF& end_px) -> QPointF
+                {
+                    const QPointF delta_px(end_px - start_px);
+                    if(side < 2)
+                    {
+                        const qreal x(side == 0 ? rect_px.left() : rect_px.right());
+                        return QPointF(x, start_px.y() + delta_px.y() * (x - start_px.x()) / delta_px.x());
+                    }
+                    else
+                    {
+                        const qreal y(side == 2 ? rect_px.top() : rect_px.bottom());
+                        return QPointF(start_px.x() + delta_px.x() * (y - start_px.y()) / delta_px.y(), y);
+                    }
+                };
+
+                // Loop through each edge (from the last point, so the polygon is closed).
+                QPointF previous_px(input_px.last());
+                bool previous_inside(inside(previous_px));
+                for(const auto& point_px : input_px)
+                {
+                    // Does the edge cross the side?
+                    const bool point_inside(inside(point_px));
+                    if(point_inside != previous_inside)
+                    {
+                        output_px.append(crossing(previous_px, point_px));
+                    }
+
+                    // Keep the point if it is inside.
+                    if(point_inside)
+                    {
+                        output_px.append(point_px);
+                    }
+
+                    // Move to the next edge.
+                    previous_px = point_px;
+                    previous_inside = point_inside;
+                }
+            }
+
+            // Return the clipped polygon.
+            return output_px;
+        }
+
+        bool polygonIntersectsRect(const QPolygonF& polygon, const QRectF& rect)
+        {
+            // Is there a polygon, and does its bounding box intersect the rect?
+            const QRectF rect_normalised(rect.normalized());
+            if(polygon.empty() || rectsOverlap(polygon.boundingRect(), rect_normalised) == false)
+            {
+                return false;
+            }
+
+            // Is any point within the rect, or does any edge cross it?
+            for(int i = 0; i < polygon.size(); ++i)
+            {
+                QPointF start(polygon[i]);
+                QPointF end(polygon[(i + 1) % polygon.size()]);
+                if(clipSegment(start, end, rect_normalised))
+                {
+                    return true;
+                }
+            }
+
+            // Otherwise the rect can only be entirely within the polygon.
+            return polygon.containsPoint(rect_normalised.center(), Qt::OddEvenFill);
+        }
+
+        bool polygonsIntersect(const QPolygonF& polygon_a, const QPolygonF& polygon_b)
+        {
+            // Are there polygons, and do their bounding boxes intersect?
+            if(polygon_a.empty() || polygon_b.empty())
+            {
+                return false;
+            }
+            const QRectF bounding_rect_a(polygon_a.boundingRect());
+            const QRectF bounding_rect_b(polygon_b.boundingRect());
+            if(rectsOverlap(bounding_rect_a, bounding_rect_b) == false)
+            {
+                return false;
+            }
+
+            // Does any edge of the first polygon cross an edge of the second?
+            for(int i = 0; i < polygon_a.size(); ++i)
+            {
+                // Skip the edges that are outside of the second polygon's bounding box.
+                const QPointF& start_a(polygon_a[i]);
+                const QPointF& end_a(polygon_a[(i + 1) % polygon_a.size()]);
+                if(rectsOverlap(QRectF(start_a, end_a).normalized(), bounding_rect_b))
+                {
+                    for(int j = 0; j < polygon_b.size(); ++j)
+                    {
+                        if(segmentsIntersect(start_a, end_a, polygon_b[j], polygon_b[(j + 1) % polygon_b.size()]))
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            // Otherwise one polygon can only be entirely within the other.
+            return polygon_b.containsPoint(polygon_a.first(), Qt::OddEvenFill) || polygon_a.containsPoint(polygon_b.first(), Qt::OddEvenFill);
+        }
+    }
+}
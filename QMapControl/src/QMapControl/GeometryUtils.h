@@ -0,0 +1,86 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QRectF>
+#include <QtGui/QPolygonF>
+
+// STL includes.
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Point.h"
+
+namespace qmapcontrol
+{
+    /*!
+     * Clipping and intersection helpers for projected geometries (pixels), which avoid Qt's polygon boolean operations.
+     */
+    namespace geometry_utils
+    {
+        /*!
+         * Projects a rect (ie: the backbuffer rect) to pixels, to clip to.
+         * @param rect_coord The rect to project (world coordinates).
+         * @param controller_zoom The zoom to project at.
+         * @param guard_px The guard band to expand the rect by on each side, so that pen caps/joins are not clipped (pixels).
+         * @return the normalised rect (pixels).
+         */
+        QMAPCONTROL_EXPORT QRectF clipRectPx(const RectWorldCoord& rect_coord, const int& controller_zoom, const qreal& guard_px);
+
+        /*!
+         * Clips a line to a rect (Cohen-Sutherland), splitting it wherever it leaves and re-enters the rect.
+         * @param points_px The line's points (pixels).
+         * @param rect_px The rect to clip to, including any guard band (pixels).
+         * @param return_lines_px The parts of the line within the rect.
+         * @param return_offsets_px The distance along the line that each part starts at, so dash patterns can be continued (pixels).
+         */
+        QMAPCONTROL_EXPORT void clipLinePx(const QPolygonF& points_px, const QRectF& rect_px, std::vector<QPolygonF>& return_lines_px, std::vector<qreal>& return_offsets_px);
+
+        /*!
+         * Clips a polygon to a rect (Sutherland-Hodgman).
+         * The parts outside the rect are replaced by edges along it, so the rect should include a guard band wider than the pen.
+         * @param points_px The polygon's points (pixels).
+         * @param rect_px The rect to clip to, including any guard band (pixels).
+         * @return the clipped polygon (empty if it is entirely outside the rect).
+         */
+        QMAPCONTROL_EXPORT QPolygonF clipPolygonPx(const QPolygonF& points_px, const QRectF& rect_px);
+
+        /*!
+         * Checks whether a polygon (its edges or its area) intersects with a rect, without a polygon boolean operation.
+         * @param polygon The polygon to check.
+         * @param rect The rect to check against.
+         * @return whether the polygon intersects with the rect.
+         */
+        QMAPCONTROL_EXPORT bool polygonIntersectsRect(const QPolygonF& polygon, const QRectF& rect);
+
+        /*!
+         * Checks whether two polygons (their edges or their areas) intersect, without a polygon boolean operation.
+         * @param polygon_a The first polygon to check.
+         * @param polygon_b The second polygon to check.
+         * @return whether the polygons intersect.
+         */
+        QMAPCONTROL_EXPORT bool polygonsIntersect(const QPolygonF& polygon_a, const QPolygonF& polygon_b);
+    }
+}
@@ -30,6 +30,7 @@
 
 // Local includes.
 #include "GeometryPolygon.h"
+#include "GeometryUtils.h"
 #include "Projection.h"
 
 namespace qmapcontrol
@@ -84,6 +85,9 @@ namespace qmapcontrol
             // Set the new point.
             m_point_coord = point;
 
+            // Re-index the geometry on its layer.
+            updateLayerIndex();
+
             // Emit that we need to redraw to display this change.
             emit requestRedraw();
 
@@ -205,7 +209,7 @@ namespace qmapcontrol
                 case GeometryType::GeometryPolygon:
                 {
                     // Check if the poylgon intersects with our bounding box.
-                    if(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF().intersected(boundingBox(controller_zoom).rawRect()).empty() == false)
+                    if(geometry_utils::polygonIntersectsRect(static_cast<const GeometryPolygon*>(geometry)->toQPolygonF(), boundingBox(controller_zoom).rawRect()))
                     {
                         // Set that we have touched.
                         return_touches = true;
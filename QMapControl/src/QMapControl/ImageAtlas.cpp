@@ -0,0 +1,291 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ImageAtlas.h"
+
+// Qt includes.
+#include <QtCore/QMutexLocker>
+#include <QtGui/QPainter>
+
+// STL includes.
+#include <algorithm>
+
+// Local includes.
+#include "WeakPtrMap.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The size of each atlas (pixels).
+        const int atlas_size_px(1024);
+
+        /// The maximum number of atlases (once these are full, images are drawn individually).
+        const std::size_t atlas_count_maximum(4);
+
+        /// The largest image (width or height) that is packed into an atlas (pixels).
+        const int sprite_size_maximum_px(256);
+
+        /// The gap left around each packed image, so neighbouring images do not bleed into each other when filtered (pixels).
+        const int sprite_padding_px(1);
+
+        /// The fraction of the packed area that must have been released before full atlases are released and packed again.
+        const qreal released_area_fraction_minimum(0.25);
+
+        /// The number of images decoded from files to prune the released ones at initially.
+        const std::size_t prune_size_minimum(64);
+    }
+
+    ImageAtlas& ImageAtlas::get()
+    {
+        // The singleton instance (the first sprite may be packed by a render thread rather than the GUI thread, which a
+        // function-local static allows, as it is constructed exactly once).
+        static ImageAtlas instance;
+
+        // Return the reference to the instance object.
+        return instance;
+    }
+
+    ImageAtlas::ImageAtlas()
+        : m_pixmaps_from_file_prune_size(prune_size_minimum)
+    {
+
+    }
+
+    std::shared_ptr<QPixmap> ImageAtlas::pixmapFromFile(const std::string& filename)
+    {
+        // Gain a lock to protect the images decoded from files.
+        QMutexLocker locker(&m_pixmaps_from_file_mutex);
+
+        // Is the file already decoded (and still used)?
+        std::weak_ptr<QPixmap>& decoded(m_pixmaps_from_file[filename]);
+        std::shared_ptr<QPixmap> return_pixmap(decoded.lock());
+        if(return_pixmap == nullptr)
+        {
+            // Decode the file.
+            return_pixmap = std::make_shared<QPixmap>(filename.c_str());
+            decoded = return_pixmap;
+        }
+
+        // Remove the images no longer used by any geometry (a marker image per filename is only decoded while used).
+        pruneExpired(m_pixmaps_from_file, m_pixmaps_from_file_prune_size, prune_size_minimum);
+
+        // Return the shared image pixmap.
+        return return_pixmap;
+    }
+
+    bool ImageAtlas::sprite(const std::shared_ptr<QPixmap>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect)
+    {
+        // Fetch where the pixmap is packed (its pixels are only converted to an image the first time it is packed).
+        return sprite(m_pixmap_sprites, image->cacheKey(), image, image->size(), [&image]() { return image->toImage(); }, return_atlas, return_source_rect);
+    }
+
+    bool ImageAtlas::sprite(const ShapeCache::Key& key, const std::shared_ptr<const QImage>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect)
+    {
+        // Fetch where the shape is packed.
+        return sprite(m_shape_sprites, key, image, image->size(), [&image]() { return *image; }, return_atlas, return_source_rect);
+    }
+
+    template <class Key>
+    bool ImageAtlas::sprite(std::map<Key, Sprite>& sprites, const Key& key, const std::shared_ptr<const void>& source, const QSize& size_px, const std::function<QImage()>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect)
+    {
+        // Is the image too large to pack (or empty)?
+        if(size_px.isEmpty() || size_px.width() > sprite_size_maximum_px || size_px.height() > sprite_size_maximum_px)
+        {
+            // Draw the image individually.
+            return false;
+        }
+
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a read lock to protect the atlases (this is the common case).
+            QReadLocker locker(&m_atlases_mutex);
+
+            // Has the image already been packed?
+            const auto itr_find = sprites.find(key);
+            if(itr_find != sprites.end())
+            {
+                // Return where it is packed.
+                return_atlas = m_atlases[itr_find->second.atlas_index].view;
+                return_source_rect = itr_find->second.source_rect;
+                return true;
+            }
+        }
+
+        // Gain a write lock to protect the atlases.
+        QWriteLocker locker(&m_atlases_mutex);
+
+        // Has the image been packed since we checked (by another thread)?
+        Sprite sprite;
+        const auto itr_find = sprites.find(key);
+        if(itr_find != sprites.end())
+        {
+            // Use where it is packed.
+            sprite = itr_find->second;
+        }
+        else
+        {
+            // Try to pack the image (if the atlases are full, release them if enough of their images have been, and try again).
+            const QImage image_to_pack(image());
+            if(pack(image_to_pack, sprite) == false && (releaseIfSparse() == false || pack(image_to_pack, sprite) == false))
+            {
+                // The atlases are full.
+                return false;
+            }
+
+            // Remember where it is packed.
+            sprite.source = source;
+            sprites.emplace(key, sprite);
+        }
+
+        // Return where it is packed.
+        return_atlas = m_atlases[sprite.atlas_index].view;
+        return_source_rect = sprite.source_rect;
+        return true;
+    }
+
+    void ImageAtlas::clear()
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the images decoded from files.
+            QMutexLocker locker(&m_pixmaps_from_file_mutex);
+
+            // Forget the images (geometries keep any they still use).
+            m_pixmaps_from_file.clear();
+            m_pixmaps_from_file_prune_size = prune_size_minimum;
+        }
+
+        // Gain a write lock to protect the atlases.
+        QWriteLocker locker(&m_atlases_mutex);
+
+        // Release the atlases (any batch being drawn keeps its atlas image alive).
+        m_atlases.clear();
+        m_pixmap_sprites.clear();
+        m_shape_sprites.clear();
+    }
+
+    bool ImageAtlas::releaseIfSparse()
+    {
+        // Measure the area of the packed images, and of those that have since been released.
+        qreal packed_area_px(0.0);
+        qreal released_area_px(0.0);
+        const auto measure = [&](const Sprite& sprite)
+        {
+            const qreal area_px(sprite.source_rect.width() * sprite.source_rect.height());
+            packed_area_px += area_px;
+            released_area_px += sprite.source.expired() ? area_px : 0.0;
+        };
+        for(const auto& sprite : m_pixmap_sprites)
+        {
+            measure(sprite.second);
+        }
+        for(const auto& sprite : m_shape_sprites)
+        {
+            measure(sprite.second);
+        }
+
+        // Have too few images been released to be worth packing the rest again (so the atlases do not churn)?
+        if(released_area_px < packed_area_px * released_area_fraction_minimum)
+        {
+            return false;
+        }
+
+        // Release the atlases (any batch being drawn keeps its atlas image alive, and the images still used are packed
+        // again as they are next drawn).
+        m_atlases.clear();
+        m_pixmap_sprites.clear();
+        m_shape_sprites.clear();
+        return true;
+    }
+
+    bool ImageAtlas::pack(const QImage& image, Sprite& return_sprite)
+    {
+        // The space the image needs, including its padding.
+        const int width_px(image.width() + sprite_padding_px * 2);
+        const int height_px(image.height() + sprite_padding_px * 2);
+
+        // Find an atlas with space for the image (only the last atlas is still being filled).
+        if(m_atlases.empty() == false)
+        {
+            // Does the image fit on the current shelf?
+            Atlas& atlas(m_atlases.back());
+            if(atlas.shelf_x_px + width_px > atlas_size_px)
+            {
+                // Start a new shelf below the current one.
+                atlas.shelf_x_px = 0;
+                atlas.shelf_y_px += atlas.shelf_height_px;
+                atlas.shelf_height_px = 0;
+            }
+
+            // Is the atlas full?
+            if(atlas.shelf_y_px + height_px > atlas_size_px)
+            {
+                // Mark the atlas as full.
+                atlas.shelf_y_px = atlas_size_px;
+            }
+        }
+
+        // Do we need a new atlas?
+        if(m_atlases.empty() || m_atlases.back().shelf_y_px >= atlas_size_px)
+        {
+            // Have we reached the maximum number of atlases?
+            if(m_atlases.size() >= atlas_count_maximum)
+            {
+                // The image cannot be packed.
+                return false;
+            }
+
+            // Create a new (transparent) atlas.
+            Atlas atlas;
+            const std::shared_ptr<QImage> image_atlas(std::make_shared<QImage>(atlas_size_px, atlas_size_px, QImage::Format_ARGB32_Premultiplied));
+            image_atlas->fill(Qt::transparent);
+            atlas.image = image_atlas;
+
+            // Wrap the atlas's pixels in a read-only view to draw from (the view does not share the atlas's image data, so
+            // drawing into the atlas never detaches or copies it, and the view keeps the atlas alive).
+            atlas.view = std::shared_ptr<const QImage>(new QImage(image_atlas->constBits(), image_atlas->width(), image_atlas->height(), image_atlas->bytesPerLine(), image_atlas->format()),
+                                                       [image_atlas](const QImage* view) { delete view; });
+            atlas.shelf_x_px = 0;
+            atlas.shelf_y_px = 0;
+            atlas.shelf_height_px = 0;
+            m_atlases.push_back(atlas);
+        }
+
+        // Draw the image into the atlas at the end of the current shelf.
+        Atlas& atlas(m_atlases.back());
+        const QPoint position_px(atlas.shelf_x_px + sprite_padding_px, atlas.shelf_y_px + sprite_padding_px);
+        QPainter painter(atlas.image.get());
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(position_px, image);
+        painter.end();
+
+        // Move along the shelf.
+        atlas.shelf_x_px += width_px;
+        atlas.shelf_height_px = std::max(atlas.shelf_height_px, height_px);
+
+        // Return where the image is packed.
+        return_sprite.atlas_index = m_atlases.size() - 1;
+        return_sprite.source_rect = QRectF(position_px, image.size());
+        return true;
+    }
+}
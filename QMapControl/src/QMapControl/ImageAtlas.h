@@ -0,0 +1,204 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QMutex>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QRectF>
+#include <QtGui/QImage>
+#include <QtGui/QPixmap>
+
+// STL includes.
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "ShapeCache.h"
+
+namespace qmapcontrol
+{
+    //! Shares decoded images, and packs small images into atlases.
+    /*!
+     * Images loaded from a file are decoded once and shared by every geometry that uses the file.
+     *
+     * Small images are packed (image pixmaps by their pixel data, so implicitly shared copies share a sprite, and
+     * rasterised shapes by their style, so a shape keeps its sprite when it is rasterised again) into a few large
+     * atlas images, so a layer can draw many markers that use them as a batch of fragments of the same image. An
+     * image is only ever packed into space no other image uses, so an atlas is never copied when an image is added
+     * to it, and the images already packed can be drawn from other threads at the same time. The atlases are kept as
+     * QImage (rather than QPixmap), so they can be packed and drawn from any render thread.
+     *
+     * Space is not reclaimed as images are released. Instead, once the atlases are full, they are released if enough of
+     * their images have been, and the images still used are packed again as they are next drawn.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT ImageAtlas
+    {
+    public:
+        /*!
+         * Get the singleton instance of the Image Atlas.
+         * @return the singleton instance.
+         */
+        static ImageAtlas& get();
+
+    public:
+        //! Disable copy constructor.
+        ///ImageAtlas(const ImageAtlas&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///ImageAtlas& operator=(const ImageAtlas&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~ImageAtlas() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Fetches the image pixmap decoded from a file (the file is only decoded again once no geometry uses it).
+         * @param filename The image file.
+         * @return the shared image pixmap (null if the file could not be decoded).
+         */
+        std::shared_ptr<QPixmap> pixmapFromFile(const std::string& filename);
+
+        /*!
+         * Fetches where an image pixmap is packed into an atlas, packing it if it has not been already.
+         * @param image The image pixmap to fetch (packed by its pixel data, until it is released).
+         * @param return_atlas The atlas image the image is packed into.
+         * @param return_source_rect The rect of the image within the atlas image (pixels).
+         * @return whether the image is packed (images that are too large, or once the atlases are full, are not).
+         */
+        bool sprite(const std::shared_ptr<QPixmap>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect);
+
+        /*!
+         * Fetches where a shape rasterised by the shape cache is packed into an atlas, packing it if it has not been already.
+         * @param key The shape style (so the shape keeps its sprite when the shape cache rasterises it again).
+         * @param image The rasterised shape.
+         * @param return_atlas The atlas image the image is packed into.
+         * @param return_source_rect The rect of the image within the atlas image (pixels).
+         * @return whether the image is packed (images that are too large, or once the atlases are full, are not).
+         */
+        bool sprite(const ShapeCache::Key& key, const std::shared_ptr<const QImage>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect);
+
+        /*!
+         * Releases every decoded image and atlas (geometries keep any image pixmaps they already hold).
+         */
+        void clear();
+
+    private:
+        //! Constructor.
+        ImageAtlas();
+
+        //! Disable copy constructor.
+        ImageAtlas(const ImageAtlas&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ImageAtlas& operator=(const ImageAtlas&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// An atlas that images are packed into (in rows, or shelves, as high as their tallest image).
+        struct Atlas
+        {
+            /// The images packed so far (only ever drawn into where no image has been packed yet).
+            std::shared_ptr<QImage> image;
+
+            /// A read-only view of the image's pixels to draw from (which keeps the image alive).
+            std::shared_ptr<const QImage> view;
+
+            /// The left of the next image on the current shelf (pixels).
+            int shelf_x_px;
+
+            /// The top of the current shelf (pixels).
+            int shelf_y_px;
+
+            /// The height of the current shelf (pixels).
+            int shelf_height_px;
+        };
+
+        /// Where an image is packed.
+        struct Sprite
+        {
+            /// The index of the atlas the image is packed into.
+            std::size_t atlas_index;
+
+            /// The rect of the image within the atlas (pixels).
+            QRectF source_rect;
+
+            /// The image that was packed (expired once it is released, so its space can be reclaimed).
+            std::weak_ptr<const void> source;
+        };
+
+        /*!
+         * Fetches where an image is packed into an atlas, packing it if it has not been already.
+         * @param sprites The packed images to find the image in.
+         * @param key The image's key within the packed images.
+         * @param source The image to pack.
+         * @param size_px The size of the image (pixels).
+         * @param image The function that fetches the image to pack (only called if it has not been packed already).
+         * @param return_atlas The atlas image the image is packed into.
+         * @param return_source_rect The rect of the image within the atlas image (pixels).
+         * @return whether the image is packed (images that are too large, or once the atlases are full, are not).
+         */
+        template <class Key>
+        bool sprite(std::map<Key, Sprite>& sprites, const Key& key, const std::shared_ptr<const void>& source, const QSize& size_px, const std::function<QImage()>& image, std::shared_ptr<const QImage>& return_atlas, QRectF& return_source_rect);
+
+        /*!
+         * Releases the atlases, if enough of the images packed into them have been released to be worth packing the rest
+         * again (the atlases lock must be held for writing).
+         * @return whether the atlases were released.
+         */
+        bool releaseIfSparse();
+
+        /*!
+         * Packs an image into an atlas (the atlases lock must be held for writing).
+         * @param image The image to pack.
+         * @param return_sprite Where the image was packed.
+         * @return whether the image was packed.
+         */
+        bool pack(const QImage& image, Sprite& return_sprite);
+
+    private:
+        /// The images decoded from files, keyed by filename (only held while a geometry uses them).
+        std::map<std::string, std::weak_ptr<QPixmap>> m_pixmaps_from_file;
+
+        /// The number of images decoded from files to prune the released ones at.
+        std::size_t m_pixmaps_from_file_prune_size;
+
+        /// Mutex to protect the images decoded from files.
+        QMutex m_pixmaps_from_file_mutex;
+
+        /// The atlases.
+        std::vector<Atlas> m_atlases;
+
+        /// The packed image pixmaps, keyed by their pixel data (QPixmap::cacheKey()).
+        std::map<qint64, Sprite> m_pixmap_sprites;
+
+        /// The packed shapes, keyed by their style.
+        std::map<ShapeCache::Key, Sprite> m_shape_sprites;
+
+        /// Mutex to protect the atlases and packed images (several render threads look up sprites at once).
+        QReadWriteLock m_atlases_mutex;
+    };
+}
@@ -29,10 +29,12 @@
 #include <QDateTime>
 #include <QtCore/QCryptographicHash>
 #include <QtCore/QDateTime>
+#include <QtCore/QMutexLocker>
 #include <QtGui/QPainter>
 
 // Local includes.
 #include "Projection.h"
+#include "TilePack.h"
 
 namespace qmapcontrol
 {
@@ -40,6 +42,9 @@ namespace qmapcontrol
     {
         /// Singleton instance of Image Manager.
         std::unique_ptr<ImageManager> m_instance = nullptr;
+
+        /// The memory the volatile "in-memory" image cache may use (bytes).
+        const std::size_t image_cache_bytes_maximum(128 * 1024 * 1024);
     }
 
     ImageManager& ImageManager::get()
@@ -64,12 +69,13 @@ namespace qmapcontrol
     ImageManager::ImageManager(const int& tile_size_px, QObject* parent)
         : QObject(parent),
           m_tile_size_px(tile_size_px),
-          m_pixmap_loading(),
+          m_image_cache_bytes(0),
+          m_image_loading(),
           m_persistent_cache(false),
           m_persistent_cache_expiry(0)
     {
-        // Setup a loading pixmap.
-        setupLoadingPixmap();
+        // Setup a loading image.
+        setupLoadingImage();
 
         // Connect signal/slot for image downloads.
         QObject::connect(this, &ImageManager::downloadImage, &m_nm, &NetworkManager::downloadImage);
@@ -80,17 +86,23 @@ namespace qmapcontrol
 
     int ImageManager::tileSizePx() const
     {
+        // Gain a lock to protect the tile size.
+        QMutexLocker locker(&m_mutex_image);
+
         // Return the tiles size in pixels.
         return m_tile_size_px;
     }
 
     void ImageManager::setTileSizePx(const int& tile_size_px)
     {
+        // Gain a lock to protect the tile size and loading image.
+        QMutexLocker locker(&m_mutex_image);
+
         // Set the new tile size.
         m_tile_size_px = tile_size_px;
 
-        // Create a new loading pixmap.
-        setupLoadingPixmap();
+        // Create a new loading image.
+        setupLoadingImage();
     }
 
     void ImageManager::setProxy(const QNetworkProxy& proxy)
@@ -107,6 +119,9 @@ namespace qmapcontrol
         // If the path does exist, enable persistent cache.
         if(success)
         {
+            // Gain a lock to protect the persistent cache settings.
+            QMutexLocker locker(&m_mutex_image);
+
             // Set the persistent cache directory path.
             m_persistent_cache_directory = path;
 
@@ -139,59 +154,81 @@ namespace qmapcontrol
         return m_nm.downloadQueueSize();
     }
 
-    QPixmap ImageManager::getImage(const QUrl& url)
+    QImage ImageManager::getImage(const QUrl& url)
     {
         // Holding resource for image to be loaded into.
-        QPixmap return_pixmap(m_pixmap_loading);
+        QImage return_image;
 
-        // Is the image already been downloaded by the network manager?
-        if(m_nm.isDownloading(url) == false)
+        // Keep track of whether the image needs to be downloaded.
+        bool download(false);
+
+        // Scope the lock to the cache look-up, so the signal is emitted without holding it.
         {
-            // Is the image in our volatile "in-memory" cache?
-            const auto find_itr = m_pixmap_cache.find(md5hex(url));
-            if(find_itr != m_pixmap_cache.end())
-            {
-                // Set the return image to the "in-memory" cached version.
-                return_pixmap = find_itr->second;
-            }
-            // Is the persistent cache enabled?
-            else if(m_persistent_cache)
-            {
-                // Does the image exist in the persistent cache.
-                if(persistentCacheFind(url, return_pixmap))
-                {
-                    // Add the image to the volatile cache.
-                    m_pixmap_cache[md5hex(url)] = return_pixmap;
-                }
-                else
-                {
-                    // Emit that we need to download the image using the network manager.
-                    emit downloadImage(url);
-                }
-            }
-            else
-            {
-                // Emit that we need to download the image using the network manager.
-                emit downloadImage(url);
-            }
+            // Gain a lock to protect the caches and prefetch list.
+            QMutexLocker locker(&m_mutex_image);
+
+            // The image is now required on screen, so it is no longer a prefetch request (and its download must be announced).
+            m_prefetch_urls.removeAll(url);
+
+            // Fetch the image (the lock is released while it is read from disk).
+            download = findImage(url, return_image, locker);
+        }
+
+        // Do we need to download the image?
+        if(download)
+        {
+            // Emit that we need to download the image using the network manager.
+            emit downloadImage(url);
         }
 
         // Default return the image.
-        return return_pixmap;
+        return return_image;
     }
 
-    QPixmap ImageManager::prefetchImage(const QUrl& url)
+    QImage ImageManager::prefetchImage(const QUrl& url)
     {
-        // Add the url to the prefetch list.
-        m_prefetch_urls.append(url);
+        // Holding resource for image to be loaded into.
+        QImage return_image;
+
+        // Keep track of whether the image needs to be downloaded.
+        bool download(false);
+
+        // Scope the lock to the cache look-up, so the signal is emitted without holding it.
+        {
+            // Gain a lock to protect the caches and prefetch list.
+            QMutexLocker locker(&m_mutex_image);
+
+            // Fetch the image (the lock is released while it is read from disk).
+            download = findImage(url, return_image, locker);
+
+            // Add the url to the prefetch list, if we are the ones starting its download (so an on screen request is still announced).
+            if(download && m_prefetch_urls.contains(url) == false)
+            {
+                m_prefetch_urls.append(url);
+            }
+        }
+
+        // Do we need to download the image?
+        if(download)
+        {
+            // Emit that we need to download the image using the network manager.
+            emit downloadImage(url);
+        }
 
         // Return the image for the url.
-        return getImage(url);
+        return return_image;
     }
 
     void ImageManager::setLoadingPixmap(const QPixmap &pixmap)
     {
-        m_pixmap_loading = pixmap;
+        // Convert the pixmap before we lock (this is called on the GUI thread).
+        const QImage image(pixmap.toImage());
+
+        // Gain a lock to protect the loading image.
+        QMutexLocker locker(&m_mutex_image);
+
+        // Set the loading image.
+        m_image_loading = image;
     }
 
     void ImageManager::imageDownloaded(const QUrl& url, const QPixmap& pixmap)
@@ -200,45 +237,221 @@ namespace qmapcontrol
         qDebug() << "ImageManager::imageDownloaded '" << url << "'";
 #endif
 
-        // Add it to the pixmap cache.
-        m_pixmap_cache[md5hex(url)] = pixmap;
+        // Convert the pixmap before we lock (downloads are received on the GUI thread), so the image can be drawn from any thread.
+        const QImage image(pixmap.toImage());
 
-        // Do we have the persistent cache enabled?
-        if(m_persistent_cache)
+        // Keep track of whether this is a prefetch request.
+        bool prefetch(false);
+
+        // The file to add the image to in the persistent cache (empty if it is disabled).
+        QString persistent_filename;
+
+        // Scope the lock to the cache update, so the image is saved and the signal is emitted without holding it.
         {
-            // Add the pixmap to the persistent cache.
-            persistentCacheInsert(url, pixmap);
+            // Gain a lock to protect the caches and prefetch list.
+            QMutexLocker locker(&m_mutex_image);
+
+            // Add it to the image cache.
+            insertCachedImage(md5hex(url), image);
+
+            // Do we have the persistent cache enabled?
+            if(m_persistent_cache)
+            {
+                // Fetch the file to add the image to.
+                persistent_filename = persistentCacheFilename(url);
+            }
+
+            // Is this a prefetch request (if so, remove the url from the prefetch list)?
+            prefetch = m_prefetch_urls.removeAll(url) > 0;
         }
 
-        // Is this a prefetch request?
-        if(m_prefetch_urls.contains(url))
+        // Do we have the persistent cache enabled?
+        if(persistent_filename.isEmpty() == false)
         {
-            // Remove the url from the prefetch list.
-            m_prefetch_urls.removeAt(m_prefetch_urls.indexOf(url));
+            // Add the image to the persistent cache.
+            persistentCacheInsert(persistent_filename, image);
         }
-        else
+
+        // Is this an on screen request (nothing is waiting to draw a prefetched image)?
+        if(prefetch == false)
         {
             // Let the world know we have received an updated image.
             emit imageUpdated(url);
         }
     }
 
-    void ImageManager::setupLoadingPixmap()
+    bool ImageManager::findImage(const QUrl& url, QImage& return_image, QMutexLocker& locker)
+    {
+        // Default to the loading image.
+        return_image = m_image_loading;
+
+        // Wait for any other thread reading the image (rather than read it twice).
+        const QString hex(md5hex(url));
+        while(m_images_reading.count(hex) > 0)
+        {
+            m_images_read.wait(&m_mutex_image);
+        }
+
+        // Is the image in our volatile "in-memory" cache?
+        if(findCachedImage(hex, return_image))
+        {
+            // Nothing to download.
+            return false;
+        }
+
+        // Is the image a packed tile (which is read from the pack, rather than downloaded)?
+        QString pack_filename;
+        int zoom(0);
+        int x(0);
+        int y(0);
+        const bool packed(TilePack::parseUrl(url, pack_filename, zoom, x, y));
+        if(packed == false)
+        {
+            // Is the image already being downloaded by the network manager?
+            if(m_nm.isDownloading(url))
+            {
+                // Nothing to download.
+                return false;
+            }
+            // Is the persistent cache disabled?
+            else if(m_persistent_cache == false)
+            {
+                // We need to download the image using the network manager.
+                return true;
+            }
+        }
+
+        // Fetch what the image is read with, while we hold the lock.
+        const auto itr_pack = packed ? m_tile_packs.find(pack_filename) : m_tile_packs.end();
+        const bool pack_opened(itr_pack != m_tile_packs.end());
+        std::shared_ptr<TilePack> tile_pack(pack_opened ? itr_pack->second : nullptr);
+        const QString persistent_filename(packed ? QString() : persistentCacheFilename(url));
+        const std::chrono::minutes persistent_expiry(m_persistent_cache_expiry);
+        const int tile_size_px(m_tile_size_px);
+
+        // Mark the image as being read, and release the lock while it is read and decoded.
+        m_images_reading.insert(hex);
+        locker.unlock();
+
+        // Read the image (decoded as a QImage, as this may be a render thread).
+        QImage image;
+        bool found(false);
+        if(packed)
+        {
+            // Have we opened the pack yet?
+            if(pack_opened == false)
+            {
+                // Open the pack (keeping a null pack if it cannot be opened, so we only try once).
+                tile_pack = std::make_shared<TilePack>(pack_filename);
+                if(tile_pack->open() == false)
+                {
+                    tile_pack.reset();
+                }
+            }
+
+            // Decode the tile from the pack.
+            if(tile_pack == nullptr || image.loadFromData(tile_pack->read(zoom, x, y)) == false)
+            {
+                // The tile is not in the pack (it was empty when seeded), so leave it transparent.
+                image = QImage(tile_size_px, tile_size_px, QImage::Format_ARGB32_Premultiplied);
+                image.fill(Qt::transparent);
+            }
+
+            // A packed tile is always found.
+            found = true;
+        }
+        else
+        {
+            // Does the image exist in the persistent cache?
+            found = persistentCacheFind(persistent_filename, persistent_expiry, image);
+        }
+
+        // Gain the lock again, and wake any threads waiting for the image.
+        locker.relock();
+        m_images_reading.erase(hex);
+        m_images_read.wakeAll();
+
+        // Keep the pack we opened (unless another thread has opened it in the meantime).
+        if(packed && pack_opened == false)
+        {
+            m_tile_packs.emplace(pack_filename, tile_pack);
+        }
+
+        // Was the image found?
+        if(found == false)
+        {
+            // We need to download the image using the network manager.
+            return true;
+        }
+
+        // Add the image to the volatile cache.
+        insertCachedImage(hex, image);
+        return_image = image;
+
+        // Nothing to download.
+        return false;
+    }
+
+    void ImageManager::setupLoadingImage()
     {
-        // Create a new pixmap.
-        m_pixmap_loading = QPixmap(m_tile_size_px, m_tile_size_px);
+        // Create a new image (as the image manager may be first used from a render thread).
+        m_image_loading = QImage(m_tile_size_px, m_tile_size_px, QImage::Format_ARGB32_Premultiplied);
 
         // Make is transparent.
-        m_pixmap_loading.fill(Qt::transparent);
+        m_image_loading.fill(Qt::transparent);
 
         // Add a pattern.
-        QPainter painter(&m_pixmap_loading);
+        QPainter painter(&m_image_loading);
         QBrush brush(Qt::lightGray, Qt::Dense5Pattern);
-        painter.fillRect(m_pixmap_loading.rect(), brush);
+        painter.fillRect(m_image_loading.rect(), brush);
 
         // Add "LOADING..." text.
         painter.setPen(Qt::black);
-        painter.drawText(m_pixmap_loading.rect(), Qt::AlignCenter, "LOADING...");
+        painter.drawText(m_image_loading.rect(), Qt::AlignCenter, "LOADING...");
+    }
+
+    bool ImageManager::findCachedImage(const QString& hex, QImage& return_image)
+    {
+        // Is the image in the cache?
+        const auto itr_find = m_image_cache.find(hex);
+        if(itr_find == m_image_cache.end())
+        {
+            return false;
+        }
+
+        // Mark the image as the most recently used, and return it (implicitly shared, so no copy takes place).
+        m_image_cache_lru.splice(m_image_cache_lru.begin(), m_image_cache_lru, itr_find->second.lru_itr);
+        return_image = itr_find->second.image;
+        return true;
+    }
+
+    void ImageManager::insertCachedImage(const QString& hex, const QImage& image)
+    {
+        // Remove any image already cached for the key.
+        const auto itr_find = m_image_cache.find(hex);
+        if(itr_find != m_image_cache.end())
+        {
+            m_image_cache_bytes -= itr_find->second.bytes;
+            m_image_cache_lru.erase(itr_find->second.lru_itr);
+            m_image_cache.erase(itr_find);
+        }
+
+        // Add the image as the most recently used.
+        m_image_cache_lru.push_front(hex);
+        CachedImage& cached_image(m_image_cache[hex]);
+        cached_image.image = image;
+        cached_image.bytes = std::size_t(image.byteCount());
+        cached_image.lru_itr = m_image_cache_lru.begin();
+        m_image_cache_bytes += cached_image.bytes;
+
+        // Evict the least recently used images until we are within the memory limit (always keeping the newest).
+        while(m_image_cache_bytes > image_cache_bytes_maximum && m_image_cache_lru.size() > 1)
+        {
+            const auto itr_evict = m_image_cache.find(m_image_cache_lru.back());
+            m_image_cache_bytes -= itr_evict->second.bytes;
+            m_image_cache.erase(itr_evict);
+            m_image_cache_lru.pop_back();
+        }
     }
 
     QString ImageManager::md5hex(const QUrl& url)
@@ -253,13 +466,13 @@ namespace qmapcontrol
         return m_persistent_cache_directory.absolutePath() + QDir::separator() + md5hex(url);
     }
 
-    bool ImageManager::persistentCacheFind(const QUrl& url, QPixmap& return_pixmap)
+    bool ImageManager::persistentCacheFind(const QString& filename, const std::chrono::minutes& expiry, QImage& return_image)
     {
         // Track our success.
         bool success(false);
 
         // The file for the given url from the persistent cache.
-        QFile file(persistentCacheFilename(url));
+        QFile file(filename);
 
         // Does the file exist?
         if(file.exists())
@@ -269,21 +482,21 @@ namespace qmapcontrol
 
             // Is the persistent cache expiry set, and if so is the file older than the expiry time
             // allowed?
-            if(m_persistent_cache_expiry.count() > 0
-               && file_info.lastModified().msecsTo(QDateTime::currentDateTime()) > std::chrono::duration_cast<std::chrono::milliseconds>(m_persistent_cache_expiry).count())
+            if(expiry.count() > 0
+               && file_info.lastModified().msecsTo(QDateTime::currentDateTime()) > std::chrono::duration_cast<std::chrono::milliseconds>(expiry).count())
             {
                 // The file is too old, remove it.
-                m_persistent_cache_directory.remove(file.fileName());
+                file.remove();
 
                 // Log removing the file.
 #ifdef QMAP_DEBUG
-                qDebug() << "Removing '" << file.fileName() << "' from persistent cache for url '" << url << "'";
+                qDebug() << "Removing '" << filename << "' from persistent cache";
 #endif
             }
             else
             {
-                // Try to load the file into the pixmap, store the success result.
-                success = return_pixmap.load(persistentCacheFilename(url));
+                // Try to load the file into the image, store the success result.
+                success = return_image.load(filename);
             }
         }
 
@@ -291,9 +504,9 @@ namespace qmapcontrol
         return success;
     }
 
-    bool ImageManager::persistentCacheInsert(const QUrl& url, const QPixmap& pixmap)
+    bool ImageManager::persistentCacheInsert(const QString& filename, const QImage& image)
     {
-        // Return the result of saving the pixmap to the persistent cache.
-        return pixmap.save(persistentCacheFilename(url), "PNG");
+        // Return the result of saving the image to the persistent cache.
+        return image.save(filename, "PNG");
     }
 }
@@ -29,14 +29,19 @@
 #include <QtCore/QDir>
 #include <QtCore/QObject>
 #include <QtCore/QList>
+#include <QtCore/QMutex>
 #include <QtCore/QUrl>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QImage>
 #include <QtGui/QPixmap>
 #include <QtNetwork/QNetworkProxy>
 
 // STL includes.
 #include <chrono>
+#include <list>
 #include <map>
 #include <memory>
+#include <set>
 
 // Local includes.
 #include "qmapcontrol_global.h"
@@ -48,6 +53,8 @@
  */
 namespace qmapcontrol
 {
+    class TilePack;
+
     class QMAPCONTROL_EXPORT ImageManager : public QObject
     {
         Q_OBJECT
@@ -111,15 +118,17 @@ namespace qmapcontrol
 
         /*!
          * If this component doesn't have the image a network query gets started to load it.
+         * This is safe to call from several render threads at once.
          * Fetch the requested image either from an in-memory cache or persistent file cache (if
          * enabled).
          * If the image does not exist, then it is fetched using a network manager and a "loading"
-         * placeholder pixmap is returned. Once the image has been downloaded, the image manager
+         * placeholder image is returned. Once the image has been downloaded, the image manager
          * will emit "imageReceived" to inform that the image is now ready.
+         * The image is a QImage (rather than a QPixmap), so it can be fetched and drawn from any thread.
          * @param url The image url to fetch.
-         * @return the pixmap of the image.
+         * @return the image.
          */
-        QPixmap getImage(const QUrl& url);
+        QImage getImage(const QUrl& url);
 
         /*!
          * Fetches the requested image using the getImage function, which has been deemed
@@ -128,12 +137,12 @@ namespace qmapcontrol
          * emitted on particular hardware platforms only (Eg: mobile platforms do not receive the
          * "imageReceived" emission.
          * @param url The image url to fetch.
-         * @return the pixmap of the image.
+         * @return the image.
          */
-        QPixmap prefetchImage(const QUrl& url);
+        QImage prefetchImage(const QUrl& url);
 
         /*!
-         * \brief setLoadingPixmap sets the pixmap displayed when a tile is not yet loaded
+         * \brief setLoadingPixmap sets the pixmap displayed when a tile is not yet loaded (call from the GUI thread)
          * \param pixmap the pixmap to display
          */
         void setLoadingPixmap (const QPixmap &pixmap);
@@ -186,9 +195,38 @@ namespace qmapcontrol
         ImageManager& operator=(const ImageManager&); /// @todo remove once MSVC supports default/delete syntax.
 
         /*!
-         * Create a loading pixmap for use.
+         * Create a loading image for use (the image mutex must be held).
+         */
+        void setupLoadingImage();
+
+        /*!
+         * Fetch an image from the volatile "in-memory" cache, marking it as the most recently used (the image mutex must be held).
+         * @param hex The image's key (see md5hex()).
+         * @param return_image The cached image.
+         * @return whether the image was cached.
+         */
+        bool findCachedImage(const QString& hex, QImage& return_image);
+
+        /*!
+         * Add an image to the volatile "in-memory" cache, evicting the least recently used images to stay within its
+         * memory limit (the image mutex must be held).
+         * @param hex The image's key (see md5hex()).
+         * @param image The image to cache.
+         */
+        void insertCachedImage(const QString& hex, const QImage& image);
+
+        /*!
+         * Fetch the requested image from the in-memory cache, or read it from a tile pack (if the url is of a packed tile)
+         * or the persistent cache.
+         * The image mutex must be held by the locker. It is released while the image is read and decoded, and any other
+         * thread requesting the same image waits for it to be read rather than reading it again.
+         * @param url The image url to fetch.
+         * @param return_image The image, or the loading image if it is not cached (packed tiles that are not in the pack are
+         * transparent).
+         * @param locker The locker holding the image mutex.
+         * @return whether the image needs to be downloaded.
          */
-        void setupLoadingPixmap();
+        bool findImage(const QUrl& url, QImage& return_image, QMutexLocker& locker);
 
         /*!
          * Generate a md5 hex for the given url.
@@ -205,33 +243,65 @@ namespace qmapcontrol
         QString persistentCacheFilename(const QUrl& url);
 
         /*!
-         * Finds and loads the requested image if is exists in the persistent cache.
-         * @param url The image url to fetch.
-         * @param return_pixmap The pixmap of the image to be populated.
+         * Finds and loads the requested image if is exists in the persistent cache (the image mutex need not be held).
+         * @param filename The persistent file path of the image (see persistentCacheFilename()).
+         * @param expiry The max age of the image before it is removed (0 to keep forever).
+         * @param return_image The image to be populated.
          * @return whether the image was actually found and loaded.
          */
-        bool persistentCacheFind(const QUrl& url, QPixmap& return_pixmap);
+        static bool persistentCacheFind(const QString& filename, const std::chrono::minutes& expiry, QImage& return_image);
 
         /*!
-         * Inserts the image into the persistent cache.
-         * @param url The image url to insert.
-         * @param pixmap The pixmap of the image to insert.
+         * Inserts the image into the persistent cache (the image mutex need not be held).
+         * @param filename The persistent file path of the image (see persistentCacheFilename()).
+         * @param image The image to insert.
          * @return whether the image was actually inserted.
          */
-        bool persistentCacheInsert(const QUrl& url, const QPixmap& pixmap);
+        static bool persistentCacheInsert(const QString& filename, const QImage& image);
 
     private:
         /// Network manager.
         NetworkManager m_nm;
 
-        /// Cache of pixmaps already loaded.
-        std::map<QString, QPixmap> m_pixmap_cache;
+        /// Mutex to protect the caches, prefetch list and loading image (images are fetched from several render threads).
+        mutable QMutex m_mutex_image;
+
+        /// An image in the volatile "in-memory" cache.
+        struct CachedImage
+        {
+            /// The image.
+            QImage image;
+
+            /// The memory used by the image (bytes).
+            std::size_t bytes;
+
+            /// The image's position in the least recently used list.
+            std::list<QString>::iterator lru_itr;
+        };
+
+        /// Cache of images already loaded (kept as QImage, so render threads never create pixmaps).
+        std::map<QString, CachedImage> m_image_cache;
+
+        /// The keys of the cached images, most recently used first.
+        std::list<QString> m_image_cache_lru;
+
+        /// The memory used by the cached images (bytes).
+        std::size_t m_image_cache_bytes;
+
+        /// The images being read from a tile pack or the persistent cache, keyed as in the image cache.
+        std::set<QString> m_images_reading;
+
+        /// Wait condition to wake the threads waiting for an image being read by another thread.
+        QWaitCondition m_images_read;
+
+        /// The tile packs opened to fetch packed tiles from, keyed by the pack file (null if it could not be opened).
+        std::map<QString, std::shared_ptr<TilePack>> m_tile_packs;
 
         /// The tile size in pixels.
         int m_tile_size_px;
 
-        /// Pixmap of an empty image with "LOADING..." text.
-        QPixmap m_pixmap_loading;
+        /// An empty image with "LOADING..." text.
+        QImage m_image_loading;
 
         /// A list of image urls being prefetched.
         QList<QUrl> m_prefetch_urls;
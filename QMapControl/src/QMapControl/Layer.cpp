@@ -104,6 +104,18 @@ namespace qmapcontrol
         emit requestRedraw();
     }
 
+    bool Layer::prepareDraw(const RectWorldPx& /*backbuffer_rect_px*/, const int& /*controller_zoom*/) const
+    {
+        // By default, each render tile is drawn independently.
+        return false;
+    }
+
+    qreal Layer::damagedMarginPx(const int& /*controller_zoom*/) const
+    {
+        // By default, a layer only draws within the rects it emits as damaged.
+        return 0.0;
+    }
+
     bool Layer::isMouseEventsEnabled() const
     {
         // Return the enabled value.
@@ -61,7 +61,9 @@ namespace qmapcontrol
             /// Layer that draws Geometries.
             LayerGeometry,
             /// Layer that draws ESRI Shapefiles.
-            LayerESRIShapefile
+            LayerESRIShapefile,
+            /// Layer that draws the density of weighted points.
+            LayerHeatmap
         };
 
     protected:
@@ -160,12 +162,35 @@ namespace qmapcontrol
          */
         virtual void draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const = 0;
 
+        /*!
+         * Prepares to draw the layer as several render tiles of the backbuffer rect (which may be drawn concurrently), so
+         * work that spans the tiles (ie: label placement) is done once for the whole backbuffer rect.
+         * @param backbuffer_rect_px The backbuffer rect that the render tiles cover (pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the layer's drawing has changed outside the rects it emitted as damaged (so it must be redrawn in full).
+         */
+        virtual bool prepareDraw(const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const;
+
+        /*!
+         * Fetches how far the layer can draw outside the rects it emits as damaged (see requestRedrawDamaged()).
+         * @param controller_zoom The current controller zoom.
+         * @return the distance in pixels.
+         */
+        virtual qreal damagedMarginPx(const int& controller_zoom) const;
+
     signals:
         /*!
          * Signal emitted when a change has occurred that requires the layer to be redrawn.
          */
         void requestRedraw() const;
 
+        /*!
+         * Signal emitted when a change has occurred that only requires part of the layer to be redrawn.
+         * @param damaged_rect_coord The rect that needs to be redrawn (world coordinates).
+         * @param damaged_margin_px The margin around the rect that also needs to be redrawn in pixels (in addition to damagedMarginPx()).
+         */
+        void requestRedrawDamaged(const RectWorldCoord& damaged_rect_coord, const qreal& damaged_margin_px) const;
+
     private:
         //! Disable copy constructor.
         Layer(const Layer&); /// @todo remove once MSVC supports default/delete syntax.
@@ -0,0 +1,628 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LayerCluster.h"
+
+// Qt includes.
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QMutexLocker>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QPainter>
+
+// STL includes.
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+// Local includes.
+#include "GeometryPoint.h"
+#include "ImageManager.h"
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /*!
+         * Calculates the key of a grid cell (sorted by row, then column).
+         * @param column The column of the cell.
+         * @param row The row of the cell.
+         * @return the key.
+         */
+        inline quint64 cellKey(const quint64& column, const quint64& row)
+        {
+            return (row << 32) | column;
+        }
+
+        /*!
+         * Calculates the row/column index of the grid cell a position falls in (clamped to the cells a key can hold).
+         * @param position_px The position (pixels).
+         * @param cell_size_px The size of a grid cell (pixels).
+         * @return the row/column index.
+         */
+        inline quint64 cellIndex(const qreal& position_px, const qreal& cell_size_px)
+        {
+            return quint64(std::min(std::max(std::floor(position_px / cell_size_px), qreal(0.0)), qreal(std::numeric_limits<quint32>::max())));
+        }
+
+        /*!
+         * Calculates the key of the grid cell a cell falls in at the zoom below (each cell covers 2x2 cells at the zoom above).
+         * @param key The key of the cell.
+         * @return the key of the parent cell.
+         */
+        inline quint64 parentCellKey(const quint64& key)
+        {
+            return cellKey((key & 0xFFFFFFFF) >> 1, (key >> 32) >> 1);
+        }
+
+        /*!
+         * Calculates the diameter to draw a cluster's symbol with.
+         * @param count The number of points in the cluster.
+         * @param radius_px The grid cell size (the largest symbol).
+         * @return the diameter (pixels).
+         */
+        inline qreal clusterDiameterPx(const std::size_t& count, const int& radius_px)
+        {
+            return std::min(qreal(radius_px), qreal(20.0) + qreal(10.0) * std::log10(qreal(count)));
+        }
+
+        /*!
+         * Visits the clusters at a zoom whose grid cell intersects a range.
+         * @param level The clusters at the zoom.
+         * @param range_px The range (pixels at the zoom).
+         * @param cell_size_px The size of a grid cell (pixels at the zoom).
+         * @param visitor Called as 'void visitor(const Cluster& cluster)' for each cluster.
+         */
+        template <class ClusterLevel, class Visitor>
+        void visitClusters(const ClusterLevel& level, const QRectF& range_px, const qreal& cell_size_px, Visitor&& visitor)
+        {
+            // Is any of the range within the grid?
+            if(range_px.right() >= 0.0 && range_px.bottom() >= 0.0)
+            {
+                // Calculate the range of grid cells.
+                const quint64 column_first(cellIndex(range_px.left(), cell_size_px));
+                const quint64 column_last(cellIndex(range_px.right(), cell_size_px));
+                const quint64 row_first(cellIndex(range_px.top(), cell_size_px));
+                const quint64 row_last(cellIndex(range_px.bottom(), cell_size_px));
+
+                // Loop through each row (the clusters in a row are contiguous, as they are sorted by row, then column).
+                for(quint64 row = row_first; row <= row_last; ++row)
+                {
+                    // Find the first cluster in the range on this row.
+                    const quint64 key_last(cellKey(column_last, row));
+                    for(auto itr_key = std::lower_bound(level.keys.begin(), level.keys.end(), cellKey(column_first, row)); itr_key != level.keys.end() && *itr_key <= key_last; ++itr_key)
+                    {
+                        // Visit the cluster.
+                        visitor(level.clusters[std::size_t(itr_key - level.keys.begin())]);
+                    }
+                }
+            }
+        }
+    }
+
+    LayerCluster::LayerCluster(const std::string& name, const int& zoom_minimum, const int& zoom_maximum, QObject* parent)
+        : LayerGeometry(name, zoom_minimum, zoom_maximum, parent),
+          m_cluster_radius_px(60),
+          m_cluster_zoom_maximum(std::max(std::min(zoom_maximum - 1, 15), 0)),
+          m_cluster_pen(QPen(Qt::white, 2.0)),
+          m_cluster_brush(QBrush(QColor(51, 136, 255, 220))),
+          m_cluster_tree(nullptr),
+          m_cluster_tree_building(false)
+    {
+        // Geometries draw their own labels, as only the points that are not clustered are drawn.
+        setLabelsPlaced(false);
+    }
+
+    LayerCluster::~LayerCluster()
+    {
+        // Wait for any clusters that are still being built (the worker uses this layer).
+        QMutexLocker locker(&m_cluster_tree_future_mutex);
+        m_cluster_tree_future.waitForFinished();
+    }
+
+    int LayerCluster::clusterRadiusPx() const
+    {
+        // Return the grid cell size.
+        return m_cluster_radius_px;
+    }
+
+    void LayerCluster::setClusterRadiusPx(const int& radius_px)
+    {
+        // Set the grid cell size (the clusters are rebuilt when next drawn).
+        m_cluster_radius_px = std::max(radius_px, 1);
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    int LayerCluster::clusterZoomMaximum() const
+    {
+        // Return the highest zoom that points are clustered at.
+        return m_cluster_zoom_maximum;
+    }
+
+    void LayerCluster::setClusterZoomMaximum(const int& zoom_maximum)
+    {
+        // Set the highest zoom that points are clustered at (the clusters are rebuilt when next drawn).
+        m_cluster_zoom_maximum = std::max(zoom_maximum, 0);
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    QPen LayerCluster::clusterPen() const
+    {
+        // Gain a lock to protect the pen.
+        QMutexLocker locker(&m_cluster_style_mutex);
+
+        // Return the pen.
+        return m_cluster_pen;
+    }
+
+    void LayerCluster::setClusterPen(const QPen& pen)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the pen.
+            QMutexLocker locker(&m_cluster_style_mutex);
+
+            // Set the pen.
+            m_cluster_pen = pen;
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    QBrush LayerCluster::clusterBrush() const
+    {
+        // Gain a lock to protect the brush.
+        QMutexLocker locker(&m_cluster_style_mutex);
+
+        // Return the brush.
+        return m_cluster_brush;
+    }
+
+    void LayerCluster::setClusterBrush(const QBrush& brush)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the brush.
+            QMutexLocker locker(&m_cluster_style_mutex);
+
+            // Set the brush.
+            m_cluster_brush = brush;
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    const std::vector<std::shared_ptr<Geometry>> LayerCluster::getClusterGeometries(const PointWorldCoord& point_coord, const int& controller_zoom) const
+    {
+        // The geometries container to return.
+        std::vector<std::shared_ptr<Geometry>> return_geometries;
+
+        // Are the points clustered at this zoom?
+        const auto tree(clusterTree());
+        if(tree != nullptr && controller_zoom >= 0 && controller_zoom <= tree->zoom_maximum)
+        {
+            // Find the cluster at the point.
+            const Cluster* cluster(findCluster(*tree, point_coord, controller_zoom));
+            if(cluster != nullptr)
+            {
+                // Collect the points in the cluster.
+                collectPoints(return_geometries, *tree, *cluster, controller_zoom);
+            }
+        }
+
+        // Return the list of geometries.
+        return return_geometries;
+    }
+
+    bool LayerCluster::mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const
+    {
+        // Are the points clustered at this zoom?
+        const auto tree(clusterTree());
+        if(tree == nullptr || controller_zoom < 0 || controller_zoom > tree->zoom_maximum)
+        {
+            // Handle the geometries as normal.
+            return LayerGeometry::mousePressEvent(mouse_event, mouse_point_coord, controller_zoom);
+        }
+
+        // Are mouse events enabled, is the layer visible and is it a left-click mouse press event?
+        if(isMouseEventsEnabled() && isVisible(controller_zoom) && mouse_event->type() == QEvent::MouseButtonPress && mouse_event->button() == Qt::LeftButton)
+        {
+            // Find the cluster that was clicked.
+            const Cluster* cluster(findCluster(*tree, mouse_point_coord, controller_zoom));
+            if(cluster != nullptr)
+            {
+                // Collect the points in the cluster.
+                std::vector<std::shared_ptr<Geometry>> geometries;
+                collectPoints(geometries, *tree, *cluster, controller_zoom);
+
+                // Is it a single point?
+                if(geometries.size() == 1)
+                {
+                    // Emit that the geometry has been clicked (from the geometry and the layer).
+                    emit geometries.front()->geometryClicked(geometries.front().get());
+                    emit geometryClicked(geometries.front().get());
+                }
+                else
+                {
+                    // Emit that the cluster has been clicked.
+                    const QPointF position_px(cluster->position_px * std::ldexp(qreal(1.0), controller_zoom));
+                    emit clusterClicked(projection::get().toPointWorldCoord(PointWorldPx(position_px.x(), position_px.y()), controller_zoom), geometries);
+                }
+
+                // A cluster was clicked.
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void LayerCluster::draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const
+    {
+        // Fetch the current clusters (this starts to build new clusters if required, even if they are not drawn at this zoom).
+        const auto tree(clusterTree());
+
+        // Are the points clustered at this zoom?
+        if(controller_zoom > m_cluster_zoom_maximum || controller_zoom < 0)
+        {
+            // Draw the geometries as normal.
+            LayerGeometry::draw(painter, backbuffer_rect_px, controller_zoom);
+        }
+        // Check the layer is visible, and we have clusters for this zoom (otherwise they are drawn once built).
+        else if(isVisible(controller_zoom) && tree != nullptr && controller_zoom <= tree->zoom_maximum)
+        {
+            // Calculate the world coordinates.
+            const RectWorldCoord backbuffer_rect_coord(projection::get().toPointWorldCoord(backbuffer_rect_px.topLeftPx(), controller_zoom), projection::get().toPointWorldCoord(backbuffer_rect_px.bottomRightPx(), controller_zoom));
+
+            // Save the current painter's state.
+            painter.save();
+
+            // Draw the other geometries within the backbuffer as normal (in z-index order, which is the order they are indexed).
+            thread_local std::vector<std::size_t> t_geometry_indices;
+            t_geometry_indices.clear();
+            tree->geometries_index.query(t_geometry_indices, backbuffer_rect_coord);
+            std::sort(t_geometry_indices.begin(), t_geometry_indices.end());
+            for(const auto& geometry_index : t_geometry_indices)
+            {
+                tree->geometries[geometry_index]->draw(painter, backbuffer_rect_coord, controller_zoom);
+            }
+
+            // Fetch the pen and brush for the cluster symbols.
+            const QPen cluster_pen(clusterPen());
+            const QBrush cluster_brush(clusterBrush());
+
+            // Clusters are drawn around the mean of their points, so allow for a symbol crossing into the range from a neighbouring cell.
+            const qreal radius_px(tree->radius_px);
+            const QRectF range_px(QRectF(backbuffer_rect_px.topLeftPx().rawPoint(), backbuffer_rect_px.bottomRightPx().rawPoint()).normalized().adjusted(-radius_px, -radius_px, radius_px, radius_px));
+
+            // Draw each cluster within the range (single points are collected into a buffer that keeps its capacity).
+            const qreal scale(std::ldexp(qreal(1.0), controller_zoom));
+            std::vector<std::shared_ptr<Geometry>> single_point;
+            visitClusters(tree->levels.at(std::size_t(controller_zoom)), range_px, radius_px, [&](const Cluster& cluster)
+            {
+                // Are all of its points hidden at this zoom?
+                if(cluster.count == 0)
+                {
+                    // Nothing to draw.
+                    return;
+                }
+
+                // Is it a single point?
+                if(cluster.count == 1)
+                {
+                    // Draw the point itself.
+                    single_point.clear();
+                    collectPoints(single_point, *tree, cluster, controller_zoom);
+                    single_point.front()->draw(painter, backbuffer_rect_coord, controller_zoom);
+                }
+                else
+                {
+                    // Draw the cluster symbol, with the number of points it represents.
+                    const qreal diameter_px(clusterDiameterPx(cluster.count, tree->radius_px));
+                    const QRectF symbol_rect_px(cluster.position_px * scale - QPointF(diameter_px / 2.0, diameter_px / 2.0), QSizeF(diameter_px, diameter_px));
+                    painter.setPen(cluster_pen);
+                    painter.setBrush(cluster_brush);
+                    painter.drawEllipse(symbol_rect_px);
+                    painter.drawText(symbol_rect_px, Qt::AlignCenter, QString::number(qulonglong(cluster.count)));
+                }
+            });
+
+            // Restore the painter's state.
+            painter.restore();
+        }
+    }
+
+    std::shared_ptr<const LayerCluster::ClusterTree> LayerCluster::clusterTree() const
+    {
+        // Fetch the published clusters, and the current geometries/settings.
+        auto tree = std::atomic_load(&m_cluster_tree);
+        const auto snapshot(geometriesSnapshot());
+        const int radius_px(m_cluster_radius_px);
+        const int zoom_maximum(m_cluster_zoom_maximum);
+        const int epsg(projection::get().epsg());
+        const int tile_size_px(ImageManager::get().tileSizePx());
+
+        // Are the clusters out-of-date?
+        if(tree == nullptr || tree->snapshot != snapshot || tree->radius_px != radius_px || tree->zoom_maximum != zoom_maximum || tree->epsg != epsg || tree->tile_size_px != tile_size_px)
+        {
+            // Are we the first to notice (only one worker builds the clusters at a time)?
+            if(m_cluster_tree_building.exchange(true) == false)
+            {
+                // Gain a lock to protect the worker's future.
+                QMutexLocker locker(&m_cluster_tree_future_mutex);
+
+                // Build the new clusters on a worker thread (the redraw signal is queued back to the controller once they are ready).
+                m_cluster_tree_future = QtConcurrent::run(this, &LayerCluster::buildClusterTree, snapshot, radius_px, zoom_maximum, epsg);
+            }
+
+            // The previous clusters are still drawn until the new ones are ready, unless they were projected differently.
+            if(tree != nullptr && (tree->epsg != epsg || tree->tile_size_px != tile_size_px))
+            {
+                tree = nullptr;
+            }
+        }
+
+        // Return the clusters.
+        return tree;
+    }
+
+    void LayerCluster::buildClusterTree(const std::shared_ptr<const GeometriesSnapshot>& snapshot, const int& radius_px, const int& zoom_maximum, const int& epsg) const
+    {
+        // Project with the same projection as the thread that requested the clusters.
+        const projection::ThreadOverride projection_override(projection::EPSG(epsg));
+
+        // Create the new clusters.
+        const auto tree(std::make_shared<ClusterTree>());
+        tree->snapshot = snapshot;
+        tree->radius_px = radius_px;
+        tree->zoom_maximum = zoom_maximum;
+        tree->epsg = projection::get().epsg();
+        tree->tile_size_px = ImageManager::get().tileSizePx();
+        tree->levels.resize(std::size_t(zoom_maximum) + 1);
+
+        // Collect the points (and their positions at zoom 0) and the other geometries (and their bounding boxes), in z-index order.
+        std::vector<QPointF> points_px;
+        std::vector<std::pair<RectWorldCoord, std::size_t>> geometries_entries;
+        for(const auto& geometries : snapshot->geometries)
+        {
+            geometries.second->visit(GeometriesIndex::worldBoundary(), [&](const std::shared_ptr<Geometry>& geometry)
+            {
+                // Is it a GeometryPoint?
+                if(geometry->geometryType() == Geometry::GeometryType::GeometryPoint)
+                {
+                    // Find the zooms the point is visible at (a geometry is visible over a single range of zooms).
+                    int zoom_first(-1);
+                    int zoom_last(-1);
+                    for(int zoom = 0; zoom <= zoom_maximum; ++zoom)
+                    {
+                        if(geometry->isVisible(zoom))
+                        {
+                            zoom_first = zoom_first == -1 ? zoom : zoom_first;
+                            zoom_last = zoom;
+                        }
+                    }
+
+                    // Is the point visible at any zoom (hidden points are not clustered)?
+                    if(zoom_first != -1)
+                    {
+                        // Add the point to be clustered.
+                        tree->points.push_back(geometry);
+                        tree->point_zooms.emplace_back(zoom_first, zoom_last);
+                        points_px.push_back(projection::get().toPointWorldPx(static_cast<const GeometryPoint&>(*geometry).coord(), 0).rawPoint());
+                    }
+                }
+                else
+                {
+                    // Add the geometry to be drawn as normal.
+                    geometries_entries.emplace_back(geometry->boundingBox(0), tree->geometries.size());
+                    tree->geometries.push_back(geometry);
+                }
+                return true;
+            });
+        }
+
+        // Index the other geometries, so only those within a backbuffer are drawn.
+        tree->geometries_index.insert(geometries_entries);
+
+        // The keys and children to group into the clusters at each zoom (starting with the points at the zoom maximum).
+        std::vector<std::pair<quint64, std::size_t>> children;
+        children.reserve(points_px.size());
+
+        // Calculate the grid cell of each point at the zoom maximum (cells are the radius at that zoom).
+        const qreal cell_size_px(qreal(radius_px) / std::ldexp(qreal(1.0), zoom_maximum));
+        std::vector<quint64> point_keys;
+        point_keys.reserve(points_px.size());
+        for(std::size_t i = 0; i < points_px.size(); ++i)
+        {
+            point_keys.push_back(cellKey(cellIndex(points_px[i].x(), cell_size_px), cellIndex(points_px[i].y(), cell_size_px)));
+            children.emplace_back(point_keys.back(), i);
+        }
+
+        // A cluster counts the points in it that are visible at its zoom, so note the zoom below the zoom maximum each point
+        // is shown from (its last zoom) and hidden from (the zoom before its first), working down from the zoom maximum.
+        std::vector<std::vector<std::pair<std::size_t, bool>>> point_changes(std::size_t(zoom_maximum) + 1);
+        for(std::size_t i = 0; i < tree->point_zooms.size(); ++i)
+        {
+            if(tree->point_zooms[i].second < zoom_maximum)
+            {
+                point_changes[std::size_t(tree->point_zooms[i].second)].emplace_back(i, true);
+            }
+            if(tree->point_zooms[i].first > 0)
+            {
+                point_changes[std::size_t(tree->point_zooms[i].first - 1)].emplace_back(i, false);
+            }
+        }
+
+        // Build each zoom from the one above (so every cluster is made up of the clusters it splits into).
+        for(int zoom = zoom_maximum; zoom >= 0; --zoom)
+        {
+            // Group the children by their cell.
+            std::sort(children.begin(), children.end());
+
+            // Create a cluster for each cell.
+            ClusterLevel& level(tree->levels[std::size_t(zoom)]);
+            level.children.reserve(children.size());
+            for(std::size_t i = 0; i < children.size(); ++i)
+            {
+                // Is this the first child in a new cell?
+                if(i == 0 || children[i].first != children[i - 1].first)
+                {
+                    // Start a new cluster.
+                    Cluster cluster;
+                    cluster.position_px = QPointF(0.0, 0.0);
+                    cluster.count = 0;
+                    cluster.children_begin = level.children.size();
+                    cluster.children_end = level.children.size();
+                    level.keys.push_back(children[i].first);
+                    level.clusters.push_back(cluster);
+                }
+
+                // Add the child to the cluster (the position is summed, weighted by the number of visible points).
+                Cluster& cluster(level.clusters.back());
+                const std::size_t child_count(zoom == zoom_maximum ? (tree->point_zooms[children[i].second].second == zoom_maximum ? 1 : 0) : tree->levels[std::size_t(zoom) + 1].clusters[children[i].second].count);
+                const QPointF child_position_px(zoom == zoom_maximum ? points_px[children[i].second] : tree->levels[std::size_t(zoom) + 1].clusters[children[i].second].position_px);
+                cluster.position_px += child_position_px * qreal(child_count);
+                cluster.count += child_count;
+                level.children.push_back(children[i].second);
+                cluster.children_end = level.children.size();
+            }
+
+            // Add the points shown from this zoom, and remove those hidden from it, to the cluster they fall in.
+            const int shift(zoom_maximum - zoom);
+            for(const auto& point_change : point_changes[std::size_t(zoom)])
+            {
+                // Find the cluster from the point's cell at this zoom.
+                const quint64 point_key(point_keys[point_change.first]);
+                const quint64 key(cellKey((point_key & 0xFFFFFFFF) >> shift, (point_key >> 32) >> shift));
+                Cluster& cluster(level.clusters[std::size_t(std::lower_bound(level.keys.begin(), level.keys.end(), key) - level.keys.begin())]);
+
+                // Update the cluster's count and summed position.
+                if(point_change.second)
+                {
+                    cluster.position_px += points_px[point_change.first];
+                    ++cluster.count;
+                }
+                else
+                {
+                    cluster.position_px -= points_px[point_change.first];
+                    --cluster.count;
+                }
+            }
+
+            // Calculate the mean position of each cluster (that has any visible points).
+            for(auto& cluster : level.clusters)
+            {
+                cluster.position_px = cluster.count == 0 ? QPointF(0.0, 0.0) : cluster.position_px / qreal(cluster.count);
+            }
+
+            // The clusters are the children of the zoom below, in the cell they fall in at that zoom.
+            children.clear();
+            for(std::size_t i = 0; i < level.clusters.size(); ++i)
+            {
+                children.emplace_back(parentCellKey(level.keys[i]), i);
+            }
+        }
+
+        // Publish the new clusters.
+        std::atomic_store(&m_cluster_tree, std::shared_ptr<const ClusterTree>(tree));
+
+        // A later change can now build again.
+        m_cluster_tree_building = false;
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    const LayerCluster::Cluster* LayerCluster::findCluster(const ClusterTree& tree, const PointWorldCoord& point_coord, const int& controller_zoom) const
+    {
+        // The nearest cluster found so far, and how far it is outside its symbol.
+        const Cluster* return_cluster(nullptr);
+        qreal return_distance_px(std::numeric_limits<qreal>::max());
+
+        // Search the grid cells whose symbols could be drawn over the point.
+        const QPointF point_px(projection::get().toPointWorldPx(point_coord, controller_zoom).rawPoint());
+        const qreal radius_px(tree.radius_px);
+        const qreal scale(std::ldexp(qreal(1.0), controller_zoom));
+        visitClusters(tree.levels.at(std::size_t(controller_zoom)), QRectF(point_px - QPointF(radius_px, radius_px), QSizeF(radius_px * 2.0, radius_px * 2.0)), radius_px, [&](const Cluster& cluster)
+        {
+            // Are all of its points hidden at this zoom?
+            if(cluster.count == 0)
+            {
+                return;
+            }
+
+            // Measure the distance from the edge of the symbol (single points are drawn as themselves, so use their size).
+            const QPointF difference_px(point_px - cluster.position_px * scale);
+            const qreal distance_px(std::max(std::hypot(difference_px.x(), difference_px.y()) - clusterDiameterPx(cluster.count, tree.radius_px) / 2.0, qreal(0.0)));
+
+            // Is it within the fuzzy factor, and nearer than what we have?
+            if(distance_px <= getFuzzyFactorPx() && distance_px < return_distance_px)
+            {
+                return_cluster = &cluster;
+                return_distance_px = distance_px;
+            }
+        });
+
+        // Return the nearest cluster.
+        return return_cluster;
+    }
+
+    void LayerCluster::collectPoints(std::vector<std::shared_ptr<Geometry>>& return_geometries, const ClusterTree& tree, const Cluster& cluster, const int& controller_zoom) const
+    {
+        // The clusters still to expand, and their zooms.
+        std::vector<std::pair<const Cluster*, int>> clusters(1, std::make_pair(&cluster, controller_zoom));
+        while(clusters.empty() == false)
+        {
+            // Take the next cluster.
+            const std::pair<const Cluster*, int> next(clusters.back());
+            clusters.pop_back();
+
+            // Loop through its children.
+            const ClusterLevel& level(tree.levels[std::size_t(next.second)]);
+            for(std::size_t i = next.first->children_begin; i < next.first->children_end; ++i)
+            {
+                // Are the children points?
+                if(next.second == tree.zoom_maximum)
+                {
+                    // Add the point, if it is visible at the cluster's zoom.
+                    const std::pair<int, int>& point_zooms(tree.point_zooms[level.children[i]]);
+                    if(point_zooms.first <= controller_zoom && controller_zoom <= point_zooms.second)
+                    {
+                        return_geometries.push_back(tree.points[level.children[i]]);
+                    }
+                }
+                else
+                {
+                    // Expand the child cluster.
+                    clusters.emplace_back(&tree.levels[std::size_t(next.second) + 1].clusters[level.children[i]], next.second + 1);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,294 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QFuture>
+#include <QtCore/QMutex>
+#include <QtCore/QPointF>
+#include <QtGui/QBrush>
+#include <QtGui/QPen>
+
+// STL includes.
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "LayerGeometry.h"
+#include "QuadTreeContainer.h"
+
+namespace qmapcontrol
+{
+    //! Layer class
+    /*!
+     * Layer that displays its point geometries as clusters.
+     *
+     * Up to the cluster zoom maximum, the points within each cell of a grid are drawn as a single symbol showing
+     * how many points it represents. The grid cells halve in size with each zoom, so a cluster splits into the
+     * clusters it contains when zooming in. The clusters for every zoom are built on a worker thread whenever the
+     * geometries change, and the previous clusters are drawn until the new ones are ready. Only the points visible at a
+     * zoom (when the clusters were built) are clustered at it.
+     *
+     * Line strings and polygons are drawn as normal, but only points are clustered (and up to the cluster zoom
+     * maximum, only clusters can be clicked).
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT LayerCluster : public LayerGeometry
+    {
+        Q_OBJECT
+    public:
+        //! Layer constructor
+        /*!
+         * This is used to construct a layer.
+         * @param name The name of the layer.
+         * @param zoom_minimum The minimum zoom level to show this geometry at.
+         * @param zoom_maximum The maximum zoom level to show this geometry at.
+         * @param parent QObject parent ownership.
+         */
+        LayerCluster(const std::string& name, const int& zoom_minimum = 0, const int& zoom_maximum = 17, QObject* parent = 0);
+
+        //! Disable copy constructor.
+        ///LayerCluster(const LayerCluster&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///LayerCluster& operator=(const LayerCluster&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        virtual ~LayerCluster();
+
+        /*!
+         * Fetches the size of the grid cells that points are clustered by.
+         * @return the cell size in pixels.
+         */
+        int clusterRadiusPx() const;
+
+        /*!
+         * Sets the size of the grid cells that points are clustered by (this is also the largest cluster symbol).
+         * @param radius_px The cell size in pixels.
+         */
+        void setClusterRadiusPx(const int& radius_px);
+
+        /*!
+         * Fetches the highest zoom that points are clustered at.
+         * @return the highest zoom that points are clustered at.
+         */
+        int clusterZoomMaximum() const;
+
+        /*!
+         * Sets the highest zoom that points are clustered at (above this, every point is drawn).
+         * @param zoom_maximum The highest zoom that points are clustered at.
+         */
+        void setClusterZoomMaximum(const int& zoom_maximum);
+
+        /*!
+         * Fetches the pen used to draw the cluster symbols (and their counts).
+         * @return the pen.
+         */
+        QPen clusterPen() const;
+
+        /*!
+         * Sets the pen used to draw the cluster symbols (and their counts).
+         * @param pen The pen to set.
+         */
+        void setClusterPen(const QPen& pen);
+
+        /*!
+         * Fetches the brush used to fill the cluster symbols.
+         * @return the brush.
+         */
+        QBrush clusterBrush() const;
+
+        /*!
+         * Sets the brush used to fill the cluster symbols.
+         * @param brush The brush to set.
+         */
+        void setClusterBrush(const QBrush& brush);
+
+        /*!
+         * Returns the point Geometry objects in the cluster drawn nearest to a point at the given zoom (within its symbol).
+         * @param point_coord The point to search from in coordinates.
+         * @param controller_zoom The current controller zoom.
+         * @return a list of the geometries in the cluster (empty if there is no cluster at the point, or the zoom is not clustered).
+         */
+        const std::vector<std::shared_ptr<Geometry>> getClusterGeometries(const PointWorldCoord& point_coord, const int& controller_zoom) const;
+
+        /*!
+         * Handles mouse press events (such as left-clicking a cluster on the layer).
+         * @param mouse_event The mouse event.
+         * @param mouse_point_coord The mouse point on the map in coord.
+         * @param controller_zoom The current controller zoom.
+         */
+        bool mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const final;
+
+        /*!
+         * Draws each cluster and geometry to a pixmap using the provided painter.
+         * @param painter The painter that will draw to the pixmap.
+         * @param backbuffer_rect_px Only draw clusters/geometries that are contained in the backbuffer rect (pixels).
+         * @param controller_zoom The current controller zoom.
+         */
+        void draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const final;
+
+    signals:
+        /*!
+         * Signal emitted when a cluster of several points is clicked (a single point emits geometryClicked()).
+         * @param cluster_coord The position the cluster is drawn at in coordinates.
+         * @param geometries The geometries in the cluster.
+         */
+        void clusterClicked(const PointWorldCoord& cluster_coord, const std::vector<std::shared_ptr<Geometry>>& geometries) const;
+
+    private:
+        //! Disable copy constructor.
+        LayerCluster(const LayerCluster&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        LayerCluster& operator=(const LayerCluster&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// The points within a grid cell at a zoom.
+        struct Cluster
+        {
+            /// The mean position of the points visible at the zoom (pixels at zoom 0).
+            QPointF position_px;
+
+            /// The number of points visible at the zoom (zero if they are all hidden at the zoom).
+            std::size_t count;
+
+            /// The range of the cluster's children in its level (clusters at the next zoom, or points at the cluster zoom maximum).
+            std::size_t children_begin;
+            std::size_t children_end;
+        };
+
+        /// The clusters at a zoom, sorted by their grid cell (row, then column).
+        struct ClusterLevel
+        {
+            /// The grid cell key of each cluster.
+            std::vector<quint64> keys;
+
+            /// The clusters.
+            std::vector<Cluster> clusters;
+
+            /// The indices of each cluster's children.
+            std::vector<std::size_t> children;
+        };
+
+        /// The clusters at every zoom, built from a snapshot of the geometries.
+        struct ClusterTree
+        {
+            //! Constructor.
+            ClusterTree() : geometries_index(50, GeometriesIndex::worldBoundary()) { }
+
+            /// The snapshot of the geometries the clusters were built from.
+            std::shared_ptr<const GeometriesSnapshot> snapshot;
+
+            /// The grid cell size the clusters were built with (pixels).
+            int radius_px;
+
+            /// The highest zoom the clusters were built for.
+            int zoom_maximum;
+
+            /// The EPSG of the projection the clusters were built with.
+            int epsg;
+
+            /// The tile size the clusters were built with.
+            int tile_size_px;
+
+            /// The points that are clustered (those visible at one of the zooms at least).
+            std::vector<std::shared_ptr<Geometry>> points;
+
+            /// The first and last zoom each point is visible at.
+            std::vector<std::pair<int, int>> point_zooms;
+
+            /// The other geometries (drawn as normal), in z-index order.
+            std::vector<std::shared_ptr<Geometry>> geometries;
+
+            /// The index of each of the other geometries, by their bounding box.
+            QuadTreeContainer<std::size_t> geometries_index;
+
+            /// The clusters for each zoom (0 to the zoom maximum).
+            std::vector<ClusterLevel> levels;
+        };
+
+        /*!
+         * Fetches the current clusters, and starts to build new clusters if the geometries or settings have changed.
+         * @return the current clusters, or nullptr if there are none yet for the current projection.
+         */
+        std::shared_ptr<const ClusterTree> clusterTree() const;
+
+        /*!
+         * Builds the clusters for every zoom and publishes them (called on a worker thread).
+         * @param snapshot The snapshot of the geometries to cluster.
+         * @param radius_px The grid cell size to cluster by (pixels).
+         * @param zoom_maximum The highest zoom to build the clusters for.
+         * @param epsg The projection to build the clusters with (the drawing thread's, which a renderer may override).
+         */
+        void buildClusterTree(const std::shared_ptr<const GeometriesSnapshot>& snapshot, const int& radius_px, const int& zoom_maximum, const int& epsg) const;
+
+        /*!
+         * Finds the cluster whose symbol is drawn nearest to a point (within the fuzzy factor).
+         * @param tree The clusters.
+         * @param point_coord The point to search from in coordinates.
+         * @param controller_zoom The current controller zoom (no more than the tree's zoom maximum).
+         * @return the cluster, or nullptr if none is near enough.
+         */
+        const Cluster* findCluster(const ClusterTree& tree, const PointWorldCoord& point_coord, const int& controller_zoom) const;
+
+        /*!
+         * Collects the points within a cluster.
+         * @param return_geometries The points are added to this.
+         * @param tree The clusters.
+         * @param cluster The cluster.
+         * @param controller_zoom The zoom the cluster is at.
+         */
+        void collectPoints(std::vector<std::shared_ptr<Geometry>>& return_geometries, const ClusterTree& tree, const Cluster& cluster, const int& controller_zoom) const;
+
+    private:
+        /// The grid cell size that points are clustered by (pixels).
+        std::atomic<int> m_cluster_radius_px;
+
+        /// The highest zoom that points are clustered at.
+        std::atomic<int> m_cluster_zoom_maximum;
+
+        /// The pen used to draw the cluster symbols.
+        QPen m_cluster_pen;
+
+        /// The brush used to fill the cluster symbols.
+        QBrush m_cluster_brush;
+
+        /// Mutex to protect the pen and brush (the clusters may be drawn from several threads).
+        mutable QMutex m_cluster_style_mutex;
+
+        /// The latest published clusters (only accessed via std::atomic_load/std::atomic_store).
+        mutable std::shared_ptr<const ClusterTree> m_cluster_tree;
+
+        /// Whether new clusters are being built.
+        mutable std::atomic<bool> m_cluster_tree_building;
+
+        /// The worker building the new clusters.
+        mutable QFuture<void> m_cluster_tree_future;
+
+        /// Mutex to protect the worker's future.
+        mutable QMutex m_cluster_tree_future_mutex;
+    };
+}
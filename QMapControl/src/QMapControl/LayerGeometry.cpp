@@ -25,39 +25,451 @@
 
 #include "LayerGeometry.h"
 
+// Qt includes.
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QHash>
+#include <QtGui/QFontMetricsF>
+#include <QtGui/QStaticText>
+
 // Local includes.
 #include "GeometryPoint.h"
 #include "GeometryLineString.h"
 #include "GeometryPolygon.h"
 #include "Projection.h"
 
+// STL includes.
 #include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 namespace qmapcontrol
 {
+    namespace
+    {
+        /// The fewest changes to a geometries container that are folded into its spatial index.
+        const size_t geometries_fold_changes_minimum(1024);
+
+        /// The changes to a geometries container are folded into its spatial index once they number more than its size divided by this.
+        const size_t geometries_fold_changes_divisor(16);
+
+        /// Per-thread buffer of geometries (and their distances) to hit-test, which keeps its capacity between clicks.
+        thread_local std::vector<std::pair<qreal, std::shared_ptr<Geometry>>> t_hit_test_geometries;
+
+        /// The geometries container entries to add at a z-index, and the geometry of each entry (so we can store its handle).
+        struct GeometryEntries
+        {
+            /// The geometries container entries.
+            std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>> entries;
+
+            /// The geometry of each entry.
+            std::vector<Geometry*> geometries;
+        };
+
+        /*!
+         * Fetches the bounding box a geometry is indexed by.
+         * Points are indexed by their coordinate (their symbol is allowed for at query time), and line strings and
+         * polygons by their bounding box (which does not depend on the zoom).
+         * @param geometry The geometry (not a geometry widget).
+         * @return the bounding box in coordinates.
+         */
+        RectWorldCoord indexBoundingBox(const Geometry& geometry)
+        {
+            // Is it a GeometryPoint?
+            if(geometry.geometryType() == Geometry::GeometryType::GeometryPoint)
+            {
+                // Index by the coordinate.
+                const PointWorldCoord& point_coord(static_cast<const GeometryPoint&>(geometry).coord());
+                return RectWorldCoord(point_coord, point_coord);
+            }
+
+            // Index by the bounding box.
+            return geometry.boundingBox(0);
+        }
+
+        /*!
+         * Calculates the distance from a point to a line segment.
+         * @param point The point.
+         * @param segment_start The start of the line segment.
+         * @param segment_end The end of the line segment.
+         * @return the distance.
+         */
+        qreal segmentDistance(const QPointF& point, const QPointF& segment_start, const QPointF& segment_end)
+        {
+            // Calculate how far along the segment the nearest point is (clamped to the segment).
+            const QPointF segment(segment_end - segment_start);
+            const qreal length_squared(QPointF::dotProduct(segment, segment));
+            const qreal ratio(length_squared > 0.0 ? std::min(std::max(QPointF::dotProduct(point - segment_start, segment) / length_squared, qreal(0.0)), qreal(1.0)) : qreal(0.0));
+
+            // Return the distance to the nearest point.
+            const QPointF difference(point - (segment_start + segment * ratio));
+            return std::hypot(difference.x(), difference.y());
+        }
+
+        /*!
+         * Calculates the distance from a point to a polyline (or polygon outline).
+         * @param point The point.
+         * @param polyline The polyline's points.
+         * @param closed Whether the last point joins back to the first (a polygon outline).
+         * @return the distance (the maximum qreal if there are no points).
+         */
+        qreal polylineDistance(const QPointF& point, const QPolygonF& polyline, const bool& closed)
+        {
+            // Default to no distance.
+            qreal return_distance(std::numeric_limits<qreal>::max());
+
+            // Do we have a single point?
+            if(polyline.size() == 1)
+            {
+                // Measure to the point.
+                return_distance = segmentDistance(point, polyline.front(), polyline.front());
+            }
+            else
+            {
+                // Measure to each segment.
+                for(int i = 1; i < polyline.size(); ++i)
+                {
+                    return_distance = std::min(return_distance, segmentDistance(point, polyline.at(i - 1), polyline.at(i)));
+                }
+
+                // Measure to the closing segment.
+                if(closed && polyline.size() > 2)
+                {
+                    return_distance = std::min(return_distance, segmentDistance(point, polyline.back(), polyline.front()));
+                }
+            }
+
+            // Return the distance.
+            return return_distance;
+        }
+
+        /*!
+         * Calculates the distance from a point to a geometry.
+         * @param geometry The geometry.
+         * @param point The point (in the space returned by project).
+         * @param controller_zoom The current controller zoom (to measure to a point's symbol), or -1 to measure to a point's coordinate.
+         * @param project Called as 'QPointF project(const PointWorldCoord& point_coord)' to convert coordinates to the space distances are measured in.
+         * @return the distance (zero if the point is inside a polygon).
+         */
+        template <class Project>
+        qreal geometryDistance(const Geometry& geometry, const QPointF& point, const int& controller_zoom, const Project& project)
+        {
+            // Default to no distance.
+            qreal return_distance(std::numeric_limits<qreal>::max());
+
+            // Handle the different geometry types.
+            switch(geometry.geometryType())
+            {
+                // Is it a GeometryPoint.
+                case Geometry::GeometryType::GeometryPoint:
+                {
+                    // Are we measuring to the symbol as drawn?
+                    if(controller_zoom >= 0)
+                    {
+                        // Measure to the symbol's bounding box.
+                        const RectWorldCoord bounding_box_coord(geometry.boundingBox(controller_zoom));
+                        return_distance = QuadTreeContainer<std::shared_ptr<Geometry>>::rectDistance(QRectF(project(bounding_box_coord.topLeftCoord()), project(bounding_box_coord.bottomRightCoord())).normalized(), point);
+                    }
+                    else
+                    {
+                        // Measure to the coordinate.
+                        const QPointF difference(point - project(static_cast<const GeometryPoint&>(geometry).coord()));
+                        return_distance = std::hypot(difference.x(), difference.y());
+                    }
+
+                    // Finished.
+                    break;
+                }
+
+                // Is it a GeometryLineString.
+                case Geometry::GeometryType::GeometryLineString:
+                {
+                    // Measure to the line.
+                    QPolygonF polyline;
+                    for(const auto& point_coord : static_cast<const GeometryLineString&>(geometry).points())
+                    {
+                        polyline.append(project(point_coord));
+                    }
+                    return_distance = polylineDistance(point, polyline, false);
+
+                    // Finished.
+                    break;
+                }
+
+                // Is it a GeometryPolygon.
+                case Geometry::GeometryType::GeometryPolygon:
+                {
+                    // Measure to the outline, unless the point is inside.
+                    QPolygonF polygon;
+                    for(const auto& point_coord : static_cast<const GeometryPolygon&>(geometry).points())
+                    {
+                        polygon.append(project(point_coord));
+                    }
+                    return_distance = polygon.containsPoint(point, Qt::OddEvenFill) ? 0.0 : polylineDistance(point, polygon, true);
+
+                    // Finished.
+                    break;
+                }
+
+                // Is it a GeometryPointWidget.
+                case Geometry::GeometryType::GeometryWidget:
+                {
+                    // Geometry widgets are not spatially indexed.
+
+                    // Finished.
+                    break;
+                }
+            }
+
+            // Return the distance.
+            return return_distance;
+        }
+
+        /*!
+         * Merges a point's symbol size at each zoom into the largest point symbol extents.
+         * @param point_symbol_extent_px The largest point symbol extent at each zoom (pixels).
+         * @param geometry_point The point to merge.
+         */
+        void mergePointSymbolExtents(std::vector<qreal>& point_symbol_extent_px, const GeometryPoint& geometry_point)
+        {
+            // Loop through each zoom.
+            for(size_t zoom = 0; zoom < point_symbol_extent_px.size(); ++zoom)
+            {
+                // The symbol can be aligned/rotated anywhere around the point, so allow for its diagonal.
+                const QSizeF symbol_size_px(geometry_point.symbolSizePx(int(zoom)));
+                point_symbol_extent_px[zoom] = std::max(point_symbol_extent_px[zoom], std::hypot(symbol_size_px.width(), symbol_size_px.height()));
+            }
+        }
+
+        /// The size of the grid cells that labels are checked for overlaps within (pixels).
+        const qreal label_cell_size_px(64.0);
+
+        /// The smallest margin around the backbuffer that labels are placed within, so panning reuses the placement (pixels).
+        const qreal label_area_margin_px(256.0);
+
+        /// The number of areas that labels are kept placed within at each projection and zoom (ie: the widget's backbuffer, and
+        /// any map renderers drawing the same layer).
+        const std::size_t label_placements_maximum(4);
+
+        /*!
+         * Calls a function for each label grid cell that a rect covers.
+         * @param rect_px The rect (world pixels).
+         * @param function Called as 'void function(quint64 cell_key)' for each cell.
+         */
+        template <class Function>
+        void forEachLabelCell(const QRectF& rect_px, Function&& function)
+        {
+            // Calculate the range of cells covered.
+            const qint64 column_begin(qint64(std::floor(rect_px.left() / label_cell_size_px)));
+            const qint64 column_end(qint64(std::floor(rect_px.right() / label_cell_size_px)));
+            const qint64 row_begin(qint64(std::floor(rect_px.top() / label_cell_size_px)));
+            const qint64 row_end(qint64(std::floor(rect_px.bottom() / label_cell_size_px)));
+
+            // Loop through each cell.
+            for(qint64 row = row_begin; row <= row_end; ++row)
+            {
+                for(qint64 column = column_begin; column <= column_end; ++column)
+                {
+                    function((quint64(quint32(row)) << 32) | quint64(quint32(column)));
+                }
+            }
+        }
+
+        /*!
+         * Fetches the glyph run of a label, preparing it if this thread has not already.
+         * A QStaticText caches its layout when it is first drawn, so each render thread keeps its own.
+         * @param text The label text.
+         * @param font The font the label is drawn with.
+         * @param font_key The font's key (QFont::key()).
+         * @return the prepared glyph run.
+         */
+        const QStaticText& labelStaticText(const QString& text, const QFont& font, const QString& font_key)
+        {
+            // The glyph runs prepared by this thread, keyed by font and text.
+            thread_local QHash<QString, QStaticText> t_label_static_texts;
+
+            // Have we already prepared the label?
+            const QString key(font_key + QChar('\n') + text);
+            auto itr_find = t_label_static_texts.find(key);
+            if(itr_find == t_label_static_texts.end())
+            {
+                // Keep the cache bounded (labels are cheap to prepare again).
+                if(t_label_static_texts.size() >= 4096)
+                {
+                    t_label_static_texts.clear();
+                }
+
+                // Lay out the glyphs once.
+                QStaticText static_text(text);
+                static_text.setTextFormat(Qt::PlainText);
+                static_text.setPerformanceHint(QStaticText::AggressiveCaching);
+                static_text.prepare(QTransform(), font);
+                itr_find = t_label_static_texts.insert(key, static_text);
+            }
+
+            // Return the glyph run.
+            return itr_find.value();
+        }
+
+        /*!
+         * Fetches the size of a label, measuring it if this thread has not already.
+         * @param text The label text.
+         * @param font_metrics The metrics of the font the label is drawn with.
+         * @param font_key The font's key (QFont::key()).
+         * @return the size of the label (pixels).
+         */
+        QSizeF labelSize(const QString& text, const QFontMetricsF& font_metrics, const QString& font_key)
+        {
+            // The label sizes measured by this thread, keyed by font and text.
+            thread_local QHash<QString, QSizeF> t_label_sizes;
+
+            // Have we already measured the label?
+            const QString key(font_key + QChar('\n') + text);
+            auto itr_find = t_label_sizes.find(key);
+            if(itr_find == t_label_sizes.end())
+            {
+                // Keep the cache bounded (labels are cheap to measure again).
+                if(t_label_sizes.size() >= 4096)
+                {
+                    t_label_sizes.clear();
+                }
+
+                // Measure the text once.
+                itr_find = t_label_sizes.insert(key, font_metrics.size(Qt::TextSingleLine, text));
+            }
+
+            // Return the size.
+            return itr_find.value();
+        }
+
+        /*!
+         * Draws a batch of fragments from an atlas image (as QPainter::drawPixmapFragments() does for a pixmap).
+         * @param painter The painter to draw with.
+         * @param fragments The fragments to draw (centred on their position, with their scale, rotation and opacity).
+         * @param atlas The atlas image to draw the fragments from.
+         */
+        void drawImageFragments(QPainter& painter, const std::vector<QPainter::PixmapFragment>& fragments, const QImage& atlas)
+        {
+            // Capture the painter's transform and opacity, to restore after each transformed fragment.
+            const QTransform transform(painter.transform());
+            const qreal opacity(painter.opacity());
+
+            // Draw each fragment.
+            for(const auto& fragment : fragments)
+            {
+                // The fragment's rect within the atlas.
+                const QRectF source_rect(fragment.sourceLeft, fragment.sourceTop, fragment.width, fragment.height);
+
+                // Is the fragment drawn as it is (the common case, which needs no painter state change)?
+                if(fragment.scaleX == 1.0 && fragment.scaleY == 1.0 && fragment.rotation == 0.0 && fragment.opacity == 1.0)
+                {
+                    // Draw the fragment centred on its position.
+                    painter.drawImage(QRectF(fragment.x - fragment.width / 2.0, fragment.y - fragment.height / 2.0, fragment.width, fragment.height), atlas, source_rect);
+                }
+                else
+                {
+                    // Draw the fragment centred on its position, with its scale, rotation and opacity.
+                    painter.translate(fragment.x, fragment.y);
+                    painter.rotate(fragment.rotation);
+                    painter.scale(fragment.scaleX, fragment.scaleY);
+                    painter.setOpacity(opacity * fragment.opacity);
+                    painter.drawImage(QRectF(-fragment.width / 2.0, -fragment.height / 2.0, fragment.width, fragment.height), atlas, source_rect);
+                    painter.setTransform(transform);
+                    painter.setOpacity(opacity);
+                }
+            }
+        }
+    }
+
     LayerGeometry::LayerGeometry(const std::string& name, const int& zoom_minimum, const int& zoom_maximum, QObject* parent)
         : Layer(LayerType::LayerGeometry, name, zoom_minimum, zoom_maximum, parent),
-          m_geometries(50, RectWorldCoord(PointWorldCoord(-180.0, 90.0), PointWorldCoord(180.0, -90.0))),
-          mFuzzyFactorPx(5.0)
+          m_geometries(),
+          m_index_strategy(IndexStrategy::QuadTree),
+          m_point_symbol_extent_px(std::max(zoom_maximum, 0) + 1, 0.0),
+          m_geometries_snapshot(std::make_shared<GeometriesSnapshot>(m_geometries, m_point_symbol_extent_px)),
+          m_geometries_snapshot_dirty(false),
+          mFuzzyFactorPx(5.0),
+          m_labels_placed(false),
+          m_label_font(),
+          m_label_pen(Qt::black),
+          m_labels_version(0)
     {
 
     }
 
     const std::vector<std::shared_ptr<Geometry>> LayerGeometry::getGeometries(const RectWorldCoord& range_coord) const
     {
-        // Gain a read lock to protect the geometries container.
-        QReadLocker locker(&m_geometries_mutex);
+        // The geometries container to return.
+        std::vector<std::shared_ptr<Geometry>> return_geometries;
+
+        // Fetch the current snapshot of the geometries (held, so it outlives the loop).
+        const auto snapshot(geometriesSnapshot());
+
+        // Populate the geometries container from the snapshot, one z-index at a time (so they are already in z-index order).
+        for(const auto& geometries : snapshot->geometries)
+        {
+            geometries.second->query(return_geometries, range_coord);
+        }
 
+        // Return the list of geometries.
+        return return_geometries;
+    }
+
+    const std::vector<std::shared_ptr<Geometry>> LayerGeometry::getGeometries(const RectWorldCoord& range_coord, const int& controller_zoom) const
+    {
         // The geometries container to return.
         std::vector<std::shared_ptr<Geometry>> return_geometries;
 
         // Populate the geometries container.
-        m_geometries.query(return_geometries, range_coord);
+        getGeometries(return_geometries, range_coord, controller_zoom);
+
+        // Return the list of geometries.
+        return return_geometries;
+    }
+
+    void LayerGeometry::getGeometries(std::vector<std::shared_ptr<Geometry>>& return_geometries, const RectWorldCoord& range_coord, const int& controller_zoom) const
+    {
+        // Clear the buffer (this keeps its capacity).
+        return_geometries.clear();
+
+        // Populate the buffer (the geometries are visited in z-index order).
+        visitGeometries(range_coord, controller_zoom, [&](const std::shared_ptr<Geometry>& geometry) { return_geometries.push_back(geometry); return true; });
+    }
+
+    const std::vector<std::shared_ptr<Geometry>> LayerGeometry::getGeometriesNearest(const PointWorldCoord& point_coord, const size_t& count, const qreal& distance_maximum_coord) const
+    {
+        // Find the nearest geometries, measured in coordinates.
+        std::vector<std::pair<qreal, std::shared_ptr<Geometry>>> nearest;
+        findGeometriesNearest(nearest, point_coord, -1, count, distance_maximum_coord);
+
+        // The geometries container to return.
+        std::vector<std::shared_ptr<Geometry>> return_geometries;
+        return_geometries.reserve(nearest.size());
+        for(const auto& geometry : nearest)
+        {
+            return_geometries.push_back(geometry.second);
+        }
+
+        // Return the list of geometries.
+        return return_geometries;
+    }
+
+    const std::vector<std::shared_ptr<Geometry>> LayerGeometry::getGeometriesNearestPx(const PointWorldCoord& point_coord, const int& controller_zoom, const size_t& count, const qreal& distance_maximum_px) const
+    {
+        // Find the nearest geometries, measured in pixels at the zoom.
+        std::vector<std::pair<qreal, std::shared_ptr<Geometry>>> nearest;
+        findGeometriesNearest(nearest, point_coord, std::max(controller_zoom, 0), count, distance_maximum_px);
+
+        // The geometries container to return.
+        std::vector<std::shared_ptr<Geometry>> return_geometries;
+        return_geometries.reserve(nearest.size());
+        for(const auto& geometry : nearest)
+        {
+            return_geometries.push_back(geometry.second);
+        }
 
-        // Sort by z-index
-        std::sort(return_geometries.begin(), return_geometries.end(),
-                  [](std::shared_ptr<Geometry> a, std::shared_ptr<Geometry> b) {
-                      return a->zIndex() < b->zIndex();
-                  });
         // Return the list of geometries.
         return return_geometries;
     }
@@ -105,90 +517,158 @@ namespace qmapcontrol
 
     void LayerGeometry::addGeometry(const std::shared_ptr<Geometry>& geometry, const bool& disable_redraw)
     {
-        // Check the geometry is valid.
-        if(geometry != nullptr)
-        {
-            geometry->mLayer = this;
-            // Handle the different geometry types.
-            switch(geometry->geometryType())
-            {
-                // Is it a GeometryPoint.
-                case Geometry::GeometryType::GeometryPoint:
-                {
-                    // Gain a write lock to protect the geometries container.
-                    QWriteLocker locker(&m_geometries_mutex);
+        // Add the geometry as a batch of one.
+        addGeometries(std::vector<std::shared_ptr<Geometry>>(1, geometry), disable_redraw);
+    }
 
-                    // Add the geometry.
-                    m_geometries.insert(std::static_pointer_cast<GeometryPoint>(geometry)->coord(), geometry);
+    void LayerGeometry::addGeometries(const std::vector<std::shared_ptr<Geometry>>& geometries, const bool& disable_redraw)
+    {
+        // The geometries container entries to add for each z-index.
+        std::map<int, GeometryEntries> entries;
 
-                    // Finished.
-                    break;
-                }
+        // The geometry widgets to add.
+        std::vector<std::shared_ptr<GeometryWidget>> geometry_widgets;
 
-                // Is it a GeometryPointWidget.
-                case Geometry::GeometryType::GeometryWidget:
-                {
-                    // Gain a write lock to protect the geometry widget container.
-                    QWriteLocker locker(&m_geometry_widgets_mutex);
+        // The largest symbol drawn at each zoom by the new points (the number of zooms tracked never changes).
+        std::vector<qreal> point_symbol_extent_px(m_point_symbol_extent_px.size(), 0.0);
 
-                    // Add the geometry widget.
-                    m_geometry_widgets.insert(std::static_pointer_cast<GeometryWidget>(geometry));
+        // Prepare each geometry before we take any locks.
+        for(const auto& geometry : geometries)
+        {
+            // Check the geometry is valid.
+            if(geometry != nullptr)
+            {
+                // Set the owning layer (and whether it places the geometry's label).
+                geometry->mLayer = this;
+                geometry->m_layer_places_label = m_labels_placed.load();
+                // Handle the different geometry types.
+                switch(geometry->geometryType())
+                {
+                    // Is it a GeometryPoint.
+                    case Geometry::GeometryType::GeometryPoint:
+                    {
+                        // Add the geometry entry at its z-index.
+                        auto& z_index_entries = entries[geometry->zIndex()];
+                        z_index_entries.entries.emplace_back(indexBoundingBox(*geometry), geometry);
+                        z_index_entries.geometries.push_back(geometry.get());
 
-                    // Finished.
-                    break;
-                }
+                        // Keep track of the largest symbol drawn at each zoom, so queries can include symbols that cross their edge.
+                        mergePointSymbolExtents(point_symbol_extent_px, static_cast<const GeometryPoint&>(*geometry));
 
-                /// @todo move linestring and polygon into different container type.
-                // Is it a GeometryLineString.
-                case Geometry::GeometryType::GeometryLineString:
-                {
-                    // Gain a write lock to protect the geometries container.
-                    QWriteLocker locker(&m_geometries_mutex);
+                        // Finished.
+                        break;
+                    }
 
-                    // Loop through each GeometryLineString point and add it to the container.
-                    for(const auto point : std::static_pointer_cast<GeometryLineString>(geometry)->points())
+                    // Is it a GeometryPointWidget.
+                    case Geometry::GeometryType::GeometryWidget:
                     {
-                        // Add the geometry.
-                        m_geometries.insert(point, geometry);
+                        // Add the geometry widget.
+                        geometry_widgets.push_back(std::static_pointer_cast<GeometryWidget>(geometry));
+
+                        // Finished.
+                        break;
                     }
 
-                    // Finished.
-                    break;
+                    // Is it a GeometryLineString or GeometryPolygon.
+                    case Geometry::GeometryType::GeometryLineString:
+                    case Geometry::GeometryType::GeometryPolygon:
+                    {
+                        // Add the geometry entry once at its z-index, keyed by its bounding box (which does not depend on the zoom).
+                        auto& z_index_entries = entries[geometry->zIndex()];
+                        z_index_entries.entries.emplace_back(indexBoundingBox(*geometry), geometry);
+                        z_index_entries.geometries.push_back(geometry.get());
+
+                        // Finished.
+                        break;
+                    }
                 }
+            }
+        }
 
-                // Is it a GeometryPolygon.
-                case Geometry::GeometryType::GeometryPolygon:
-                {
-                    // Gain a write lock to protect the geometries container.
-                    QWriteLocker locker(&m_geometries_mutex);
+        // Do we have any geometries to add?
+        if(entries.empty() == false)
+        {
+            // Gain a write lock to protect the geometries container.
+            QWriteLocker locker(&m_geometries_mutex);
 
-                    // Loop through each GeometryPolygon point and add it to the container.
-                    for(const auto point : std::static_pointer_cast<GeometryPolygon>(geometry)->points())
-                    {
-                        // Add the geometry.
-                        m_geometries.insert(point, geometry);
-                    }
+            // Loop through each z-index.
+            for(auto& z_index_entries : entries)
+            {
+                // Add the geometries in one pass, and store their handles.
+                GeometriesIndex& geometries(geometriesAt(z_index_entries.first));
+                const auto handles = geometries.insert(z_index_entries.second.entries);
+                for(size_t i = 0; i < handles.size(); ++i)
+                {
+                    z_index_entries.second.geometries[i]->m_layer_handle = handles[i];
+                    z_index_entries.second.geometries[i]->m_layer_z_index = z_index_entries.first;
 
-                    // Finished.
-                    break;
+                    // Resolve the style rules that match the geometry (once, so drawing only checks the zoom).
+                    std::atomic_store(&z_index_entries.second.geometries[i]->m_layer_style_rules, matchStyleRules(*z_index_entries.second.geometries[i]));
                 }
+
+                // Fold the changes into the spatial index, if there are enough.
+                foldGeometries(geometries);
+            }
+
+            // Merge the point symbol extents.
+            for(size_t zoom = 0; zoom < m_point_symbol_extent_px.size(); ++zoom)
+            {
+                m_point_symbol_extent_px[zoom] = std::max(m_point_symbol_extent_px[zoom], point_symbol_extent_px[zoom]);
             }
 
-            geometry->onAddedToLayer(this);
+            // The snapshot needs to be refreshed.
+            m_geometries_snapshot_dirty = true;
+        }
+
+        // Do we have any geometry widgets to add?
+        if(geometry_widgets.empty() == false)
+        {
+            // Gain a write lock to protect the geometry widget container.
+            QWriteLocker locker(&m_geometry_widgets_mutex);
+
+            // Add the geometry widgets.
+            m_geometry_widgets.insert(geometry_widgets.begin(), geometry_widgets.end());
+        }
+
+        // Keep track of whether anything was added.
+        bool geometries_added(false);
 
-            // Should we redraw?
-            if(disable_redraw == false)
+        // Loop through each geometry to finish adding it.
+        for(const auto& geometry : geometries)
+        {
+            // Check the geometry is valid.
+            if(geometry != nullptr)
             {
-                // Emit to redraw layer.
-                emit requestRedraw();
+                geometry->onAddedToLayer(this);
+
+                // Geometries can request a redraw, e.g. when its position has been changed.
+                // Connect the redraw signal to promulgate up only the area it damaged (directly, so the area is
+                // recorded in the order the geometry changes, whichever thread changes it).
+                Geometry* geometry_changed(geometry.get());
+                QObject::connect(geometry_changed, &Geometry::requestRedraw, this, [this, geometry_changed]() { damageGeometry(*geometry_changed, true, true); }, Qt::DirectConnection);
+
+                // Record the area the geometry is drawn over (a single geometry only redraws its area).
+                damageGeometry(*geometry, true, disable_redraw == false && geometries.size() == 1);
+
+                // Something was added.
+                geometries_added = true;
             }
+        }
 
-            // Geometries can request a redraw, e.g. when its position has been changed.
-            // Connect the redraw signal to promulgate up as required.
-            QObject::connect(geometry.get(), &Geometry::requestRedraw, this, &Layer::requestRedraw);
+        // Should we redraw the whole layer?
+        if(geometries_added && disable_redraw == false && geometries.size() > 1)
+        {
+            // Emit to redraw layer.
+            emit requestRedraw();
         }
     }
 
+    QFuture<void> LayerGeometry::addGeometriesConcurrently(const std::vector<std::shared_ptr<Geometry>>& geometries, const bool& disable_redraw)
+    {
+        // Add the geometries on a worker thread (the redraw signal is queued back to the controller).
+        return QtConcurrent::run(this, &LayerGeometry::addGeometries, geometries, disable_redraw);
+    }
+
     void LayerGeometry::removeGeometry(const std::shared_ptr<Geometry>& geometry, const bool& disable_redraw)
     {
         // Check the geometry is valid.
@@ -207,7 +687,13 @@ namespace qmapcontrol
                     QObject::disconnect(geometry.get(), 0, this, 0);
 
                     // Remove the geometry from the list.
-                    m_geometries.erase(std::static_pointer_cast<GeometryPoint>(geometry)->coord(), geometry);
+                    eraseGeometry(geometry, indexBoundingBox(*geometry));
+
+                    // The snapshot needs to be refreshed.
+                    m_geometries_snapshot_dirty = true;
+
+                    // Finished.
+                    break;
                 }
 
                 // Is it a GeometryPointWidget.
@@ -231,9 +717,9 @@ namespace qmapcontrol
                     break;
                 }
 
-                /// @todo move linestring and polygon into different container type.
-                // Is it a GeometryLineString.
+                // Is it a GeometryLineString or GeometryPolygon.
                 case Geometry::GeometryType::GeometryLineString:
+                case Geometry::GeometryType::GeometryPolygon:
                 {
                     // Gain a write lock to protect the geometries container.
                     QWriteLocker locker(&m_geometries_mutex);
@@ -241,46 +727,30 @@ namespace qmapcontrol
                     // Disconnect any signals that were previously connected.
                     QObject::disconnect(geometry.get(), 0, this, 0);
 
-                    // Loop through each GeometryLineString point and remove it to the container.
-                    for(const auto point : std::static_pointer_cast<GeometryLineString>(geometry)->points())
-                    {
-                        // Remove the geometry.
-                        m_geometries.erase(point, geometry);
-                    }
+                    // Remove the geometry from the list.
+                    eraseGeometry(geometry, indexBoundingBox(*geometry));
+
+                    // The snapshot needs to be refreshed.
+                    m_geometries_snapshot_dirty = true;
 
                     // Finished.
                     break;
                 }
-
-                // Is it a GeometryPolygon.
-                case Geometry::GeometryType::GeometryPolygon:
-                {
-                    // Gain a write lock to protect the geometries container.
-                    QWriteLocker locker(&m_geometries_mutex);
-
-                    // Disconnect any signals that were previously connected.
-                    QObject::disconnect(geometry.get(), 0, this, 0);
-
-                    // Loop through each GeometryPolygon point and remove it to the container.
-                    for(const auto point : std::static_pointer_cast<GeometryPolygon>(geometry)->points())
-                    {
-                        // Remove the geometry.
-                        m_geometries.erase(point, geometry);
-                    }
-
-                    // Finished.
-                    break;
-                }
-            }
+            }
 
             geometry->onRemovedFromLayer();
 
-            // Should we redraw?
-            if(disable_redraw == false)
+            // Is the geometry still owned by this layer?
+            if(geometry->mLayer == this)
             {
-                // Emit to redraw layer.
-                emit requestRedraw();
+                // The geometry is no longer on a layer.
+                geometry->mLayer = nullptr;
+                geometry->m_layer_places_label = false;
+                std::atomic_store(&geometry->m_layer_style_rules, std::shared_ptr<const std::vector<StyleRule>>());
             }
+
+            // Redraw the area the geometry was drawn over (if required).
+            damageGeometry(*geometry, false, disable_redraw == false);
         }
     }
 
@@ -293,6 +763,13 @@ namespace qmapcontrol
         // Remove all geometries from the list.
         m_geometries.clear();
         m_geometry_widgets.clear();
+
+        // Reset the point symbol extents.
+        std::fill(m_point_symbol_extent_px.begin(), m_point_symbol_extent_px.end(), 0.0);
+
+        // The snapshot (and any labels placed) need to be refreshed.
+        m_geometries_snapshot_dirty = true;
+        ++m_labels_version;
     }
 
     bool LayerGeometry::mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const
@@ -303,29 +780,35 @@ namespace qmapcontrol
             // Is this a left-click event?
             if(mouse_event->button() == Qt::LeftButton)
             {
-                // Calculate the mouse press world point in pixels.
-                const PointWorldPx mouse_point_px(projection::get().toPointWorldPx(mouse_point_coord, controller_zoom));
-
-                // Calculate a rect around the mouse point with a 'fuzzy-factor' around it in pixels.
-                const RectWorldPx mouse_rect_px(PointWorldPx(mouse_point_px.x() - mFuzzyFactorPx, mouse_point_px.y() - mFuzzyFactorPx), PointWorldPx(mouse_point_px.x() + mFuzzyFactorPx, mouse_point_px.y() + mFuzzyFactorPx));
-
-                // Calculate a rect around the mouse point with a 'fuzzy-factor' around it in coordinates.
-                const RectWorldCoord mouse_rect_coord(projection::get().toPointWorldCoord(mouse_rect_px.topLeftPx(), controller_zoom), projection::get().toPointWorldCoord(mouse_rect_px.bottomRightPx(), controller_zoom));
+                // Fetch the geometries within the 'fuzzy-factor' of the mouse point as drawn (nearest first) into the hit-test buffer.
+                auto& geometries = t_hit_test_geometries;
+                findGeometriesNearest(geometries, mouse_point_coord, controller_zoom, std::numeric_limits<size_t>::max(), mFuzzyFactorPx);
 
-                // Create a QGraphicsRectItem to perform touches check, as required.
-                const GeometryPolygon touches_rect_coord({ mouse_rect_coord.topLeftCoord(), mouse_rect_coord.bottomRightCoord() });
-
-                // Check each geometry to see it is contained in our touch area.
-                for(const auto& geometry : getGeometries(mouse_rect_coord))
+                // Pick the nearest geometry (the top-most if several are equally near, such as overlapping polygons).
+                std::shared_ptr<Geometry> geometry_nearest;
+                for(auto itr_geometry = geometries.begin(); itr_geometry != geometries.end() && itr_geometry->first == geometries.front().first; ++itr_geometry)
                 {
-                    // Does it touch? (Will emit if it does).
-                    if(geometry->touches(&touches_rect_coord, controller_zoom))
+                    // Is this above the top-most so far (strictly, so a geometry at the same z-index does not replace it)?
+                    if(geometry_nearest == nullptr || itr_geometry->second->zIndex() > geometry_nearest->zIndex())
                     {
-                        // Emit that the geometry has been clicked.
-                        emit geometryClicked(geometry.get());
-                        return true;
+                        geometry_nearest = itr_geometry->second;
                     }
                 }
+
+                // Release the geometries (this keeps the buffer's capacity).
+                geometries.clear();
+
+                // Was a geometry clicked?
+                const bool geometry_clicked(geometry_nearest != nullptr);
+                if(geometry_clicked)
+                {
+                    // Emit that the geometry has been clicked (from the geometry and the layer).
+                    emit geometry_nearest->geometryClicked(geometry_nearest.get());
+                    emit geometryClicked(geometry_nearest.get());
+                }
+
+                // Return whether a geometry was clicked.
+                return geometry_clicked;
             }
         }
 
@@ -343,18 +826,203 @@ namespace qmapcontrol
             // Save the current painter's state.
             painter.save();
 
-            // Loop through each geometry and draw it.
-            for(const auto& geometry : getGeometries(backbuffer_rect_coord))
+            // Image markers packed into a shared atlas are collected into a batch and drawn together for each atlas
+            // (the batch is flushed before anything else is drawn, so the z-index order is kept).
+            thread_local std::vector<QPainter::PixmapFragment> t_fragments;
+            std::shared_ptr<const QImage> fragments_atlas;
+            const auto flush_fragments = [&]()
+            {
+                // Do we have any fragments to draw?
+                if(t_fragments.empty() == false)
+                {
+                    // Draw the batch from its atlas.
+                    drawImageFragments(painter, t_fragments, *fragments_atlas);
+                    t_fragments.clear();
+                }
+            };
+
+            // Line strings and polygons are collected into a batch for each style (interned pen and brush), and each batch is
+            // drawn with a single painter state change (the batches reuse their capacity between draws).
+            thread_local std::vector<StyleBatch> t_style_batches;
+            thread_local std::map<std::tuple<const QPen*, const QBrush*, bool>, size_t> t_style_batch_indices;
+            thread_local std::vector<QLineF> t_style_lines_px;
+            const auto flush_style_batches = [&]()
+            {
+                // Draw each batch, in the order its style was first seen.
+                for(size_t i = 0; i < t_style_batch_indices.size(); ++i)
+                {
+                    // Set the pen to use.
+                    StyleBatch& style_batch(t_style_batches[i]);
+                    painter.setPen(*style_batch.pen);
+
+                    // Are the polygons closed?
+                    if(style_batch.closed)
+                    {
+                        // Set the brush to use, and draw each polygon.
+                        painter.setBrush(*style_batch.brush);
+                        for(const auto& polygon_px : style_batch.polygons_px)
+                        {
+                            painter.drawPolygon(polygon_px);
+                        }
+                    }
+                    // Is the pen thin and opaque (so the joins are not noticeable, and no pixel is blended twice)?
+                    else if(style_batch.pen->widthF() <= 1.0 && style_batch.pen->color().alpha() == 255)
+                    {
+                        // Draw every segment of every polyline with one call.
+                        t_style_lines_px.clear();
+                        for(const auto& polyline_px : style_batch.polygons_px)
+                        {
+                            for(int j = 1; j < polyline_px.size(); ++j)
+                            {
+                                t_style_lines_px.emplace_back(polyline_px[j - 1], polyline_px[j]);
+                            }
+                        }
+                        painter.drawLines(t_style_lines_px.data(), int(t_style_lines_px.size()));
+                    }
+                    else
+                    {
+                        // Draw each polyline.
+                        for(const auto& polyline_px : style_batch.polygons_px)
+                        {
+                            painter.drawPolyline(polyline_px);
+                        }
+                    }
+
+                    // Empty the batch (keeping its capacity), and release its style.
+                    style_batch.polygons_px.clear();
+                    style_batch.pen.reset();
+                    style_batch.brush.reset();
+                }
+                t_style_batch_indices.clear();
+            };
+
+            // The geometries that draw themselves (or as fragments of an atlas), drawn after the style batches at each z-index.
+            thread_local std::vector<Geometry*> t_geometries;
+            t_geometries.clear();
+
+            // Fetch the current snapshot of the geometries (this keeps the geometries alive while we draw them).
+            const auto snapshot(geometriesSnapshot());
+            const RectWorldCoord range_expanded_coord(expandByPointSymbols(*snapshot, backbuffer_rect_coord, controller_zoom));
+
+            // Draw each z-index in turn (lowest first), straight from the snapshot.
+            for(const auto& geometries : snapshot->geometries)
             {
-                // Draw the geometry (this will not move widgets).
-                geometry->draw(painter, backbuffer_rect_coord, controller_zoom);
+                // Collect the geometries at this z-index within the range.
+                geometries.second->visit(range_expanded_coord, [&](const std::shared_ptr<Geometry>& geometry)
+                {
+                    // Is the geometry visible?
+                    if(geometry->isVisible(controller_zoom) == false)
+                    {
+                        // Continue collecting.
+                        return true;
+                    }
+
+                    // Can the geometry be drawn in a style batch?
+                    thread_local std::vector<QPolygonF> t_polygons_px;
+                    t_polygons_px.clear();
+                    bool closed(false);
+                    std::shared_ptr<const QPen> pen;
+                    std::shared_ptr<const QBrush> brush;
+                    if(geometry->stylePolygons(t_polygons_px, closed, pen, brush, backbuffer_rect_coord, controller_zoom))
+                    {
+                        // Is there anything to draw?
+                        if(t_polygons_px.empty() == false)
+                        {
+                            // Find the batch for the style (the brush is ignored for polylines).
+                            const auto itr_insert = t_style_batch_indices.emplace(std::make_tuple(pen.get(), closed ? brush.get() : nullptr, closed), t_style_batch_indices.size());
+                            if(itr_insert.second)
+                            {
+                                // Start a new batch (reusing a previous batch's capacity where possible).
+                                if(t_style_batches.size() < t_style_batch_indices.size())
+                                {
+                                    t_style_batches.emplace_back();
+                                }
+                                StyleBatch& style_batch(t_style_batches[itr_insert.first->second]);
+                                style_batch.pen = pen;
+                                style_batch.brush = brush;
+                                style_batch.closed = closed;
+                            }
+
+                            // Add the polygons to the batch.
+                            auto& polygons_px = t_style_batches[itr_insert.first->second].polygons_px;
+                            polygons_px.insert(polygons_px.end(), t_polygons_px.begin(), t_polygons_px.end());
+                        }
+                    }
+                    else
+                    {
+                        // Draw the geometry after the style batches.
+                        t_geometries.push_back(geometry.get());
+                    }
+
+                    // Continue collecting.
+                    return true;
+                });
+
+                // Draw the style batches.
+                flush_style_batches();
+
+                // Draw the other geometries (in the order they were collected).
+                for(const auto& geometry : t_geometries)
+                {
+                    // Can the geometry be drawn as a fragment of an atlas?
+                    QPainter::PixmapFragment fragment;
+                    std::shared_ptr<const QImage> atlas;
+                    if(geometry->atlasFragment(fragment, atlas, backbuffer_rect_coord, controller_zoom))
+                    {
+                        // Is there anything to draw?
+                        if(atlas != nullptr)
+                        {
+                            // Is the fragment from a different atlas to the batch?
+                            if(atlas != fragments_atlas)
+                            {
+                                // Draw the batch, and start a new one for this atlas.
+                                flush_fragments();
+                                fragments_atlas = atlas;
+                            }
+
+                            // Add the fragment to the batch.
+                            t_fragments.push_back(fragment);
+                        }
+                    }
+                    else
+                    {
+                        // Draw the batch first, so it stays below this geometry.
+                        flush_fragments();
+
+                        // Draw the geometry (this will not move widgets).
+                        geometry->draw(painter, backbuffer_rect_coord, controller_zoom);
+                    }
+                }
+                t_geometries.clear();
+
+                // Draw the remaining batch (before the next z-index).
+                flush_fragments();
             }
 
+            // Draw the labels on top of the geometries.
+            drawLabels(painter, backbuffer_rect_px, controller_zoom);
+
             // Restore the painter's state.
             painter.restore();
+
+            // Was a writer holding the geometries when we drew (so the snapshot drawn may miss an area already damaged)?
+            if(m_geometries_snapshot_dirty)
+            {
+                // Emit to redraw the whole layer, so nothing is left stale.
+                emit requestRedraw();
+            }
         }
     }
 
+    qreal LayerGeometry::damagedMarginPx(const int& controller_zoom) const
+    {
+        // Fetch the current snapshot of the geometries.
+        const auto snapshot(geometriesSnapshot());
+
+        // Points are recorded by their coordinate, so allow for the largest point symbol at this zoom (clamped to the zooms we track).
+        return snapshot->point_symbol_extent_px.at(std::min(std::max(controller_zoom, 0), int(snapshot->point_symbol_extent_px.size()) - 1));
+    }
+
     void LayerGeometry::moveGeometryWidgets(const PointPx& offset_px, const int& controller_zoom) const
     {
         // Check the layer is visible.
@@ -368,6 +1036,175 @@ namespace qmapcontrol
             }
         }
     }
+
+    LayerGeometry::IndexStrategy LayerGeometry::indexStrategy() const
+    {
+        // Gain a read lock to protect the index strategy.
+        QReadLocker locker(&m_geometries_mutex);
+
+        // Return the index strategy.
+        return m_index_strategy;
+    }
+
+    void LayerGeometry::setIndexStrategy(const IndexStrategy& strategy)
+    {
+        // Gain a write lock to protect the geometries container.
+        QWriteLocker locker(&m_geometries_mutex);
+
+        // Has the index strategy changed?
+        if(m_index_strategy != strategy)
+        {
+            // Set the index strategy (used for any new z-index).
+            m_index_strategy = strategy;
+
+            // Re-index the geometries at each z-index.
+            std::map<int, std::shared_ptr<GeometriesIndex>> geometries;
+            for(const auto& z_index_geometries : m_geometries)
+            {
+                // Fetch each geometry entry (every entry intersects the world boundary).
+                GeometryEntries z_index_entries;
+                z_index_geometries.second->visit(GeometriesIndex::worldBoundary(), [&](const std::shared_ptr<Geometry>& geometry)
+                {
+                    z_index_entries.entries.emplace_back(indexBoundingBox(*geometry), geometry);
+                    z_index_entries.geometries.push_back(geometry.get());
+                    return true;
+                });
+
+                // Add the geometries to the new index in one pass, and store their new handles.
+                const auto handles = geometries.emplace(z_index_geometries.first, std::make_shared<GeometriesIndex>(strategy)).first->second->insert(z_index_entries.entries);
+                for(size_t i = 0; i < handles.size(); ++i)
+                {
+                    z_index_entries.geometries[i]->m_layer_handle = handles[i];
+                }
+            }
+
+            // Replace the geometries container.
+            m_geometries.swap(geometries);
+
+            // The snapshot needs to be refreshed.
+            m_geometries_snapshot_dirty = true;
+        }
+    }
+
+    bool LayerGeometry::labelsPlaced() const
+    {
+        // Return whether the labels are placed by the layer.
+        return m_labels_placed;
+    }
+
+    void LayerGeometry::setLabelsPlaced(const bool& enabled)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a write lock to protect the geometries container (so geometries being added see the new setting).
+            QWriteLocker locker(&m_geometries_mutex);
+
+            // Set whether the labels are placed by the layer.
+            m_labels_placed = enabled;
+
+            // Tell each geometry whether to draw its own label.
+            for(const auto& z_index_geometries : m_geometries)
+            {
+                z_index_geometries.second->visit(GeometriesIndex::worldBoundary(), [&](const std::shared_ptr<Geometry>& geometry)
+                {
+                    geometry->m_layer_places_label = enabled;
+                    return true;
+                });
+            }
+
+            // Any labels placed need to be refreshed.
+            ++m_labels_version;
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    std::vector<StyleRule> LayerGeometry::styleRules() const
+    {
+        // Gain a read lock to protect the style rules.
+        QReadLocker locker(&m_geometries_mutex);
+
+        // Return the style rules.
+        return m_style_rules;
+    }
+
+    void LayerGeometry::setStyleRules(const std::vector<StyleRule>& style_rules)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a write lock to protect the geometries container (so geometries being added see the new rules).
+            QWriteLocker locker(&m_geometries_mutex);
+
+            // Set the style rules, and forget the previous matches.
+            m_style_rules = style_rules;
+            m_style_rule_matches.clear();
+
+            // Resolve the style rules that match each geometry.
+            for(const auto& z_index_geometries : m_geometries)
+            {
+                z_index_geometries.second->visit(GeometriesIndex::worldBoundary(), [&](const std::shared_ptr<Geometry>& geometry)
+                {
+                    std::atomic_store(&geometry->m_layer_style_rules, matchStyleRules(*geometry));
+                    return true;
+                });
+            }
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    QFont LayerGeometry::labelFont() const
+    {
+        // Gain a lock to protect the label style.
+        QMutexLocker locker(&m_labels_mutex);
+
+        // Return the label font.
+        return m_label_font;
+    }
+
+    void LayerGeometry::setLabelFont(const QFont& font)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the label style.
+            QMutexLocker locker(&m_labels_mutex);
+
+            // Set the label font (the labels need to be placed again, as their sizes change).
+            m_label_font = font;
+            ++m_labels_version;
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    QPen LayerGeometry::labelPen() const
+    {
+        // Gain a lock to protect the label style.
+        QMutexLocker locker(&m_labels_mutex);
+
+        // Return the label pen.
+        return m_label_pen;
+    }
+
+    void LayerGeometry::setLabelPen(const QPen& pen)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the label style.
+            QMutexLocker locker(&m_labels_mutex);
+
+            // Set the label pen.
+            m_label_pen = pen;
+            ++m_labels_version;
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
     qreal LayerGeometry::getFuzzyFactorPx() const
     {
         return mFuzzyFactorPx;
@@ -378,5 +1215,966 @@ namespace qmapcontrol
         mFuzzyFactorPx = value;
     }
 
+    std::shared_ptr<const LayerGeometry::GeometriesSnapshot> LayerGeometry::geometriesSnapshot() const
+    {
+        // Fetch the published snapshot.
+        auto snapshot = std::atomic_load(&m_geometries_snapshot);
+
+        // Have the geometries changed, and can we read them without waiting for a writer?
+        if(m_geometries_snapshot_dirty && m_geometries_mutex.tryLockForRead())
+        {
+            // Are we the first reader to refresh the snapshot?
+            if(m_geometries_snapshot_dirty.exchange(false))
+            {
+                // Share each z-index's geometries container and publish the new snapshot (writers copy a container before
+                // they next change it, so this does not copy any geometries).
+                snapshot = std::make_shared<GeometriesSnapshot>(m_geometries, m_point_symbol_extent_px);
+                std::atomic_store(&m_geometries_snapshot, snapshot);
+            }
+            else
+            {
+                // Another reader has refreshed the snapshot.
+                snapshot = std::atomic_load(&m_geometries_snapshot);
+            }
+
+            // Release the read lock.
+            m_geometries_mutex.unlock();
+        }
+
+        // Return the snapshot.
+        return snapshot;
+    }
+
+    void LayerGeometry::findGeometriesNearest(std::vector<std::pair<qreal, std::shared_ptr<Geometry>>>& return_nearest, const PointWorldCoord& point_coord, const int& controller_zoom, const size_t& count, const qreal& distance_maximum) const
+    {
+        // Check we have something to find.
+        if(count > 0)
+        {
+            // Fetch the current snapshot of the geometries.
+            const auto snapshot(geometriesSnapshot());
+
+            // Are we measuring in pixels?
+            const bool use_pixels(controller_zoom >= 0);
+
+            // Converts a coordinate to the space we are measuring in.
+            const auto project = [&](const PointWorldCoord& project_coord) { return use_pixels ? projection::get().toPointWorldPx(project_coord, controller_zoom).rawPoint() : project_coord.rawPoint(); };
+            const QPointF point(project(point_coord));
+
+            // Point symbols can be drawn up to this far from their coordinate, so bounding boxes can be this much nearer.
+            const qreal extent_px(use_pixels ? snapshot->point_symbol_extent_px.at(std::min(controller_zoom, int(snapshot->point_symbol_extent_px.size()) - 1)) : 0.0);
+
+            // The nearest geometries found so far (a max-heap on distance, so the furthest is at the front).
+            const auto compare_nearer = [](const std::pair<qreal, std::shared_ptr<Geometry>>& a, const std::pair<qreal, std::shared_ptr<Geometry>>& b) { return a.first < b.first; };
+            std::vector<std::pair<qreal, std::shared_ptr<Geometry>>> nearest;
+
+            // Calculates the lower bound of the distance to anything within a bounding box.
+            const auto metric = [&](const QRectF& bounding_box)
+            {
+                // Calculate the lower bound of the distance to anything within the bounding box.
+                return std::max(QuadTreeContainer<std::shared_ptr<Geometry>>::rectDistance(QRectF(project(PointWorldCoord(bounding_box.left(), bounding_box.top())), project(PointWorldCoord(bounding_box.right(), bounding_box.bottom()))).normalized(), point) - extent_px, qreal(0.0));
+            };
+
+            // Measures each geometry, in order of the distance to its bounding box (a lower bound of its actual distance).
+            const auto visitor = [&](const std::shared_ptr<Geometry>& geometry, const qreal& distance_lower_bound)
+            {
+                // Can this (or any later) geometry be within the maximum distance, and nearer than the furthest we have?
+                const bool continue_query(distance_lower_bound <= distance_maximum && (nearest.size() < count || distance_lower_bound < nearest.front().first));
+
+                // Should we measure the geometry (only visible geometries when measuring as drawn)?
+                if(continue_query && (use_pixels == false || geometry->isVisible(controller_zoom)))
+                {
+                    // Calculate the actual distance.
+                    const qreal distance(geometryDistance(*geometry, point, controller_zoom, project));
+
+                    // Is it within the maximum distance, and nearer than the furthest we have?
+                    if(distance <= distance_maximum && (nearest.size() < count || distance < nearest.front().first))
+                    {
+                        // Add the geometry.
+                        nearest.emplace_back(distance, geometry);
+                        std::push_heap(nearest.begin(), nearest.end(), compare_nearer);
+
+                        // Have we exceeded the count?
+                        if(nearest.size() > count)
+                        {
+                            // Remove the furthest geometry.
+                            std::pop_heap(nearest.begin(), nearest.end(), compare_nearer);
+                            nearest.pop_back();
+                        }
+                    }
+                }
+
+                // Return whether we should continue.
+                return continue_query;
+            };
+
+            // Search each z-index (the nearest found so far are shared, so later searches stop as soon as they cannot improve on them).
+            for(const auto& geometries : snapshot->geometries)
+            {
+                geometries.second->visitNearest(metric, visitor);
+            }
+
+            // Add the geometries, nearest first.
+            std::sort_heap(nearest.begin(), nearest.end(), compare_nearer);
+            return_nearest.insert(return_nearest.end(), std::make_move_iterator(nearest.begin()), std::make_move_iterator(nearest.end()));
+        }
+    }
+
+    RectWorldCoord LayerGeometry::expandByPointSymbols(const GeometriesSnapshot& snapshot, const RectWorldCoord& range_coord, const int& controller_zoom) const
+    {
+        // Fetch the point symbol extent for this zoom (clamped to the zooms we track).
+        const qreal extent_px(snapshot.point_symbol_extent_px.at(std::min(std::max(controller_zoom, 0), int(snapshot.point_symbol_extent_px.size()) - 1)));
+
+        // Default to the original range.
+        RectWorldCoord return_range_coord(range_coord);
+
+        // Do we need to expand the range?
+        if(extent_px > 0.0)
+        {
+            // Calculate the range in pixels.
+            const QRectF range_px(QRectF(projection::get().toPointWorldPx(range_coord.topLeftCoord(), controller_zoom).rawPoint(), projection::get().toPointWorldPx(range_coord.bottomRightCoord(), controller_zoom).rawPoint()).normalized().adjusted(-extent_px, -extent_px, extent_px, extent_px));
+
+            // Convert the expanded range back to coordinates.
+            return_range_coord = RectWorldCoord(projection::get().toPointWorldCoord(PointWorldPx(range_px.left(), range_px.top()), controller_zoom), projection::get().toPointWorldCoord(PointWorldPx(range_px.right(), range_px.bottom()), controller_zoom));
+        }
+
+        // Return the expanded range.
+        return return_range_coord;
+    }
+
+    void LayerGeometry::relocateGeometry(Geometry* geometry)
+    {
+        // Geometry widgets are not spatially indexed, so there is nothing to do.
+        if(geometry->geometryType() != Geometry::GeometryType::GeometryWidget)
+        {
+            // Calculate the new bounding box before we lock.
+            const RectWorldCoord bounding_box_coord(indexBoundingBox(*geometry));
+
+            // Calculate the new symbol extents before we lock.
+            std::vector<qreal> point_symbol_extent_px(m_point_symbol_extent_px.size(), 0.0);
+            if(geometry->geometryType() == Geometry::GeometryType::GeometryPoint)
+            {
+                mergePointSymbolExtents(point_symbol_extent_px, static_cast<const GeometryPoint&>(*geometry));
+            }
+
+            // Gain a write lock to protect the geometries container.
+            QWriteLocker locker(&m_geometries_mutex);
+
+            // Has the z-index changed?
+            if(geometry->m_layer_z_index != geometry->zIndex())
+            {
+                // Fetch the geometry entry's object from its current z-index.
+                auto itr_geometries = m_geometries.find(geometry->m_layer_z_index);
+                const auto object = itr_geometries == m_geometries.end() ? nullptr : itr_geometries->second->find(geometry, geometry->m_layer_handle);
+                if(object != nullptr)
+                {
+                    // Take a copy of the object, as erasing the entry destroys it.
+                    const std::shared_ptr<Geometry> geometry_shared(*object);
+
+                    // Move the geometry entry to its new z-index.
+                    eraseGeometry(geometry_shared, bounding_box_coord);
+                    GeometriesIndex& geometries(geometriesAt(geometry->zIndex()));
+                    geometry->m_layer_handle = geometries.insert(bounding_box_coord, geometry_shared);
+                    geometry->m_layer_z_index = geometry->zIndex();
+                    foldGeometries(geometries);
+                }
+            }
+            else
+            {
+                // Move the geometry entry within its z-index.
+                const auto itr_find = m_geometries.find(geometry->m_layer_z_index);
+                if(itr_find != m_geometries.end())
+                {
+                    GeometriesIndex& geometries(detachGeometries(itr_find->second));
+                    geometries.relocate(geometry, geometry->m_layer_handle, bounding_box_coord);
+                    foldGeometries(geometries);
+                }
+            }
+
+            // Merge the point symbol extents (these only ever grow until the layer is cleared).
+            for(size_t zoom = 0; zoom < m_point_symbol_extent_px.size(); ++zoom)
+            {
+                m_point_symbol_extent_px[zoom] = std::max(m_point_symbol_extent_px[zoom], point_symbol_extent_px[zoom]);
+            }
+
+            // The snapshot needs to be refreshed.
+            m_geometries_snapshot_dirty = true;
+        }
+    }
+
+    LayerGeometry::GeometriesIndex& LayerGeometry::geometriesAt(const int& z_index)
+    {
+        // Find the geometries container for the z-index.
+        auto itr_find = m_geometries.find(z_index);
+        if(itr_find == m_geometries.end())
+        {
+            // Create the geometries container (covering the whole world, with the current index strategy).
+            itr_find = m_geometries.emplace(z_index, std::make_shared<GeometriesIndex>(m_index_strategy)).first;
+        }
+
+        // Return the geometries container (detached from any snapshot).
+        return detachGeometries(itr_find->second);
+    }
+
+    LayerGeometry::GeometriesIndex& LayerGeometry::detachGeometries(std::shared_ptr<GeometriesIndex>& geometries)
+    {
+        // Is the geometries container still shared with a snapshot (a snapshot can only gain a reference while we hold
+        // the write lock, so a count of one means we are the only owner, although readers may release theirs at any time)?
+        if(geometries.use_count() > 1)
+        {
+            // Copy it, so the snapshot keeps the unchanged version (this only copies the pointers to its spatial index and
+            // change buckets, which are shared until they are changed).
+            geometries = std::make_shared<GeometriesIndex>(*geometries);
+        }
+        else
+        {
+            // Ensure the released snapshots' reads happen before our writes.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        // Return the geometries container.
+        return *geometries;
+    }
+
+    void LayerGeometry::foldGeometries(GeometriesIndex& geometries)
+    {
+        // Are there enough changes to be worth folding (queries visit every change, whereas folding may copy the index)?
+        if(geometries.changes_count > std::max(geometries_fold_changes_minimum, geometries.size() / geometries_fold_changes_divisor))
+        {
+            // Fold the changes, and store the handles of the geometries added.
+            std::vector<std::pair<Geometry*, size_t>> handles;
+            geometries.fold(handles);
+            for(const auto& handle : handles)
+            {
+                handle.first->m_layer_handle = handle.second;
+            }
+        }
+    }
+
+    size_t LayerGeometry::GeometriesIndex::insert(const RectWorldCoord& bounding_box_coord, const std::shared_ptr<Geometry>& object)
+    {
+        // Is the object outside of the index (the containers would not insert it)?
+        if(rectIntersects(worldBoundary().rawRect().normalized(), bounding_box_coord.rawRect().normalized()) == false)
+        {
+            return QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle();
+        }
+
+        // Record the object as added (if it was removed since the containers were folded, it keeps its handle).
+        GeometriesChangeBucket& bucket(detachChangeBucket(object.get()));
+        const auto itr_emplace = bucket.emplace(object.get(), GeometriesChange{ object, bounding_box_coord, QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle(), false });
+        if(itr_emplace.second)
+        {
+            ++changes_count;
+            ++count;
+        }
+        else
+        {
+            // Was it removed (otherwise it is only moved)?
+            if(itr_emplace.first->second.erased)
+            {
+                ++count;
+            }
+            itr_emplace.first->second.object = object;
+            itr_emplace.first->second.bounding_box_coord = bounding_box_coord;
+            itr_emplace.first->second.erased = false;
+        }
+
+        // Return the object's handle.
+        return itr_emplace.first->second.handle;
+    }
 
+    std::vector<size_t> LayerGeometry::GeometriesIndex::insert(const std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>>& entries)
+    {
+        // Can the objects be added to the containers directly (they are not shared, or copying them costs no more than
+        // adding the objects)?
+        std::vector<size_t> return_handles(entries.size(), QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle());
+        if(containers.use_count() == 1 || entries.size() >= containers->size())
+        {
+            // Fetch the containers to change, copying them first if a snapshot still shares them.
+            if(containers.use_count() > 1)
+            {
+                containers = std::make_shared<GeometriesContainers>(*containers);
+            }
+            else
+            {
+                // Ensure the other owners' reads happen before our writes (they may have released it without a lock).
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+
+            // Gather the objects that have not changed since the containers were folded (any that have are recorded as
+            // added instead, so they keep their handles).
+            std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>> entries_direct;
+            std::vector<size_t> entries_direct_index;
+            for(size_t i = 0; i < entries.size(); ++i)
+            {
+                if(changes_count == 0 || findChange(entries[i].second.get()) == nullptr)
+                {
+                    entries_direct.push_back(entries[i]);
+                    entries_direct_index.push_back(i);
+                }
+                else
+                {
+                    return_handles[i] = insert(entries[i].first, entries[i].second);
+                }
+            }
+
+            // Add the objects to the containers in one pass.
+            const auto handles = containers->insert(entries_direct);
+            for(size_t i = 0; i < handles.size(); ++i)
+            {
+                return_handles[entries_direct_index[i]] = handles[i];
+                count += handles[i] != QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle() ? 1 : 0;
+            }
+        }
+        else
+        {
+            // Record each object as added.
+            for(size_t i = 0; i < entries.size(); ++i)
+            {
+                return_handles[i] = insert(entries[i].first, entries[i].second);
+            }
+        }
+
+        // Return the handles.
+        return return_handles;
+    }
+
+    bool LayerGeometry::GeometriesIndex::relocate(const Geometry* geometry, const size_t& handle, const RectWorldCoord& bounding_box_coord)
+    {
+        // Has the object changed since the containers were folded?
+        GeometriesChangeBucket& bucket(detachChangeBucket(geometry));
+        auto itr_find = bucket.find(geometry);
+        if(itr_find == bucket.end())
+        {
+            // Is the object in the containers?
+            const auto object = containers->find(handle);
+            if(object == nullptr)
+            {
+                return false;
+            }
+
+            // Record the object as changed.
+            itr_find = bucket.emplace(geometry, GeometriesChange{ *object, bounding_box_coord, handle, false }).first;
+            ++changes_count;
+        }
+        else if(itr_find->second.erased)
+        {
+            // The object has been removed.
+            return false;
+        }
+
+        // Move the object.
+        itr_find->second.bounding_box_coord = bounding_box_coord;
+        return true;
+    }
+
+    const std::shared_ptr<Geometry>* LayerGeometry::GeometriesIndex::find(const Geometry* geometry, const size_t& handle) const
+    {
+        // Has the object changed since the containers were folded?
+        const GeometriesChange* change(findChange(geometry));
+        if(change != nullptr)
+        {
+            // Return the changed object, unless it has been removed.
+            return change->erased ? nullptr : &change->object;
+        }
+
+        // Return the object in the containers.
+        return containers->find(handle);
+    }
+
+    bool LayerGeometry::GeometriesIndex::erase(const Geometry* geometry, const size_t& handle)
+    {
+        // Has the object changed since the containers were folded?
+        GeometriesChangeBucket& bucket(detachChangeBucket(geometry));
+        auto itr_find = bucket.find(geometry);
+        if(itr_find == bucket.end())
+        {
+            // Is the object in the containers?
+            const auto object = containers->find(handle);
+            if(object == nullptr)
+            {
+                return false;
+            }
+
+            // Record the object as changed.
+            itr_find = bucket.emplace(geometry, GeometriesChange{ *object, RectWorldCoord(), handle, false }).first;
+            ++changes_count;
+        }
+        else if(itr_find->second.erased)
+        {
+            // The object has already been removed.
+            return false;
+        }
+
+        // Remove the object.
+        itr_find->second.erased = true;
+        --count;
+        return true;
+    }
+
+    bool LayerGeometry::GeometriesIndex::erase(const RectWorldCoord& bounding_box_coord, const std::shared_ptr<Geometry>& object)
+    {
+        // Has the object changed since the containers were folded?
+        const GeometriesChange* change(findChange(object.get()));
+        if(change != nullptr)
+        {
+            // Remove it by its handle (which erase ignores).
+            return erase(object.get(), change->handle);
+        }
+
+        // Fetch the containers to change, copying them first if a snapshot still shares them.
+        if(containers.use_count() > 1)
+        {
+            containers = std::make_shared<GeometriesContainers>(*containers);
+        }
+        else
+        {
+            // Ensure the other owners' reads happen before our writes (they may have released it without a lock).
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        // Remove the object from the containers (the handles of the other objects remain valid).
+        const bool success(containers->erase(bounding_box_coord, object));
+        if(success)
+        {
+            --count;
+        }
+
+        // Return our success.
+        return success;
+    }
+
+    void LayerGeometry::GeometriesIndex::fold(std::vector<std::pair<Geometry*, size_t>>& return_handles)
+    {
+        // Fetch the containers to change, copying them first if a snapshot still shares them.
+        if(containers.use_count() > 1)
+        {
+            containers = std::make_shared<GeometriesContainers>(*containers);
+        }
+        else
+        {
+            // Ensure the other owners' reads happen before our writes (they may have released it without a lock).
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        // Apply each change to the objects in the containers, and gather the objects that were added.
+        std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>> entries;
+        std::vector<Geometry*> geometries;
+        for(const auto& bucket : changes)
+        {
+            if(bucket != nullptr)
+            {
+                for(const auto& change : *bucket)
+                {
+                    // Is the object in the containers?
+                    if(change.second.handle != QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle())
+                    {
+                        // Remove or move the object.
+                        if(change.second.erased)
+                        {
+                            containers->erase(change.second.handle);
+                        }
+                        else if(containers->relocate(change.second.handle, change.second.bounding_box_coord) == false)
+                        {
+                            // The object was moved outside of the containers' boundary and removed (as it would not
+                            // have been added there either), so it no longer has a handle.
+                            return_handles.emplace_back(change.second.object.get(), QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle());
+                        }
+                    }
+                    else if(change.second.erased == false)
+                    {
+                        // Add the object (once the removed objects have released their handles).
+                        entries.emplace_back(change.second.bounding_box_coord, change.second.object);
+                        geometries.push_back(change.second.object.get());
+                    }
+                }
+            }
+        }
+
+        // Add the objects in one pass, and return their handles.
+        const auto handles = containers->insert(entries);
+        for(size_t i = 0; i < handles.size(); ++i)
+        {
+            return_handles.emplace_back(geometries[i], handles[i]);
+        }
+
+        // Forget the changes (the containers now hold every object, less any outside of their boundary).
+        changes.assign(changeBucketCount(), nullptr);
+        changes_count = 0;
+        count = containers->size();
+    }
+
+    const LayerGeometry::GeometriesChange* LayerGeometry::GeometriesIndex::findChange(const Geometry* geometry) const
+    {
+        // Find the geometry in its bucket.
+        const auto& bucket(changes[changeBucketIndex(geometry)]);
+        if(bucket != nullptr)
+        {
+            const auto itr_find = bucket->find(geometry);
+            if(itr_find != bucket->end())
+            {
+                return &itr_find->second;
+            }
+        }
+
+        // The geometry has not changed.
+        return nullptr;
+    }
+
+    LayerGeometry::GeometriesChangeBucket& LayerGeometry::GeometriesIndex::detachChangeBucket(const Geometry* geometry)
+    {
+        // Is the bucket still shared with a snapshot (or not yet created)?
+        std::shared_ptr<GeometriesChangeBucket>& bucket(changes[changeBucketIndex(geometry)]);
+        if(bucket == nullptr)
+        {
+            bucket = std::make_shared<GeometriesChangeBucket>();
+        }
+        else if(bucket.use_count() > 1)
+        {
+            // Copy it, so the snapshot keeps the unchanged version.
+            bucket = std::make_shared<GeometriesChangeBucket>(*bucket);
+        }
+        else
+        {
+            // Ensure the other owners' reads happen before our writes (they may have released it without a lock).
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+
+        // Return the bucket.
+        return *bucket;
+    }
+
+    void LayerGeometry::damageGeometry(Geometry& geometry, const bool& drawn, const bool& emit_damaged)
+    {
+        // Is it a GeometryWidget?
+        if(geometry.geometryType() == Geometry::GeometryType::GeometryWidget)
+        {
+            // Geometry widgets are not drawn by the layer (nor indexed), so redraw the whole layer as required.
+            if(emit_damaged)
+            {
+                emit requestRedraw();
+            }
+        }
+        else
+        {
+            // Calculate the area the geometry is drawn over before we lock.
+            const RectWorldCoord damaged_rect_coord(indexBoundingBox(geometry));
+
+            // The pen (and anti-aliasing) can draw outside the bounding box.
+            qreal damaged_margin_px(geometry.pen().widthF() / 2.0 + 2.0);
+
+            // So can the meta-data value displayed beside the geometry.
+            if(geometry.m_metadata_displayed_key.empty() == false)
+            {
+                const QVariant metadata_value(geometry.metadata(geometry.m_metadata_displayed_key));
+                if(metadata_value.isNull() == false)
+                {
+                    const QSizeF text_size_px(QFontMetricsF(QFont()).size(0, metadata_value.toString()));
+                    damaged_margin_px += geometry.m_metadata_displayed_alignment_offset_px + std::max(text_size_px.width(), text_size_px.height());
+                }
+            }
+
+            // Does the layer place the geometry's label (a label can move, hide or reveal other labels anywhere on the layer)?
+            const bool label_placed(m_labels_placed && geometry.m_metadata_displayed_key.empty() == false);
+            if(label_placed)
+            {
+                // The labels need to be placed again.
+                ++m_labels_version;
+            }
+
+            // The area previously recorded.
+            RectWorldCoord previous_rect_coord;
+            qreal previous_margin_px(-1.0);
+
+            // Scope the locker to ensure the mutex is release as soon as possible.
+            {
+                // Gain a lock to protect the recorded areas.
+                QMutexLocker locker(&m_geometries_damaged_mutex);
+
+                // Swap in the new area (or none if the geometry is no longer drawn).
+                previous_rect_coord = geometry.m_layer_damaged_rect_coord;
+                previous_margin_px = geometry.m_layer_damaged_margin_px;
+                geometry.m_layer_damaged_rect_coord = damaged_rect_coord;
+                geometry.m_layer_damaged_margin_px = drawn ? damaged_margin_px : -1.0;
+            }
+
+            // Should we emit the damaged areas?
+            if(emit_damaged && label_placed)
+            {
+                // Emit to redraw the whole layer, as the placement of any label may have changed.
+                emit requestRedraw();
+            }
+            else if(emit_damaged)
+            {
+                // Was the geometry drawn over a different area (or with a larger margin)?
+                if(previous_margin_px >= 0.0 && (drawn == false || previous_rect_coord.rawRect() != damaged_rect_coord.rawRect() || previous_margin_px > damaged_margin_px))
+                {
+                    // Emit to redraw the previous area.
+                    emit requestRedrawDamaged(previous_rect_coord, previous_margin_px);
+                }
+
+                // Is the geometry still drawn?
+                if(drawn)
+                {
+                    // Emit to redraw the new area.
+                    emit requestRedrawDamaged(damaged_rect_coord, damaged_margin_px);
+                }
+            }
+        }
+    }
+
+    void LayerGeometry::eraseGeometry(const std::shared_ptr<Geometry>& geometry, const RectWorldCoord& bounding_box_coord)
+    {
+        // Is the geometry indexed on this layer?
+        if(geometry->mLayer == this)
+        {
+            // Find the geometries container for its z-index.
+            const auto itr_find = m_geometries.find(geometry->m_layer_z_index);
+            if(itr_find != m_geometries.end())
+            {
+                // Remove the geometry entry directly by its handle.
+                GeometriesIndex& geometries(detachGeometries(itr_find->second));
+                geometries.erase(geometry.get(), geometry->m_layer_handle);
+
+                // Remove the geometries container if it is now empty (so queries do not visit it).
+                if(geometries.size() == 0)
+                {
+                    m_geometries.erase(itr_find);
+                }
+                else
+                {
+                    // Fold the changes into the spatial index, if there are enough.
+                    foldGeometries(geometries);
+                }
+            }
+
+            // The geometry entry's handle is no longer valid.
+            geometry->m_layer_handle = QuadTreeContainer<std::shared_ptr<Geometry>>::invalidHandle();
+        }
+        else
+        {
+            // Search each geometries container for the geometry entry (by its bounding box).
+            for(auto itr_geometries = m_geometries.begin(); itr_geometries != m_geometries.end(); ++itr_geometries)
+            {
+                // Is the geometry entry in this container (checked first, so containers without it are not detached)?
+                bool found(false);
+                itr_geometries->second->visit(bounding_box_coord, [&](const std::shared_ptr<Geometry>& object)
+                {
+                    found = object == geometry;
+                    return found == false;
+                });
+                if(found && detachGeometries(itr_geometries->second).erase(bounding_box_coord, geometry))
+                {
+                    // Remove the geometries container if it is now empty (so queries do not visit it).
+                    if(itr_geometries->second->size() == 0)
+                    {
+                        m_geometries.erase(itr_geometries);
+                    }
+
+                    // Finished.
+                    break;
+                }
+            }
+        }
+    }
+
+    std::shared_ptr<const std::vector<StyleRule>> LayerGeometry::matchStyleRules(const Geometry& geometry)
+    {
+        // Are there any style rules?
+        if(m_style_rules.empty())
+        {
+            return nullptr;
+        }
+
+        // Find which style rules match the geometry.
+        std::vector<bool> matches(m_style_rules.size(), false);
+        bool any_match(false);
+        for(size_t i = 0; i < m_style_rules.size(); ++i)
+        {
+            matches[i] = m_style_rules[i].matches(geometry);
+            any_match = any_match || matches[i];
+        }
+
+        // Does no style rule match?
+        if(any_match == false)
+        {
+            return nullptr;
+        }
+
+        // Have other geometries matched the same style rules?
+        auto& return_style_rules = m_style_rule_matches[matches];
+        if(return_style_rules == nullptr)
+        {
+            // Collect the matching style rules (in priority order).
+            auto style_rules = std::make_shared<std::vector<StyleRule>>();
+            for(size_t i = 0; i < m_style_rules.size(); ++i)
+            {
+                if(matches[i])
+                {
+                    style_rules->push_back(m_style_rules[i]);
+                }
+            }
+
+            // Share them with any other geometry that matches the same style rules.
+            return_style_rules = style_rules;
+        }
+
+        // Return the matching style rules.
+        return return_style_rules;
+    }
+
+    std::shared_ptr<const LayerGeometry::LabelPlacement> LayerGeometry::labelPlacement(bool& return_placed, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const
+    {
+        // Default to reusing a placement.
+        return_placed = false;
+
+        // Fetch the current snapshot of the geometries, and the labels version it is placed for.
+        const quint64 version(m_labels_version);
+        const auto snapshot(geometriesSnapshot());
+
+        // The placements are kept for the projection (which a renderer may override) and zoom.
+        const std::pair<int, int> placement_key(projection::get().epsg(), controller_zoom);
+
+        // The label style to place the labels with.
+        QFont font;
+        QPen pen;
+
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the placements.
+            QMutexLocker locker(&m_labels_mutex);
+
+            // Drop the placements made before the last change.
+            for(auto itr = m_label_placements.begin(); itr != m_label_placements.end(); )
+            {
+                std::vector<std::shared_ptr<const LabelPlacement>>& placements(itr->second);
+                placements.erase(std::remove_if(placements.begin(), placements.end(), [&](const std::shared_ptr<const LabelPlacement>& placement) { return placement->version != version; }), placements.end());
+                itr = placements.empty() ? m_label_placements.erase(itr) : std::next(itr);
+            }
+
+            // Have the labels been placed around the backbuffer at this projection and zoom since the last change?
+            const auto itr_find = m_label_placements.find(placement_key);
+            if(itr_find != m_label_placements.end())
+            {
+                for(const auto& placement : itr_find->second)
+                {
+                    // Is the backbuffer within the area placed?
+                    if(placement->area_px.contains(backbuffer_rect_px.rawRect()))
+                    {
+                        // Reuse the placement.
+                        return placement;
+                    }
+                }
+            }
+
+            // Fetch the label style.
+            font = m_label_font;
+            pen = m_label_pen;
+        }
+
+        // Place the labels around the backbuffer, with a margin so panning reuses the placement (outside of the lock, so
+        // other renderers can still draw the labels they have placed).
+        return_placed = true;
+        const QRectF& rect_px(backbuffer_rect_px.rawRect());
+        const qreal margin_x_px(std::max(label_area_margin_px, rect_px.width() / 2.0));
+        const qreal margin_y_px(std::max(label_area_margin_px, rect_px.height() / 2.0));
+        const auto placement(placeLabels(*snapshot, version, font, pen, rect_px.adjusted(-margin_x_px, -margin_y_px, margin_x_px, margin_y_px), controller_zoom));
+
+        // Keep the placement, unless a writer was holding the geometries (so the snapshot may be older than the version).
+        if(m_geometries_snapshot_dirty == false)
+        {
+            // Gain a lock to protect the placements.
+            QMutexLocker locker(&m_labels_mutex);
+
+            // Keep the most recent placements only.
+            std::vector<std::shared_ptr<const LabelPlacement>>& placements(m_label_placements[placement_key]);
+            if(placements.size() >= label_placements_maximum)
+            {
+                placements.erase(placements.begin());
+            }
+            placements.push_back(placement);
+        }
+
+        // Return the placement.
+        return placement;
+    }
+
+    std::shared_ptr<const LayerGeometry::LabelPlacement> LayerGeometry::placeLabels(const GeometriesSnapshot& snapshot, const quint64& version, const QFont& font, const QPen& pen, const QRectF& area_px, const int& controller_zoom) const
+    {
+        // The placement to return.
+        const auto placement(std::make_shared<LabelPlacement>());
+        placement->version = version;
+        placement->area_px = area_px;
+        placement->font = font;
+        placement->pen = pen;
+
+        // Calculate the area in world coordinates (including the points whose symbols reach into it).
+        const RectWorldCoord area_coord(projection::get().toPointWorldCoord(PointWorldPx(area_px.left(), area_px.top()), controller_zoom), projection::get().toPointWorldCoord(PointWorldPx(area_px.right(), area_px.bottom()), controller_zoom));
+        const RectWorldCoord area_expanded_coord(expandByPointSymbols(snapshot, area_coord, controller_zoom));
+
+        // A label to place, beside its symbol.
+        struct Candidate
+        {
+            /// The text to draw.
+            QString text;
+
+            /// The symbol the label is placed beside (world pixels).
+            QRectF symbol_rect_px;
+
+            /// The offset the label is placed from the symbol (pixels).
+            qreal offset_px;
+        };
+
+        // Collect each point geometry within the area with a meta-data value displayed at this zoom (in ascending z-index order).
+        std::vector<Candidate> candidates;
+        for(const auto& geometries : snapshot.geometries)
+        {
+            geometries.second->visit(area_expanded_coord, [&](const std::shared_ptr<Geometry>& geometry)
+            {
+                // Is the label displayed at this zoom?
+                if(geometry->geometryType() == Geometry::GeometryType::GeometryPoint && geometry->isVisible(controller_zoom) && geometry->m_metadata_displayed_key.empty() == false && controller_zoom >= geometry->m_metadata_displayed_zoom_minimum)
+                {
+                    // Does the geometry have a value to display?
+                    const QVariant metadata_value(geometry->metadata(geometry->m_metadata_displayed_key));
+                    if(metadata_value.isNull() == false)
+                    {
+                        // Calculate the symbol rect.
+                        const RectWorldCoord symbol_rect_coord(geometry->boundingBox(controller_zoom));
+                        const QRectF symbol_rect_px(projection::get().toPointWorldPx(symbol_rect_coord.topLeftCoord(), controller_zoom).rawPoint(), projection::get().toPointWorldPx(symbol_rect_coord.bottomRightCoord(), controller_zoom).rawPoint());
+
+                        // Add the candidate.
+                        Candidate candidate;
+                        candidate.text = metadata_value.toString();
+                        candidate.symbol_rect_px = symbol_rect_px.normalized();
+                        candidate.offset_px = geometry->m_metadata_displayed_alignment_offset_px;
+                        candidates.push_back(candidate);
+                    }
+                }
+
+                // Continue visiting.
+                return true;
+            });
+        }
+
+        // Place the topmost (last drawn) geometries' labels first.
+        const QFontMetricsF font_metrics(font);
+        const QString font_key(font.key());
+        for(auto itr = candidates.rbegin(); itr != candidates.rend(); ++itr)
+        {
+            // Measure the text (each distinct label is only measured once).
+            const QSizeF text_size_px(labelSize(itr->text, font_metrics, font_key));
+            const QRectF& symbol_rect_px(itr->symbol_rect_px);
+            const qreal offset_px(itr->offset_px);
+
+            // The positions to try, in order: above-right (where geometries draw their own labels), below-right, above-left and below-left.
+            const QPointF positions_px[] =
+            {
+                QPointF(symbol_rect_px.right() + offset_px, symbol_rect_px.top() - offset_px - font_metrics.ascent()),
+                QPointF(symbol_rect_px.right() + offset_px, symbol_rect_px.bottom() + offset_px - font_metrics.ascent()),
+                QPointF(symbol_rect_px.left() - offset_px - text_size_px.width(), symbol_rect_px.top() - offset_px - font_metrics.ascent()),
+                QPointF(symbol_rect_px.left() - offset_px - text_size_px.width(), symbol_rect_px.bottom() + offset_px - font_metrics.ascent())
+            };
+
+            // Try each position until one does not overlap a label already placed.
+            for(const auto& position_px : positions_px)
+            {
+                // Does the label overlap any placed label in the cells it covers?
+                const QRectF label_rect_px(position_px, text_size_px);
+                bool overlaps(false);
+                forEachLabelCell(label_rect_px, [&](const quint64& cell_key)
+                {
+                    const auto itr_cell = placement->cells.find(cell_key);
+                    if(overlaps == false && itr_cell != placement->cells.end())
+                    {
+                        overlaps = std::any_of(itr_cell->second.begin(), itr_cell->second.end(), [&](const size_t& label_index) { return placement->labels[label_index].rect_px.intersects(label_rect_px); });
+                    }
+                });
+
+                // Is the position free?
+                if(overlaps == false)
+                {
+                    // Place the label, and add it to the cells it covers.
+                    Label label;
+                    label.text = itr->text;
+                    label.rect_px = label_rect_px;
+                    placement->labels.push_back(label);
+                    forEachLabelCell(label_rect_px, [&](const quint64& cell_key) { placement->cells[cell_key].push_back(placement->labels.size() - 1); });
+
+                    // The label has been placed.
+                    break;
+                }
+            }
+        }
+
+        // Return the placement.
+        return placement;
+    }
+
+    bool LayerGeometry::prepareDraw(const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const
+    {
+        // Are the labels placed by the layer, and is the layer visible?
+        if(m_labels_placed == false || isVisible(controller_zoom) == false)
+        {
+            // Each render tile is drawn independently.
+            return false;
+        }
+
+        // Place the labels around the whole backbuffer, before its render tiles are drawn.
+        bool placed(false);
+        labelPlacement(placed, backbuffer_rect_px, controller_zoom);
+
+        // Return whether the labels were placed again (any labels already drawn may have moved).
+        return placed;
+    }
+
+    void LayerGeometry::drawLabels(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const
+    {
+        // Are the labels placed by the layer?
+        if(m_labels_placed == false)
+        {
+            // Each geometry draws its own label.
+            return;
+        }
+
+        // Fetch the labels placed around the backbuffer at this zoom (for a render tile, the placement prepared for the
+        // whole backbuffer contains it, so the labels are only placed here if the layer is drawn without being prepared).
+        bool placed(false);
+        const auto placement(labelPlacement(placed, backbuffer_rect_px, controller_zoom));
+        if(placement->labels.empty())
+        {
+            // Nothing to draw.
+            return;
+        }
+
+        // Collect the labels in the cells the backbuffer rect covers (a label can cover several cells).
+        thread_local std::vector<size_t> t_label_indices;
+        t_label_indices.clear();
+        forEachLabelCell(backbuffer_rect_px.rawRect(), [&](const quint64& cell_key)
+        {
+            const auto itr_cell = placement->cells.find(cell_key);
+            if(itr_cell != placement->cells.end())
+            {
+                t_label_indices.insert(t_label_indices.end(), itr_cell->second.begin(), itr_cell->second.end());
+            }
+        });
+
+        // Draw each label once, in the order they were placed.
+        std::sort(t_label_indices.begin(), t_label_indices.end());
+        t_label_indices.erase(std::unique(t_label_indices.begin(), t_label_indices.end()), t_label_indices.end());
+
+        // Set the font and pen.
+        painter.save();
+        painter.setFont(placement->font);
+        painter.setPen(placement->pen);
+
+        // Draw each label from its glyph run.
+        const QString font_key(placement->font.key());
+        for(const auto& label_index : t_label_indices)
+        {
+            const Label& label(placement->labels[label_index]);
+            painter.drawStaticText(label.rect_px.topLeft(), labelStaticText(label.text, placement->font, font_key));
+        }
+
+        // Restore the painter's state.
+        painter.restore();
+    }
 }
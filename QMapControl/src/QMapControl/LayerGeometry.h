@@ -26,19 +26,32 @@
 #pragma once
 
 // Qt includes.
+#include <QtCore/QFuture>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QReadWriteLock>
+#include <QtGui/QFont>
+#include <QtGui/QPen>
 
 // STL includes.
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Local includes.
 #include "qmapcontrol_global.h"
 #include "Geometry.h"
 #include "GeometryWidget.h"
 #include "Layer.h"
+#include "LinearQuadTreeContainer.h"
 #include "QuadTreeContainer.h"
+#include "StyleRegistry.h"
 
 namespace qmapcontrol
 {
@@ -51,7 +64,19 @@ namespace qmapcontrol
      */
     class QMAPCONTROL_EXPORT LayerGeometry : public Layer
     {
+        friend class Geometry;
+
         Q_OBJECT
+    public:
+        //! Index strategies.
+        enum class IndexStrategy
+        {
+            /// Geometries are indexed by a quad tree (QuadTreeContainer), suited to any mix of geometries.
+            QuadTree,
+            /// Geometries are indexed by a linear Morton-code quad tree (LinearQuadTreeContainer), suited to layers of mostly points.
+            LinearQuadTree
+        };
+
     public:
         //! Layer constructor
         /*!
@@ -75,10 +100,83 @@ namespace qmapcontrol
         /*!
          * Returns the Geometry objects from this Layer (Use this instead of the member variable for thread-safety).
          * @param range_coord The bounding box range to limit the geometries that are fetched in coordinates.
-         * @return a list of geometries that are on this Layer within the bounding box range.
+         * @return a list of geometries that are on this Layer within the bounding box range (in ascending z-index order).
          */
         const std::vector<std::shared_ptr<Geometry>> getGeometries(const RectWorldCoord& range_coord) const;
 
+        /*!
+         * Returns the Geometry objects from this Layer that are drawn within the range at the given zoom.
+         * This includes point geometries whose coordinate is outside of the range but whose symbol crosses into it.
+         * @param range_coord The bounding box range to limit the geometries that are fetched in coordinates.
+         * @param controller_zoom The current controller zoom.
+         * @return a list of geometries that are on this Layer within the bounding box range (in ascending z-index order).
+         */
+        const std::vector<std::shared_ptr<Geometry>> getGeometries(const RectWorldCoord& range_coord, const int& controller_zoom) const;
+
+        /*!
+         * Fetches the Geometry objects from this Layer that are drawn within the range at the given zoom into a buffer.
+         * @param return_geometries The buffer to fill in ascending z-index order (this is cleared first, so its capacity can be reused between calls).
+         * @param range_coord The bounding box range to limit the geometries that are fetched in coordinates.
+         * @param controller_zoom The current controller zoom.
+         */
+        void getGeometries(std::vector<std::shared_ptr<Geometry>>& return_geometries, const RectWorldCoord& range_coord, const int& controller_zoom) const;
+
+        /*!
+         * Visits the Geometry objects from this Layer that are drawn within the range at the given zoom, without copying them.
+         * The geometries are visited from a snapshot (without holding a lock), so the visitor may add, remove or move geometries
+         * on this Layer, but those changes are only seen by later calls.
+         * @param range_coord The bounding box range to limit the geometries that are visited in coordinates.
+         * @param controller_zoom The current controller zoom.
+         * @param visitor Called as 'bool visitor(const std::shared_ptr<Geometry>& geometry)' for each geometry (in ascending z-index order), return false to stop.
+         * @return whether every geometry within the range was visited (false if the visitor stopped early).
+         */
+        template <class Visitor>
+        bool visitGeometries(const RectWorldCoord& range_coord, const int& controller_zoom, Visitor&& visitor) const
+        {
+            // Fetch the current snapshot of the geometries (this keeps the geometries alive while we visit them).
+            const auto snapshot(geometriesSnapshot());
+
+            // Expand the range by the point symbols.
+            const RectWorldCoord range_expanded_coord(expandByPointSymbols(*snapshot, range_coord, controller_zoom));
+
+            // Visit the geometries within the range, one z-index at a time (lowest first).
+            for(const auto& geometries : snapshot->geometries)
+            {
+                // Visit the geometries at this z-index.
+                if(geometries.second->visit(range_expanded_coord, visitor) == false)
+                {
+                    // The visitor has stopped.
+                    return false;
+                }
+            }
+
+            // Every geometry was visited.
+            return true;
+        }
+
+        /*!
+         * Returns the Geometry objects from this Layer that are nearest to a point, nearest first.
+         * The distance is measured in coordinates to the geometry itself (the point, line or polygon outline, or zero
+         * if the point is inside a polygon).
+         * @param point_coord The point to search from in coordinates.
+         * @param count The maximum number of geometries to fetch.
+         * @param distance_maximum_coord Only geometries within this distance are fetched (in coordinates).
+         * @return a list of the nearest geometries, nearest first.
+         */
+        const std::vector<std::shared_ptr<Geometry>> getGeometriesNearest(const PointWorldCoord& point_coord, const size_t& count, const qreal& distance_maximum_coord = std::numeric_limits<qreal>::max()) const;
+
+        /*!
+         * Returns the Geometry objects from this Layer that are visible and nearest to a point as drawn at the given zoom, nearest first.
+         * The distance is measured in pixels to the geometry as drawn (a point's symbol, the line or polygon outline, or
+         * zero if the point is inside a polygon).
+         * @param point_coord The point to search from in coordinates.
+         * @param controller_zoom The current controller zoom.
+         * @param count The maximum number of geometries to fetch.
+         * @param distance_maximum_px Only geometries within this distance are fetched (in pixels).
+         * @return a list of the nearest geometries, nearest first.
+         */
+        const std::vector<std::shared_ptr<Geometry>> getGeometriesNearestPx(const PointWorldCoord& point_coord, const int& controller_zoom, const size_t& count, const qreal& distance_maximum_px = std::numeric_limits<qreal>::max()) const;
+
         /*!
          * Returns the Geometry QWidgets from this Layer (Use this instead of the member variable for thread-safety).
          * @return a list of geometry widgets that are on this Layer.
@@ -100,6 +198,22 @@ namespace qmapcontrol
          */
         void addGeometry(const std::shared_ptr<Geometry>& geometry, const bool& disable_redraw = false);
 
+        /*!
+         * Adds many Geometry objects to this Layer in one pass.
+         * The geometries container is locked once and packed in a single build, and at most one redraw is requested.
+         * @param geometries The new geometries to add.
+         * @param disable_redraw Whether to disable the redraw call after the geometries are added.
+         */
+        void addGeometries(const std::vector<std::shared_ptr<Geometry>>& geometries, const bool& disable_redraw = false);
+
+        /*!
+         * Adds many Geometry objects to this Layer in one pass on a worker thread.
+         * @param geometries The new geometries to add.
+         * @param disable_redraw Whether to disable the redraw call after the geometries are added.
+         * @return a future that finishes once the geometries have been added.
+         */
+        QFuture<void> addGeometriesConcurrently(const std::vector<std::shared_ptr<Geometry>>& geometries, const bool& disable_redraw = false);
+
         /*!
          * Removes a Geometry object from this Layer.
          * @param geometry The geometry to remove.
@@ -118,7 +232,7 @@ namespace qmapcontrol
          * @param mouse_point_coord The mouse point on the map in coord.
          * @param controller_zoom The current controller zoom.
          */
-        bool mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const final;
+        bool mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const override;
 
         /*!
          * Draws each map adapter and geometry to a pixmap using the provided painter.
@@ -126,7 +240,23 @@ namespace qmapcontrol
          * @param backbuffer_rect_px Only draw map tiles/geometries that are contained in the backbuffer rect (pixels).
          * @param controller_zoom The current controller zoom.
          */
-        void draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const final;
+        void draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const override;
+
+        /*!
+         * Places the labels around the backbuffer rect (if they are placed by the layer), so each render tile only draws the
+         * placed labels that it intersects.
+         * @param backbuffer_rect_px The backbuffer rect that the render tiles cover (pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return whether the labels were placed again (so the whole layer must be redrawn).
+         */
+        bool prepareDraw(const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const override;
+
+        /*!
+         * Fetches how far the layer can draw outside the rects it emits as damaged (the largest point symbol at the zoom).
+         * @param controller_zoom The current controller zoom.
+         * @return the distance in pixels.
+         */
+        qreal damagedMarginPx(const int& controller_zoom) const final;
 
         /*!
          * Moves any geometries that represent a widget, as these are not drawn to the actually pixmap.
@@ -135,6 +265,72 @@ namespace qmapcontrol
          */
         void moveGeometryWidgets(const PointPx& offset_px, const int& controller_zoom) const;
 
+        /*!
+         * Fetches the spatial index strategy used to store the geometries.
+         * @return the index strategy.
+         */
+        IndexStrategy indexStrategy() const;
+
+        /*!
+         * Set the spatial index strategy used to store the geometries (any existing geometries are re-indexed).
+         * @param strategy The index strategy to set.
+         */
+        void setIndexStrategy(const IndexStrategy& strategy);
+
+        /*!
+         * Fetches whether the layer places the point geometries' meta-data labels (see setLabelsPlaced()).
+         * @return whether the labels are placed by the layer.
+         */
+        bool labelsPlaced() const;
+
+        /*!
+         * Sets whether the layer places the point geometries' meta-data labels, rather than each geometry drawing its own
+         * (which is the default). Placed labels are laid out for the area around the backbuffer at each zoom (topmost
+         * geometries first, trying each side of the symbol), labels that would overlap another are dropped, and the text is
+         * drawn from cached glyph runs on top of the geometries. The placements are reused (ie: when panning within the
+         * area) until a labelled geometry changes.
+         * @param enabled Whether the labels are placed by the layer.
+         */
+        void setLabelsPlaced(const bool& enabled);
+
+        /*!
+         * Fetches the font that placed labels are drawn with.
+         * @return the label font.
+         */
+        QFont labelFont() const;
+
+        /*!
+         * Sets the font that placed labels are drawn with.
+         * @param font The label font.
+         */
+        void setLabelFont(const QFont& font);
+
+        /*!
+         * Fetches the pen that placed labels are drawn with.
+         * @return the label pen.
+         */
+        QPen labelPen() const;
+
+        /*!
+         * Sets the pen that placed labels are drawn with.
+         * @param pen The label pen.
+         */
+        void setLabelPen(const QPen& pen);
+
+        /*!
+         * Fetches the rules that style the line strings and polygons on this layer.
+         * @return the style rules, in priority order.
+         */
+        std::vector<StyleRule> styleRules() const;
+
+        /*!
+         * Sets the rules that style the line strings and polygons on this layer, by zoom and meta-data.
+         * The rules are matched against each geometry's meta-data once (when it is added, or now for the geometries
+         * already on this layer), so a geometry's meta-data should be set before it is added.
+         * @param style_rules The style rules, in priority order (the first that applies at a zoom is used).
+         */
+        void setStyleRules(const std::vector<StyleRule>& style_rules);
+
         qreal getFuzzyFactorPx() const;
         void setFuzzyFactorPx(const qreal &value);
 
@@ -145,13 +341,456 @@ namespace qmapcontrol
          */
         void geometryClicked(const Geometry* geometry) const;
 
+    protected:
+        /// The spatial index containers of geometries, which forward to the container of their index strategy (both use the same handles).
+        struct GeometriesContainers
+        {
+            explicit GeometriesContainers(const IndexStrategy& strategy_) : strategy(strategy_), quad_tree(50, worldBoundary()), linear_quad_tree(worldBoundary()) { }
+
+            /// The bounding box area that the containers cover in coordinates (the whole world).
+            static RectWorldCoord worldBoundary() { return RectWorldCoord(PointWorldCoord(-180.0, 90.0), PointWorldCoord(180.0, -90.0)); }
+
+            /// See QuadTreeContainer::visit().
+            template <class Visitor>
+            bool visit(const RectWorldCoord& range_coord, Visitor&& visitor) const { return strategy == IndexStrategy::QuadTree ? quad_tree.visit(range_coord, visitor) : linear_quad_tree.visit(range_coord, visitor); }
+
+            /// See QuadTreeContainer::visitNearest().
+            template <class Metric, class Visitor>
+            bool visitNearest(Metric&& metric, Visitor&& visitor) const { return strategy == IndexStrategy::QuadTree ? quad_tree.visitNearest(metric, visitor) : linear_quad_tree.visitNearest(metric, visitor); }
+
+            /// See QuadTreeContainer::insert().
+            std::vector<size_t> insert(std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>>& entries) { return strategy == IndexStrategy::QuadTree ? quad_tree.insert(entries) : linear_quad_tree.insert(entries); }
+
+            /// See QuadTreeContainer::relocate().
+            bool relocate(const size_t& handle, const RectWorldCoord& bounding_box_coord) { return strategy == IndexStrategy::QuadTree ? quad_tree.relocate(handle, bounding_box_coord) : linear_quad_tree.relocate(handle, bounding_box_coord); }
+
+            /// See QuadTreeContainer::find().
+            const std::shared_ptr<Geometry>* find(const size_t& handle) const { return strategy == IndexStrategy::QuadTree ? quad_tree.find(handle) : linear_quad_tree.find(handle); }
+
+            /// See QuadTreeContainer::erase().
+            bool erase(const size_t& handle) { return strategy == IndexStrategy::QuadTree ? quad_tree.erase(handle) : linear_quad_tree.erase(handle); }
+
+            /// See QuadTreeContainer::erase().
+            bool erase(const RectWorldCoord& bounding_box_coord, const std::shared_ptr<Geometry>& object) { return strategy == IndexStrategy::QuadTree ? quad_tree.erase(bounding_box_coord, object) : linear_quad_tree.erase(bounding_box_coord, object); }
+
+            /// See QuadTreeContainer::size().
+            size_t size() const { return strategy == IndexStrategy::QuadTree ? quad_tree.size() : linear_quad_tree.size(); }
+
+            /// The index strategy in use.
+            const IndexStrategy strategy;
+
+            /// The geometries, if indexed by a quad tree.
+            QuadTreeContainer<std::shared_ptr<Geometry>> quad_tree;
+
+            /// The geometries, if indexed by a linear quad tree.
+            LinearQuadTreeContainer<std::shared_ptr<Geometry>> linear_quad_tree;
+        };
+
+        /// A geometry added, moved or removed since the containers were last folded.
+        struct GeometriesChange
+        {
+            /// The geometry.
+            std::shared_ptr<Geometry> object;
+
+            /// The geometry's new bounding box in coordinates.
+            RectWorldCoord bounding_box_coord;
+
+            /// The geometry's handle in the containers, or invalidHandle() if it was added since they were folded.
+            size_t handle;
+
+            /// Whether the geometry has been removed.
+            bool erased;
+        };
+
+        /// The changes in one bucket, keyed by geometry.
+        typedef std::unordered_map<const Geometry*, GeometriesChange> GeometriesChangeBucket;
+
+        //! A spatial index of geometries.
+        /*!
+         * The containers are shared with the snapshots, so changes are not made to them directly. Instead, each change is
+         * recorded in one of a fixed number of buckets, and a snapshot shares the buckets as well, so a write only copies
+         * the bucket it changes. Queries visit the containers (skipping the changed geometries) and then the changes.
+         * Once there are enough changes, they are folded into the containers (which are only copied if still shared).
+         */
+        struct GeometriesIndex
+        {
+            explicit GeometriesIndex(const IndexStrategy& strategy) : containers(std::make_shared<GeometriesContainers>(strategy)), changes(changeBucketCount()), changes_count(0), count(0) { }
+
+            /// The bounding box area that the index covers in coordinates (the whole world).
+            static RectWorldCoord worldBoundary() { return GeometriesContainers::worldBoundary(); }
+
+            /// The number of buckets the changes are recorded in.
+            static size_t changeBucketCount() { return 64; }
+
+            /// The bucket a geometry's change is recorded in (the address is hashed, as geometries are allocated at regular strides).
+            static size_t changeBucketIndex(const Geometry* geometry) { return static_cast<size_t>((static_cast<quint64>(reinterpret_cast<quintptr>(geometry)) * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 32) % changeBucketCount(); }
+
+            /// See QuadTreeContainer::query().
+            void query(std::vector<std::shared_ptr<Geometry>>& return_objects, const RectWorldCoord& range_coord) const
+            {
+                // Add each object within the range.
+                visit(range_coord, [&return_objects](const std::shared_ptr<Geometry>& object) { return_objects.push_back(object); return true; });
+            }
+
+            /// See QuadTreeContainer::visit().
+            template <class Visitor>
+            bool visit(const RectWorldCoord& range_coord, Visitor&& visitor) const
+            {
+                // Visit the objects in the containers that have not changed.
+                if(containers->visit(range_coord, [&](const std::shared_ptr<Geometry>& object) { return (changes_count != 0 && findChange(object.get()) != nullptr) || visitor(object); }) == false)
+                {
+                    return false;
+                }
+
+                // Visit the changed objects still indexed within the range.
+                const QRectF range(range_coord.rawRect().normalized());
+                for(const auto& bucket : changes)
+                {
+                    if(bucket != nullptr)
+                    {
+                        for(const auto& change : *bucket)
+                        {
+                            if(change.second.erased == false && rectIntersects(range, change.second.bounding_box_coord.rawRect().normalized()) && visitor(change.second.object) == false)
+                            {
+                                return false;
+                            }
+                        }
+                    }
+                }
+
+                // Every object was visited.
+                return true;
+            }
+
+            /// See QuadTreeContainer::visitNearest().
+            template <class Metric, class Visitor>
+            bool visitNearest(Metric&& metric, Visitor&& visitor) const
+            {
+                // Measure the distance to the changed objects still indexed, nearest first.
+                std::vector<std::pair<qreal, const GeometriesChange*>> changed;
+                for(const auto& bucket : changes)
+                {
+                    if(bucket != nullptr)
+                    {
+                        for(const auto& change : *bucket)
+                        {
+                            if(change.second.erased == false)
+                            {
+                                changed.emplace_back(metric(change.second.bounding_box_coord.rawRect().normalized()), &change.second);
+                            }
+                        }
+                    }
+                }
+                std::sort(changed.begin(), changed.end(), [](const std::pair<qreal, const GeometriesChange*>& a, const std::pair<qreal, const GeometriesChange*>& b) { return a.first < b.first; });
+
+                // Visit the objects in the containers that have not changed, merged with the changed objects in distance order.
+                size_t changed_index(0);
+                bool continue_query = containers->visitNearest(metric, [&](const std::shared_ptr<Geometry>& object, const qreal& distance)
+                {
+                    // Visit the changed objects that are nearer first.
+                    for(; changed_index < changed.size() && changed[changed_index].first <= distance; ++changed_index)
+                    {
+                        if(visitor(changed[changed_index].second->object, changed[changed_index].first) == false)
+                        {
+                            return false;
+                        }
+                    }
+
+                    // Visit the object, unless it has changed.
+                    return (changes_count != 0 && findChange(object.get()) != nullptr) || visitor(object, distance);
+                });
+
+                // Visit the remaining changed objects.
+                for(; continue_query && changed_index < changed.size(); ++changed_index)
+                {
+                    continue_query = visitor(changed[changed_index].second->object, changed[changed_index].first);
+                }
+
+                // Return whether every object was visited.
+                return continue_query;
+            }
+
+            /*!
+             * Adds an object.
+             * @param bounding_box_coord The object's bounding box in coordinates.
+             * @param object The object to add.
+             * @return the object's handle in the containers (invalidHandle() until the changes are folded, unless it was
+             * removed since they were).
+             */
+            size_t insert(const RectWorldCoord& bounding_box_coord, const std::shared_ptr<Geometry>& object);
+
+            /*!
+             * Adds objects.
+             * @param entries The bounding box and object of each object to add.
+             * @return the handle of each object in the containers (in the same order as entries).
+             */
+            std::vector<size_t> insert(const std::vector<std::pair<RectWorldCoord, std::shared_ptr<Geometry>>>& entries);
+
+            /*!
+             * Moves an object to a new bounding box.
+             * @param geometry The object's geometry.
+             * @param handle The object's handle in the containers (unused if it has changed since they were folded).
+             * @param bounding_box_coord The object's new bounding box in coordinates.
+             * @return whether the object was found.
+             */
+            bool relocate(const Geometry* geometry, const size_t& handle, const RectWorldCoord& bounding_box_coord);
+
+            /*!
+             * Fetches an object.
+             * @param geometry The object's geometry.
+             * @param handle The object's handle in the containers (unused if it has changed since they were folded).
+             * @return the object, or nullptr if it is not found (the pointer is invalidated by any change to the index).
+             */
+            const std::shared_ptr<Geometry>* find(const Geometry* geometry, const size_t& handle) const;
+
+            /*!
+             * Removes an object.
+             * @param geometry The object's geometry.
+             * @param handle The object's handle in the containers (unused if it has changed since they were folded).
+             * @return whether the object was found and removed.
+             */
+            bool erase(const Geometry* geometry, const size_t& handle);
+
+            /*!
+             * Removes an object whose handle is not known (the containers are copied if they are still shared).
+             * @param bounding_box_coord The bounding box the object was indexed with in coordinates.
+             * @param object The object to remove.
+             * @return whether the object was found and removed.
+             */
+            bool erase(const RectWorldCoord& bounding_box_coord, const std::shared_ptr<Geometry>& object);
+
+            /*!
+             * Folds the changes into the containers (the containers are copied if they are still shared).
+             * @param return_handles The geometries added since the containers were last folded, and their new handles, are added to this
+             *                       (as are those moved outside of the containers' boundary, with an invalid handle).
+             */
+            void fold(std::vector<std::pair<Geometry*, size_t>>& return_handles);
+
+            /// See QuadTreeContainer::size().
+            size_t size() const { return count; }
+
+            /*!
+             * Fetches the change recorded for a geometry.
+             * @param geometry The geometry.
+             * @return the change, or nullptr if the geometry has not changed since the containers were folded.
+             */
+            const GeometriesChange* findChange(const Geometry* geometry) const;
+
+            /*!
+             * Fetches the bucket a geometry's change is recorded in, copying it first if it is still shared.
+             * @param geometry The geometry.
+             * @return the bucket, owned only by this index.
+             */
+            GeometriesChangeBucket& detachChangeBucket(const Geometry* geometry);
+
+            /// Checks whether two normalised rects intersect (edges inclusive, so points are not treated as null rects).
+            static bool rectIntersects(const QRectF& rect_a, const QRectF& rect_b) { return rect_a.left() <= rect_b.right() && rect_b.left() <= rect_a.right() && rect_a.top() <= rect_b.bottom() && rect_b.top() <= rect_a.bottom(); }
+
+            /// The geometries as of the last fold, shared with any snapshot taken since.
+            std::shared_ptr<GeometriesContainers> containers;
+
+            /// The changes since the last fold, in buckets by geometry (each bucket is shared with any snapshot taken since it last changed).
+            std::vector<std::shared_ptr<GeometriesChangeBucket>> changes;
+
+            /// The number of changes recorded.
+            size_t changes_count;
+
+            /// The number of geometries indexed.
+            size_t count;
+        };
+
+        /// An immutable view of the geometries containers, which readers can use without locking.
+        struct GeometriesSnapshot
+        {
+            GeometriesSnapshot(const std::map<int, std::shared_ptr<GeometriesIndex>>& geometries_, const std::vector<qreal>& point_symbol_extent_px_) : geometries(geometries_.begin(), geometries_.end()), point_symbol_extent_px(point_symbol_extent_px_) { }
+
+            /// List of geometries for each z-index (keyed by their bounding box), shared with the layer until a writer changes them.
+            const std::map<int, std::shared_ptr<const GeometriesIndex>> geometries;
+
+            /// The largest distance a point symbol can be drawn from its coordinate, for each zoom (pixels).
+            const std::vector<qreal> point_symbol_extent_px;
+        };
+
+        /*!
+         * Fetches the current snapshot of the geometries (lock-free).
+         * If the geometries have changed, the snapshot is refreshed, unless a writer currently holds the geometries
+         * lock, in which case the previous snapshot is returned rather than waiting.
+         * @return the current snapshot.
+         */
+        std::shared_ptr<const GeometriesSnapshot> geometriesSnapshot() const;
+
+    private:
+        /*!
+         * Finds the Geometry objects nearest to a point, nearest first.
+         * The index is searched best-first by the distance to each bounding box, and each candidate's exact distance is
+         * then calculated, until no remaining candidate can be nearer than the furthest geometry found.
+         * @param return_nearest The nearest geometries and their distances are added to this (nearest first).
+         * @param point_coord The point to search from in coordinates.
+         * @param controller_zoom The current controller zoom, or -1 to measure the distances in coordinates.
+         * @param count The maximum number of geometries to find.
+         * @param distance_maximum Only geometries within this distance are found (in pixels, or coordinates if controller_zoom is -1).
+         */
+        void findGeometriesNearest(std::vector<std::pair<qreal, std::shared_ptr<Geometry>>>& return_nearest, const PointWorldCoord& point_coord, const int& controller_zoom, const size_t& count, const qreal& distance_maximum) const;
+
+        /*!
+         * Expands a range by the largest point symbol drawn on this layer at the given zoom.
+         * @param snapshot The snapshot of the geometries.
+         * @param range_coord The bounding box range in coordinates.
+         * @param controller_zoom The current controller zoom.
+         * @return the expanded bounding box range in coordinates.
+         */
+        RectWorldCoord expandByPointSymbols(const GeometriesSnapshot& snapshot, const RectWorldCoord& range_coord, const int& controller_zoom) const;
+
+        /*!
+         * Re-indexes a Geometry object on this Layer after its position, extent or z-index has changed.
+         * @param geometry The geometry to re-index.
+         */
+        void relocateGeometry(Geometry* geometry);
+
+        /*!
+         * Fetches the geometries container for a z-index, creating it if required (the geometries mutex must be held for writing).
+         * @param z_index The z-index.
+         * @return the geometries container.
+         */
+        GeometriesIndex& geometriesAt(const int& z_index);
+
+        /*!
+         * Fetches a geometries container to change, copying it first if a snapshot still shares it (the geometries mutex must be held for writing).
+         * The copy shares the spatial index and the change buckets, which are only copied once they are changed.
+         * @param geometries The geometries container (replaced by its copy, if it was shared).
+         * @return the geometries container, owned only by this layer.
+         */
+        GeometriesIndex& detachGeometries(std::shared_ptr<GeometriesIndex>& geometries);
+
+        /*!
+         * Folds a geometries container's changes into its spatial index, once there are enough of them (the geometries mutex must be held for writing).
+         * @param geometries The geometries container.
+         */
+        void foldGeometries(GeometriesIndex& geometries);
+
+        /*!
+         * Removes a Geometry object's entry from the geometries containers (the geometries mutex must be held for writing).
+         * @param geometry The geometry to remove.
+         * @param bounding_box_coord The bounding box the geometry was indexed with, used if it is not indexed on this layer.
+         */
+        void eraseGeometry(const std::shared_ptr<Geometry>& geometry, const RectWorldCoord& bounding_box_coord);
+
+        /*!
+         * Records the area a Geometry object is drawn over, and emits both it and the area previously recorded as damaged.
+         * @param geometry The geometry that has changed.
+         * @param drawn Whether the geometry is still drawn by this layer (false once it has been removed).
+         * @param emit_damaged Whether to emit the damaged areas (otherwise the area is only recorded).
+         */
+        void damageGeometry(Geometry& geometry, const bool& drawn, const bool& emit_damaged);
+
+        /*!
+         * Fetches the style rules that match a Geometry object's meta-data (the geometries mutex must be held for writing).
+         * @param geometry The geometry to match.
+         * @return the matching style rules, in priority order (shared by every geometry matching the same rules, or null if none match).
+         */
+        std::shared_ptr<const std::vector<StyleRule>> matchStyleRules(const Geometry& geometry);
+
+        /// Polygons (or polylines) that are drawn with the same pen and brush.
+        struct StyleBatch
+        {
+            /// The pen to draw with.
+            std::shared_ptr<const QPen> pen;
+
+            /// The brush to fill closed polygons with.
+            std::shared_ptr<const QBrush> brush;
+
+            /// Whether the polygons are closed (otherwise they are drawn as polylines).
+            bool closed;
+
+            /// The polygons to draw (pixels).
+            std::vector<QPolygonF> polygons_px;
+        };
+
+        /// A label that has been placed.
+        struct Label
+        {
+            /// The text to draw.
+            QString text;
+
+            /// The rect the text is drawn within (world pixels).
+            QRectF rect_px;
+        };
+
+        /// The labels placed within an area at a zoom.
+        struct LabelPlacement
+        {
+            /// The labels version the placement was made for.
+            quint64 version;
+
+            /// The area the labels were placed within (world pixels).
+            QRectF area_px;
+
+            /// The font the labels are drawn with.
+            QFont font;
+
+            /// The pen the labels are drawn with.
+            QPen pen;
+
+            /// The labels placed.
+            std::vector<Label> labels;
+
+            /// The labels that cover each grid cell, keyed by (row << 32 | column).
+            std::unordered_map<quint64, std::vector<size_t>> cells;
+        };
+
+        /*!
+         * Fetches the labels placed around the backbuffer rect at the zoom, placing them if the backbuffer rect has moved out
+         * of the area they were placed within, or the labelled geometries have changed.
+         * @param return_placed Whether the labels were placed again.
+         * @param backbuffer_rect_px The backbuffer rect the labels are drawn within (world pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return the label placement.
+         */
+        std::shared_ptr<const LabelPlacement> labelPlacement(bool& return_placed, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const;
+
+        /*!
+         * Places the labels of every point geometry with a meta-data value displayed at the zoom within an area.
+         * @param snapshot The snapshot of the geometries.
+         * @param version The labels version the placement is made for.
+         * @param font The font the labels are drawn with.
+         * @param pen The pen the labels are drawn with.
+         * @param area_px The area to place the labels within (world pixels).
+         * @param controller_zoom The current controller zoom.
+         * @return the label placement.
+         */
+        std::shared_ptr<const LabelPlacement> placeLabels(const GeometriesSnapshot& snapshot, const quint64& version, const QFont& font, const QPen& pen, const QRectF& area_px, const int& controller_zoom) const;
+
+        /*!
+         * Draws the placed labels within the backbuffer rect (the placement prepared for the render tiles' backbuffer rect, if
+         * the rect is a render tile).
+         * @param painter The painter that will draw to the pixmap.
+         * @param backbuffer_rect_px Only draw labels that intersect the backbuffer rect (pixels).
+         * @param controller_zoom The current controller zoom.
+         */
+        void drawLabels(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const;
+
     private:
-        /// List of geometries drawn by this layer.
-        QuadTreeContainer<std::shared_ptr<Geometry>> m_geometries;
+        /// List of geometries drawn by this layer for each z-index (keyed by their bounding box), so they are always fetched in z-index order (each is copied before it is changed while a snapshot shares it).
+        std::map<int, std::shared_ptr<GeometriesIndex>> m_geometries;
+
+        /// The spatial index strategy used to store the geometries.
+        IndexStrategy m_index_strategy;
 
-        /// Mutex to protect geometries.
+        /// The largest distance a point symbol can be drawn from its coordinate, for each zoom (pixels).
+        std::vector<qreal> m_point_symbol_extent_px;
+
+        /// Mutex to protect geometries (only writers and snapshot refreshes take this).
         mutable QReadWriteLock m_geometries_mutex;
 
+        /// The latest published snapshot of the geometries (only accessed via std::atomic_load/std::atomic_store).
+        mutable std::shared_ptr<const GeometriesSnapshot> m_geometries_snapshot;
+
+        /// Whether the geometries have changed since the snapshot was published.
+        mutable std::atomic<bool> m_geometries_snapshot_dirty;
+
+        /// Mutex to protect the area each geometry was last recorded as drawn over.
+        QMutex m_geometries_damaged_mutex;
+
         /// List of geometry widgets drawn by this layer.
         std::set<std::shared_ptr<GeometryWidget>> m_geometry_widgets;
 
@@ -159,5 +798,29 @@ namespace qmapcontrol
         mutable QReadWriteLock m_geometry_widgets_mutex;
 
         qreal mFuzzyFactorPx;
+
+        /// Whether the layer places the point geometries' meta-data labels.
+        std::atomic<bool> m_labels_placed;
+
+        /// The font that placed labels are drawn with.
+        QFont m_label_font;
+
+        /// The pen that placed labels are drawn with.
+        QPen m_label_pen;
+
+        /// Incremented whenever a labelled geometry (or the label style) changes, so placements are refreshed.
+        std::atomic<quint64> m_labels_version;
+
+        /// The most recent labels placed at each projection (EPSG) and zoom, for a few areas (protected by the labels mutex).
+        mutable std::map<std::pair<int, int>, std::vector<std::shared_ptr<const LabelPlacement>>> m_label_placements;
+
+        /// Mutex to protect the label style and placements.
+        mutable QMutex m_labels_mutex;
+
+        /// The rules that style the line strings and polygons (protected by the geometries mutex).
+        std::vector<StyleRule> m_style_rules;
+
+        /// The matching style rules shared by geometries, keyed by which rules match (protected by the geometries mutex).
+        std::map<std::vector<bool>, std::shared_ptr<const std::vector<StyleRule>>> m_style_rule_matches;
     };
 }
@@ -0,0 +1,446 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "LayerHeatmap.h"
+
+// Qt includes.
+#include <QtCore/QMutexLocker>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+
+// STL includes.
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// SIMD includes (SSE2 is always available on x86-64, and is used on x86 when enabled).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define QMC_LAYER_HEATMAP_SSE2
+    #include <emmintrin.h>
+#endif
+
+// Local includes.
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The number of colours the density is mapped to.
+        const int colour_table_size(256);
+
+        /// Per-thread density grid, which keeps its capacity between draws (each screen tile is drawn on its own thread).
+        thread_local std::vector<float> t_density_grid;
+
+        /// Per-thread horizontally blurred density grid, which keeps its capacity between draws.
+        thread_local std::vector<float> t_density_blurred;
+
+        /// Per-thread colour-mapped pixels, which keep their capacity between draws.
+        thread_local std::vector<QRgb> t_density_pixels;
+
+        /*!
+         * Adds a scaled row of values to another (destination += source * scale).
+         * @param destination The row to add to.
+         * @param source The row to add.
+         * @param scale The scale to apply to the source.
+         * @param count The number of values in the rows.
+         */
+        void accumulateScaled(float* destination, const float* source, const float& scale, const int& count)
+        {
+            // Keep track of the values added.
+            int i(0);
+
+#ifdef QMC_LAYER_HEATMAP_SSE2
+            // Add four values at a time.
+            const __m128 scale4(_mm_set1_ps(scale));
+            for(; i + 4 <= count; i += 4)
+            {
+                _mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(_mm_loadu_ps(source + i), scale4)));
+            }
+#endif
+
+            // Add the remaining values.
+            for(; i < count; ++i)
+            {
+                destination[i] += source[i] * scale;
+            }
+        }
+
+        /*!
+         * Maps a row of densities to colours.
+         * @param destination The colours to set.
+         * @param density The densities to map.
+         * @param scale The scale from a density to its colour table index.
+         * @param colour_table The colour table (colour_table_size entries).
+         * @param count The number of values in the rows.
+         */
+        void colourMap(QRgb* destination, const float* density, const float& scale, const QRgb* colour_table, const std::size_t& count)
+        {
+            // Keep track of the values mapped.
+            std::size_t i(0);
+
+#ifdef QMC_LAYER_HEATMAP_SSE2
+            // Calculate the colour table indices four values at a time (clamped to the table).
+            const __m128 scale4(_mm_set1_ps(scale));
+            const __m128 minimum4(_mm_setzero_ps());
+            const __m128 maximum4(_mm_set1_ps(float(colour_table_size - 1)));
+            for(; i + 4 <= count; i += 4)
+            {
+                int indices[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(density + i), scale4), minimum4), maximum4)));
+                destination[i] = colour_table[indices[0]];
+                destination[i + 1] = colour_table[indices[1]];
+                destination[i + 2] = colour_table[indices[2]];
+                destination[i + 3] = colour_table[indices[3]];
+            }
+#endif
+
+            // Map the remaining values.
+            for(; i < count; ++i)
+            {
+                destination[i] = colour_table[int(std::min(std::max(density[i] * scale, 0.0f), float(colour_table_size - 1)))];
+            }
+        }
+
+        /*!
+         * Builds a colour table from gradient stops.
+         * @param colour_stops The gradient stops (positions from 0 to 1, in ascending order).
+         * @return the colour table (colour_table_size premultiplied colours).
+         */
+        std::vector<QRgb> colourTable(const QGradientStops& colour_stops)
+        {
+            // Default to transparent.
+            std::vector<QRgb> return_colour_table(colour_table_size, qRgba(0, 0, 0, 0));
+
+            // Do we have any stops?
+            if(colour_stops.isEmpty() == false)
+            {
+                // Loop through each entry.
+                for(int i = 0; i < colour_table_size; ++i)
+                {
+                    // Find the stops either side of this position.
+                    const qreal position(qreal(i) / qreal(colour_table_size - 1));
+                    int stop(0);
+                    while(stop < colour_stops.size() - 1 && colour_stops.at(stop + 1).first <= position)
+                    {
+                        ++stop;
+                    }
+                    const QGradientStop& stop_from(colour_stops.at(stop));
+                    const QGradientStop& stop_to(colour_stops.at(std::min(stop + 1, colour_stops.size() - 1)));
+
+                    // Interpolate between the stops.
+                    const qreal range(stop_to.first - stop_from.first);
+                    const qreal t(range > 0.0 ? std::min(std::max((position - stop_from.first) / range, qreal(0.0)), qreal(1.0)) : qreal(0.0));
+                    const QColor& from(stop_from.second);
+                    const QColor& to(stop_to.second);
+                    return_colour_table[std::size_t(i)] = qPremultiply(qRgba(int(from.red() + (to.red() - from.red()) * t),
+                                                                             int(from.green() + (to.green() - from.green()) * t),
+                                                                             int(from.blue() + (to.blue() - from.blue()) * t),
+                                                                             int(from.alpha() + (to.alpha() - from.alpha()) * t)));
+                }
+            }
+
+            // Return the colour table.
+            return return_colour_table;
+        }
+    }
+
+    LayerHeatmap::LayerHeatmap(const std::string& name, const int& zoom_minimum, const int& zoom_maximum, QObject* parent)
+        : Layer(LayerType::LayerHeatmap, name, zoom_minimum, zoom_maximum, parent),
+          m_points(RectWorldCoord(PointWorldCoord(-180.0, 90.0), PointWorldCoord(180.0, -90.0))),
+          m_radius_px(20.0),
+          m_density_maximum(4.0)
+    {
+        // Set the default colours (transparent, through blue, cyan, green and yellow, to red).
+        QGradientStops colour_stops;
+        colour_stops.append(QGradientStop(0.0, QColor(0, 0, 255, 0)));
+        colour_stops.append(QGradientStop(0.2, QColor(0, 0, 255, 160)));
+        colour_stops.append(QGradientStop(0.4, QColor(0, 255, 255, 190)));
+        colour_stops.append(QGradientStop(0.6, QColor(0, 255, 0, 210)));
+        colour_stops.append(QGradientStop(0.8, QColor(255, 255, 0, 230)));
+        colour_stops.append(QGradientStop(1.0, QColor(255, 0, 0, 255)));
+        m_colour_table = colourTable(colour_stops);
+    }
+
+    void LayerHeatmap::addPoint(const PointWorldCoord& point_coord, const qreal& weight, const bool& disable_redraw)
+    {
+        // Add the point as a batch of one.
+        addPoints(std::vector<std::pair<PointWorldCoord, qreal>>(1, std::make_pair(point_coord, weight)), disable_redraw);
+    }
+
+    void LayerHeatmap::addPoints(const std::vector<std::pair<PointWorldCoord, qreal>>& points, const bool& disable_redraw)
+    {
+        // Do we have any points to add?
+        if(points.empty() == false)
+        {
+            // Prepare the entries (and the area they cover) before we take the lock.
+            std::vector<std::pair<RectWorldCoord, HeatmapPoint>> entries;
+            entries.reserve(points.size());
+            qreal left(points.front().first.longitude());
+            qreal right(left);
+            qreal bottom(points.front().first.latitude());
+            qreal top(bottom);
+            for(const auto& point : points)
+            {
+                // Add the entry, keyed by its coordinate.
+                entries.emplace_back(RectWorldCoord(point.first, point.first), HeatmapPoint(point.first, point.second));
+
+                // Expand the area to include the point.
+                left = std::min(left, point.first.longitude());
+                right = std::max(right, point.first.longitude());
+                bottom = std::min(bottom, point.first.latitude());
+                top = std::max(top, point.first.latitude());
+            }
+
+            // Scope the locker to ensure the mutex is release as soon as possible.
+            {
+                // Gain a write lock to protect the points.
+                QWriteLocker locker(&m_points_mutex);
+
+                // Add the points in one pass (they are appended to the unsorted points, so this is cheap).
+                m_points.insert(entries);
+            }
+
+            // Should we redraw?
+            if(disable_redraw == false)
+            {
+                // Emit to redraw only the area the new points are drawn over (the kernel radius is allowed for by damagedMarginPx()).
+                emit requestRedrawDamaged(RectWorldCoord(PointWorldCoord(left, top), PointWorldCoord(right, bottom)), 0.0);
+            }
+        }
+    }
+
+    void LayerHeatmap::clearPoints(const bool& disable_redraw)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a write lock to protect the points.
+            QWriteLocker locker(&m_points_mutex);
+
+            // Remove all points.
+            m_points.clear();
+        }
+
+        // Should we redraw?
+        if(disable_redraw == false)
+        {
+            // Emit to redraw layer.
+            emit requestRedraw();
+        }
+    }
+
+    size_t LayerHeatmap::pointCount() const
+    {
+        // Gain a read lock to protect the points.
+        QReadLocker locker(&m_points_mutex);
+
+        // Return the number of points.
+        return m_points.size();
+    }
+
+    qreal LayerHeatmap::radiusPx() const
+    {
+        // Return the radius.
+        return m_radius_px;
+    }
+
+    void LayerHeatmap::setRadiusPx(const qreal& radius_px)
+    {
+        // Set the radius (at least a pixel).
+        m_radius_px = std::max(radius_px, qreal(1.0));
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    qreal LayerHeatmap::densityMaximum() const
+    {
+        // Return the maximum density.
+        return m_density_maximum;
+    }
+
+    void LayerHeatmap::setDensityMaximum(const qreal& density_maximum)
+    {
+        // Set the maximum density (it must be positive).
+        m_density_maximum = std::max(density_maximum, std::numeric_limits<qreal>::epsilon());
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    void LayerHeatmap::setColourStops(const QGradientStops& colour_stops)
+    {
+        // Build the colour table before we lock.
+        std::vector<QRgb> colour_table(colourTable(colour_stops));
+
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the colour table.
+            QMutexLocker locker(&m_colour_table_mutex);
+
+            // Set the colour table.
+            m_colour_table.swap(colour_table);
+        }
+
+        // Emit to redraw layer.
+        emit requestRedraw();
+    }
+
+    bool LayerHeatmap::mousePressEvent(const QMouseEvent* /*mouse_event*/, const PointWorldCoord& /*mouse_point_coord*/, const int& /*controller_zoom*/) const
+    {
+        // Do Nothing...
+        return false;
+    }
+
+    void LayerHeatmap::draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const
+    {
+        // Check the layer is visible.
+        if(isVisible(controller_zoom))
+        {
+            // Calculate the resolution to bin the points at: world pixels, unless the painter scales them down (ie: a
+            // MapRenderer thumbnail of a large rect), in which case the device pixels (so the grid is never larger than
+            // the area it is drawn to).
+            const QRectF rect_px(backbuffer_rect_px.rawRect().normalized());
+            qreal resolution(1.0);
+            if(rect_px.isEmpty() == false)
+            {
+                const QRectF device_rect_px(painter.worldTransform().mapRect(rect_px));
+                resolution = std::min(resolution, std::min(device_rect_px.width() / rect_px.width(), device_rect_px.height() / rect_px.height()));
+            }
+
+            // Calculate the whole pixels to draw (at the resolution).
+            const int left_px(int(std::floor(rect_px.left() * resolution)));
+            const int top_px(int(std::floor(rect_px.top() * resolution)));
+            const int width_px(int(std::ceil(rect_px.right() * resolution)) - left_px);
+            const int height_px(int(std::ceil(rect_px.bottom() * resolution)) - top_px);
+
+            // Is there anything to draw?
+            if(width_px > 0 && height_px > 0)
+            {
+                // The points within the kernel radius of the rect are added to the grid (which has a border of the kernel radius).
+                const qreal radius(m_radius_px * resolution);
+                const int radius_px(int(std::ceil(radius)));
+                const int grid_width_px(width_px + radius_px * 2);
+                const int grid_height_px(height_px + radius_px * 2);
+                const int grid_left_px(left_px - radius_px);
+                const int grid_top_px(top_px - radius_px);
+
+                // Add the weight of each point to the pixel it falls in (by world pixel at the resolution, so each tile bins the points identically).
+                auto& grid = t_density_grid;
+                grid.assign(std::size_t(grid_width_px) * std::size_t(grid_height_px), 0.0f);
+                std::vector<char> grid_rows(std::size_t(grid_height_px), 0);
+                bool points_found(false);
+                const RectWorldCoord range_coord(projection::get().toPointWorldCoord(PointWorldPx(grid_left_px / resolution, grid_top_px / resolution), controller_zoom), projection::get().toPointWorldCoord(PointWorldPx((grid_left_px + grid_width_px) / resolution, (grid_top_px + grid_height_px) / resolution), controller_zoom));
+
+                // Scope the locker to ensure the mutex is release as soon as possible.
+                {
+                    // Gain a read lock to protect the points.
+                    QReadLocker locker(&m_points_mutex);
+
+                    // Visit the points within the range.
+                    m_points.visit(range_coord, [&](const HeatmapPoint& point)
+                    {
+                        // Find the pixel the point falls in.
+                        const PointWorldPx point_px(projection::get().toPointWorldPx(point.coord, controller_zoom));
+                        const int x(int(std::floor(point_px.x() * resolution)) - grid_left_px);
+                        const int y(int(std::floor(point_px.y() * resolution)) - grid_top_px);
+                        if(x >= 0 && x < grid_width_px && y >= 0 && y < grid_height_px)
+                        {
+                            // Add the weight.
+                            grid[std::size_t(y) * std::size_t(grid_width_px) + std::size_t(x)] += float(point.weight);
+                            grid_rows[std::size_t(y)] = 1;
+                            points_found = true;
+                        }
+
+                        // Continue the query.
+                        return true;
+                    });
+                }
+
+                // Did we find any points (otherwise there is nothing to draw)?
+                if(points_found)
+                {
+                    // Calculate the Gaussian kernel (the radius is three standard deviations, and the peak is 1).
+                    const qreal sigma(std::max(radius / 3.0, qreal(0.5)));
+                    std::vector<float> kernel(std::size_t(radius_px * 2 + 1));
+                    for(int i = -radius_px; i <= radius_px; ++i)
+                    {
+                        kernel[std::size_t(i + radius_px)] = float(std::exp(-(qreal(i) * qreal(i)) / (2.0 * sigma * sigma)));
+                    }
+
+                    // Blur each row horizontally (rows without any points remain zero, so are skipped).
+                    auto& blurred = t_density_blurred;
+                    blurred.assign(std::size_t(width_px) * std::size_t(grid_height_px), 0.0f);
+                    for(int y = 0; y < grid_height_px; ++y)
+                    {
+                        if(grid_rows[std::size_t(y)] != 0)
+                        {
+                            for(int i = 0; i < int(kernel.size()); ++i)
+                            {
+                                accumulateScaled(&blurred[std::size_t(y) * std::size_t(width_px)], &grid[std::size_t(y) * std::size_t(grid_width_px) + std::size_t(i)], kernel[std::size_t(i)], width_px);
+                            }
+                        }
+                    }
+
+                    // Blur each column vertically into the density (re-using the grid, which is no longer needed).
+                    auto& density = t_density_grid;
+                    density.assign(std::size_t(width_px) * std::size_t(height_px), 0.0f);
+                    for(int y = 0; y < height_px; ++y)
+                    {
+                        for(int i = 0; i < int(kernel.size()); ++i)
+                        {
+                            if(grid_rows[std::size_t(y + i)] != 0)
+                            {
+                                accumulateScaled(&density[std::size_t(y) * std::size_t(width_px)], &blurred[std::size_t(y + i) * std::size_t(width_px)], kernel[std::size_t(i)], width_px);
+                            }
+                        }
+                    }
+
+                    // Map the density to colours.
+                    auto& pixels = t_density_pixels;
+                    pixels.resize(std::size_t(width_px) * std::size_t(height_px));
+                    const float scale(float((colour_table_size - 1) / m_density_maximum));
+
+                    // Scope the locker to ensure the mutex is release as soon as possible.
+                    {
+                        // Gain a lock to protect the colour table.
+                        QMutexLocker locker(&m_colour_table_mutex);
+
+                        // Map every pixel in one pass.
+                        colourMap(pixels.data(), density.data(), scale, m_colour_table.data(), pixels.size());
+                    }
+
+                    // Draw the colours (the image wraps the pixels, so no copy takes place).
+                    const QImage image(reinterpret_cast<const uchar*>(pixels.data()), width_px, height_px, width_px * int(sizeof(QRgb)), QImage::Format_ARGB32_Premultiplied);
+                    painter.drawImage(QRectF(left_px / resolution, top_px / resolution, width_px / resolution, height_px / resolution), image);
+                }
+            }
+        }
+    }
+
+    qreal LayerHeatmap::damagedMarginPx(const int& /*controller_zoom*/) const
+    {
+        // The density is spread over the kernel radius.
+        return std::ceil(qreal(m_radius_px));
+    }
+}
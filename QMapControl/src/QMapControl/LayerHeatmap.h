@@ -0,0 +1,203 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QReadWriteLock>
+#include <QtGui/QGradient>
+#include <QtGui/QRgb>
+
+// STL includes.
+#include <atomic>
+#include <utility>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Layer.h"
+#include "LinearQuadTreeContainer.h"
+#include "Point.h"
+
+namespace qmapcontrol
+{
+    //! Layer class
+    /*!
+     * Layer that displays the density of weighted points as a heatmap.
+     *
+     * Each drawn rect fetches the points within the kernel radius of it from a linear quad tree, adds their
+     * weights into a float grid at the backbuffer resolution, and blurs the grid with a separable Gaussian
+     * kernel (so the cost depends on the area drawn, not on the number of points). The density is then
+     * colour-mapped into the frame. The accumulation, blur and colour-mapping loops use SSE2 where available,
+     * and the backbuffer's screen tiles are drawn concurrently.
+     *
+     * The density is mapped against a fixed maximum (rather than the densest pixel drawn), so each tile and
+     * each partial redraw match their neighbours.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT LayerHeatmap : public Layer
+    {
+        Q_OBJECT
+    public:
+        //! Layer constructor
+        /*!
+         * This is used to construct a layer.
+         * @param name The name of the layer.
+         * @param zoom_minimum The minimum zoom level to show this geometry at.
+         * @param zoom_maximum The maximum zoom level to show this geometry at.
+         * @param parent QObject parent ownership.
+         */
+        LayerHeatmap(const std::string& name, const int& zoom_minimum = 0, const int& zoom_maximum = 17, QObject* parent = 0);
+
+        //! Disable copy constructor.
+        ///LayerHeatmap(const LayerHeatmap&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///LayerHeatmap& operator=(const LayerHeatmap&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        virtual ~LayerHeatmap() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Adds a weighted point to this Layer.
+         * @param point_coord The point in coordinates.
+         * @param weight The weight of the point (the density at its centre).
+         * @param disable_redraw Whether to disable the redraw call after the point is added.
+         */
+        void addPoint(const PointWorldCoord& point_coord, const qreal& weight = 1.0, const bool& disable_redraw = false);
+
+        /*!
+         * Adds many weighted points to this Layer in one pass.
+         * Only the area the new points are drawn over is redrawn, so points can be appended cheaply.
+         * @param points The points in coordinates, and their weights.
+         * @param disable_redraw Whether to disable the redraw call after the points are added.
+         */
+        void addPoints(const std::vector<std::pair<PointWorldCoord, qreal>>& points, const bool& disable_redraw = false);
+
+        /*!
+         * Removes all points from this Layer.
+         * @param disable_redraw Whether to disable the redraw call after the points are removed.
+         */
+        void clearPoints(const bool& disable_redraw = false);
+
+        /*!
+         * Fetches the number of points on this Layer.
+         * @return the number of points.
+         */
+        size_t pointCount() const;
+
+        /*!
+         * Fetches the radius of each point's kernel (three standard deviations of the Gaussian).
+         * @return the radius in pixels.
+         */
+        qreal radiusPx() const;
+
+        /*!
+         * Sets the radius of each point's kernel (three standard deviations of the Gaussian).
+         * @param radius_px The radius in pixels.
+         */
+        void setRadiusPx(const qreal& radius_px);
+
+        /*!
+         * Fetches the density that is drawn with the last colour.
+         * @return the maximum density (a point of weight 1 has a density of 1 at its centre).
+         */
+        qreal densityMaximum() const;
+
+        /*!
+         * Sets the density that is drawn with the last colour (higher densities are clamped to it).
+         * @param density_maximum The maximum density (a point of weight 1 has a density of 1 at its centre).
+         */
+        void setDensityMaximum(const qreal& density_maximum);
+
+        /*!
+         * Sets the colours the density is mapped to (from 0 to the maximum density).
+         * @param colour_stops The gradient stops (positions from 0 to 1), including their alpha.
+         */
+        void setColourStops(const QGradientStops& colour_stops);
+
+        /*!
+         * Handles mouse press events (such as left-clicking an item on the layer).
+         * @param mouse_event The mouse event.
+         * @param mouse_point_coord The mouse point on the map in coord.
+         * @param controller_zoom The current controller zoom.
+         */
+        bool mousePressEvent(const QMouseEvent* mouse_event, const PointWorldCoord& mouse_point_coord, const int& controller_zoom) const final;
+
+        /*!
+         * Draws the heatmap to a pixmap using the provided painter.
+         * @param painter The painter that will draw to the pixmap.
+         * @param backbuffer_rect_px Only draw the density within the backbuffer rect (pixels).
+         * @param controller_zoom The current controller zoom.
+         */
+        void draw(QPainter& painter, const RectWorldPx& backbuffer_rect_px, const int& controller_zoom) const final;
+
+        /*!
+         * Fetches how far the layer can draw outside the rects it emits as damaged (the kernel radius).
+         * @param controller_zoom The current controller zoom.
+         * @return the distance in pixels.
+         */
+        qreal damagedMarginPx(const int& controller_zoom) const final;
+
+    private:
+        //! Disable copy constructor.
+        LayerHeatmap(const LayerHeatmap&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        LayerHeatmap& operator=(const LayerHeatmap&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// A weighted point.
+        struct HeatmapPoint
+        {
+            HeatmapPoint() : coord(), weight(0.0) { }
+            HeatmapPoint(const PointWorldCoord& coord_, const qreal& weight_) : coord(coord_), weight(weight_) { }
+
+            /// The point in coordinates.
+            PointWorldCoord coord;
+
+            /// The weight of the point.
+            qreal weight;
+        };
+
+    private:
+        /// The points, indexed by their coordinate.
+        LinearQuadTreeContainer<HeatmapPoint> m_points;
+
+        /// Mutex to protect the points.
+        mutable QReadWriteLock m_points_mutex;
+
+        /// The radius of each point's kernel (pixels).
+        std::atomic<qreal> m_radius_px;
+
+        /// The density that is drawn with the last colour.
+        std::atomic<qreal> m_density_maximum;
+
+        /// The colour (premultiplied) for each step of density from 0 to the maximum.
+        std::vector<QRgb> m_colour_table;
+
+        /// Mutex to protect the colour table.
+        mutable QMutex m_colour_table_mutex;
+    };
+}
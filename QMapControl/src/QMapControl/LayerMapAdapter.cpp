@@ -108,7 +108,7 @@ namespace qmapcontrol
                             const PointWorldPx top_left_px(i * tile_size_px.width(), j * tile_size_px.height());
 
                             // Draw the tile.
-                            painter.drawPixmap(top_left_px.rawPoint(), ImageManager::get().getImage(m_mapadapter->tileQuery(i, j, controller_zoom)));
+                            painter.drawImage(top_left_px.rawPoint(), ImageManager::get().getImage(m_mapadapter->tileQuery(i, j, controller_zoom)));
                         }
                     }
                 }
@@ -0,0 +1,1424 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// STD includes.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// SIMD includes (SSE2 is always available on x86-64, and is used on x86 when enabled).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define QMC_LINEAR_QUAD_TREE_SSE2
+    #include <emmintrin.h>
+#endif
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Point.h"
+
+/*!
+ * @author Chris Stylianou <chris5287@gmail.com>
+ */
+namespace qmapcontrol
+{
+    /*!
+     * Based on: http://en.wikipedia.org/wiki/Z-order_curve
+     *
+     * A linear (pointerless) quad tree, suited to containers of many points. Each point is quantised to
+     * 32 bits per axis within the boundary and keyed by its Morton (Z-order) code, and the points are
+     * stored as structure-of-arrays sorted by that code, so every quad tree cell is a contiguous range.
+     * A rect query is decomposed into a small number of cells (code ranges), each found by a binary
+     * search, and the coordinates within each range are tested against the rect in bulk (using SSE2
+     * where available).
+     *
+     * New or moved points are appended to an unsorted tail, which is tested in bulk by every query and
+     * merged into the sorted points once it grows past a fraction of them. Erased points are marked
+     * (their coordinates are set to NaN, so they never pass a test) and are dropped by the next merge.
+     *
+     * Objects with an extent (a bounding box larger than a point) are stored in a separate unsorted
+     * structure-of-arrays which every query tests in bulk, so this container should only be used when
+     * most objects are points (use QuadTreeContainer otherwise).
+     *
+     * The public interface matches QuadTreeContainer: each inserted object is given a stable handle,
+     * which can be used to erase or relocate the object without searching for it, and only objects whose
+     * bounding box intersects the boundary are stored (an object moved entirely outside of it is removed).
+     */
+    template <class T>
+    class QMAPCONTROL_EXPORT LinearQuadTreeContainer
+    {
+    public:
+        /// A stable handle to an object in the container (valid until the object is erased or the container is cleared).
+        typedef size_t Handle;
+
+        /*!
+         * Fetches the handle value that represents no object.
+         * @return the invalid handle.
+         */
+        static Handle invalidHandle()
+        {
+            // Return the largest handle value.
+            return std::numeric_limits<Handle>::max();
+        }
+
+    public:
+        //! Constuctor.
+        /*!
+         * Linear Quad Tree Container constructor.
+         * @param boundary_coord The bounding box area that this quad tree container covers in coordinates.
+         */
+        explicit LinearQuadTreeContainer(const RectWorldCoord& boundary_coord)
+            : m_boundary_coord(RectWorldCoord::fromQRectF(boundary_coord.rawRect().normalized())),
+              m_scale_x(m_boundary_coord.rawRect().width() > 0.0 ? quantisedSize() / m_boundary_coord.rawRect().width() : 0.0),
+              m_scale_y(m_boundary_coord.rawRect().height() > 0.0 ? quantisedSize() / m_boundary_coord.rawRect().height() : 0.0),
+              m_points_sorted(0),
+              m_points_erased(0)
+        {
+
+        }
+
+        //! Disable copy assignment.
+        ///LinearQuadTreeContainer& operator=(const LinearQuadTreeContainer&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        virtual ~LinearQuadTreeContainer() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Fetches objects whose bounding box intersects the specified bounding box range.
+         * @param return_objects The objects that are within the specified range are added to this (each object is only added once).
+         * @param range_coord The bounding box range.
+         * @note return_objects is only appended to, so a caller can clear() and reuse it to avoid reallocating.
+         */
+        void query(std::vector<T>& return_objects, const RectWorldCoord& range_coord) const
+        {
+            // Add each object within the range.
+            visit(range_coord, [&](const T& object) { return_objects.push_back(object); return true; });
+        }
+
+        /*!
+         * Fetches up to a maximum number of objects whose bounding box intersects the specified bounding box range.
+         * @param return_objects The objects that are within the specified range are added to this (each object is only added once).
+         * @param range_coord The bounding box range.
+         * @param limit The maximum number of objects to add (the query stops once this is reached).
+         */
+        void query(std::vector<T>& return_objects, const RectWorldCoord& range_coord, const size_t& limit) const
+        {
+            // Keep track of how many objects we have added.
+            size_t count(0);
+
+            // Add each object within the range until we reach the limit.
+            if(limit > 0)
+            {
+                visit(range_coord, [&](const T& object) { return_objects.push_back(object); return ++count < limit; });
+            }
+        }
+
+        /*!
+         * Visits objects whose bounding box intersects the specified bounding box range, without copying them.
+         * The sorted points are visited first (in Morton order), then the unsorted points, then the objects with an extent.
+         * @param range_coord The bounding box range.
+         * @param visitor Called as 'bool visitor(const T& object)' for each object within the range, return false to stop the query.
+         * @return whether every object within the range was visited (false if the visitor stopped the query early).
+         */
+        template <class Visitor>
+        bool visit(const RectWorldCoord& range_coord, Visitor&& visitor) const
+        {
+            // Normalise the range.
+            const QRectF range(range_coord.rawRect().normalized());
+
+            // Keep track of whether we should continue.
+            bool continue_query(true);
+
+            // Do we have any sorted points?
+            if(m_points_sorted > 0)
+            {
+                // Decompose the range into code ranges, and visit the points within each.
+                std::vector<std::pair<std::uint64_t, std::uint64_t>> code_ranges;
+                decomposeRange(code_ranges, range);
+                const auto codes_begin(m_point_codes.begin());
+                const auto codes_end(m_point_codes.begin() + m_points_sorted);
+                for(auto itr_range = code_ranges.begin(); continue_query && itr_range != code_ranges.end(); ++itr_range)
+                {
+                    // Find the points within the code range (they are contiguous).
+                    const auto itr_begin(std::lower_bound(codes_begin, codes_end, itr_range->first));
+                    const auto itr_end(std::upper_bound(itr_begin, codes_end, itr_range->second));
+
+                    // Test their coordinates against the range.
+                    continue_query = visitPoints(size_t(itr_begin - m_point_codes.begin()), size_t(itr_end - m_point_codes.begin()), range, visitor);
+                }
+            }
+
+            // Test the unsorted points against the range.
+            if(continue_query)
+            {
+                continue_query = visitPoints(m_points_sorted, m_point_codes.size(), range, visitor);
+            }
+
+            // Test the objects with an extent against the range.
+            if(continue_query)
+            {
+                continue_query = visitExtents(range, visitor);
+            }
+
+            // Return whether we visited every object.
+            return continue_query;
+        }
+
+        /*!
+         * Fetches the objects nearest to a point, nearest first.
+         * The distance to an object is the (coordinate) distance from the point to the object's bounding box.
+         * @param return_objects The nearest objects are added to this (nearest first).
+         * @param point_coord The point to search from in coordinates.
+         * @param count The maximum number of objects to add.
+         * @param distance_maximum_coord Only objects within this distance are added (in coordinates).
+         */
+        void queryNearest(std::vector<T>& return_objects, const PointWorldCoord& point_coord, const size_t& count, const qreal& distance_maximum_coord = std::numeric_limits<qreal>::max()) const
+        {
+            // Keep track of how many objects we have added.
+            size_t added(0);
+
+            // Add the nearest objects until we reach the count or the maximum distance.
+            if(count > 0)
+            {
+                const QPointF point(point_coord.rawPoint());
+                visitNearest([&](const QRectF& bounding_box) { return rectDistance(bounding_box, point); },
+                             [&](const T& object, const qreal& distance)
+                             {
+                                 // Is the object within the maximum distance?
+                                 const bool within_distance(distance <= distance_maximum_coord);
+                                 if(within_distance)
+                                 {
+                                     return_objects.push_back(object);
+                                 }
+
+                                 // Objects are visited nearest first, so we can stop at the first that is too far away.
+                                 return within_distance && ++added < count;
+                             });
+            }
+        }
+
+        /*!
+         * Visits objects in order of increasing distance (a best-first search over the implicit quad tree cells), without copying them.
+         * The metric is called with normalised cell boundaries and object bounding boxes, and must never return a
+         * larger distance for a rect than for any rect it contains (for example the distance from a point to the rect).
+         * @param metric Called as 'qreal metric(const QRectF& bounding_box)' to calculate the distance to a normalised rect.
+         * @param visitor Called as 'bool visitor(const T& object, const qreal& distance)' for each object (nearest first), return false to stop the query.
+         * @return whether every object was visited (false if the visitor stopped the query early).
+         */
+        template <class Metric, class Visitor>
+        bool visitNearest(Metric&& metric, Visitor&& visitor) const
+        {
+            // A cell of sorted points waiting to be searched.
+            struct Cell
+            {
+                /// The cell's position at its level.
+                std::uint64_t x;
+                std::uint64_t y;
+
+                /// The cell's level (0 is the whole boundary).
+                unsigned int level;
+
+                /// The range of sorted points within the cell.
+                size_t index_begin;
+                size_t index_end;
+            };
+
+            // A cell, point or object with an extent waiting to be visited.
+            struct Candidate
+            {
+                /// The distance to the cell's boundary or object's bounding box.
+                qreal distance;
+
+                /// The index of the cell, point or object with an extent.
+                size_t index;
+
+                /// The type of candidate.
+                CandidateType type;
+            };
+
+            // The cells that have been queued.
+            std::vector<Cell> cells;
+
+            // The queue of candidates (a min-heap on distance).
+            const auto compare_further = [](const Candidate& a, const Candidate& b) { return a.distance > b.distance; };
+            std::vector<Candidate> candidates;
+
+            // Queue the root cell (covering the sorted points).
+            if(m_points_sorted > 0)
+            {
+                cells.push_back(Cell{ 0, 0, 0, 0, m_points_sorted });
+                candidates.push_back(Candidate{ metric(cellBoundary(0, 0, 0)), 0, CandidateType::Cell });
+            }
+
+            // The queue of unsorted points and objects with an extent (a separate min-heap, built once and only popped from).
+            std::vector<Candidate> candidates_unsorted;
+            candidates_unsorted.reserve(m_point_codes.size() - m_points_sorted + m_extent_objects.size());
+
+            // Queue each unsorted point.
+            for(size_t index = m_points_sorted; index < m_point_codes.size(); ++index)
+            {
+                if(m_point_handles[index] != invalidHandle())
+                {
+                    candidates_unsorted.push_back(Candidate{ metric(QRectF(m_point_xs[index], m_point_ys[index], 0.0, 0.0)), index, CandidateType::Point });
+                }
+            }
+
+            // Queue each object with an extent.
+            for(size_t index = 0; index < m_extent_objects.size(); ++index)
+            {
+                candidates_unsorted.push_back(Candidate{ metric(QRectF(QPointF(m_extent_lefts[index], m_extent_tops[index]), QPointF(m_extent_rights[index], m_extent_bottoms[index]))), index, CandidateType::Extent });
+            }
+
+            // Order the unsorted queue.
+            std::make_heap(candidates_unsorted.begin(), candidates_unsorted.end(), compare_further);
+
+            // Keep track of whether we should continue.
+            bool continue_query(true);
+
+            // Visit the nearest candidate until there are none left.
+            while(continue_query && (candidates.empty() == false || candidates_unsorted.empty() == false))
+            {
+                // Take the nearest candidate from whichever queue has it.
+                std::vector<Candidate>& queue((candidates_unsorted.empty() || (candidates.empty() == false && candidates.front().distance <= candidates_unsorted.front().distance)) ? candidates : candidates_unsorted);
+                std::pop_heap(queue.begin(), queue.end(), compare_further);
+                const Candidate candidate(queue.back());
+                queue.pop_back();
+
+                // Is it a point?
+                if(candidate.type == CandidateType::Point)
+                {
+                    // Nothing left in the queue can be nearer, so visit the object.
+                    continue_query = visitor(m_point_objects[candidate.index], candidate.distance);
+                }
+                // Is it an object with an extent?
+                else if(candidate.type == CandidateType::Extent)
+                {
+                    // Nothing left in the queue can be nearer, so visit the object.
+                    continue_query = visitor(m_extent_objects[candidate.index], candidate.distance);
+                }
+                else
+                {
+                    // Copy the cell (queuing further cells may reallocate the list).
+                    const Cell cell(cells[candidate.index]);
+
+                    // Is the cell small enough (or as deep as possible) to queue its points directly?
+                    if(cell.index_end - cell.index_begin <= cell_points_maximum || cell.level == code_bits)
+                    {
+                        // Queue each point in the cell.
+                        for(size_t index = cell.index_begin; index < cell.index_end; ++index)
+                        {
+                            if(m_point_handles[index] != invalidHandle())
+                            {
+                                candidates.push_back(Candidate{ metric(QRectF(m_point_xs[index], m_point_ys[index], 0.0, 0.0)), index, CandidateType::Point });
+                                std::push_heap(candidates.begin(), candidates.end(), compare_further);
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // Queue each child cell that has points (in Morton order, so each is found after the last).
+                        size_t index_begin(cell.index_begin);
+                        for(unsigned int child = 0; child < 4; ++child)
+                        {
+                            // Calculate the child's position and the last code it covers.
+                            const std::uint64_t child_x((cell.x << 1) | (child & 1));
+                            const std::uint64_t child_y((cell.y << 1) | (child >> 1));
+                            const unsigned int child_level(cell.level + 1);
+                            const std::uint64_t code_last(cellCodeFirst(child_x, child_y, child_level) | cellCodeMask(child_level));
+
+                            // Find the points within the child.
+                            const size_t index_end(size_t(std::upper_bound(m_point_codes.begin() + index_begin, m_point_codes.begin() + cell.index_end, code_last) - m_point_codes.begin()));
+                            if(index_end > index_begin)
+                            {
+                                cells.push_back(Cell{ child_x, child_y, child_level, index_begin, index_end });
+                                candidates.push_back(Candidate{ metric(cellBoundary(child_x, child_y, child_level)), cells.size() - 1, CandidateType::Cell });
+                                std::push_heap(candidates.begin(), candidates.end(), compare_further);
+                            }
+
+                            // The next child starts where this one ends.
+                            index_begin = index_end;
+                        }
+                    }
+                }
+            }
+
+            // Return whether we visited every object.
+            return continue_query;
+        }
+
+        /*!
+         * Calculates the distance from a point to a normalised rect (zero if the point is inside the rect).
+         * @param rect The normalised rect.
+         * @param point The point.
+         * @return the distance.
+         */
+        static qreal rectDistance(const QRectF& rect, const QPointF& point)
+        {
+            // Calculate the distance outside the rect along each axis.
+            const qreal dx(std::max(std::max(rect.left() - point.x(), point.x() - rect.right()), qreal(0.0)));
+            const qreal dy(std::max(std::max(rect.top() - point.y(), point.y() - rect.bottom()), qreal(0.0)));
+
+            // Return the distance.
+            return std::sqrt(dx * dx + dy * dy);
+        }
+
+        /*!
+         * Inserts a point object into the quad tree container.
+         * @param point_coord The objects's point in coordinates.
+         * @param object The object to insert.
+         * @return the object's handle, or invalidHandle() if it was not inserted into this quad tree container.
+         */
+        Handle insert(const PointWorldCoord& point_coord, const T& object)
+        {
+            // Insert the point as a zero-sized bounding box.
+            return insert(RectWorldCoord(point_coord, point_coord), object);
+        }
+
+        /*!
+         * Inserts an object into the quad tree container.
+         * @param bounding_box_coord The objects's bounding box in coordinates.
+         * @param object The object to insert.
+         * @return the object's handle, or invalidHandle() if it was not inserted into this quad tree container.
+         */
+        Handle insert(const RectWorldCoord& bounding_box_coord, const T& object)
+        {
+            // Store the object.
+            const Handle handle(insertEntry(bounding_box_coord.rawRect().normalized(), T(object)));
+
+            // Merge the unsorted points, if there are now too many.
+            mergePointsIfRequired();
+
+            // Return the handle.
+            return handle;
+        }
+
+        /*!
+         * Inserts many objects into the quad tree container in one pass (the points are sorted once, at the end).
+         * Existing handles remain valid.
+         * @param entries The objects' bounding boxes in coordinates and the objects to insert (the contents are moved from).
+         * @return the handle of each object (in the same order as entries), or invalidHandle() if it was not inserted.
+         */
+        std::vector<Handle> insert(std::vector<std::pair<RectWorldCoord, T>>& entries)
+        {
+            // The handles to return.
+            std::vector<Handle> return_handles;
+            return_handles.reserve(entries.size());
+
+            // Store each object.
+            for(auto& entry : entries)
+            {
+                return_handles.push_back(insertEntry(entry.first.rawRect().normalized(), std::move(entry.second)));
+            }
+
+            // Merge the unsorted points, if there are now too many.
+            mergePointsIfRequired();
+
+            // Return the handles.
+            return return_handles;
+        }
+
+        /*!
+         * Moves an object to a new bounding box.
+         * A point that keeps its sorted position, or is still unsorted, is updated in place. A point that has moved a short
+         * distance along the Morton order is shifted to its new position, otherwise it is moved to the unsorted points.
+         * @param handle The object's handle.
+         * @param bounding_box_coord The objects's new bounding box in coordinates.
+         * @return whether the object is still stored (false if the handle was not valid, or if the new bounding box does
+         *         not intersect our boundary, in which case the object is removed and its handle released, as insert()
+         *         would not have stored it).
+         */
+        bool relocate(const Handle& handle, const RectWorldCoord& bounding_box_coord)
+        {
+            // Keep track of our success.
+            bool success(false);
+
+            // Normalise the bounding box.
+            const QRectF bounding_box(bounding_box_coord.rawRect().normalized());
+
+            // Has the object moved outside of our boundary?
+            if(isValidHandle(handle) && intersectsBoundary(bounding_box) == false)
+            {
+                // Remove the object.
+                erase(handle);
+            }
+            // Is the handle valid?
+            else if(isValidHandle(handle))
+            {
+                // Fetch where the object is stored.
+                const HandleEntry& handle_entry(m_handle_entries[handle]);
+
+                // Is it a point that is still a point?
+                if(handle_entry.extent == false && isPoint(bounding_box))
+                {
+                    // Can the point be updated in place (it is unsorted, or its new code keeps the sorted points in order)?
+                    const size_t index(handle_entry.index);
+                    const std::uint64_t code(pointCode(bounding_box.left(), bounding_box.top()));
+                    if(index >= m_points_sorted || ((index == 0 || m_point_codes[index - 1] <= code) && (index + 1 == m_points_sorted || code <= m_point_codes[index + 1])))
+                    {
+                        // Update the point.
+                        m_point_codes[index] = code;
+                        m_point_xs[index] = bounding_box.left();
+                        m_point_ys[index] = bounding_box.top();
+                    }
+                    // Can the point be shifted to its new position within the sorted points (it has only moved a short distance)?
+                    else if(shiftPoint(index, code))
+                    {
+                        // Update the point at its new position.
+                        const size_t index_shifted(m_handle_entries[handle].index);
+                        m_point_xs[index_shifted] = bounding_box.left();
+                        m_point_ys[index_shifted] = bounding_box.top();
+                    }
+                    else
+                    {
+                        // Move the point to the unsorted points.
+                        T object(takeEntry(handle));
+                        storeEntry(handle, bounding_box, std::move(object));
+                    }
+                }
+                // Is it an object with an extent that still has an extent?
+                else if(handle_entry.extent && isPoint(bounding_box) == false)
+                {
+                    // Update the extent.
+                    const size_t index(handle_entry.index);
+                    m_extent_lefts[index] = bounding_box.left();
+                    m_extent_tops[index] = bounding_box.top();
+                    m_extent_rights[index] = bounding_box.right();
+                    m_extent_bottoms[index] = bounding_box.bottom();
+                }
+                else
+                {
+                    // Move the object between the points and the objects with an extent.
+                    T object(takeEntry(handle));
+                    storeEntry(handle, bounding_box, std::move(object));
+                }
+
+                // Merge the unsorted points, if there are now too many.
+                mergePointsIfRequired();
+
+                // Update our success.
+                success = true;
+            }
+
+            // Return our success.
+            return success;
+        }
+
+        /*!
+         * Fetches an object by its handle.
+         * @param handle The object's handle.
+         * @return the object, or nullptr if the handle is not valid (the pointer is invalidated by any change to the container).
+         */
+        const T* find(const Handle& handle) const
+        {
+            // Default to not found.
+            const T* object(nullptr);
+
+            // Is the handle valid?
+            if(isValidHandle(handle))
+            {
+                // Fetch the object.
+                const HandleEntry& handle_entry(m_handle_entries[handle]);
+                object = handle_entry.extent ? &m_extent_objects[handle_entry.index] : &m_point_objects[handle_entry.index];
+            }
+
+            // Return the object.
+            return object;
+        }
+
+        /*!
+         * Removes an object from the quad tree container.
+         * @param handle The object's handle.
+         * @return whether the handle was valid and the object removed.
+         */
+        bool erase(const Handle& handle)
+        {
+            // Keep track of our success.
+            bool success(false);
+
+            // Is the handle valid?
+            if(isValidHandle(handle))
+            {
+                // Remove the object and release its handle.
+                takeEntry(handle);
+                m_handle_entries[handle].index = invalidIndex();
+                m_handles_free.push_back(handle);
+
+                // Have most of the points been erased?
+                if(m_points_erased > 0 && m_points_erased >= m_point_codes.size() / 2)
+                {
+                    // Drop the erased points.
+                    mergePoints();
+                }
+
+                // Update our success.
+                success = true;
+            }
+
+            // Return our success.
+            return success;
+        }
+
+        /*!
+         * Removes a point object from the quad tree container.
+         * @param point_coord The objects's point in coordinates.
+         * @param object The object to remove.
+         * @return whether the object was found and removed.
+         */
+        bool erase(const PointWorldCoord& point_coord, const T& object)
+        {
+            // Remove the point as a zero-sized bounding box.
+            return erase(RectWorldCoord(point_coord, point_coord), object);
+        }
+
+        /*!
+         * Removes an object from the quad tree container.
+         * @param bounding_box_coord The objects's bounding box in coordinates (as used when it was inserted).
+         * @param object The object to remove.
+         * @return whether the object was found and removed.
+         */
+        bool erase(const RectWorldCoord& bounding_box_coord, const T& object)
+        {
+            // Find the object's handle and remove it.
+            return erase(findHandle(bounding_box_coord.rawRect().normalized(), object));
+        }
+
+        /*!
+         * Fetches the number of objects in the quad tree container.
+         * @return the number of objects in the quad tree container.
+         */
+        size_t size() const
+        {
+            // Return the number of points (excluding those erased) and objects with an extent.
+            return m_point_codes.size() - m_points_erased + m_extent_objects.size();
+        }
+
+        /*!
+         * Removes all objects from the quad tree container (this invalidates all handles).
+         * The buffers keep their capacity, so this does not free or reallocate any memory.
+         */
+        void clear()
+        {
+            // Clear the points.
+            m_point_codes.clear();
+            m_point_xs.clear();
+            m_point_ys.clear();
+            m_point_objects.clear();
+            m_point_handles.clear();
+            m_points_sorted = 0;
+            m_points_erased = 0;
+
+            // Clear the objects with an extent.
+            m_extent_lefts.clear();
+            m_extent_tops.clear();
+            m_extent_rights.clear();
+            m_extent_bottoms.clear();
+            m_extent_objects.clear();
+            m_extent_handles.clear();
+
+            // Clear the handles.
+            m_handle_entries.clear();
+            m_handles_free.clear();
+        }
+
+    private:
+        //! Disable copy assignment.
+        LinearQuadTreeContainer& operator=(const LinearQuadTreeContainer&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// Where a handle's object is stored.
+        struct HandleEntry
+        {
+            /// The index of the object in the points or objects with an extent (invalid if the handle is free).
+            size_t index;
+
+            /// Whether the object has an extent (otherwise it is a point).
+            bool extent;
+        };
+
+        /// The types of candidate queued by a nearest search.
+        enum class CandidateType
+        {
+            /// A cell of sorted points.
+            Cell,
+            /// A point.
+            Point,
+            /// An object with an extent.
+            Extent
+        };
+
+        /// The number of bits each axis is quantised to (the depth of the implicit quad tree).
+        static const unsigned int code_bits = 32;
+
+        /// The maximum number of cells a rect query is decomposed into.
+        static const size_t query_cells_maximum = 64;
+
+        /// The number of points in a cell below which a nearest search queues the points directly.
+        static const size_t cell_points_maximum = 16;
+
+        /// The minimum number of unsorted points before they are merged into the sorted points.
+        static const size_t unsorted_points_minimum = 256;
+
+        /// The maximum number of positions a relocated point is shifted within the sorted points (further moves go to the unsorted points).
+        static const size_t shift_points_maximum = 64;
+
+        /*!
+         * Fetches the index value that represents no object.
+         * @return the invalid index.
+         */
+        static size_t invalidIndex()
+        {
+            // Return the largest index value.
+            return std::numeric_limits<size_t>::max();
+        }
+
+        /*!
+         * Fetches the number of quantised positions along each axis.
+         * @return the number of quantised positions.
+         */
+        static double quantisedSize()
+        {
+            // Return 2^code_bits.
+            return std::ldexp(1.0, int(code_bits));
+        }
+
+        /*!
+         * Checks whether a normalised bounding box intersects our boundary (inclusive, so points on its edge are stored).
+         * @param bounding_box The normalised bounding box.
+         * @return whether the bounding box intersects our boundary.
+         */
+        bool intersectsBoundary(const QRectF& bounding_box) const
+        {
+            // Check each edge.
+            const QRectF& boundary(m_boundary_coord.rawRect());
+            return boundary.left() <= bounding_box.right() && bounding_box.left() <= boundary.right() && boundary.top() <= bounding_box.bottom() && bounding_box.top() <= boundary.bottom();
+        }
+
+        /*!
+         * Checks whether a normalised bounding box is a point (has no extent).
+         * @param bounding_box The normalised bounding box.
+         * @return whether the bounding box is a point.
+         */
+        static bool isPoint(const QRectF& bounding_box)
+        {
+            // Check the bounding box has no width or height.
+            return bounding_box.left() == bounding_box.right() && bounding_box.top() == bounding_box.bottom();
+        }
+
+        /*!
+         * Spreads the lower 32 bits of a value out to the even bits.
+         * @param value The value to spread.
+         * @return the spread value.
+         */
+        static std::uint64_t spreadBits(std::uint64_t value)
+        {
+            // Spread the bits in halving steps.
+            value &= 0x00000000FFFFFFFFull;
+            value = (value | (value << 16)) & 0x0000FFFF0000FFFFull;
+            value = (value | (value << 8)) & 0x00FF00FF00FF00FFull;
+            value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0Full;
+            value = (value | (value << 2)) & 0x3333333333333333ull;
+            value = (value | (value << 1)) & 0x5555555555555555ull;
+
+            // Return the spread value.
+            return value;
+        }
+
+        /*!
+         * Fetches the first Morton code within a cell.
+         * @param x The cell's x position at its level.
+         * @param y The cell's y position at its level.
+         * @param level The cell's level (0 is the whole boundary).
+         * @return the first code.
+         */
+        static std::uint64_t cellCodeFirst(const std::uint64_t& x, const std::uint64_t& y, const unsigned int& level)
+        {
+            // Interleave the cell's first quantised position (x in the even bits, y in the odd bits).
+            const unsigned int shift(code_bits - level);
+            return spreadBits(x << shift) | (spreadBits(y << shift) << 1);
+        }
+
+        /*!
+         * Fetches the mask of the Morton code bits that vary within a cell.
+         * @param level The cell's level (0 is the whole boundary).
+         * @return the mask.
+         */
+        static std::uint64_t cellCodeMask(const unsigned int& level)
+        {
+            // Each level below the cell adds two bits.
+            const unsigned int shift(code_bits - level);
+            return shift >= 32 ? ~std::uint64_t(0) : (std::uint64_t(1) << (2 * shift)) - 1;
+        }
+
+        /*!
+         * Quantises a position along an axis (positions outside the boundary are clamped to its edge).
+         * @param position The position in coordinates, relative to the boundary's minimum.
+         * @param scale The number of quantised positions per coordinate.
+         * @return the quantised position.
+         */
+        static std::uint64_t quantise(const double& position, const double& scale)
+        {
+            // Scale the position, and clamp it (this also handles NaN).
+            const double quantised(position * scale);
+            return quantised > 0.0 ? (quantised < quantisedSize() - 1.0 ? std::uint64_t(quantised) : std::uint64_t(quantisedSize() - 1.0)) : 0;
+        }
+
+        /*!
+         * Calculates the Morton code of a point.
+         * @param x The point's x coordinate.
+         * @param y The point's y coordinate.
+         * @return the Morton code.
+         */
+        std::uint64_t pointCode(const double& x, const double& y) const
+        {
+            // Interleave the quantised position.
+            return cellCodeFirst(quantise(x - m_boundary_coord.rawRect().left(), m_scale_x), quantise(y - m_boundary_coord.rawRect().top(), m_scale_y), code_bits);
+        }
+
+        /*!
+         * Calculates the boundary of a cell in coordinates.
+         * @param x The cell's x position at its level.
+         * @param y The cell's y position at its level.
+         * @param level The cell's level (0 is the whole boundary).
+         * @return the normalised boundary.
+         */
+        QRectF cellBoundary(const std::uint64_t& x, const std::uint64_t& y, const unsigned int& level) const
+        {
+            // Each level halves the cell size.
+            const double cell_width(m_boundary_coord.rawRect().width() * std::ldexp(1.0, -int(level)));
+            const double cell_height(m_boundary_coord.rawRect().height() * std::ldexp(1.0, -int(level)));
+
+            // Return the boundary.
+            return QRectF(m_boundary_coord.rawRect().left() + double(x) * cell_width, m_boundary_coord.rawRect().top() + double(y) * cell_height, cell_width, cell_height);
+        }
+
+        /*!
+         * Decomposes a range into the Morton code ranges of the cells that cover it (in code order).
+         * Cells that are only partly within the range are subdivided level by level, until they are all within the
+         * range or there would be too many cells, so the points found must still be tested against the range.
+         * @param code_ranges The first and last code of each range are added to this.
+         * @param range The normalised range.
+         */
+        void decomposeRange(std::vector<std::pair<std::uint64_t, std::uint64_t>>& code_ranges, const QRectF& range) const
+        {
+            // A cell covering part of the range.
+            struct Cell
+            {
+                /// The cell's position at its level.
+                std::uint64_t x;
+                std::uint64_t y;
+
+                /// The cell's level (0 is the whole boundary).
+                unsigned int level;
+
+                /// Whether the cell is completely within the range.
+                bool within;
+            };
+
+            // Quantise the range.
+            const std::uint64_t range_left(quantise(range.left() - m_boundary_coord.rawRect().left(), m_scale_x));
+            const std::uint64_t range_right(quantise(range.right() - m_boundary_coord.rawRect().left(), m_scale_x));
+            const std::uint64_t range_top(quantise(range.top() - m_boundary_coord.rawRect().top(), m_scale_y));
+            const std::uint64_t range_bottom(quantise(range.bottom() - m_boundary_coord.rawRect().top(), m_scale_y));
+
+            // Start with the root cell.
+            std::vector<Cell> cells(1, Cell{ 0, 0, 0, range_left == 0 && range_top == 0 && range_right == quantisedSize() - 1.0 && range_bottom == quantisedSize() - 1.0 });
+            std::vector<Cell> cells_next;
+
+            // Subdivide the cells that are only partly within the range, one level at a time.
+            for(unsigned int level = 0; level < code_bits && cells.size() * 4 <= query_cells_maximum; ++level)
+            {
+                // Subdivide each cell that is only partly within the range (in Morton order, so the cells stay sorted by code).
+                bool subdivided(false);
+                cells_next.clear();
+                for(const auto& cell : cells)
+                {
+                    // Is the cell completely within the range?
+                    if(cell.within)
+                    {
+                        // Keep the cell.
+                        cells_next.push_back(cell);
+                    }
+                    else
+                    {
+                        // Check each child cell against the range.
+                        for(unsigned int child = 0; child < 4; ++child)
+                        {
+                            // Calculate the child's quantised extent.
+                            const std::uint64_t child_x((cell.x << 1) | (child & 1));
+                            const std::uint64_t child_y((cell.y << 1) | (child >> 1));
+                            const unsigned int shift(code_bits - (cell.level + 1));
+                            const std::uint64_t child_left(child_x << shift);
+                            const std::uint64_t child_right(child_left + (std::uint64_t(1) << shift) - 1);
+                            const std::uint64_t child_top(child_y << shift);
+                            const std::uint64_t child_bottom(child_top + (std::uint64_t(1) << shift) - 1);
+
+                            // Does the child overlap the range?
+                            if(child_left <= range_right && child_right >= range_left && child_top <= range_bottom && child_bottom >= range_top)
+                            {
+                                // Keep the child (noting whether it is completely within the range).
+                                cells_next.push_back(Cell{ child_x, child_y, cell.level + 1, child_left >= range_left && child_right <= range_right && child_top >= range_top && child_bottom <= range_bottom });
+                            }
+                        }
+
+                        // A cell was subdivided.
+                        subdivided = true;
+                    }
+                }
+
+                // Have all the cells been completely within the range?
+                if(subdivided == false)
+                {
+                    // Finished.
+                    break;
+                }
+
+                // Move to the next level.
+                cells.swap(cells_next);
+            }
+
+            // Add the code range of each cell, joining ranges that are contiguous.
+            for(const auto& cell : cells)
+            {
+                // Calculate the cell's code range.
+                const std::uint64_t code_first(cellCodeFirst(cell.x, cell.y, cell.level));
+                const std::uint64_t code_last(code_first | cellCodeMask(cell.level));
+
+                // Does the cell follow on from the last range?
+                if(code_ranges.empty() == false && code_ranges.back().second + 1 == code_first)
+                {
+                    // Extend the last range.
+                    code_ranges.back().second = code_last;
+                }
+                else
+                {
+                    // Add the range.
+                    code_ranges.emplace_back(code_first, code_last);
+                }
+            }
+        }
+
+        /*!
+         * Visits the points within a range of indices whose coordinates are within a range.
+         * @param index_begin The first index to test.
+         * @param index_end The index after the last to test.
+         * @param range The normalised range.
+         * @param visitor Called as 'bool visitor(const T& object)' for each point within the range, return false to stop.
+         * @return whether every point within the range was visited (false if the visitor stopped early).
+         */
+        template <class Visitor>
+        bool visitPoints(const size_t& index_begin, const size_t& index_end, const QRectF& range, Visitor& visitor) const
+        {
+            // Erased points have NaN coordinates, so they never pass the test.
+            size_t index(index_begin);
+
+#ifdef QMC_LINEAR_QUAD_TREE_SSE2
+            // Test two points at a time.
+            const __m128d range_left(_mm_set1_pd(range.left()));
+            const __m128d range_right(_mm_set1_pd(range.right()));
+            const __m128d range_top(_mm_set1_pd(range.top()));
+            const __m128d range_bottom(_mm_set1_pd(range.bottom()));
+            for(; index + 2 <= index_end; index += 2)
+            {
+                // Test the coordinates against the range.
+                const __m128d x(_mm_loadu_pd(&m_point_xs[index]));
+                const __m128d y(_mm_loadu_pd(&m_point_ys[index]));
+                const int within(_mm_movemask_pd(_mm_and_pd(_mm_and_pd(_mm_cmpge_pd(x, range_left), _mm_cmple_pd(x, range_right)), _mm_and_pd(_mm_cmpge_pd(y, range_top), _mm_cmple_pd(y, range_bottom)))));
+
+                // Visit the points that are within the range.
+                if(within != 0)
+                {
+                    if((within & 1) != 0 && visitor(m_point_objects[index]) == false)
+                    {
+                        return false;
+                    }
+                    if((within & 2) != 0 && visitor(m_point_objects[index + 1]) == false)
+                    {
+                        return false;
+                    }
+                }
+            }
+#endif
+
+            // Test the remaining points one at a time.
+            for(; index < index_end; ++index)
+            {
+                // Is the point within the range?
+                if(m_point_xs[index] >= range.left() && m_point_xs[index] <= range.right() && m_point_ys[index] >= range.top() && m_point_ys[index] <= range.bottom())
+                {
+                    // Visit the point.
+                    if(visitor(m_point_objects[index]) == false)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            // Every point within the range was visited.
+            return true;
+        }
+
+        /*!
+         * Visits the objects with an extent whose bounding box intersects a range.
+         * @param range The normalised range.
+         * @param visitor Called as 'bool visitor(const T& object)' for each object within the range, return false to stop.
+         * @return whether every object within the range was visited (false if the visitor stopped early).
+         */
+        template <class Visitor>
+        bool visitExtents(const QRectF& range, Visitor& visitor) const
+        {
+            // Keep track of the index we are testing.
+            size_t index(0);
+            const size_t index_end(m_extent_objects.size());
+
+#ifdef QMC_LINEAR_QUAD_TREE_SSE2
+            // Test two objects at a time.
+            const __m128d range_left(_mm_set1_pd(range.left()));
+            const __m128d range_right(_mm_set1_pd(range.right()));
+            const __m128d range_top(_mm_set1_pd(range.top()));
+            const __m128d range_bottom(_mm_set1_pd(range.bottom()));
+            for(; index + 2 <= index_end; index += 2)
+            {
+                // Test the bounding boxes against the range.
+                const __m128d left(_mm_loadu_pd(&m_extent_lefts[index]));
+                const __m128d right(_mm_loadu_pd(&m_extent_rights[index]));
+                const __m128d top(_mm_loadu_pd(&m_extent_tops[index]));
+                const __m128d bottom(_mm_loadu_pd(&m_extent_bottoms[index]));
+                const int intersects(_mm_movemask_pd(_mm_and_pd(_mm_and_pd(_mm_cmple_pd(left, range_right), _mm_cmpge_pd(right, range_left)), _mm_and_pd(_mm_cmple_pd(top, range_bottom), _mm_cmpge_pd(bottom, range_top)))));
+
+                // Visit the objects that intersect the range.
+                if(intersects != 0)
+                {
+                    if((intersects & 1) != 0 && visitor(m_extent_objects[index]) == false)
+                    {
+                        return false;
+                    }
+                    if((intersects & 2) != 0 && visitor(m_extent_objects[index + 1]) == false)
+                    {
+                        return false;
+                    }
+                }
+            }
+#endif
+
+            // Test the remaining objects one at a time.
+            for(; index < index_end; ++index)
+            {
+                // Does the bounding box intersect the range?
+                if(m_extent_lefts[index] <= range.right() && m_extent_rights[index] >= range.left() && m_extent_tops[index] <= range.bottom() && m_extent_bottoms[index] >= range.top())
+                {
+                    // Visit the object.
+                    if(visitor(m_extent_objects[index]) == false)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            // Every object within the range was visited.
+            return true;
+        }
+
+        /*!
+         * Checks whether a handle refers to an object in the container.
+         * @param handle The handle to check.
+         * @return whether the handle is valid.
+         */
+        bool isValidHandle(const Handle& handle) const
+        {
+            // Check the handle is in range and is in use.
+            return handle < m_handle_entries.size() && m_handle_entries[handle].index != invalidIndex();
+        }
+
+        /*!
+         * Allocates a handle and stores a new object, if its bounding box intersects our boundary.
+         * @param bounding_box The object's normalised bounding box.
+         * @param object The object to store.
+         * @return the object's handle, or invalidHandle() if it was not stored.
+         */
+        Handle insertEntry(const QRectF& bounding_box, T&& object)
+        {
+            // Default to not inserted.
+            Handle handle(invalidHandle());
+
+            // Does our boundary intersect the bounding box?
+            if(intersectsBoundary(bounding_box))
+            {
+                // Re-use a free handle, or allocate a new one.
+                if(m_handles_free.empty() == false)
+                {
+                    handle = m_handles_free.back();
+                    m_handles_free.pop_back();
+                }
+                else
+                {
+                    handle = m_handle_entries.size();
+                    m_handle_entries.push_back(HandleEntry{ invalidIndex(), false });
+                }
+
+                // Store the object.
+                storeEntry(handle, bounding_box, std::move(object));
+            }
+
+            // Return the handle.
+            return handle;
+        }
+
+        /*!
+         * Stores an object against an allocated handle (points are added to the unsorted points).
+         * @param handle The object's handle.
+         * @param bounding_box The object's normalised bounding box.
+         * @param object The object to store.
+         */
+        void storeEntry(const Handle& handle, const QRectF& bounding_box, T&& object)
+        {
+            // Is it a point?
+            if(isPoint(bounding_box))
+            {
+                // Add the point to the unsorted points.
+                m_handle_entries[handle] = HandleEntry{ m_point_codes.size(), false };
+                m_point_codes.push_back(pointCode(bounding_box.left(), bounding_box.top()));
+                m_point_xs.push_back(bounding_box.left());
+                m_point_ys.push_back(bounding_box.top());
+                m_point_objects.push_back(std::move(object));
+                m_point_handles.push_back(handle);
+            }
+            else
+            {
+                // Add the object with an extent.
+                m_handle_entries[handle] = HandleEntry{ m_extent_objects.size(), true };
+                m_extent_lefts.push_back(bounding_box.left());
+                m_extent_tops.push_back(bounding_box.top());
+                m_extent_rights.push_back(bounding_box.right());
+                m_extent_bottoms.push_back(bounding_box.bottom());
+                m_extent_objects.push_back(std::move(object));
+                m_extent_handles.push_back(handle);
+            }
+        }
+
+        /*!
+         * Removes a handle's object from where it is stored (the handle remains allocated).
+         * @param handle The object's (valid) handle.
+         * @return the object.
+         */
+        T takeEntry(const Handle& handle)
+        {
+            // Fetch where the object is stored.
+            const HandleEntry handle_entry(m_handle_entries[handle]);
+
+            // Take the object.
+            T return_object = T();
+
+            // Is it a point?
+            if(handle_entry.extent == false)
+            {
+                // Take the object, and mark the point as erased (it is dropped by the next merge).
+                const size_t index(handle_entry.index);
+                return_object = std::move(m_point_objects[index]);
+                m_point_objects[index] = T();
+                m_point_xs[index] = std::numeric_limits<double>::quiet_NaN();
+                m_point_ys[index] = std::numeric_limits<double>::quiet_NaN();
+                m_point_handles[index] = invalidHandle();
+                ++m_points_erased;
+            }
+            else
+            {
+                // Take the object, and fill its slot with the last object with an extent.
+                const size_t index(handle_entry.index);
+                const size_t index_last(m_extent_objects.size() - 1);
+                return_object = std::move(m_extent_objects[index]);
+                if(index != index_last)
+                {
+                    m_extent_lefts[index] = m_extent_lefts[index_last];
+                    m_extent_tops[index] = m_extent_tops[index_last];
+                    m_extent_rights[index] = m_extent_rights[index_last];
+                    m_extent_bottoms[index] = m_extent_bottoms[index_last];
+                    m_extent_objects[index] = std::move(m_extent_objects[index_last]);
+                    m_extent_handles[index] = m_extent_handles[index_last];
+                    m_handle_entries[m_extent_handles[index]].index = index;
+                }
+                m_extent_lefts.pop_back();
+                m_extent_tops.pop_back();
+                m_extent_rights.pop_back();
+                m_extent_bottoms.pop_back();
+                m_extent_objects.pop_back();
+                m_extent_handles.pop_back();
+            }
+
+            // Return the object.
+            return return_object;
+        }
+
+        /*!
+         * Finds the handle of an object by its bounding box.
+         * @param bounding_box The object's normalised bounding box.
+         * @param object The object to find.
+         * @return the object's handle, or invalidHandle() if it was not found.
+         */
+        Handle findHandle(const QRectF& bounding_box, const T& object) const
+        {
+            // Is it a point?
+            if(isPoint(bounding_box))
+            {
+                // Search the sorted points with the same code.
+                const auto codes_end(m_point_codes.begin() + m_points_sorted);
+                const auto range(std::equal_range(m_point_codes.begin(), codes_end, pointCode(bounding_box.left(), bounding_box.top())));
+                for(auto itr_code = range.first; itr_code != range.second; ++itr_code)
+                {
+                    const size_t index(size_t(itr_code - m_point_codes.begin()));
+                    if(m_point_handles[index] != invalidHandle() && m_point_objects[index] == object)
+                    {
+                        return m_point_handles[index];
+                    }
+                }
+
+                // Search the unsorted points.
+                for(size_t index = m_points_sorted; index < m_point_codes.size(); ++index)
+                {
+                    if(m_point_handles[index] != invalidHandle() && m_point_objects[index] == object)
+                    {
+                        return m_point_handles[index];
+                    }
+                }
+            }
+            else
+            {
+                // Search the objects with an extent.
+                for(size_t index = 0; index < m_extent_objects.size(); ++index)
+                {
+                    if(m_extent_objects[index] == object)
+                    {
+                        return m_extent_handles[index];
+                    }
+                }
+            }
+
+            // Not found.
+            return invalidHandle();
+        }
+
+        /*!
+         * Shifts a sorted point to the position of its new code, if it is within shift_points_maximum positions.
+         * The points in between are shifted by one position to make room (and their handles updated).
+         * @param index The index of the sorted point.
+         * @param code The point's new Morton code.
+         * @return whether the point was shifted (its code is updated, but not its coordinates).
+         */
+        bool shiftPoint(const size_t& index, const std::uint64_t& code)
+        {
+            // Find the new position within the window of points either side.
+            const size_t index_window_begin(index > shift_points_maximum ? index - shift_points_maximum : 0);
+            const size_t index_window_end(std::min(index + 1 + shift_points_maximum, m_points_sorted));
+            size_t index_first(index);
+            size_t index_last(index);
+            if(code < m_point_codes[index])
+            {
+                // The new position is before the point (after any points with the same code).
+                index_first = size_t(std::upper_bound(m_point_codes.begin() + index_window_begin, m_point_codes.begin() + index, code) - m_point_codes.begin());
+
+                // Is the new position outside the window?
+                if(index_first == index_window_begin && index_window_begin > 0 && m_point_codes[index_window_begin - 1] > code)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                // The new position is after the point (before any points with the same code).
+                index_last = size_t(std::lower_bound(m_point_codes.begin() + index + 1, m_point_codes.begin() + index_window_end, code) - m_point_codes.begin()) - 1;
+
+                // Is the new position outside the window?
+                if(index_last + 1 == index_window_end && index_window_end < m_points_sorted && m_point_codes[index_window_end] < code)
+                {
+                    return false;
+                }
+            }
+
+            // Rotate the point to its new position (shifting the points in between by one).
+            const size_t rotate_begin(std::min(index_first, index));
+            const size_t rotate_middle(index_first < index ? index : index + 1);
+            const size_t rotate_end(index_last + 1);
+            std::rotate(m_point_codes.begin() + rotate_begin, m_point_codes.begin() + rotate_middle, m_point_codes.begin() + rotate_end);
+            std::rotate(m_point_xs.begin() + rotate_begin, m_point_xs.begin() + rotate_middle, m_point_xs.begin() + rotate_end);
+            std::rotate(m_point_ys.begin() + rotate_begin, m_point_ys.begin() + rotate_middle, m_point_ys.begin() + rotate_end);
+            std::rotate(m_point_objects.begin() + rotate_begin, m_point_objects.begin() + rotate_middle, m_point_objects.begin() + rotate_end);
+            std::rotate(m_point_handles.begin() + rotate_begin, m_point_handles.begin() + rotate_middle, m_point_handles.begin() + rotate_end);
+
+            // Update the point's code and the handles of the points that were shifted.
+            m_point_codes[index_first < index ? index_first : index_last] = code;
+            for(size_t index_shifted = index_first; index_shifted <= index_last; ++index_shifted)
+            {
+                if(m_point_handles[index_shifted] != invalidHandle())
+                {
+                    m_handle_entries[m_point_handles[index_shifted]].index = index_shifted;
+                }
+            }
+
+            // The point was shifted.
+            return true;
+        }
+
+        /*!
+         * Merges the unsorted points into the sorted points, if there are too many of them.
+         */
+        void mergePointsIfRequired()
+        {
+            // Are there too many unsorted points (each query tests all of them)?
+            const size_t points_unsorted(m_point_codes.size() - m_points_sorted);
+            if(points_unsorted > std::max(unsorted_points_minimum, m_points_sorted / 8))
+            {
+                // Merge the points.
+                mergePoints();
+            }
+        }
+
+        /*!
+         * Sorts the unsorted points and merges them into the sorted points, dropping any erased points.
+         * This is linear in the number of points (plus sorting the unsorted points).
+         */
+        void mergePoints()
+        {
+            // Fetch the order of the sorted points that have not been erased (these are already in code order).
+            std::vector<size_t> order;
+            order.reserve(m_point_codes.size() - m_points_erased);
+            for(size_t index = 0; index < m_points_sorted; ++index)
+            {
+                if(m_point_handles[index] != invalidHandle())
+                {
+                    order.push_back(index);
+                }
+            }
+            const size_t order_sorted(order.size());
+
+            // Add the unsorted points that have not been erased, and sort them by code.
+            for(size_t index = m_points_sorted; index < m_point_codes.size(); ++index)
+            {
+                if(m_point_handles[index] != invalidHandle())
+                {
+                    order.push_back(index);
+                }
+            }
+            const auto compare_code = [&](const size_t& a, const size_t& b) { return m_point_codes[a] < m_point_codes[b]; };
+            std::sort(order.begin() + order_sorted, order.end(), compare_code);
+
+            // Merge the two sorted runs.
+            std::inplace_merge(order.begin(), order.begin() + order_sorted, order.end(), compare_code);
+
+            // Gather the points in the merged order.
+            std::vector<std::uint64_t> codes;
+            std::vector<double> xs;
+            std::vector<double> ys;
+            std::vector<T> objects;
+            std::vector<Handle> handles;
+            codes.reserve(order.size());
+            xs.reserve(order.size());
+            ys.reserve(order.size());
+            objects.reserve(order.size());
+            handles.reserve(order.size());
+            for(const auto& index : order)
+            {
+                // Update the handle's index.
+                m_handle_entries[m_point_handles[index]].index = codes.size();
+
+                // Move the point.
+                codes.push_back(m_point_codes[index]);
+                xs.push_back(m_point_xs[index]);
+                ys.push_back(m_point_ys[index]);
+                objects.push_back(std::move(m_point_objects[index]));
+                handles.push_back(m_point_handles[index]);
+            }
+
+            // Store the merged points.
+            m_point_codes.swap(codes);
+            m_point_xs.swap(xs);
+            m_point_ys.swap(ys);
+            m_point_objects.swap(objects);
+            m_point_handles.swap(handles);
+            m_points_sorted = m_point_codes.size();
+            m_points_erased = 0;
+        }
+
+    private:
+        /// The bounding box area that this quad tree container covers in coordinates (normalised).
+        RectWorldCoord m_boundary_coord;
+
+        /// The number of quantised positions per coordinate along the x-axis.
+        double m_scale_x;
+
+        /// The number of quantised positions per coordinate along the y-axis.
+        double m_scale_y;
+
+        /// The Morton code of each point (the first m_points_sorted are in code order).
+        std::vector<std::uint64_t> m_point_codes;
+
+        /// The x coordinate of each point (NaN if erased).
+        std::vector<double> m_point_xs;
+
+        /// The y coordinate of each point (NaN if erased).
+        std::vector<double> m_point_ys;
+
+        /// The object of each point.
+        std::vector<T> m_point_objects;
+
+        /// The handle of each point (invalid if erased).
+        std::vector<Handle> m_point_handles;
+
+        /// The number of points that are sorted by code.
+        size_t m_points_sorted;
+
+        /// The number of points that have been erased (but not yet dropped).
+        size_t m_points_erased;
+
+        /// The left of each object with an extent.
+        std::vector<double> m_extent_lefts;
+
+        /// The top of each object with an extent.
+        std::vector<double> m_extent_tops;
+
+        /// The right of each object with an extent.
+        std::vector<double> m_extent_rights;
+
+        /// The bottom of each object with an extent.
+        std::vector<double> m_extent_bottoms;
+
+        /// The object of each object with an extent.
+        std::vector<T> m_extent_objects;
+
+        /// The handle of each object with an extent.
+        std::vector<Handle> m_extent_handles;
+
+        /// Where each handle's object is stored.
+        std::vector<HandleEntry> m_handle_entries;
+
+        /// The handles that are free to re-use.
+        std::vector<Handle> m_handles_free;
+    };
+
+    // Definitions of the static constants (required, as they are odr-used, ie: by std::max).
+    template <class T> const unsigned int LinearQuadTreeContainer<T>::code_bits;
+    template <class T> const size_t LinearQuadTreeContainer<T>::query_cells_maximum;
+    template <class T> const size_t LinearQuadTreeContainer<T>::cell_points_maximum;
+    template <class T> const size_t LinearQuadTreeContainer<T>::unsorted_points_minimum;
+    template <class T> const size_t LinearQuadTreeContainer<T>::shift_points_maximum;
+}
@@ -0,0 +1,196 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "MapRenderer.h"
+
+// Qt includes.
+#include <QtCore/QMutexLocker>
+
+namespace qmapcontrol
+{
+    MapRenderer::MapRenderer(const projection::EPSG& epsg)
+        : m_epsg(epsg),
+          m_layers(),
+          m_background_colour(Qt::transparent),
+          m_render_hints(0)
+    {
+
+    }
+
+    projection::EPSG MapRenderer::projection() const
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the projection type.
+        return m_epsg;
+    }
+
+    void MapRenderer::setProjection(const projection::EPSG& epsg)
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Set the projection type.
+        m_epsg = epsg;
+    }
+
+    std::vector<std::shared_ptr<Layer>> MapRenderer::layers() const
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the layers.
+        return m_layers;
+    }
+
+    void MapRenderer::setLayers(const std::vector<std::shared_ptr<Layer>>& layers)
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Set the layers.
+        m_layers = layers;
+    }
+
+    void MapRenderer::addLayer(const std::shared_ptr<Layer>& layer)
+    {
+        // Check the layer is valid.
+        if(layer != nullptr)
+        {
+            // Gain a lock to protect the settings.
+            QMutexLocker locker(&m_mutex);
+
+            // Add the layer on top of the others.
+            m_layers.push_back(layer);
+        }
+    }
+
+    QColor MapRenderer::backgroundColour() const
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the background colour.
+        return m_background_colour;
+    }
+
+    void MapRenderer::setBackgroundColour(const QColor& colour)
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Set the background colour.
+        m_background_colour = colour;
+    }
+
+    QPainter::RenderHints MapRenderer::renderHints() const
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the render hints.
+        return m_render_hints;
+    }
+
+    void MapRenderer::setRenderHints(const QPainter::RenderHints& hints)
+    {
+        // Gain a lock to protect the settings.
+        QMutexLocker locker(&m_mutex);
+
+        // Set the render hints.
+        m_render_hints = hints;
+    }
+
+    void MapRenderer::render(QImage& image, const RectWorldPx& rect_px, const int& controller_zoom) const
+    {
+        // Take a copy of the settings (so the lock is not held while the layers are drawn).
+        projection::EPSG epsg;
+        std::vector<std::shared_ptr<Layer>> layers;
+        QColor background_colour;
+        QPainter::RenderHints render_hints;
+
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the settings.
+            QMutexLocker locker(&m_mutex);
+
+            // Copy the settings.
+            epsg = m_epsg;
+            layers = m_layers;
+            background_colour = m_background_colour;
+            render_hints = m_render_hints;
+        }
+
+        // Check there is something to render into, and something to render.
+        const QRectF rect_normalised_px(rect_px.rawRect().normalized());
+        if(image.isNull() || rect_normalised_px.isEmpty())
+        {
+            return;
+        }
+
+        // Override the projection for this thread while the layers are drawn.
+        const projection::ThreadOverride projection_override(epsg);
+
+        // Fill the background.
+        image.fill(background_colour);
+
+        // Create a painter for the image.
+        QPainter painter(&image);
+        painter.setRenderHints(render_hints, true);
+
+        // Scale the rect to fill the image, and translate to the rect's top/left point.
+        painter.scale(image.width() / rect_normalised_px.width(), image.height() / rect_normalised_px.height());
+        painter.translate(-rect_normalised_px.topLeft());
+
+        // Draw each layer (bottom first), each with a fresh painter state.
+        const RectWorldPx render_rect_px(PointWorldPx(rect_normalised_px.left(), rect_normalised_px.top()), rect_normalised_px.size());
+        for(const auto& layer : layers)
+        {
+            // Check the layer is valid.
+            if(layer != nullptr)
+            {
+                // Prepare the layer for the whole rect (which is drawn as a single tile).
+                layer->prepareDraw(render_rect_px, controller_zoom);
+
+                // Draw the layer.
+                painter.save();
+                layer->draw(painter, render_rect_px, controller_zoom);
+                painter.restore();
+            }
+        }
+    }
+
+    void MapRenderer::render(QImage& image, const PointWorldCoord& centre_coord, const int& controller_zoom) const
+    {
+        // Calculate the centre in world pixels, with the renderer's projection.
+        PointWorldPx centre_px;
+        {
+            // Override the projection for this thread while converting.
+            const projection::ThreadOverride projection_override(projection());
+            centre_px = projection::get().toPointWorldPx(centre_coord, controller_zoom);
+        }
+
+        // Render the rect the size of the image around the centre.
+        render(image, RectWorldPx(PointWorldPx(centre_px.x() - image.width() / 2.0, centre_px.y() - image.height() / 2.0), QSizeF(image.size())), controller_zoom);
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QMutex>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+
+// STL includes.
+#include <memory>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Layer.h"
+#include "Point.h"
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    //! Renders layers into an image, without a QMapControl widget.
+    /*!
+     * This is intended for generating static maps and thumbnails (ie: in batch jobs or on a server), where creating a
+     * widget is too slow or there is no display. The layers are drawn in the calling thread, with the renderer's
+     * projection overriding the singleton instance for that thread only, so several renderers (with different
+     * projections) can render concurrently, and alongside any widget that shares the layers.
+     *
+     * Map adapter layers draw the tiles already in the image manager's cache (any others are requested as usual), and
+     * geometry widgets are not drawn.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT MapRenderer
+    {
+    public:
+        //! Constructor.
+        /*!
+         * Map Renderer constructor.
+         * @param epsg The projection to render with.
+         */
+        explicit MapRenderer(const projection::EPSG& epsg = projection::EPSG::SphericalMercator);
+
+        //! Disable copy constructor.
+        ///MapRenderer(const MapRenderer&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///MapRenderer& operator=(const MapRenderer&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~MapRenderer() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Fetches the projection the layers are rendered with.
+         * @return the projection type.
+         */
+        projection::EPSG projection() const;
+
+        /*!
+         * Sets the projection to render the layers with.
+         * @param epsg The projection type.
+         */
+        void setProjection(const projection::EPSG& epsg);
+
+        /*!
+         * Fetches the layers that are rendered.
+         * @return the layers (bottom first).
+         */
+        std::vector<std::shared_ptr<Layer>> layers() const;
+
+        /*!
+         * Sets the layers to render.
+         * @param layers The layers (bottom first).
+         */
+        void setLayers(const std::vector<std::shared_ptr<Layer>>& layers);
+
+        /*!
+         * Adds a layer to render (on top of the others).
+         * @param layer The layer to add.
+         */
+        void addLayer(const std::shared_ptr<Layer>& layer);
+
+        /*!
+         * Fetches the colour the image is filled with before the layers are rendered.
+         * @return the background colour.
+         */
+        QColor backgroundColour() const;
+
+        /*!
+         * Sets the colour to fill the image with before the layers are rendered (transparent by default).
+         * @param colour The background colour.
+         */
+        void setBackgroundColour(const QColor& colour);
+
+        /*!
+         * Fetches the render hints the layers are rendered with.
+         * @return the render hints.
+         */
+        QPainter::RenderHints renderHints() const;
+
+        /*!
+         * Sets the render hints to render the layers with (none by default, as the widget draws its layers).
+         * @param hints The render hints.
+         */
+        void setRenderHints(const QPainter::RenderHints& hints);
+
+        /*!
+         * Renders the layers within a world pixel rect into an image, scaling the rect to fill the image.
+         * This may be called from any thread.
+         * @param image The image to render into (ARGB32 premultiplied is the fastest to render into).
+         * @param rect_px The world pixel rect to render.
+         * @param controller_zoom The zoom to render at.
+         */
+        void render(QImage& image, const RectWorldPx& rect_px, const int& controller_zoom) const;
+
+        /*!
+         * Renders the layers into an image (at one world pixel per image pixel), centred on a coordinate.
+         * This may be called from any thread.
+         * @param image The image to render into (ARGB32 premultiplied is the fastest to render into).
+         * @param centre_coord The world coordinate to centre the image on.
+         * @param controller_zoom The zoom to render at.
+         */
+        void render(QImage& image, const PointWorldCoord& centre_coord, const int& controller_zoom) const;
+
+    private:
+        //! Disable copy constructor.
+        MapRenderer(const MapRenderer&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        MapRenderer& operator=(const MapRenderer&); /// @todo remove once MSVC supports default/delete syntax.
+
+    private:
+        /// The projection to render with.
+        projection::EPSG m_epsg;
+
+        /// The layers to render (bottom first).
+        std::vector<std::shared_ptr<Layer>> m_layers;
+
+        /// The colour to fill the image with before the layers are rendered.
+        QColor m_background_colour;
+
+        /// The render hints to render the layers with.
+        QPainter::RenderHints m_render_hints;
+
+        /// Mutex to protect the renderer's settings (so it can be configured while another thread renders).
+        mutable QMutex m_mutex;
+    };
+}
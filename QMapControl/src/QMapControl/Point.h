@@ -61,6 +61,7 @@ namespace qmapcontrol
     class QMAPCONTROL_EXPORT RectWorldCoord
     {
     public:
+        RectWorldCoord() : m_raw_rect() { }
         RectWorldCoord(const PointWorldCoord& top_left, const PointWorldCoord& bottom_right) : m_raw_rect(top_left.rawPoint(), bottom_right.rawPoint()) { } /// = default; @todo re-add once MSVC supports default/delete syntax.
         RectWorldCoord(const PointWorldCoord& top_left, const QSizeF& size) : m_raw_rect(top_left.rawPoint(), size) { } /// = default; @todo re-add once MSVC supports default/delete syntax.
         inline QRectF rawRect() const { return m_raw_rect; }
@@ -38,10 +38,40 @@ namespace qmapcontrol
     {
         /// Singleton instance of Projection Interface.
         std::unique_ptr<Projection> m_instance = nullptr;
+
+        /// The current thread's override of the singleton instance (null if there is none).
+        thread_local Projection* t_override = nullptr;
+
+        /*!
+         * Creates an instance of a projection type.
+         * @param type The projection type required.
+         * @return the new instance.
+         */
+        Projection* create(const projection::EPSG& type)
+        {
+            // Equirectangular ?
+            if(type == projection::EPSG::Equirectangular)
+            {
+                // Create a Equirectangular instance.
+                return new ProjectionEquirectangular;
+            }
+            else
+            {
+                // Default to a Spherical Mercator instance.
+                return new ProjectionSphericalMercator;
+            }
+        }
     }
 
     Projection& projection::get()
     {
+        // Has the current thread overridden the projection?
+        if(t_override != nullptr)
+        {
+            // Return the reference to the override.
+            return *t_override;
+        }
+
         // Does the singleton instance exist?
         if(m_instance == nullptr)
         {
@@ -55,16 +85,21 @@ namespace qmapcontrol
 
     void projection::set(const EPSG& type)
     {
-        // Equirectangular ?
-        if(type == EPSG::Equirectangular)
-        {
-            // Create a Equirectangular instance.
-            m_instance.reset(new ProjectionEquirectangular);
-        }
-        else
-        {
-            // Default to a Spherical Mercator instance.
-            m_instance.reset(new ProjectionSphericalMercator);
-        }
+        // Create the instance of the projection type.
+        m_instance.reset(create(type));
+    }
+
+    projection::ThreadOverride::ThreadOverride(const EPSG& type)
+        : m_projection(create(type)),
+          m_previous_projection(t_override)
+    {
+        // Override the projection for the current thread.
+        t_override = m_projection.get();
+    }
+
+    projection::ThreadOverride::~ThreadOverride()
+    {
+        // Restore the current thread's previous projection.
+        t_override = m_previous_projection;
     }
 }
@@ -28,6 +28,9 @@
 // Qt includes.
 #include <QtCore/QPoint>
 
+// STL includes.
+#include <memory>
+
 // Local includes.
 #include "qmapcontrol_global.h"
 #include "Point.h"
@@ -112,7 +115,7 @@ namespace qmapcontrol
         };
 
         /*!
-         * Get the singleton instance of the Projection.
+         * Get the singleton instance of the Projection (or the current thread's override, if one is set).
          * @return the singleton instance.
          */
         QMAPCONTROL_EXPORT Projection& get();
@@ -122,5 +125,49 @@ namespace qmapcontrol
          * @param type The projection type required.
          */
         QMAPCONTROL_EXPORT void set(const EPSG& type);
+
+        //! Overrides the projection for the current thread only, for the lifetime of the override.
+        /*!
+         * This allows a thread (ie: a MapRenderer) to draw layers with a different projection to the singleton instance,
+         * without affecting the widget or any other thread. Overrides can be nested (the previous override is restored).
+         *
+         * @author Chris Stylianou <chris5287@gmail.com>
+         */
+        class QMAPCONTROL_EXPORT ThreadOverride
+        {
+        public:
+            //! Constructor.
+            /*!
+             * Overrides the projection for the current thread.
+             * @param type The projection type required.
+             */
+            explicit ThreadOverride(const EPSG& type);
+
+            //! Disable copy constructor.
+            ///ThreadOverride(const ThreadOverride&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+            //! Disable copy assignment.
+            ///ThreadOverride& operator=(const ThreadOverride&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+            //! Destructor.
+            /*!
+             * Restores the current thread's previous projection.
+             */
+            ~ThreadOverride();
+
+        private:
+            //! Disable copy constructor.
+            ThreadOverride(const ThreadOverride&); /// @todo remove once MSVC supports default/delete syntax.
+
+            //! Disable copy assignment.
+            ThreadOverride& operator=(const ThreadOverride&); /// @todo remove once MSVC supports default/delete syntax.
+
+        private:
+            /// The projection the current thread uses while overridden.
+            std::unique_ptr<Projection> m_projection;
+
+            /// The current thread's previous override (null if there was none).
+            Projection* m_previous_projection;
+        };
     }
 }
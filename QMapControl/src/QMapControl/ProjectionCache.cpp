@@ -0,0 +1,323 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ProjectionCache.h"
+
+// Qt includes.
+#include <QtCore/QMutexLocker>
+
+// STL includes.
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Local includes.
+#include "ImageManager.h"
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The number of zooms to keep the projected points at (the current zoom, and those zoomed from and drawn ahead).
+        const std::size_t zoom_points_maximum(4);
+
+        /*!
+         * Calculates the dot product of two vectors (QPointF::dotProduct() requires Qt 5.1).
+         * @param a The first vector.
+         * @param b The second vector.
+         * @return the dot product.
+         */
+        inline qreal dotProduct(const QPointF& a, const QPointF& b)
+        {
+            return (a.x() * b.x()) + (a.y() * b.y());
+        }
+
+        /*!
+         * Calculates the squared distance from a point to a line segment.
+         * @param point_px The point to measure from.
+         * @param start_px The start of the line segment.
+         * @param end_px The end of the line segment.
+         * @return the squared distance (pixels).
+         */
+        qreal distanceToSegmentSquared(const QPointF& point_px, const QPointF& start_px, const QPointF& end_px)
+        {
+            // Default to the distance from the start point (for a zero length segment, ie: a closed ring).
+            QPointF nearest_px(start_px);
+
+            // Project the point onto the segment, clamped to its ends.
+            const QPointF segment_px(end_px - start_px);
+            const qreal segment_length_squared(dotProduct(segment_px, segment_px));
+            if(segment_length_squared > 0.0)
+            {
+                const qreal t(std::max(qreal(0.0), std::min(qreal(1.0), dotProduct(point_px - start_px, segment_px) / segment_length_squared)));
+                nearest_px = start_px + (segment_px * t);
+            }
+
+            // Return the squared distance to the nearest point on the segment.
+            const QPointF delta_px(point_px - nearest_px);
+            return dotProduct(delta_px, delta_px);
+        }
+    }
+
+    QPolygonF ProjectionCache::simplifyPx(const QPolygonF& points_px, const qreal& tolerance_px)
+    {
+        // Is there anything to simplify?
+        if(tolerance_px <= 0.0 || points_px.size() < 3)
+        {
+            // Nothing to do.
+            return points_px;
+        }
+
+        const qreal tolerance_squared(tolerance_px * tolerance_px);
+
+        // First drop the runs of points that fall within the tolerance of the previous kept point (cheap, and at low zooms removes most of them).
+        QPolygonF radial_px;
+        radial_px.reserve(points_px.size());
+        radial_px.append(points_px.front());
+        for(int i = 1; i < points_px.size() - 1; ++i)
+        {
+            // Is the point far enough from the last kept point?
+            const QPointF delta_px(points_px.at(i) - radial_px.back());
+            if(dotProduct(delta_px, delta_px) > tolerance_squared)
+            {
+                // Keep the point.
+                radial_px.append(points_px.at(i));
+            }
+        }
+        radial_px.append(points_px.back());
+
+        // Douglas-Peucker: keep the point furthest from each segment while it is outside the tolerance (iteratively, as recursion could overflow the stack).
+        std::vector<char> keep(std::size_t(radial_px.size()), 0);
+        keep.front() = 1;
+        keep.back() = 1;
+        std::vector<std::pair<int, int>> segments;
+        segments.emplace_back(0, radial_px.size() - 1);
+        while(segments.empty() == false)
+        {
+            // Take the next segment to check.
+            const std::pair<int, int> segment(segments.back());
+            segments.pop_back();
+
+            // Find the point furthest from the segment.
+            qreal furthest_distance_squared(0.0);
+            int furthest_index(-1);
+            for(int i = segment.first + 1; i < segment.second; ++i)
+            {
+                const qreal distance_squared(distanceToSegmentSquared(radial_px.at(i), radial_px.at(segment.first), radial_px.at(segment.second)));
+                if(distance_squared > furthest_distance_squared)
+                {
+                    furthest_distance_squared = distance_squared;
+                    furthest_index = i;
+                }
+            }
+
+            // Is it outside the tolerance?
+            if(furthest_index != -1 && furthest_distance_squared > tolerance_squared)
+            {
+                // Keep the point, and check either side of it.
+                keep[std::size_t(furthest_index)] = 1;
+                segments.emplace_back(segment.first, furthest_index);
+                segments.emplace_back(furthest_index, segment.second);
+            }
+        }
+
+        // Collect the kept points.
+        QPolygonF simplified_px;
+        for(int i = 0; i < radial_px.size(); ++i)
+        {
+            if(keep[std::size_t(i)] != 0)
+            {
+                simplified_px.append(radial_px.at(i));
+            }
+        }
+
+        // Return the simplified points.
+        return simplified_px;
+    }
+
+    ProjectionCache::ProjectionCache(const qreal& simplify_tolerance_px)
+        : m_simplify_tolerance_px(simplify_tolerance_px),
+          m_bounding_box_valid(false),
+          m_base_epsg(-1),
+          m_base_tile_size_px(0)
+    {
+
+    }
+
+    void ProjectionCache::invalidate()
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Mark the bounding box and projected points as invalid.
+        m_bounding_box_valid = false;
+        m_base_epsg = -1;
+
+        // Release the projected points.
+        m_base_points_px.clear();
+        m_zoom_points_px.clear();
+    }
+
+    qreal ProjectionCache::simplifyTolerancePx() const
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the tolerance.
+        return m_simplify_tolerance_px;
+    }
+
+    void ProjectionCache::setSimplifyTolerancePx(const qreal& simplify_tolerance_px)
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Has the tolerance changed?
+        if(m_simplify_tolerance_px != simplify_tolerance_px)
+        {
+            // Set the new tolerance.
+            m_simplify_tolerance_px = simplify_tolerance_px;
+
+            // The points at each zoom are no longer valid.
+            m_zoom_points_px.clear();
+        }
+    }
+
+    RectWorldCoord ProjectionCache::boundingBox(const std::vector<PointWorldCoord>& points)
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Ensure the bounding box is up-to-date.
+        updateBoundingBox(points);
+
+        // Return the bounding box.
+        return RectWorldCoord::fromQRectF(m_bounding_box_coord);
+    }
+
+    bool ProjectionCache::intersects(const std::vector<PointWorldCoord>& points, const RectWorldCoord& rect_coord)
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Ensure the bounding box is up-to-date.
+        updateBoundingBox(points);
+
+        // Normalise the rect to check against (world coordinate rects generally have a negative height).
+        const QRectF rect(rect_coord.rawRect().normalized());
+
+        // Inclusive check, as QRectF::intersects() ignores rects with no width/height.
+        return points.empty() == false &&
+                m_bounding_box_coord.left() <= rect.right() && rect.left() <= m_bounding_box_coord.right() &&
+                m_bounding_box_coord.top() <= rect.bottom() && rect.top() <= m_bounding_box_coord.bottom();
+    }
+
+    QPolygonF ProjectionCache::toPolygonPx(const std::vector<PointWorldCoord>& points, const int& controller_zoom)
+    {
+        // Gain a lock to protect the cached values.
+        QMutexLocker locker(&m_mutex);
+
+        // Has the projection (or tile size) changed since the zoom 0 points were projected?
+        const int epsg(projection::get().epsg());
+        const int tile_size_px(ImageManager::get().tileSizePx());
+        if(m_base_epsg != epsg || m_base_tile_size_px != tile_size_px)
+        {
+            // Project the points at zoom 0.
+            m_base_points_px.clear();
+            m_base_points_px.reserve(int(points.size()));
+            for(const auto& point : points)
+            {
+                // Add the projected point.
+                m_base_points_px.append(projection::get().toPointWorldPx(point, 0).rawPoint());
+            }
+
+            // Store what the points were projected with.
+            m_base_epsg = epsg;
+            m_base_tile_size_px = tile_size_px;
+
+            // The points at each zoom are no longer valid.
+            m_zoom_points_px.clear();
+        }
+
+        // Have the points been scaled to this zoom recently?
+        auto itr_find = std::find_if(m_zoom_points_px.begin(), m_zoom_points_px.end(), [&controller_zoom](const std::pair<int, QPolygonF>& zoom_points_px) { return zoom_points_px.first == controller_zoom; });
+        if(itr_find == m_zoom_points_px.end())
+        {
+            // Scale the zoom 0 points (pixels double with each zoom level).
+            const qreal scale(std::ldexp(qreal(1.0), controller_zoom));
+            QPolygonF zoom_points_px(m_base_points_px);
+            for(auto& point_px : zoom_points_px)
+            {
+                // Scale the point.
+                point_px *= scale;
+            }
+
+            // Simplify the points to what is visible at this zoom, and add them (evicting the least recently used zoom).
+            if(m_zoom_points_px.size() >= zoom_points_maximum)
+            {
+                m_zoom_points_px.pop_back();
+            }
+            itr_find = m_zoom_points_px.emplace(m_zoom_points_px.end(), controller_zoom, simplifyPx(zoom_points_px, m_simplify_tolerance_px));
+        }
+
+        // Mark the zoom as the most recently used.
+        std::rotate(m_zoom_points_px.begin(), itr_find, itr_find + 1);
+
+        // Return the projected points (implicitly shared, so no copy takes place).
+        return m_zoom_points_px.front().second;
+    }
+
+    void ProjectionCache::updateBoundingBox(const std::vector<PointWorldCoord>& points)
+    {
+        // Is the cached bounding box invalid?
+        if(m_bounding_box_valid == false)
+        {
+            // Default to an empty bounding box.
+            m_bounding_box_coord = QRectF();
+
+            // Do we have any points?
+            if(points.empty() == false)
+            {
+                // Find the minimum/maximum of the points.
+                qreal left(points.front().longitude());
+                qreal right(left);
+                qreal top(points.front().latitude());
+                qreal bottom(top);
+                for(const auto& point : points)
+                {
+                    // Expand to include the point.
+                    left = std::min(left, point.longitude());
+                    right = std::max(right, point.longitude());
+                    top = std::min(top, point.latitude());
+                    bottom = std::max(bottom, point.latitude());
+                }
+
+                // Store the bounding box.
+                m_bounding_box_coord = QRectF(QPointF(left, top), QPointF(right, bottom));
+            }
+
+            // The bounding box is now valid.
+            m_bounding_box_valid = true;
+        }
+    }
+}
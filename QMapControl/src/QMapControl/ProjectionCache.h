@@ -0,0 +1,163 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QMutex>
+#include <QtCore/QRectF>
+#include <QtGui/QPolygonF>
+
+// STL includes.
+#include <utility>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Point.h"
+
+namespace qmapcontrol
+{
+    //! Caches a list of points projected into world pixels.
+    /*!
+     * Both supported projections scale linearly with 2^zoom, so the points are projected once
+     * at zoom 0 and then scaled (without any trigonometry) to the requested zoom. The points at
+     * the last few requested zooms are kept, so panning at a fixed zoom re-uses the same array,
+     * and zooming back and forth (or drawing the previous zoom's tiles) does not scale them again.
+     *
+     * The points at the requested zoom are simplified (Douglas-Peucker) to a pixel tolerance, so
+     * at low zooms a long line collapses to the handful of vertices that are actually visible.
+     *
+     * The cache does not own the points; the owner must call invalidate() whenever they change.
+     * A change of projection or tile size is detected automatically.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT ProjectionCache
+    {
+    public:
+        //! Constructor.
+        /*!
+         * @param simplify_tolerance_px The tolerance to simplify the projected points to (pixels, 0 to disable).
+         */
+        explicit ProjectionCache(const qreal& simplify_tolerance_px = 0.5);
+
+        //! Disable copy constructor.
+        ///ProjectionCache(const ProjectionCache&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///ProjectionCache& operator=(const ProjectionCache&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~ProjectionCache() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+    private:
+        //! Disable copy constructor.
+        ProjectionCache(const ProjectionCache&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ProjectionCache& operator=(const ProjectionCache&); /// @todo remove once MSVC supports default/delete syntax.
+
+    public:
+        /*!
+         * Simplifies a list of points (Douglas-Peucker), so that no removed point is further than the tolerance from the result.
+         * @param points_px The points to simplify (pixels).
+         * @param tolerance_px The maximum distance a removed point can be from the simplified line (pixels).
+         * @return the simplified points, which always include the first and last points.
+         */
+        static QPolygonF simplifyPx(const QPolygonF& points_px, const qreal& tolerance_px);
+
+    public:
+        /*!
+         * Discards all cached values (call whenever the points change).
+         */
+        void invalidate();
+
+        /*!
+         * Fetches the tolerance the projected points are simplified to.
+         * @return the tolerance (pixels, 0 if disabled).
+         */
+        qreal simplifyTolerancePx() const;
+
+        /*!
+         * Sets the tolerance to simplify the projected points to.
+         * @param simplify_tolerance_px The tolerance (pixels, 0 to disable).
+         */
+        void setSimplifyTolerancePx(const qreal& simplify_tolerance_px);
+
+        /*!
+         * Fetches the bounding box of the points (world coordinates).
+         * @param points The points that are cached.
+         * @return the bounding box.
+         */
+        RectWorldCoord boundingBox(const std::vector<PointWorldCoord>& points);
+
+        /*!
+         * Checks whether the bounding box of the points intersects with a rect (inclusive, so
+         * horizontal/vertical lines and single points are still considered).
+         * @param points The points that are cached.
+         * @param rect_coord The rect to check against (world coordinates).
+         * @return whether the bounding box intersects with the rect.
+         */
+        bool intersects(const std::vector<PointWorldCoord>& points, const RectWorldCoord& rect_coord);
+
+        /*!
+         * Fetches the points projected into world pixels, simplified to the tolerance.
+         * @param points The points that are cached.
+         * @param controller_zoom The zoom to project the points at.
+         * @return the projected (and simplified) points (pixels).
+         */
+        QPolygonF toPolygonPx(const std::vector<PointWorldCoord>& points, const int& controller_zoom);
+
+    private:
+        /*!
+         * Updates the cached bounding box, if required (the mutex must be held).
+         * @param points The points that are cached.
+         */
+        void updateBoundingBox(const std::vector<PointWorldCoord>& points);
+
+    private:
+        /// Mutex to protect the cached values (geometries may be drawn from several threads).
+        mutable QMutex m_mutex;
+
+        /// The tolerance to simplify the projected points to (pixels, 0 if disabled).
+        qreal m_simplify_tolerance_px;
+
+        /// Whether the cached bounding box is valid.
+        bool m_bounding_box_valid;
+
+        /// The cached bounding box (world coordinates, normalised).
+        QRectF m_bounding_box_coord;
+
+        /// The EPSG of the projection the zoom 0 points were projected with (-1 if invalid).
+        int m_base_epsg;
+
+        /// The tile size the zoom 0 points were projected with.
+        int m_base_tile_size_px;
+
+        /// The points projected at zoom 0 (pixels).
+        QPolygonF m_base_points_px;
+
+        /// The points projected (and simplified) at the last few requested zooms, keyed by zoom and most recently used first (pixels).
+        std::vector<std::pair<int, QPolygonF>> m_zoom_points_px;
+    };
+}
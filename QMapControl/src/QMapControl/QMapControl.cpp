@@ -26,12 +26,16 @@
 #include "QMapControl.h"
 
 // Qt includes.
-#include <QtConcurrent/QtConcurrentRun>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtGui/QRegion>
 #include <QtWidgets/QStyleOption>
 
 // STL includes.
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <utility>
+#include <vector>
 
 // Local includes.
 #include "GeometryLineString.h"
@@ -45,6 +49,34 @@
 
 namespace qmapcontrol
 {
+    namespace
+    {
+        /*!
+         * Scrolls an image's pixels in place (the pixels scrolled in keep their previous values).
+         * @param image The image to scroll (32-bit pixels).
+         * @param scroll_px The distance to move the pixels in pixels.
+         */
+        void scrollImage(QImage& image, const QPoint& scroll_px)
+        {
+            // Calculate the part of the image that is kept.
+            const QRect source_rect_px(image.rect() & image.rect().translated(-scroll_px));
+            if(source_rect_px.isEmpty() == false)
+            {
+                // Fetch the image's pixels (once, as fetching them can detach the image).
+                uchar* bits(image.bits());
+                const int bytes_per_line(image.bytesPerLine());
+                const size_t row_bytes(size_t(source_rect_px.width()) * 4);
+
+                // Move each row (bottom first when scrolling down, so rows are not overwritten before they are moved).
+                for(int i = 0; i < source_rect_px.height(); ++i)
+                {
+                    const int row(scroll_px.y() > 0 ? source_rect_px.bottom() - i : source_rect_px.top() + i);
+                    std::memmove(bits + (row + scroll_px.y()) * bytes_per_line + (source_rect_px.left() + scroll_px.x()) * 4, bits + row * bytes_per_line + source_rect_px.left() * 4, row_bytes);
+                }
+            }
+        }
+    }
+
     QMapControl::QMapControl(QWidget* parent, Qt::WindowFlags window_flags)
         : QMapControl(parent->size(), parent, window_flags)
     {
@@ -74,7 +106,7 @@ namespace qmapcontrol
           m_mouse_right_origin_center(false),
           m_mouse_position_pressed_px(0.0, 0.0),
           m_mouse_position_current_px(0.0, 0.0),
-          m_primary_screen(size_px.toSize() * 2),
+          m_primary_screen(size_px.toSize() * 2, QImage::Format_ARGB32_Premultiplied),
           m_primary_screen_map_focus_point_px(0.0, 0.0),
           m_primary_screen_backbuffer_rect_px(PointWorldPx(0.0, 0.0), PointWorldPx(0.0, 0.0)),
           m_primary_screen_scaled_enabled(false),
@@ -84,9 +116,26 @@ namespace qmapcontrol
           m_zoom_control_button_in("+", this),
           m_zoom_control_slider(Qt::Vertical, this),
           m_zoom_control_button_out("-", this),
+          m_primary_screen_pending_backbuffer_rect_px(PointWorldPx(0.0, 0.0), PointWorldPx(0.0, 0.0)),
+          m_primary_screen_pending_map_focus_point_px(0.0, 0.0),
+          m_primary_screen_pending_ready(false),
+          m_render_stop(false),
+          m_render_requested_generation(0),
+          m_render_started_generation(0),
+          m_render_requested_zoom(0),
+          m_render_requested_viewport_size_px(size_px),
+          m_render_requested_map_focus_px(0.0, 0.0),
+          m_render_in_flight_zoom(-1),
+          m_render_in_flight_viewport_size_px(),
+          m_render_superseded(false),
+          m_render_frame_rate(60),
+          m_render_tile_size_px(512),
+          m_backbuffer_overscan(0.5),
+          m_layer_surfaces_all_dirty(true),
           m_progress_indicator(this)
     {
         // Register meta types.
+        qRegisterMetaType<RectWorldCoord>("RectWorldCoord");
         qRegisterMetaType<RectWorldPx>("RectWorldPx");
         qRegisterMetaType<PointWorldPx>("PointWorldPx");
 
@@ -97,6 +146,10 @@ namespace qmapcontrol
         // Connect signal/slot for when the backbuffer is updated, so that primary screen is updated in the main thread.
         QObject::connect(this, &QMapControl::updatedBackBuffer, this, &QMapControl::updatePrimaryScreen);
 
+        // Start the render thread (it waits until a redraw is requested).
+        m_render_frame_timer.start();
+        m_render_thread = std::thread(&QMapControl::renderLoop, this);
+
         // Connect signals from the Image Manager.
         QObject::connect(&ImageManager::get(), &ImageManager::imageUpdated, this, &QMapControl::requestRedraw);
         QObject::connect(&ImageManager::get(), &ImageManager::downloadingFinished, this, &QMapControl::loadingFinished);
@@ -125,6 +178,20 @@ namespace qmapcontrol
 
     QMapControl::~QMapControl()
     {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the render thread's requests.
+            QMutexLocker locker(&m_render_mutex);
+
+            // Stop the render thread (any in-flight redraw is abandoned).
+            m_render_stop = true;
+            m_render_superseded = true;
+            m_render_condition.wakeAll();
+        }
+
+        // Wait for the render thread to finish.
+        m_render_thread.join();
+
         // Destroy the image manager instance.
         ImageManager::destory();
     }
@@ -174,6 +241,30 @@ namespace qmapcontrol
         m_primary_screen_scaled_enabled = visible;
     }
 
+    void QMapControl::setRenderTileSizePx(const int& tile_size_px)
+    {
+        // Set the render tile size (used from the next redraw).
+        m_render_tile_size_px = std::max(tile_size_px, 0);
+    }
+
+    void QMapControl::setMaximumFrameRate(const int& frames_per_second)
+    {
+        // Gain a lock to protect the render thread's requests.
+        QMutexLocker locker(&m_render_mutex);
+
+        // Set the maximum frame rate (used from the next redraw).
+        m_render_frame_rate = std::max(frames_per_second, 0);
+    }
+
+    void QMapControl::setBackbufferOverscan(const qreal& overscan)
+    {
+        // Set the backbuffer overscan.
+        m_backbuffer_overscan = std::max(overscan, qreal(0.0));
+
+        // Force the primary screen to be redrawn.
+        redrawPrimaryScreen(true);
+    }
+
     void QMapControl::enableScalebar(const bool& visible)
     {
         // Set whether the scalebar should be visible.
@@ -228,6 +319,10 @@ namespace qmapcontrol
 
             // Connect signals as required.
             QObject::connect(layer.get(), &Layer::requestRedraw, this, &QMapControl::requestRedraw);
+            QObject::connect(layer.get(), &Layer::requestRedrawDamaged, this, &QMapControl::requestRedrawDamaged);
+
+            // Ensure the layer is drawn (in case a removed layer's surface is still held at the same address).
+            markLayerDirty(layer.get());
 
             // Is it a geometry layer?
             if(layer->getLayerType() == Layer::LayerType::LayerGeometry)
@@ -358,8 +453,8 @@ namespace qmapcontrol
         // Calculate the middle point of the viewport (visible-part of the layer) in pixels.
         m_viewport_center_px = PointViewportPx(m_viewport_size_px.width() / 2.0, m_viewport_size_px.height() / 2.0);
 
-        // Create new pixmaps with the new size required (2 x viewport size to allow for panning backbuffer).
-        m_primary_screen = QPixmap(m_viewport_size_px.toSize() * 2);
+        // Create new pixmaps with the new size required (the backbuffer size to allow for panning backbuffer).
+        m_primary_screen = QImage(backbufferSizePx(m_viewport_size_px), QImage::Format_ARGB32_Premultiplied);
         m_primary_screen.fill(Qt::transparent);
         m_primary_screen_scaled = QPixmap(m_viewport_size_px.toSize() * 2);
         m_primary_screen_scaled.fill(Qt::transparent);
@@ -757,14 +852,20 @@ namespace qmapcontrol
             // Collection of selected geometries.
             std::map<std::string, std::vector<std::shared_ptr<Geometry>>> selected_geometries;
 
+            // Buffer of geometries to check (reused for each layer).
+            std::vector<std::shared_ptr<Geometry>> geometries;
+
             // Loop through each layer to check geometries touches.
             for(const auto& layer : getLayers())
             {
                 // Is it a geometry layer and is it visible?
                 if(layer->getLayerType() == Layer::LayerType::LayerGeometry && layer->isVisible(m_current_zoom))
                 {
+                    // Fetch the geometries for the layer within the area.
+                    std::static_pointer_cast<LayerGeometry>(layer)->getGeometries(geometries, RectWorldCoord(top_left_coord, bottom_right_coord), m_current_zoom);
+
                     // Loop through each geometry for the layer.
-                    for(const auto& geometry : std::static_pointer_cast<LayerGeometry>(layer)->getGeometries(RectWorldCoord(top_left_coord, bottom_right_coord)))
+                    for(const auto& geometry : geometries)
                     {
                         // Does the geometry touch our area rect?
 //                        if(geometry->touches(*(area_px.get()), m_current_zoom))
@@ -946,8 +1047,8 @@ namespace qmapcontrol
     QPixmap QMapControl::getPrimaryScreen() const
     {
         // Return the primary screen (ie: what is currently being displayed).
-        // Note: m_viewport_center_px is the same as (m_viewport_size_px / 2)
-        return m_primary_screen.copy(QRect((m_viewport_center_px + mapFocusPointWorldPx() - m_primary_screen_map_focus_point_px).rawPoint().toPoint(), m_viewport_size_px.toSize()));
+        // Note: the viewport's top-left is (map focus point - m_viewport_center_px).
+        return QPixmap::fromImage(m_primary_screen.copy(QRect(((mapFocusPointWorldPx() - m_viewport_center_px) - m_primary_screen_backbuffer_rect_px.topLeftPx()).rawPoint().toPoint(), m_viewport_size_px.toSize())));
     }
 
 
@@ -1009,7 +1110,10 @@ namespace qmapcontrol
                 new_primary_screen_scaled.fill(Qt::transparent);
                 QPainter painter(&new_primary_screen_scaled);
                 painter.scale(0.5, 0.5);
-                painter.drawPixmap(PointWorldPx(m_viewport_size_px.width(), m_viewport_size_px.height()).rawPoint(), m_primary_screen);
+
+                // Place the primary screen so the viewport is at 1.5 x viewport size (the centre of the scaled screen).
+                const PointPx primary_screen_viewport_px((mapFocusPointWorldPx() - m_viewport_center_px) - m_primary_screen_backbuffer_rect_px.topLeftPx());
+                painter.drawImage(QPointF(m_viewport_size_px.width() * 1.5, m_viewport_size_px.height() * 1.5) - primary_screen_viewport_px.rawPoint(), m_primary_screen);
 
                 // Store the new scaled primary screen.
                 m_primary_screen_scaled = new_primary_screen_scaled;
@@ -1069,6 +1173,27 @@ namespace qmapcontrol
     // Drawing management.
     void QMapControl::requestRedraw()
     {
+        // Is the request from the image manager (a tile image has been downloaded)?
+        if(sender() == &ImageManager::get())
+        {
+            // Gain a read lock to protect the layers container.
+            QReadLocker read_locker(&m_layers_mutex);
+
+            // Mark the map adapter layers dirty (only they draw the image manager's images).
+            for(const auto& layer : m_layers)
+            {
+                if(layer->getLayerType() == Layer::LayerType::LayerMapAdapter)
+                {
+                    markLayerDirty(layer.get());
+                }
+            }
+        }
+        else
+        {
+            // Mark the requesting layer dirty (or all layers if not requested by a layer).
+            markLayerDirty(qobject_cast<const Layer*>(sender()));
+        }
+
         // Force the primary screen to be redrawn.
         redrawPrimaryScreen(true);
     }
@@ -1391,9 +1516,8 @@ namespace qmapcontrol
             painter->drawPixmap(-(m_viewport_center_px + mapFocusPointWorldPx() - m_primary_screen_map_focus_point_px - m_primary_screen_scaled_offset).rawPoint(), m_primary_screen_scaled);
         }
 
-        // Draws the primary screen image to the pixmap.
-        // Note: m_viewport_center_px is the same as (m_viewport_size_px / 2)
-        painter->drawPixmap(-(m_viewport_center_px + mapFocusPointWorldPx() - m_primary_screen_map_focus_point_px).rawPoint(), m_primary_screen);
+        // Draws the primary screen image to the pixmap (at its backbuffer rect's top-left, relative to the viewport's top-left).
+        painter->drawImage((m_primary_screen_backbuffer_rect_px.topLeftPx() - (mapFocusPointWorldPx() - m_viewport_center_px)).rawPoint(), m_primary_screen);
     }
 
     bool QMapControl::checkBackbuffer() const
@@ -1415,13 +1539,39 @@ namespace qmapcontrol
         return return_redraw_required;
     }
 
+    QSize QMapControl::backbufferSizePx(const QSizeF& viewport_size_px) const
+    {
+        // Fetch the overscan.
+        const qreal overscan(m_backbuffer_overscan);
+
+        // Return the viewport plus the overscan on each side (in whole pixels, plus one so it always covers a viewport that
+        // is not aligned to whole pixels).
+        return QSize(int(std::ceil(viewport_size_px.width() * (1.0 + 2.0 * overscan))) + 1, int(std::ceil(viewport_size_px.height() * (1.0 + 2.0 * overscan))) + 1);
+    }
+
     void QMapControl::redrawPrimaryScreen(const bool& force_redraw)
     {
         // If we are forced to redraw, or current backbuffer does not cover the required viewport.
         if(force_redraw || checkBackbuffer())
         {
-            // Schedule the redraw in a background thread.
-            QtConcurrent::run(this, &QMapControl::redrawBackbuffer);
+            // Gain a lock to protect the render thread's requests.
+            QMutexLocker locker(&m_render_mutex);
+
+            // Request a redraw of the current view (any earlier requests not yet started are merged into it).
+            ++m_render_requested_generation;
+            m_render_requested_zoom = m_current_zoom;
+            m_render_requested_viewport_size_px = m_viewport_size_px;
+            m_render_requested_map_focus_px = mapFocusPointWorldPx();
+
+            // Does the request supersede the in-flight redraw (which would be thrown away once drawn)?
+            if(m_render_in_flight_zoom != m_render_requested_zoom || m_render_in_flight_viewport_size_px != m_render_requested_viewport_size_px)
+            {
+                // Abandon the in-flight redraw.
+                m_render_superseded = true;
+            }
+
+            // Wake the render thread.
+            m_render_condition.wakeAll();
         }
 
         // Loop through the layers to update the Geometries that have widgets as well.
@@ -1439,65 +1589,359 @@ namespace qmapcontrol
         QWidget::update();
     }
 
-    void QMapControl::redrawBackbuffer()
+    void QMapControl::renderLoop()
     {
-        // Get access to the backbuffer's queue mutex.
-        if(m_backbuffer_queued_mutex.tryLock())
+        // Gain a lock to protect the render thread's requests.
+        QMutexLocker locker(&m_render_mutex);
+
+        // Loop until we are stopped.
+        while(m_render_stop == false)
         {
-            // Get access to the backbuffer mutex.
-            QMutexLocker locker(&m_backbuffer_mutex);
+            // Has a newer redraw been requested?
+            if(m_render_started_generation == m_render_requested_generation)
+            {
+                // Wait for a request (this releases the lock while we wait).
+                m_render_condition.wait(&m_render_mutex);
+            }
+            else
+            {
+                // Calculate how long until the next frame is due.
+                const qint64 frame_wait_ms(m_render_frame_rate > 0 ? 1000 / m_render_frame_rate - m_render_frame_timer.elapsed() : 0);
+                if(frame_wait_ms > 0)
+                {
+                    // Wait until the frame is due (any requests meanwhile are merged into it).
+                    m_render_condition.wait(&m_render_mutex, (unsigned long)frame_wait_ms);
+                }
+                else
+                {
+                    // Start the latest requested redraw.
+                    m_render_started_generation = m_render_requested_generation;
+                    m_render_frame_timer.start();
+
+                    // Capture the view we are going to draw.
+                    const int controller_zoom(m_render_requested_zoom);
+                    const QSizeF viewport_size_px(m_render_requested_viewport_size_px);
+                    const PointWorldPx backbuffer_map_focus_px(m_render_requested_map_focus_px);
+                    m_render_in_flight_zoom = controller_zoom;
+                    m_render_in_flight_viewport_size_px = viewport_size_px;
+                    m_render_superseded = false;
+
+                    // Redraw the backbuffer without holding the lock, so more redraws can be requested meanwhile.
+                    locker.unlock();
+                    redrawBackbuffer(controller_zoom, viewport_size_px, backbuffer_map_focus_px);
+                    locker.relock();
+
+                    // Nothing is in-flight.
+                    m_render_in_flight_zoom = -1;
+                    m_render_in_flight_viewport_size_px = QSizeF();
+                }
+            }
+        }
+    }
 
-            // Release the backbuffer queue mutex, so someone else can wait while we redraw.
-            m_backbuffer_queued_mutex.unlock();
+    void QMapControl::redrawBackbuffer(const int& controller_zoom, const QSizeF& viewport_size_px, const PointWorldPx& backbuffer_map_focus_px)
+    {
+        // Start the progress indicator as we are going to start the redrawing process
+        QTimer::singleShot(0, &m_progress_indicator, SLOT(startAnimation()));
 
-            // Start the progress indicator as we are going to start the redrawing process
-            QTimer::singleShot(0, &m_progress_indicator, SLOT(startAnimation()));
+        // Ensure the render image is the backbuffer size (the viewport plus the overscan on each side to allow for panning backbuffer).
+        const QSize backbuffer_size_px(backbufferSizePx(viewport_size_px));
+        if(m_render_image.size() != backbuffer_size_px)
+        {
+            m_render_image = QImage(backbuffer_size_px, QImage::Format_ARGB32_Premultiplied);
+        }
 
-            // Generate a new backbuffer (2 x viewport size to allow for panning backbuffer).
-            QImage image_backbuffer(m_viewport_size_px.toSize() * 2, QImage::Format_ARGB32);
+        // Draw the backbuffer to the render image (it is swapped, rather than copied, to the main thread once drawn).
+        QImage& image_backbuffer(m_render_image);
 
-            // Clear the backbuffer.
-            image_backbuffer.fill(Qt::transparent);
+        // Clear the backbuffer.
+        image_backbuffer.fill(Qt::transparent);
 
-            // Create a painter for the backbuffer.
-            QPainter painter_back_buffer(&image_backbuffer);
+        // Calculate the new backbuffer rect (based on the saved backbuffer map focus point).
+        // Note: the top-left is aligned to whole pixels, so a later backbuffer can reuse the layers' surfaces by scrolling them.
+        const qreal overscan(m_backbuffer_overscan);
+        const PointWorldPx backbuffer_top_left_px(backbuffer_map_focus_px - PointPx(viewport_size_px.width() * (0.5 + overscan), viewport_size_px.height() * (0.5 + overscan)));
+        const RectWorldPx backbuffer_rect_px(PointWorldPx(std::floor(backbuffer_top_left_px.x()), std::floor(backbuffer_top_left_px.y())), QSizeF(image_backbuffer.size()));
 
-            // Capture the map focus point we are going to use for this backbuffer.
-            PointWorldPx backbuffer_map_focus_px(mapFocusPointWorldPx());
+        // Take a copy of the layers to draw, so the layers container is not locked while we draw.
+        std::vector<std::shared_ptr<Layer>> layers;
+        {
+            // Gain a read lock to protect the layers container.
+            QReadLocker read_locker(&m_layers_mutex);
 
-            // Calculate the new backbuffer rect (based on the saved backbuffer map focus point).
-            // Note: m_viewport_center_px is the same as (m_viewport_size_px / 2)
-            const PointPx viewport_offset_px(m_viewport_size_px.width() / 2.0, m_viewport_size_px.height() / 2.0);
-            const RectWorldPx backbuffer_rect_px(toPointWorldPx(PointViewportPx(0, 0) - viewport_offset_px, backbuffer_map_focus_px), toPointWorldPx(PointViewportPx(m_viewport_size_px.width(), m_viewport_size_px.height()) + viewport_offset_px, backbuffer_map_focus_px));
+            // Copy the layers.
+            layers = m_layers;
+        }
 
-            // Translate to the backbuffer top/left point.
-            painter_back_buffer.translate(-backbuffer_rect_px.topLeftPx().rawPoint());
+        // Take the dirty layers (any layers marked dirty from now on are drawn by the next redraw).
+        std::set<const Layer*> layers_dirty;
+        std::map<const Layer*, std::vector<std::pair<RectWorldCoord, qreal>>> layers_damaged;
+        bool layers_all_dirty(false);
+        {
+            // Gain a lock to protect the dirty layers.
+            QMutexLocker locker_dirty(&m_layer_surfaces_dirty_mutex);
+
+            // Take the dirty layers.
+            layers_dirty.swap(m_layer_surfaces_dirty);
+            layers_damaged.swap(m_layer_surfaces_damaged);
+            layers_all_dirty = m_layer_surfaces_all_dirty;
+            m_layer_surfaces_all_dirty = false;
+        }
 
-            // Gain a read lock to protect the layers container.
-            QReadLocker read_locker(&m_layers_mutex);
+        // Remove the surfaces of any layers that have been removed.
+        for(auto itr_surface = m_layer_surfaces.begin(); itr_surface != m_layer_surfaces.end(); )
+        {
+            // Is the surface's layer still drawn?
+            if(std::find_if(layers.begin(), layers.end(), [&](const std::shared_ptr<Layer>& layer) { return layer.get() == itr_surface->first; }) == layers.end())
+            {
+                // Remove the surface.
+                itr_surface = m_layer_surfaces.erase(itr_surface);
+            }
+            else
+            {
+                // Move on to the next surface.
+                ++itr_surface;
+            }
+        }
+
+        // Fetch what the surfaces will be drawn with.
+        const int epsg(projection::get().epsg());
+        const int tile_size_px(ImageManager::get().tileSizePx());
+
+        // A screen tile of a layer's surface, drawn independently of the others.
+        struct RenderTile
+        {
+            /// The layer to draw.
+            const Layer* layer;
 
-            // Loop through each layer and draw it to the backbuffer.
-            for(std::shared_ptr<Layer> layer : m_layers)
+            /// The first pixel of the layer's surface.
+            uchar* surface_bits;
+
+            /// The number of bytes per line of the layer's surface.
+            int surface_bytes_per_line;
+
+            /// The tile's rect within the layer's surface in pixels.
+            QRect rect_px;
+        };
+
+        // Split the backbuffer into render tiles (or a single tile if disabled).
+        const int render_tile_size_px(m_render_tile_size_px > 0 ? int(m_render_tile_size_px) : std::max(image_backbuffer.width(), image_backbuffer.height()));
+        std::vector<QRect> render_tile_rects_px;
+        for(int y = 0; y < image_backbuffer.height(); y += render_tile_size_px)
+        {
+            for(int x = 0; x < image_backbuffer.width(); x += render_tile_size_px)
+            {
+                render_tile_rects_px.emplace_back(x, y, std::min(render_tile_size_px, image_backbuffer.width() - x), std::min(render_tile_size_px, image_backbuffer.height() - y));
+            }
+        }
+
+        // Find the layers whose surfaces need to be drawn, and add their render tiles.
+        std::vector<RenderTile> render_tiles;
+        for(const auto& layer : layers)
+        {
+            // Fetch the layer's surface.
+            LayerSurface& surface(m_layer_surfaces[layer.get()]);
+
+            // Is the layer hidden at this zoom?
+            if(layer->isVisible(controller_zoom) == false)
+            {
+                // Release the surface (it is drawn again once the layer is visible).
+                surface = LayerSurface();
+            }
+            // Is the surface dirty, or was it drawn for a different view (other than one it can be scrolled to)? The layer is
+            // prepared for the whole backbuffer first, as that may change its drawing anywhere (ie: its labels).
+            else if(layer->prepareDraw(backbuffer_rect_px, controller_zoom) || layers_all_dirty || layers_dirty.count(layer.get()) > 0 || surface.image.size() != image_backbuffer.size() ||
+                    surface.zoom != controller_zoom || surface.epsg != epsg || surface.tile_size_px != tile_size_px ||
+                    surface.image.rect().intersects(surface.image.rect().translated(surface.backbuffer_rect_px.topLeftPx().rawPoint().toPoint() - backbuffer_rect_px.topLeftPx().rawPoint().toPoint())) == false)
+            {
+                // Ensure the surface is the size of the backbuffer.
+                if(surface.image.size() != image_backbuffer.size())
+                {
+                    surface.image = QImage(image_backbuffer.size(), QImage::Format_ARGB32_Premultiplied);
+                }
+
+                // Store the view the surface is drawn for.
+                surface.backbuffer_rect_px = backbuffer_rect_px;
+                surface.zoom = controller_zoom;
+                surface.epsg = epsg;
+                surface.tile_size_px = tile_size_px;
+
+                // Add the layer's render tiles (the surface's bits are fetched once here, as fetching them can detach the image).
+                uchar* surface_bits(surface.image.bits());
+                for(const auto& render_tile_rect_px : render_tile_rects_px)
+                {
+                    render_tiles.push_back(RenderTile{ layer.get(), surface_bits, surface.image.bytesPerLine(), render_tile_rect_px });
+                }
+            }
+            else
+            {
+                // The areas of the surface to redraw (in surface pixels).
+                QRegion damaged_region_px;
+
+                // Has the backbuffer panned since the surface was drawn (both are aligned to whole pixels)?
+                const QPoint scroll_px(surface.backbuffer_rect_px.topLeftPx().rawPoint().toPoint() - backbuffer_rect_px.topLeftPx().rawPoint().toPoint());
+                if(scroll_px.isNull() == false)
+                {
+                    // Scroll the surface, and redraw the strips that are newly exposed.
+                    scrollImage(surface.image, scroll_px);
+                    damaged_region_px = QRegion(surface.image.rect()) - QRegion(surface.image.rect().translated(scroll_px) & surface.image.rect());
+
+                    // Store the view the surface is now drawn for.
+                    surface.backbuffer_rect_px = backbuffer_rect_px;
+                }
+
+                // Fetch how far the layer can draw outside its damaged rects at this zoom.
+                const qreal layer_margin_px(layer->damagedMarginPx(controller_zoom));
+
+                // Merge the damaged areas.
+                for(const auto& damaged : layers_damaged[layer.get()])
+                {
+                    // Calculate the damaged rect in pixels, including its margin.
+                    const qreal margin_px(damaged.second + layer_margin_px);
+                    const QRectF damaged_rect_px(QRectF(projection::get().toPointWorldPx(damaged.first.topLeftCoord(), controller_zoom).rawPoint(), projection::get().toPointWorldPx(damaged.first.bottomRightCoord(), controller_zoom).rawPoint()).normalized().adjusted(-margin_px, -margin_px, margin_px, margin_px));
+
+                    // Add the part of the rect that is on the surface.
+                    damaged_region_px += damaged_rect_px.translated(-backbuffer_rect_px.topLeftPx().rawPoint()).toAlignedRect() & surface.image.rect();
+                }
+
+                // Add the damaged area within each render tile (the region's rects never overlap, so neither do the tiles).
+                uchar* surface_bits(surface.image.bits());
+                for(const auto& damaged_rect_px : damaged_region_px.rects())
+                {
+                    for(const auto& render_tile_rect_px : render_tile_rects_px)
+                    {
+                        // Is any of the damaged rect within the render tile?
+                        const QRect render_tile_damaged_rect_px(damaged_rect_px & render_tile_rect_px);
+                        if(render_tile_damaged_rect_px.isEmpty() == false)
+                        {
+                            render_tiles.push_back(RenderTile{ layer.get(), surface_bits, surface.image.bytesPerLine(), render_tile_damaged_rect_px });
+                        }
+                    }
+                }
+            }
+        }
+
+        // Draw each render tile concurrently (each with its own painter, and with the layer only querying the tile's rect, so a
+        // damaged area only redraws what it overlaps).
+        QtConcurrent::blockingMap(render_tiles, [&](RenderTile& render_tile)
+        {
+            // Has the redraw been superseded (so there is no point drawing the remaining tiles)?
+            if(m_render_superseded)
+            {
+                return;
+            }
+
+            // Wrap the tile's part of the layer's surface (the tiles do not overlap, so each can be painted independently).
+            QImage image_tile(render_tile.surface_bits + render_tile.rect_px.top() * render_tile.surface_bytes_per_line + render_tile.rect_px.left() * 4,
+                              render_tile.rect_px.width(), render_tile.rect_px.height(), render_tile.surface_bytes_per_line, QImage::Format_ARGB32_Premultiplied);
+
+            // Clear the tile (only the tile is redrawn, the rest of the surface is kept).
+            image_tile.fill(Qt::transparent);
+
+            // Calculate the tile's rect (offset from the backbuffer rect by whole pixels, so the tiles line up exactly).
+            const PointWorldPx tile_top_left_px(backbuffer_rect_px.topLeftPx() + PointPx(render_tile.rect_px.left(), render_tile.rect_px.top()));
+            const RectWorldPx tile_rect_px(tile_top_left_px, QSizeF(render_tile.rect_px.size()));
+
+            // Create a painter for the tile, and translate to the tile's top/left point.
+            QPainter painter_tile(&image_tile);
+            painter_tile.translate(-tile_top_left_px.rawPoint());
+
+            // Draw the layer to the tile.
+            render_tile.layer->draw(painter_tile, tile_rect_px, controller_zoom);
+        });
+
+        // Has the redraw been superseded?
+        if(m_render_superseded)
+        {
+            // The surfaces that were being drawn may be incomplete, so ensure they are fully drawn next time.
+            for(const auto& render_tile : render_tiles)
             {
-                // Draw the layer to the backbuffer.
-                layer->draw(painter_back_buffer, backbuffer_rect_px, m_current_zoom);
+                m_layer_surfaces[render_tile.layer].zoom = -1;
             }
+        }
+        else
+        {
+            // Composite the layers' surfaces into the backbuffer.
+            {
+                // Create a painter for the backbuffer.
+                QPainter painter_back_buffer(&image_backbuffer);
 
-            read_locker.unlock();
+                // Loop through each layer (bottom first) and draw its surface to the backbuffer.
+                for(const auto& layer : layers)
+                {
+                    // Does the layer have a surface to draw?
+                    const LayerSurface& surface(m_layer_surfaces[layer.get()]);
+                    if(surface.image.isNull() == false)
+                    {
+                        painter_back_buffer.drawImage(0, 0, surface.image);
+                    }
+                }
+            }
 
-            // Undo the backbuffer top/left point translation.
-            painter_back_buffer.translate(backbuffer_rect_px.topLeftPx().rawPoint());
+            // Scope the locker to ensure the mutex is release as soon as possible.
+            {
+                // Gain a lock to protect the latest drawn backbuffer.
+                QMutexLocker locker(&m_primary_screen_pending_mutex);
+
+                // Hand the backbuffer over by swapping it with the pending image (we draw the next backbuffer to whichever
+                // image we get back, so nothing is copied).
+                m_primary_screen_pending.swap(image_backbuffer);
+                m_primary_screen_pending_backbuffer_rect_px = backbuffer_rect_px;
+                m_primary_screen_pending_map_focus_point_px = backbuffer_map_focus_px;
+                m_primary_screen_pending_ready = true;
+            }
 
             // Inform the main thread that we have a new backbuffer.
-            emit updatedBackBuffer(QPixmap::fromImage(image_backbuffer), backbuffer_rect_px, backbuffer_map_focus_px);
+            emit updatedBackBuffer(backbuffer_rect_px, backbuffer_map_focus_px);
+        }
+
+        // Stop the progress indicator as we have finished the redrawing process.
+        QTimer::singleShot(0, &m_progress_indicator, SLOT(stopAnimation()));
+    }
+
+    void QMapControl::markLayerDirty(const Layer* layer)
+    {
+        // Gain a lock to protect the dirty layers.
+        QMutexLocker locker(&m_layer_surfaces_dirty_mutex);
 
-            // Stop the progress indicator as we have finished the redrawing process.
-            QTimer::singleShot(0, &m_progress_indicator, SLOT(stopAnimation()));
+        // Is a specific layer dirty?
+        if(layer != nullptr)
+        {
+            // Mark the layer dirty.
+            m_layer_surfaces_dirty.insert(layer);
+        }
+        else
+        {
+            // Mark all layers dirty.
+            m_layer_surfaces_all_dirty = true;
         }
     }
 
 
     /// Private slots...
+    // Drawing management.
+    void QMapControl::requestRedrawDamaged(const RectWorldCoord& damaged_rect_coord, const qreal& damaged_margin_px)
+    {
+        // Is the request from a layer?
+        const Layer* layer(qobject_cast<const Layer*>(sender()));
+        if(layer != nullptr)
+        {
+            // Gain a lock to protect the damaged areas.
+            QMutexLocker locker(&m_layer_surfaces_dirty_mutex);
+
+            // Add the damaged area to the layer (only it is redrawn, unless the whole layer is dirty by the next redraw).
+            m_layer_surfaces_damaged[layer].emplace_back(damaged_rect_coord, damaged_margin_px);
+        }
+        else
+        {
+            // Mark all layers dirty.
+            markLayerDirty(nullptr);
+        }
+
+        // Force the primary screen to be redrawn.
+        redrawPrimaryScreen(true);
+    }
+
     // Geometry management.
     void QMapControl::geometryPositionChanged(const Geometry* geometry)
     {
@@ -1557,16 +2001,24 @@ namespace qmapcontrol
         redrawPrimaryScreen();
     }
 
-    void QMapControl::updatePrimaryScreen(QPixmap backbuffer_pixmap, RectWorldPx backbuffer_rect_px, PointWorldPx backbuffer_map_focus_px)
+    void QMapControl::updatePrimaryScreen()
     {
-        // Backbuffer image is ready, save it to the primary screen.
-        m_primary_screen = backbuffer_pixmap;
+        // Gain a lock to protect the latest drawn backbuffer.
+        QMutexLocker locker(&m_primary_screen_pending_mutex);
 
-        // Update the backbuffer rect that is available.
-        m_primary_screen_backbuffer_rect_px = backbuffer_rect_px;
+        // Has a backbuffer been drawn since we last swapped (several updates may have been queued for it)?
+        if(m_primary_screen_pending_ready)
+        {
+            // Backbuffer image is ready, swap it with the primary screen (the render thread reuses the old primary screen).
+            m_primary_screen.swap(m_primary_screen_pending);
+            m_primary_screen_pending_ready = false;
 
-        // Update the primary screen's map focus point.
-        m_primary_screen_map_focus_point_px = backbuffer_map_focus_px;
+            // Update the backbuffer rect that is available.
+            m_primary_screen_backbuffer_rect_px = m_primary_screen_pending_backbuffer_rect_px;
+
+            // Update the primary screen's map focus point.
+            m_primary_screen_map_focus_point_px = m_primary_screen_pending_map_focus_point_px;
+        }
 
         // Schedule a repaint.
         QWidget::update();
@@ -27,10 +27,13 @@
 
 // Qt includes.
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QList>
 #include <QtCore/QObject>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QTimer>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QImage>
 #include <QtGui/QMouseEvent>
 #include <QtGui/QPaintEvent>
 #include <QtGui/QWheelEvent>
@@ -41,7 +44,13 @@
 #include <QMutex>
 
 // STL includes.
+#include <atomic>
 #include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
 
 // Local includes.
 #include "qmapcontrol_global.h"
@@ -170,6 +179,25 @@ namespace qmapcontrol
          */
         void enableScaledBackground(const bool& visible);
 
+        /*!
+         * Set the size of the screen tiles the backbuffer is split into, which are drawn concurrently and then composited.
+         * @param tile_size_px The render tile size in pixels (0 to draw the backbuffer as a single tile).
+         */
+        void setRenderTileSizePx(const int& tile_size_px = 512);
+
+        /*!
+         * Set how far the backbuffer extends beyond each side of the viewport, so panning within it does not require a
+         * redraw (more overscan uses more memory for each layer's surface, but redraws less often).
+         * @param overscan The overscan as a fraction of the viewport size (0.5 for a backbuffer of 2 x viewport size).
+         */
+        void setBackbufferOverscan(const qreal& overscan = 0.5);
+
+        /*!
+         * Set the maximum rate the backbuffer is redrawn at (redraw requests in between are merged into the next redraw).
+         * @param frames_per_second The maximum number of redraws per second (0 for no limit).
+         */
+        void setMaximumFrameRate(const int& frames_per_second = 60);
+
         /*!
          * Set whether the scalebar should be displayed within the widget.
          * @param visible Whether the scalebar should be displayed.
@@ -526,6 +554,13 @@ namespace qmapcontrol
          */
         bool checkBackbuffer() const;
 
+        /*!
+         * Calculates the size of the backbuffer (the viewport plus the overscan on each side).
+         * @param viewport_size_px The viewport size in pixels.
+         * @return the backbuffer size in pixels.
+         */
+        QSize backbufferSizePx(const QSizeF& viewport_size_px) const;
+
         /*!
          * Redraws the primary screen image.
          * @param force_redraw Whether to force the backbuffer to be redrawn, even if checkBackbuffer() states we do not need to.
@@ -533,11 +568,39 @@ namespace qmapcontrol
         void redrawPrimaryScreen(const bool& force_redraw = false);
 
         /*!
-         * Redraws the backbuffer image, which when ready will emit updatePrimaryScreen() for it to be stored/drawn.
+         * The render thread's loop, which redraws the backbuffer whenever a newer redraw has been requested (no faster than
+         * the maximum frame rate), until the render thread is stopped.
+         */
+        void renderLoop();
+
+        /*!
+         * Redraws the backbuffer image, which when ready is handed to the main thread by updatePrimaryScreen() to be stored/drawn.
+         * The redraw is abandoned if a newer redraw is requested for a different zoom or viewport size (see m_render_superseded).
+         * Each layer is drawn to its own surface, which is reused until the layer is marked dirty or the view changes
+         * (when the view has only panned, the surface is scrolled and only the newly exposed strips are drawn).
+         * The dirty surfaces are split into render tiles (see setRenderTileSizePx()), which are drawn concurrently, and
+         * then the surfaces are composited.
+         * @param controller_zoom The zoom to draw at.
+         * @param viewport_size_px The viewport size to draw for in pixels.
+         * @param backbuffer_map_focus_px The map focus point to draw around in pixels.
          */
-        void redrawBackbuffer();
+        void redrawBackbuffer(const int& controller_zoom, const QSizeF& viewport_size_px, const PointWorldPx& backbuffer_map_focus_px);
+
+        /*!
+         * Marks a layer's surface as dirty, so it is drawn by the next backbuffer redraw.
+         * @param layer The layer to mark dirty (nullptr marks all layers dirty).
+         */
+        void markLayerDirty(const Layer* layer);
 
     private slots:
+        // Drawing management.
+        /*!
+         * Called when a layer requires part of the view to be redrawn.
+         * @param damaged_rect_coord The rect that needs to be redrawn (world coordinates).
+         * @param damaged_margin_px The margin around the rect that also needs to be redrawn in pixels.
+         */
+        void requestRedrawDamaged(const RectWorldCoord& damaged_rect_coord, const qreal& damaged_margin_px);
+
         // Geometry management.
         /*!
          * Called when a geometry changes its position.
@@ -558,12 +621,9 @@ namespace qmapcontrol
         void loadingFinished();
 
         /*!
-         * Called when the backbuffer has been updated, to replace the existing primary screen and request a QWidget::update().
-         * @param backbuffer_pixmap The updated backbuffer pixmap.
-         * @param backbuffer_rect_px The updated backbuffer rect in pixels.
-         * @param backbuffer_map_focus_px The updated backbuffer map foucs point in pixels.
+         * Called when the backbuffer has been updated, to swap it with the existing primary screen and request a QWidget::update().
          */
-        void updatePrimaryScreen(QPixmap backbuffer_pixmap, RectWorldPx backbuffer_rect_px, PointWorldPx backbuffer_map_focus_px);
+        void updatePrimaryScreen();
 
     signals:
         // Geometry management.
@@ -613,12 +673,11 @@ namespace qmapcontrol
 
         // Drawing management.
         /*!
-         * Signal emitted when the backbuffer has been updated.
-         * @param backbuffer_pixmap The updated backbuffer pixmap.
+         * Signal emitted when the backbuffer has been updated (it becomes the primary screen, see getPrimaryScreen()).
          * @param backbuffer_rect_px The updated backbuffer rect in pixels.
          * @param backbuffer_map_focus_px The updated backbuffer map foucs point in pixels.
          */
-        void updatedBackBuffer(QPixmap backbuffer_pixmap, RectWorldPx backbuffer_rect_px, PointWorldPx backbuffer_map_focus_px);
+        void updatedBackBuffer(RectWorldPx backbuffer_rect_px, PointWorldPx backbuffer_map_focus_px);
 
         /**
          * Signal emitted when the map foucus has changed
@@ -631,6 +690,34 @@ namespace qmapcontrol
         //! Disable copy assignment.
         QMapControl& operator=(const QMapControl&); /// @todo remove once MSVC supports default/delete syntax.
 
+        /// A layer's drawn surface, and the view it was drawn for.
+        struct LayerSurface
+        {
+            //! Constructor of an empty layer surface.
+            LayerSurface()
+                : backbuffer_rect_px(PointWorldPx(0.0, 0.0), PointWorldPx(0.0, 0.0)),
+                  zoom(-1),
+                  epsg(-1),
+                  tile_size_px(-1)
+            {
+            }
+
+            /// The layer drawn at the backbuffer size (null if the layer is not visible).
+            QImage image;
+
+            /// The backbuffer rect the layer was drawn for in pixels.
+            RectWorldPx backbuffer_rect_px;
+
+            /// The zoom the layer was drawn at.
+            int zoom;
+
+            /// The projection epsg the layer was drawn with.
+            int epsg;
+
+            /// The tile size the layer was drawn with in pixels.
+            int tile_size_px;
+        };
+
         /// Whether the scale should be visible.
         bool m_scalebar_enabled;
 
@@ -706,8 +793,8 @@ namespace qmapcontrol
         /// The current mouse position in pixels (set after every mouse event).
         PointViewportPx m_mouse_position_current_px;
 
-        /// Primary screen pixmap (always 2 x viewport size to allow for panning backbuffer).
-        QPixmap m_primary_screen;
+        /// Primary screen pixmap (the viewport plus the backbuffer overscan on each side to allow for panning backbuffer).
+        QImage m_primary_screen;
 
         /// The map focus point when the primary screen was created.
         PointWorldPx m_primary_screen_map_focus_point_px;
@@ -736,11 +823,86 @@ namespace qmapcontrol
         /// The zoom control's '-' zoom out button.
         QPushButton m_zoom_control_button_out;
 
-        /// Mutex to protect the backbuffer during the redraw process.
-        QMutex m_backbuffer_mutex;
+        /// The image the render thread draws the backbuffer to (only accessed by the render thread).
+        QImage m_render_image;
+
+        /// The latest drawn backbuffer, waiting to be swapped with the primary screen by updatePrimaryScreen().
+        QImage m_primary_screen_pending;
+
+        /// The latest drawn backbuffer's rect in pixels.
+        RectWorldPx m_primary_screen_pending_backbuffer_rect_px;
+
+        /// The latest drawn backbuffer's map focus point in pixels.
+        PointWorldPx m_primary_screen_pending_map_focus_point_px;
+
+        /// Whether the latest drawn backbuffer has not yet been swapped with the primary screen.
+        bool m_primary_screen_pending_ready;
+
+        /// Mutex to protect the latest drawn backbuffer.
+        QMutex m_primary_screen_pending_mutex;
+
+        /// The render thread, which redraws the backbuffer.
+        std::thread m_render_thread;
+
+        /// Mutex to protect the render thread's requests.
+        QMutex m_render_mutex;
+
+        /// Wakes the render thread when a redraw is requested (or it is stopped).
+        QWaitCondition m_render_condition;
+
+        /// Whether the render thread should stop.
+        bool m_render_stop;
+
+        /// The number of redraws requested (each request supersedes the previous ones).
+        quint64 m_render_requested_generation;
+
+        /// The last requested redraw the render thread has started.
+        quint64 m_render_started_generation;
+
+        /// The zoom the last redraw was requested at.
+        int m_render_requested_zoom;
+
+        /// The viewport size the last redraw was requested for in pixels.
+        QSizeF m_render_requested_viewport_size_px;
+
+        /// The map focus point the last redraw was requested around in pixels.
+        PointWorldPx m_render_requested_map_focus_px;
+
+        /// The zoom the in-flight redraw is drawing at.
+        int m_render_in_flight_zoom;
+
+        /// The viewport size the in-flight redraw is drawing for in pixels.
+        QSizeF m_render_in_flight_viewport_size_px;
+
+        /// Whether a newer request (for a different zoom or viewport size) has superseded the in-flight redraw.
+        std::atomic<bool> m_render_superseded;
+
+        /// The maximum number of redraws per second (0 for no limit).
+        int m_render_frame_rate;
+
+        /// The time since the render thread started its last redraw.
+        QElapsedTimer m_render_frame_timer;
+
+        /// The size of the screen tiles the backbuffer is split into and drawn concurrently in pixels (0 for a single tile).
+        std::atomic<int> m_render_tile_size_px;
+
+        /// How far the backbuffer extends beyond each side of the viewport, as a fraction of the viewport size.
+        std::atomic<qreal> m_backbuffer_overscan;
+
+        /// The drawn surface of each layer (only accessed by the render thread).
+        std::map<const Layer*, LayerSurface> m_layer_surfaces;
+
+        /// The layers whose surfaces must be drawn by the next backbuffer redraw.
+        std::set<const Layer*> m_layer_surfaces_dirty;
+
+        /// The areas of each layer's surface that must be redrawn by the next backbuffer redraw (rects and margins in pixels).
+        std::map<const Layer*, std::vector<std::pair<RectWorldCoord, qreal>>> m_layer_surfaces_damaged;
+
+        /// Whether all layers' surfaces must be drawn by the next backbuffer redraw.
+        bool m_layer_surfaces_all_dirty;
 
-        /// Mutex to only allow only one other thread to wait for the redraw process.
-        QMutex m_backbuffer_queued_mutex;
+        /// Mutex to protect the dirty layers and damaged areas.
+        QMutex m_layer_surfaces_dirty_mutex;
 
         /// Progress indicator to alert user to redrawing progress.
         QProgressIndicator m_progress_indicator;
@@ -34,12 +34,17 @@ HEADERS +=                                      \
     GeometryPointImageScaled.h                  \
     GeometryPolygon.h                           \
     GeometryPolygonImage.h                      \
+    GeometryUtils.h                             \
     GeometryWidget.h                            \
     GPS_Position.h                              \
+    ImageAtlas.h                                \
     ImageManager.h                              \
     Layer.h                                     \
+    LayerCluster.h                              \
     LayerGeometry.h                             \
+    LayerHeatmap.h                              \
     LayerMapAdapter.h                           \
+    LinearQuadTreeContainer.h                   \
     MapAdapter.h                                \
     MapAdapterGoogle.h                          \
     MapAdapterBing.h                            \
@@ -48,13 +53,20 @@ HEADERS +=                                      \
     MapAdapterTile.h                            \
     MapAdapterWMS.h                             \
     MapAdapterYahoo.h                           \
+    MapRenderer.h                               \
     NetworkManager.h                            \
     Point.h                                     \
     Projection.h                                \
+    ProjectionCache.h                           \
     ProjectionEquirectangular.h                 \
     ProjectionSphericalMercator.h               \
     QMapControl.h                               \
     QuadTreeContainer.h                         \
+    ShapeCache.h                                \
+    StyleRegistry.h                             \
+    TilePack.h                                  \
+    TileSeeder.h                                \
+    WeakPtrMap.h                                \
 # Third-party headers: QProgressIndicator
     QProgressIndicator.h                        \
 
@@ -71,11 +83,15 @@ SOURCES +=                                      \
     GeometryPointImageScaled.cpp                \
     GeometryPolygon.cpp                         \
     GeometryPolygonImage.cpp                    \
+    GeometryUtils.cpp                           \
     GeometryWidget.cpp                          \
     GPS_Position.cpp                            \
+    ImageAtlas.cpp                              \
     ImageManager.cpp                            \
     Layer.cpp                                   \
+    LayerCluster.cpp                            \
     LayerGeometry.cpp                           \
+    LayerHeatmap.cpp                            \
     LayerMapAdapter.cpp                         \
     MapAdapter.cpp                              \
     MapAdapterGoogle.cpp                        \
@@ -85,11 +101,17 @@ SOURCES +=                                      \
     MapAdapterTile.cpp                          \
     MapAdapterWMS.cpp                           \
     MapAdapterYahoo.cpp                         \
+    MapRenderer.cpp                             \
     NetworkManager.cpp                          \
     Projection.cpp                              \
+    ProjectionCache.cpp                         \
     ProjectionEquirectangular.cpp               \
     ProjectionSphericalMercator.cpp             \
     QMapControl.cpp                             \
+    ShapeCache.cpp                              \
+    StyleRegistry.cpp                           \
+    TilePack.cpp                                \
+    TileSeeder.cpp                              \
 # Third-party sources: QProgressIndicator
     QProgressIndicator.cpp                      \
 
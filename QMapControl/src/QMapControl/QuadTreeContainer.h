@@ -26,10 +26,12 @@
 #pragma once
 
 // STD includes.
-#include <memory>
-#include <set>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
 #include <vector>
-#include <stdexcept>
 
 // Local includes.
 #include "qmapcontrol_global.h"
@@ -42,27 +44,76 @@ namespace qmapcontrol
 {
     /*!
      * Based on: http://en.wikipedia.org/wiki/Quadtree
+     *
+     * Objects are keyed by their bounding box (points are stored as zero-sized bounding boxes) and are
+     * stored exactly once, in the deepest node whose boundary fully contains them. Objects that straddle
+     * the boundaries of a node's children remain in that node (a loose/MX-CIF quad tree).
+     *
+     * The nodes are stored in one contiguous array (each node's four children are allocated as a block and
+     * referenced by index), and the objects are stored in one packed entry buffer (each node links its
+     * entries as an intrusive list). Nodes are collapsed back into their parent as objects are erased.
+     *
+     * Each inserted object is given a stable handle (its slot in the entry buffer), which can be used to
+     * erase or relocate the object without searching for it.
+     *
+     * Only objects whose bounding box intersects the boundary are stored: insert() does not store any other
+     * object, and relocate() removes an object that is moved entirely outside of the boundary.
      */
     template <class T>
     class QMAPCONTROL_EXPORT QuadTreeContainer
     {
+    public:
+        /// A stable handle to an object in the container (valid until the object is erased or the container is cleared).
+        typedef size_t Handle;
+
+        /*!
+         * Fetches the handle value that represents no object.
+         * @return the invalid handle.
+         */
+        static Handle invalidHandle()
+        {
+            // Return the largest handle value.
+            return std::numeric_limits<Handle>::max();
+        }
+
     public:
         //! Constuctor.
         /*!
          * Quad Tree Container constructor.
-         * @param capacity The number of items this quad tree container can store before it's children are created/used.
+         * @param capacity The number of items a quad tree node can store before it's children are created/used.
          * @param boundary_coord The bounding box area that this quad tree container covers in coordinates.
+         * @param depth_maximum The maximum number of levels that can be created beneath the root quad tree node.
          */
-        QuadTreeContainer(const size_t& capacity, const RectWorldCoord& boundary_coord)
+        QuadTreeContainer(const size_t& capacity, const RectWorldCoord& boundary_coord, const size_t& depth_maximum = 24)
             : m_capacity(capacity),
-              m_boundary_coord(boundary_coord)
+              m_boundary_coord(RectWorldCoord::fromQRectF(boundary_coord.rawRect().normalized())),
+              m_depth_maximum(depth_maximum),
+              m_entries_free_first(invalidIndex()),
+              m_entries_unpacked(0)
         {
-            // Reserve the container size.
-            m_points.reserve(capacity);
+            // Create the root node.
+            clear();
         }
 
-        //! Disable copy constructor.
-        ///QuadTreeContainer(const QuadTreeContainer&) = delete; @todo re-add once MSVC supports default/delete syntax.
+        //! Copy constructor.
+        /*!
+         * Copies the quad tree container (the nodes, entries and handles are flat buffers, so this is a straight copy).
+         * @param other The quad tree container to copy.
+         */
+        QuadTreeContainer(const QuadTreeContainer& other)
+            : m_capacity(other.m_capacity),
+              m_boundary_coord(other.m_boundary_coord),
+              m_depth_maximum(other.m_depth_maximum),
+              m_nodes(other.m_nodes),
+              m_node_blocks_free(other.m_node_blocks_free),
+              m_entries(other.m_entries),
+              m_entries_free_first(other.m_entries_free_first),
+              m_entries_unpacked(other.m_entries_unpacked),
+              m_handle_entries(other.m_handle_entries),
+              m_handles_free(other.m_handles_free)
+        {
+
+        }
 
         //! Disable copy assignment.
         ///QuadTreeContainer& operator=(const QuadTreeContainer&) = delete; @todo re-add once MSVC supports default/delete syntax.
@@ -71,212 +122,1161 @@ namespace qmapcontrol
         virtual ~QuadTreeContainer() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
 
         /*!
-         * Fetches objects within the specified bounding box range.
-         * @param return_points The objects that are within the specified range are added to this.
+         * Fetches objects whose bounding box intersects the specified bounding box range.
+         * @param return_objects The objects that are within the specified range are added to this (each object is only added once).
          * @param range_coord The bounding box range.
+         * @note return_objects is only appended to, so a caller can clear() and reuse it to avoid reallocating.
          */
-        void query(std::vector<T>& return_points, const RectWorldCoord& range_coord) const
+        void query(std::vector<T>& return_objects, const RectWorldCoord& range_coord) const
         {
-            // Does the range intersect with our boundary.
-            if(range_coord.rawRect().intersects(m_boundary_coord.rawRect()))
+            // Add each object within the range.
+            visit(range_coord, [&](const T& object) { return_objects.push_back(object); return true; });
+        }
+
+        /*!
+         * Fetches up to a maximum number of objects whose bounding box intersects the specified bounding box range.
+         * @param return_objects The objects that are within the specified range are added to this (each object is only added once).
+         * @param range_coord The bounding box range.
+         * @param limit The maximum number of objects to add (the query stops once this is reached).
+         */
+        void query(std::vector<T>& return_objects, const RectWorldCoord& range_coord, const size_t& limit) const
+        {
+            // Keep track of how many objects we have added.
+            size_t count(0);
+
+            // Add each object within the range until we reach the limit.
+            if(limit > 0)
             {
-                // Check whether any of our points are contained in the range.
-                for(const auto& point : m_points)
+                visit(range_coord, [&](const T& object) { return_objects.push_back(object); return ++count < limit; });
+            }
+        }
+
+        /*!
+         * Visits objects whose bounding box intersects the specified bounding box range, without copying them.
+         * @param range_coord The bounding box range.
+         * @param visitor Called as 'bool visitor(const T& object)' for each object within the range, return false to stop the query.
+         * @return whether every object within the range was visited (false if the visitor stopped the query early).
+         */
+        template <class Visitor>
+        bool visit(const RectWorldCoord& range_coord, Visitor&& visitor) const
+        {
+            // Search from the root node down using the normalised range.
+            return visitNode(0, range_coord.rawRect().normalized(), visitor);
+        }
+
+        /*!
+         * Fetches the objects nearest to a point, nearest first.
+         * The distance to an object is the (coordinate) distance from the point to the object's bounding box.
+         * @param return_objects The nearest objects are added to this (nearest first).
+         * @param point_coord The point to search from in coordinates.
+         * @param count The maximum number of objects to add.
+         * @param distance_maximum_coord Only objects within this distance are added (in coordinates).
+         */
+        void queryNearest(std::vector<T>& return_objects, const PointWorldCoord& point_coord, const size_t& count, const qreal& distance_maximum_coord = std::numeric_limits<qreal>::max()) const
+        {
+            // Keep track of how many objects we have added.
+            size_t added(0);
+
+            // Add the nearest objects until we reach the count or the maximum distance.
+            if(count > 0)
+            {
+                const QPointF point(point_coord.rawPoint());
+                visitNearest([&](const QRectF& bounding_box) { return rectDistance(bounding_box, point); },
+                             [&](const T& object, const qreal& distance)
+                             {
+                                 // Is the object within the maximum distance?
+                                 const bool within_distance(distance <= distance_maximum_coord);
+                                 if(within_distance)
+                                 {
+                                     return_objects.push_back(object);
+                                 }
+
+                                 // Objects are visited nearest first, so we can stop at the first that is too far away.
+                                 return within_distance && ++added < count;
+                             });
+            }
+        }
+
+        /*!
+         * Visits objects in order of increasing distance (a best-first search), without copying them.
+         * The metric is called with normalised node boundaries and object bounding boxes, and must never return a
+         * larger distance for a rect than for any rect it contains (for example the distance from a point to the rect).
+         * @param metric Called as 'qreal metric(const QRectF& bounding_box)' to calculate the distance to a normalised rect.
+         * @param visitor Called as 'bool visitor(const T& object, const qreal& distance)' for each object (nearest first), return false to stop the query.
+         * @return whether every object was visited (false if the visitor stopped the query early).
+         */
+        template <class Metric, class Visitor>
+        bool visitNearest(Metric&& metric, Visitor&& visitor) const
+        {
+            // A node or entry waiting to be visited.
+            struct Candidate
+            {
+                /// The distance to the node's boundary or entry's bounding box.
+                qreal distance;
+
+                /// The index of the node or entry.
+                size_t index;
+
+                /// Whether this is an entry (otherwise it is a node).
+                bool entry;
+            };
+
+            // The queue of candidates (a min-heap on distance).
+            const auto compare_further = [](const Candidate& a, const Candidate& b) { return a.distance > b.distance; };
+            std::vector<Candidate> candidates;
+            candidates.reserve(4 * m_capacity);
+            candidates.push_back(Candidate{ metric(m_nodes.front().boundary), 0, false });
+
+            // Keep track of whether we should continue.
+            bool continue_query(true);
+
+            // Visit the nearest candidate until there are none left.
+            while(continue_query && candidates.empty() == false)
+            {
+                // Take the nearest candidate.
+                std::pop_heap(candidates.begin(), candidates.end(), compare_further);
+                const Candidate candidate(candidates.back());
+                candidates.pop_back();
+
+                // Is it an entry?
+                if(candidate.entry)
+                {
+                    // Nothing left in the queue can be nearer, so visit the object.
+                    continue_query = visitor(m_entries[candidate.index].object, candidate.distance);
+                }
+                else
                 {
-                    // Is the point contained by the query range.
-                    if(range_coord.rawRect().contains(point.first.rawPoint()))
+                    // Queue the node's entries.
+                    const Node& node(m_nodes[candidate.index]);
+                    for(size_t entry_index = node.entry_first; entry_index != invalidIndex(); entry_index = m_entries[entry_index].next)
                     {
-                        // Add to the return points.
-                        return_points.push_back(point.second);
+                        candidates.push_back(Candidate{ metric(m_entries[entry_index].bounding_box), entry_index, true });
+                        std::push_heap(candidates.begin(), candidates.end(), compare_further);
                     }
-                }
 
-                // Do we have any child quad tree nodes?
-                if(m_child_north_east != nullptr)
-                {
-                    // Search each child and add the points they return.
-                    m_child_north_east->query(return_points, range_coord);
-                    m_child_north_west->query(return_points, range_coord);
-                    m_child_south_east->query(return_points, range_coord);
-                    m_child_south_west->query(return_points, range_coord);
+                    // Do we have any child quad tree nodes?
+                    if(node.children != invalidIndex())
+                    {
+                        // Queue each child that has entries.
+                        for(size_t child_index = node.children; child_index < node.children + 4; ++child_index)
+                        {
+                            if(m_nodes[child_index].size > 0)
+                            {
+                                candidates.push_back(Candidate{ metric(m_nodes[child_index].boundary), child_index, false });
+                                std::push_heap(candidates.begin(), candidates.end(), compare_further);
+                            }
+                        }
+                    }
                 }
             }
+
+            // Return whether we visited every object.
+            return continue_query;
         }
 
         /*!
-         * Inserts an object into the quad tree container.
+         * Calculates the distance from a point to a normalised rect (zero if the point is inside the rect).
+         * @param rect The normalised rect.
+         * @param point The point.
+         * @return the distance.
+         */
+        static qreal rectDistance(const QRectF& rect, const QPointF& point)
+        {
+            // Calculate the distance outside the rect along each axis.
+            const qreal dx(std::max(std::max(rect.left() - point.x(), point.x() - rect.right()), qreal(0.0)));
+            const qreal dy(std::max(std::max(rect.top() - point.y(), point.y() - rect.bottom()), qreal(0.0)));
+
+            // Return the distance.
+            return std::sqrt(dx * dx + dy * dy);
+        }
+
+        /*!
+         * Inserts a point object into the quad tree container.
          * @param point_coord The objects's point in coordinates.
          * @param object The object to insert.
-         * @return whether the object was inserted into this quad tree container.
+         * @return the object's handle, or invalidHandle() if it was not inserted into this quad tree container.
          */
-        bool insert(const PointWorldCoord& point_coord, const T& object)
+        Handle insert(const PointWorldCoord& point_coord, const T& object)
         {
-            // Keep track of our success.
-            bool success(false);
+            // Insert the point as a zero-sized bounding box.
+            return insert(RectWorldCoord(point_coord, point_coord), object);
+        }
 
-            // Does this boundary contain the point?
-            if(m_boundary_coord.rawRect().contains(point_coord.rawPoint()))
+        /*!
+         * Inserts an object into the quad tree container.
+         * @param bounding_box_coord The objects's bounding box in coordinates.
+         * @param object The object to insert.
+         * @return the object's handle, or invalidHandle() if it was not inserted into this quad tree container.
+         */
+        Handle insert(const RectWorldCoord& bounding_box_coord, const T& object)
+        {
+            // Default to not inserted.
+            Handle handle(invalidHandle());
+
+            // Normalise the bounding box (coordinate rects are often stored with a negative height).
+            const QRectF bounding_box(bounding_box_coord.rawRect().normalized());
+
+            // Does our boundary intersect the bounding box?
+            if(rectIntersects(m_boundary_coord.rawRect(), bounding_box))
             {
-                // Have we reached our capacity?
-                if(m_points.size() < m_capacity)
-                {
-                    // Add the point.
-                    m_points.emplace_back(point_coord, object);
+                // Store the object and add it to the deepest node that fully contains it.
+                handle = allocateEntry(bounding_box, T(object));
+                insertEntry(m_handle_entries[handle]);
+            }
+
+            // Return the handle.
+            return handle;
+        }
+
+        /*!
+         * Inserts many objects into the quad tree container in one pass.
+         * If the batch is at least as large as the current contents, the tree is rebuilt top-down by partitioning the
+         * objects by quadrant (the quad tree equivalent of a sort-tile-recursive packed load), so each node is only
+         * built once. Otherwise the objects are inserted individually. Existing handles remain valid.
+         * @param entries The objects' bounding boxes in coordinates and the objects to insert (the contents are moved from).
+         * @return the handle of each object (in the same order as entries), or invalidHandle() if it was not inserted.
+         */
+        std::vector<Handle> insert(std::vector<std::pair<RectWorldCoord, T>>& entries)
+        {
+            // The handles to return.
+            std::vector<Handle> return_handles(entries.size(), invalidHandle());
+
+            // Store the objects whose bounding box intersects our boundary.
+            m_entries.reserve(m_entries.size() + entries.size());
+            size_t count(0);
+            for(size_t i = 0; i < entries.size(); ++i)
+            {
+                // Normalise the bounding box.
+                const QRectF bounding_box(entries[i].first.rawRect().normalized());
 
-                    // Update our success.
-                    success = true;
+                // Does our boundary intersect the bounding box?
+                if(rectIntersects(m_boundary_coord.rawRect(), bounding_box))
+                {
+                    // Store the object.
+                    return_handles[i] = allocateEntry(bounding_box, std::move(entries[i].second));
+                    ++count;
                 }
-                else
+            }
+
+            // Is the batch large enough to warrant rebuilding the tree?
+            if(count >= m_nodes.front().size)
+            {
+                // Take the entry buffer, and fetch every entry in use (existing and new).
+                std::vector<Entry> entries_source;
+                entries_source.swap(m_entries);
+                std::vector<size_t> indices;
+                indices.reserve(m_nodes.front().size + count);
+                for(size_t i = 0; i < entries_source.size(); ++i)
                 {
-                    // Do we already have child quad tree nodes?
-                    if(m_child_north_east == nullptr)
+                    // Is the slot in use?
+                    if(entries_source[i].handle != invalidHandle())
                     {
-                        // We need to create the child quad tree nodes before we continue.
-                        subdivide();
+                        indices.push_back(i);
                     }
+                }
 
-                    // Try inserting into north east.
-                    if(m_child_north_east->insert(point_coord, object))
-                    {
-                        // Update our success.
-                        success = true;
-                    }
-                    // Try inserting into north west.
-                    else if(m_child_north_west->insert(point_coord, object))
-                    {
-                        // Update our success.
-                        success = true;
-                    }
-                    // Try inserting into south east.
-                    else if(m_child_south_east->insert(point_coord, object))
-                    {
-                        // Update our success.
-                        success = true;
-                    }
-                    // Try inserting into south west.
-                    else if(m_child_south_west->insert(point_coord, object))
-                    {
-                        // Update our success.
-                        success = true;
-                    }
-                    else
+                // Rebuild the tree from scratch, packing the entry buffer in tree order (this keeps the handles).
+                m_entries.reserve(indices.size());
+                m_entries_free_first = invalidIndex();
+                m_entries_unpacked = 0;
+                resetNodes();
+                std::vector<size_t> indices_scratch(indices.size());
+                buildEntries(0, entries_source, indices, indices_scratch, 0, indices.size());
+            }
+            else
+            {
+                // Insert each new object individually (without re-packing the entry buffer, as that only keeps the entries
+                // already linked into the tree, which would drop the rest of the batch).
+                for(const auto& handle : return_handles)
+                {
+                    // Was the object stored?
+                    if(handle != invalidHandle())
                     {
-                        // We cannot insert, fail!
-                        throw std::runtime_error("Unable to insert into quad tree container.");
+                        // Add the object to the deepest node that fully contains it.
+                        insertEntry(m_handle_entries[handle], false);
                     }
                 }
+
+                // Re-pack the entry buffer once the whole batch is linked, if required.
+                packEntriesIfUnpacked();
+            }
+
+            // Return the handles.
+            return return_handles;
+        }
+
+        /*!
+         * Moves an object to a new bounding box.
+         * If the object still belongs in the same node it is updated in place, otherwise it is moved.
+         * @param handle The object's handle.
+         * @param bounding_box_coord The objects's new bounding box in coordinates.
+         * @return whether the object is still stored (false if the handle was not valid, or if the new bounding box does
+         *         not intersect our boundary, in which case the object is removed and its handle released, as insert()
+         *         would not have stored it).
+         */
+        bool relocate(const Handle& handle, const RectWorldCoord& bounding_box_coord)
+        {
+            // Keep track of our success.
+            bool success(false);
+
+            // Normalise the bounding box.
+            const QRectF bounding_box(bounding_box_coord.rawRect().normalized());
+
+            // Has the object moved outside of our boundary?
+            if(isValidHandle(handle) && rectIntersects(m_boundary_coord.rawRect(), bounding_box) == false)
+            {
+                // Remove the object.
+                erase(handle);
+            }
+            // Is the handle valid?
+            else if(isValidHandle(handle))
+            {
+
+                // Fetch the entry and the node it is stored in.
+                const size_t entry_index(m_handle_entries[handle]);
+                const size_t node_index(m_entries[entry_index].node);
+
+                // Update the bounding box.
+                m_entries[entry_index].bounding_box = bounding_box;
+
+                // Must the object move (it is no longer contained, or it now fits in a child)?
+                if((node_index != 0 && rectContains(m_nodes[node_index].boundary, bounding_box) == false) || childContaining(node_index, bounding_box) != invalidIndex())
+                {
+                    // Take the object out of its current node, and collapse any nodes that are now sparse.
+                    unlinkEntry(entry_index);
+                    decrementSize(node_index);
+                    collapseFrom(node_index);
+
+                    // Re-insert the object from the root.
+                    insertEntry(entry_index);
+                }
+
+                // Update our success.
+                success = true;
             }
 
             // Return our success.
             return success;
         }
 
+        /*!
+         * Fetches an object by its handle.
+         * @param handle The object's handle.
+         * @return the object, or nullptr if the handle is not valid (the pointer is invalidated by any change to the container).
+         */
+        const T* find(const Handle& handle) const
+        {
+            // Return the object, if the handle is valid.
+            return isValidHandle(handle) ? &m_entries[m_handle_entries[handle]].object : nullptr;
+        }
+
         /*!
          * Removes an object from the quad tree container.
+         * @param handle The object's handle.
+         * @return whether the handle was valid and the object removed.
+         */
+        bool erase(const Handle& handle)
+        {
+            // Keep track of our success.
+            bool success(false);
+
+            // Is the handle valid?
+            if(isValidHandle(handle))
+            {
+                // Take the object out of its node.
+                const size_t entry_index(m_handle_entries[handle]);
+                const size_t node_index(m_entries[entry_index].node);
+                unlinkEntry(entry_index);
+                decrementSize(node_index);
+
+                // Release the object's slot and handle.
+                releaseEntry(entry_index);
+
+                // Collapse any nodes that are now sparse.
+                collapseFrom(node_index);
+
+                // Update our success.
+                success = true;
+            }
+
+            // Return our success.
+            return success;
+        }
+
+        /*!
+         * Removes a point object from the quad tree container.
          * @param point_coord The objects's point in coordinates.
          * @param object The object to remove.
+         * @return whether the object was found and removed.
+         */
+        bool erase(const PointWorldCoord& point_coord, const T& object)
+        {
+            // Remove the point as a zero-sized bounding box.
+            return erase(RectWorldCoord(point_coord, point_coord), object);
+        }
+
+        /*!
+         * Removes an object from the quad tree container.
+         * @param bounding_box_coord The objects's bounding box in coordinates (as used when it was inserted).
+         * @param object The object to remove.
+         * @return whether the object was found and removed.
+         */
+        bool erase(const RectWorldCoord& bounding_box_coord, const T& object)
+        {
+            // Find the object's handle and remove it.
+            return erase(findHandle(bounding_box_coord.rawRect().normalized(), object));
+        }
+
+        /*!
+         * Fetches the number of objects in the quad tree container.
+         * @return the number of objects in the quad tree container.
+         */
+        size_t size() const
+        {
+            // Return the number of objects in the root node and its children.
+            return m_nodes.front().size;
+        }
+
+        /*!
+         * Removes all objects from the quad tree container (this invalidates all handles).
+         * The node, entry and handle buffers keep their capacity, so this does not free or reallocate any memory.
+         */
+        void clear()
+        {
+            // Clear the entries.
+            m_entries.clear();
+            m_entries_free_first = invalidIndex();
+            m_entries_unpacked = 0;
+
+            // Clear the handles.
+            m_handle_entries.clear();
+            m_handles_free.clear();
+
+            // Clear the nodes.
+            resetNodes();
+        }
+
+    private:
+        //! Disable copy assignment.
+        QuadTreeContainer& operator=(const QuadTreeContainer&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// A quad tree node.
+        struct Node
+        {
+            /// Boundary of the node (normalised).
+            QRectF boundary;
+
+            /// The index of the parent node (invalid for the root).
+            size_t parent;
+
+            /// The index of the first of the four children (north east, north west, south east, south west), or invalid.
+            size_t children;
+
+            /// The maximum number of levels that can be created beneath the node.
+            size_t depth_maximum;
+
+            /// The number of entries in the node and its children.
+            size_t size;
+
+            /// The number of entries in the node itself.
+            size_t entry_count;
+
+            /// The index of the first entry in the node's list, or invalid.
+            size_t entry_first;
+        };
+
+        /// An object stored in the entry buffer.
+        struct Entry
+        {
+            /// The normalised bounding box of the object.
+            QRectF bounding_box;
+
+            /// The object.
+            T object;
+
+            /// The object's handle (invalid if the slot is free).
+            Handle handle;
+
+            /// The index of the node the entry is stored in (invalid if the slot is free or not yet stored).
+            size_t node;
+
+            /// The index of the previous entry in the node's list, or invalid.
+            size_t previous;
+
+            /// The index of the next entry in the node's list (or the next free slot), or invalid.
+            size_t next;
+        };
+
+        /*!
+         * Fetches the index value that represents no node/entry.
+         * @return the invalid index.
+         */
+        static size_t invalidIndex()
+        {
+            // Return the largest index value.
+            return std::numeric_limits<size_t>::max();
+        }
+
+        /*!
+         * Checks whether a normalised rect fully contains another normalised rect (edges inclusive).
+         * @note QRectF::contains() treats zero-sized rects as null, so cannot be used for points.
+         * @param outer The outer rect.
+         * @param inner The inner rect.
+         * @return whether the outer rect contains the inner rect.
+         */
+        static bool rectContains(const QRectF& outer, const QRectF& inner)
+        {
+            // Check each edge.
+            return inner.left() >= outer.left() && inner.right() <= outer.right() && inner.top() >= outer.top() && inner.bottom() <= outer.bottom();
+        }
+
+        /*!
+         * Checks whether two normalised rects intersect (edges inclusive).
+         * @note QRectF::intersects() treats zero-sized rects as null, so cannot be used for points.
+         * @param rect_a The first rect.
+         * @param rect_b The second rect.
+         * @return whether the rects intersect.
          */
-        void erase(const PointWorldCoord& point_coord, const T& object)
+        static bool rectIntersects(const QRectF& rect_a, const QRectF& rect_b)
         {
-            // Does this boundary contain the point?
-            if(m_boundary_coord.rawRect().contains(point_coord.rawPoint()))
+            // Check each edge.
+            return rect_a.left() <= rect_b.right() && rect_b.left() <= rect_a.right() && rect_a.top() <= rect_b.bottom() && rect_b.top() <= rect_a.bottom();
+        }
+
+        /*!
+         * Visits objects whose bounding box intersects the normalised range.
+         * @param node_index The node to search from.
+         * @param range The normalised bounding box range.
+         * @param visitor Called for each object within the range, return false to stop the query.
+         * @return whether the query should continue.
+         */
+        template <class Visitor>
+        bool visitNode(const size_t& node_index, const QRectF& range, Visitor& visitor) const
+        {
+            // Keep track of whether we should continue.
+            bool continue_query(true);
+
+            // Check whether any of the node's entries intersect the range.
+            const Node& node(m_nodes[node_index]);
+            for(size_t entry_index = node.entry_first; continue_query && entry_index != invalidIndex(); entry_index = m_entries[entry_index].next)
             {
-                // Check whether any of our points are contained in the range.
-                auto itr_point = m_points.begin();
-                while(itr_point != m_points.end())
+                // Does the entry's bounding box intersect the query range.
+                const Entry& entry(m_entries[entry_index]);
+                if(rectIntersects(entry.bounding_box, range))
                 {
-                    // Have we found the object?
-                    if(itr_point->second == object)
+                    // Visit the object.
+                    continue_query = visitor(entry.object);
+                }
+            }
+
+            // Do we have any child quad tree nodes?
+            if(continue_query && node.children != invalidIndex())
+            {
+                // Search each child that intersects the range.
+                for(size_t child_index = node.children; continue_query && child_index < node.children + 4; ++child_index)
+                {
+                    // Does the range intersect with the child's boundary?
+                    if(rectIntersects(m_nodes[child_index].boundary, range))
                     {
-                        // Remove the object from the container.
-                        itr_point = m_points.erase(itr_point);
+                        // Search the child.
+                        continue_query = visitNode(child_index, range, visitor);
                     }
-                    else
+                }
+            }
+
+            // Return whether we should continue.
+            return continue_query;
+        }
+
+        /*!
+         * Fetches the child node that fully contains the normalised bounding box.
+         * @param node_index The node whose children to check.
+         * @param bounding_box The normalised bounding box.
+         * @return the child node's index, or invalid if there are no children or the bounding box straddles them.
+         */
+        size_t childContaining(const size_t& node_index, const QRectF& bounding_box) const
+        {
+            // Default to no child.
+            size_t child_index(invalidIndex());
+
+            // Do we have any child quad tree nodes?
+            const Node& node(m_nodes[node_index]);
+            if(node.children != invalidIndex())
+            {
+                // Calculate the centre of the boundary.
+                const QPointF center(node.boundary.center());
+
+                // Pick the quadrant based on the bounding box's top-left corner (north has the larger latitude).
+                child_index = node.children + (bounding_box.top() >= center.y() ? 0 : 2) + (bounding_box.left() >= center.x() ? 0 : 1);
+
+                // Does the child fully contain the bounding box?
+                if(rectContains(m_nodes[child_index].boundary, bounding_box) == false)
+                {
+                    // The bounding box straddles our children.
+                    child_index = invalidIndex();
+                }
+            }
+
+            // Return the child.
+            return child_index;
+        }
+
+        /*!
+         * Checks whether a handle refers to a stored object.
+         * @param handle The handle to check.
+         * @return whether the handle is valid.
+         */
+        bool isValidHandle(const Handle& handle) const
+        {
+            // Check the handle is in range, is in use and is stored in a node.
+            return handle < m_handle_entries.size() && m_handle_entries[handle] != invalidIndex() && m_entries[m_handle_entries[handle]].node != invalidIndex();
+        }
+
+        /*!
+         * Stores an object in a free slot of the entry buffer and allocates its handle (the entry is not yet added to a node).
+         * @param bounding_box The object's normalised bounding box.
+         * @param object The object to store.
+         * @return the object's handle.
+         */
+        Handle allocateEntry(const QRectF& bounding_box, T&& object)
+        {
+            // Allocate a handle (reusing a released handle if possible).
+            Handle handle;
+            if(m_handles_free.empty() == false)
+            {
+                handle = m_handles_free.back();
+                m_handles_free.pop_back();
+            }
+            else
+            {
+                handle = m_handle_entries.size();
+                m_handle_entries.push_back(invalidIndex());
+            }
+
+            // Do we have a free slot to reuse?
+            size_t entry_index;
+            if(m_entries_free_first != invalidIndex())
+            {
+                // Reuse the slot.
+                entry_index = m_entries_free_first;
+                m_entries_free_first = m_entries[entry_index].next;
+                m_entries[entry_index] = Entry{ bounding_box, std::move(object), handle, invalidIndex(), invalidIndex(), invalidIndex() };
+            }
+            else
+            {
+                // Add a new slot.
+                entry_index = m_entries.size();
+                m_entries.push_back(Entry{ bounding_box, std::move(object), handle, invalidIndex(), invalidIndex(), invalidIndex() });
+            }
+
+            // Point the handle at the slot.
+            m_handle_entries[handle] = entry_index;
+
+            // Return the handle.
+            return handle;
+        }
+
+        /*!
+         * Releases an entry's slot and handle so they can be reused (the entry must not be stored in a node).
+         * @param entry_index The entry to release.
+         */
+        void releaseEntry(const size_t& entry_index)
+        {
+            // Release the handle.
+            Entry& entry(m_entries[entry_index]);
+            m_handle_entries[entry.handle] = invalidIndex();
+            m_handles_free.push_back(entry.handle);
+
+            // Release the object.
+            entry.object = T();
+            entry.handle = invalidHandle();
+
+            // Add the slot to the free list.
+            entry.next = m_entries_free_first;
+            m_entries_free_first = entry_index;
+        }
+
+        /*!
+         * Adds an entry to the front of a node's list (the sizes are not changed).
+         * @param node_index The node to add the entry to.
+         * @param entry_index The entry to add.
+         */
+        void linkEntry(const size_t& node_index, const size_t& entry_index)
+        {
+            // Point the entry at the current head.
+            Node& node(m_nodes[node_index]);
+            Entry& entry(m_entries[entry_index]);
+            entry.node = node_index;
+            entry.previous = invalidIndex();
+            entry.next = node.entry_first;
+
+            // Point the current head back at the entry.
+            if(node.entry_first != invalidIndex())
+            {
+                m_entries[node.entry_first].previous = entry_index;
+            }
+
+            // The entry is the new head.
+            node.entry_first = entry_index;
+            ++node.entry_count;
+        }
+
+        /*!
+         * Moves an entry to the end of the entry buffer and adds it to a node's list (the sizes are not changed).
+         * @param node_index The node to add the entry to.
+         * @param entry The entry to move.
+         */
+        void appendEntry(const size_t& node_index, Entry&& entry)
+        {
+            // Move the entry to the end of the buffer, and point its handle at it.
+            const size_t entry_index(m_entries.size());
+            m_handle_entries[entry.handle] = entry_index;
+            m_entries.push_back(std::move(entry));
+
+            // Add the entry to the node.
+            linkEntry(node_index, entry_index);
+        }
+
+        /*!
+         * Removes an entry from its node's list (the sizes are not changed).
+         * @param entry_index The entry to remove.
+         */
+        void unlinkEntry(const size_t& entry_index)
+        {
+            // Fetch the entry and its node.
+            Entry& entry(m_entries[entry_index]);
+            Node& node(m_nodes[entry.node]);
+
+            // Point the previous entry (or the head) past the entry.
+            if(entry.previous != invalidIndex())
+            {
+                m_entries[entry.previous].next = entry.next;
+            }
+            else
+            {
+                node.entry_first = entry.next;
+            }
+
+            // Point the next entry back past the entry.
+            if(entry.next != invalidIndex())
+            {
+                m_entries[entry.next].previous = entry.previous;
+            }
+
+            // Mark the entry as not stored.
+            --node.entry_count;
+            entry.node = invalidIndex();
+            entry.previous = invalidIndex();
+            entry.next = invalidIndex();
+        }
+
+        /*!
+         * Decrements the size of a node and its ancestors.
+         * @param node_index The node that has lost an entry.
+         */
+        void decrementSize(const size_t& node_index)
+        {
+            // Walk up to the root.
+            for(size_t path_index = node_index; path_index != invalidIndex(); path_index = m_nodes[path_index].parent)
+            {
+                --m_nodes[path_index].size;
+            }
+        }
+
+        /*!
+         * Adds an entry to the deepest node that fully contains its bounding box (searching from the root).
+         * @param entry_index The entry to add.
+         * @param pack_entries Whether the entry buffer can be re-packed (false while other allocated entries are not yet linked).
+         */
+        void insertEntry(const size_t& entry_index, const bool& pack_entries = true)
+        {
+            // Find the deepest node that fully contains the bounding box (each node on the way gains an entry).
+            const QRectF bounding_box(m_entries[entry_index].bounding_box);
+            size_t node_index(0);
+            ++m_nodes[node_index].size;
+            size_t child_index(childContaining(node_index, bounding_box));
+            while(child_index != invalidIndex())
+            {
+                // Move down to the child.
+                node_index = child_index;
+                ++m_nodes[node_index].size;
+                child_index = childContaining(node_index, bounding_box);
+            }
+
+            // Add the entry to the node.
+            linkEntry(node_index, entry_index);
+
+            // Have we exceeded the node's capacity and is it still allowed to create child nodes?
+            const Node& node(m_nodes[node_index]);
+            if(node.children == invalidIndex() && node.entry_count > m_capacity && node.depth_maximum > 0)
+            {
+                // Create the child quad tree nodes and push down the entries that fit within them.
+                subdivide(node_index);
+                redistributeEntries(node_index);
+            }
+
+            // Keep track of the entries added out of tree order.
+            ++m_entries_unpacked;
+
+            // Can the entry buffer be re-packed?
+            if(pack_entries)
+            {
+                // Re-pack the entry buffer, if required.
+                packEntriesIfUnpacked();
+            }
+        }
+
+        /*!
+         * Re-packs the entry buffer if enough entries have been added out of tree order (amortised O(1)).
+         */
+        void packEntriesIfUnpacked()
+        {
+            // Have enough entries been added out of tree order that the entry buffer should be re-packed?
+            if(m_entries_unpacked > std::max(m_nodes.front().size / 2, m_capacity))
+            {
+                // Re-pack the entry buffer.
+                packEntries();
+            }
+        }
+
+        /*!
+         * Re-packs the entry buffer in tree order, so each node's entries are stored together (this keeps the handles).
+         */
+        void packEntries()
+        {
+            // Take the entry buffer.
+            std::vector<Entry> entries_source;
+            entries_source.swap(m_entries);
+            m_entries.reserve(m_nodes.front().size);
+            m_entries_free_first = invalidIndex();
+
+            // Move each node's entries back in tree order.
+            packNode(0, entries_source);
+            m_entries_unpacked = 0;
+        }
+
+        /*!
+         * Moves a node's (and its children's) entries to the end of the entry buffer.
+         * @param node_index The node to pack.
+         * @param entries_source The entry buffer the node's entries are currently stored in.
+         */
+        void packNode(const size_t& node_index, std::vector<Entry>& entries_source)
+        {
+            // Reset the node's list.
+            size_t entry_index(m_nodes[node_index].entry_first);
+            m_nodes[node_index].entry_first = invalidIndex();
+            m_nodes[node_index].entry_count = 0;
+
+            // Move each entry.
+            while(entry_index != invalidIndex())
+            {
+                const size_t entry_next(entries_source[entry_index].next);
+                appendEntry(node_index, std::move(entries_source[entry_index]));
+                entry_index = entry_next;
+            }
+
+            // Do we have any child quad tree nodes?
+            const size_t children(m_nodes[node_index].children);
+            if(children != invalidIndex())
+            {
+                // Pack each child.
+                for(size_t child_index = children; child_index < children + 4; ++child_index)
+                {
+                    packNode(child_index, entries_source);
+                }
+            }
+        }
+
+        /*!
+         * Finds the handle of an object, searching the nodes it would have been filed in first.
+         * @param bounding_box The objects's normalised bounding box (as used when it was inserted).
+         * @param object The object to find.
+         * @return the object's handle, or invalidHandle() if it was not found.
+         */
+        Handle findHandle(const QRectF& bounding_box, const T& object) const
+        {
+            // Default to not found.
+            Handle handle(invalidHandle());
+
+            // Walk down the nodes that the object would have been filed in.
+            for(size_t node_index = 0; handle == invalidHandle() && node_index != invalidIndex(); node_index = childContaining(node_index, bounding_box))
+            {
+                // Try to find the object in this node.
+                for(size_t entry_index = m_nodes[node_index].entry_first; handle == invalidHandle() && entry_index != invalidIndex(); entry_index = m_entries[entry_index].next)
+                {
+                    // Is this the object?
+                    if(m_entries[entry_index].object == object)
                     {
-                        // Move on to the next point.
-                        ++itr_point;
+                        handle = m_entries[entry_index].handle;
                     }
                 }
+            }
 
-                // Do we have child quad tree nodes?
-                if(m_child_north_east != nullptr)
+            // If the object has changed its bounding box since it was inserted, search the whole entry buffer instead.
+            for(size_t entry_index = 0; handle == invalidHandle() && entry_index < m_entries.size(); ++entry_index)
+            {
+                // Is this the (stored) object?
+                if(m_entries[entry_index].node != invalidIndex() && m_entries[entry_index].object == object)
                 {
-                    // Search each child and remove the object if found.
-                    m_child_north_east->erase(point_coord, object);
-                    m_child_north_west->erase(point_coord, object);
-                    m_child_south_east->erase(point_coord, object);
-                    m_child_south_west->erase(point_coord, object);
+                    handle = m_entries[entry_index].handle;
                 }
             }
+
+            // Return the handle.
+            return handle;
         }
 
         /*!
-         * Removes all objects from the quad tree container.
+         * Collapses the highest ancestor of a node (including itself) that has become sparse into a leaf.
+         * A node is collapsed once it holds at most half its capacity, so a node does not repeatedly split and collapse.
+         * @param node_index The node that has lost an entry.
          */
-        void clear()
+        void collapseFrom(const size_t& node_index)
         {
-            // Clear the points.
-            m_points.clear();
+            // Find the highest node on the path to the root that has children but is sparse.
+            size_t collapse_index(invalidIndex());
+            for(size_t path_index = node_index; path_index != invalidIndex(); path_index = m_nodes[path_index].parent)
+            {
+                // Is the node sparse?
+                if(m_nodes[path_index].children != invalidIndex() && m_nodes[path_index].size <= m_capacity / 2)
+                {
+                    collapse_index = path_index;
+                }
+            }
 
-            // Reset the child nodes.
-            m_child_north_east.reset(nullptr);
-            m_child_north_west.reset(nullptr);
-            m_child_south_east.reset(nullptr);
-            m_child_south_west.reset(nullptr);
+            // Did we find a node to collapse?
+            if(collapse_index != invalidIndex())
+            {
+                // Pull up the descendants' entries and release their nodes.
+                collapseChildren(collapse_index, collapse_index);
+            }
         }
 
-    private:
-        //! Disable copy constructor.
-        QuadTreeContainer(const QuadTreeContainer&); /// @todo remove once MSVC supports default/delete syntax.
+        /*!
+         * Moves the entries of a node's descendants into another node, and releases the descendant nodes.
+         * @param node_index The node whose children to collapse.
+         * @param target_index The node that receives the entries.
+         */
+        void collapseChildren(const size_t& node_index, const size_t& target_index)
+        {
+            // Do we have any child quad tree nodes?
+            const size_t children(m_nodes[node_index].children);
+            if(children != invalidIndex())
+            {
+                // Loop through each child.
+                for(size_t child_index = children; child_index < children + 4; ++child_index)
+                {
+                    // Move the child's entries into the target.
+                    size_t entry_index(m_nodes[child_index].entry_first);
+                    while(entry_index != invalidIndex())
+                    {
+                        const size_t entry_next(m_entries[entry_index].next);
+                        linkEntry(target_index, entry_index);
+                        entry_index = entry_next;
+                    }
 
-        //! Disable copy assignment.
-        QuadTreeContainer& operator=(const QuadTreeContainer&); /// @todo remove once MSVC supports default/delete syntax.
+                    // Collapse the child's own children.
+                    collapseChildren(child_index, target_index);
+                }
+
+                // Release the children.
+                m_nodes[node_index].children = invalidIndex();
+                m_node_blocks_free.push_back(children);
+            }
+        }
+
+        /*!
+         * Resets the nodes to an empty root node (but not the entries).
+         */
+        void resetNodes()
+        {
+            // Reset to just the root node.
+            m_nodes.resize(1);
+            m_nodes.front() = Node{ m_boundary_coord.rawRect(), invalidIndex(), invalidIndex(), m_depth_maximum, 0, 0, invalidIndex() };
+            m_node_blocks_free.clear();
+        }
+
+        /*!
+         * Creates the (empty) child nodes of a node.
+         * @param node_index The node to subdivide.
+         */
+        void subdivide(const size_t& node_index)
+        {
+            // Allocate a block of four nodes (reusing a released block if possible).
+            size_t children;
+            if(m_node_blocks_free.empty() == false)
+            {
+                children = m_node_blocks_free.back();
+                m_node_blocks_free.pop_back();
+            }
+            else
+            {
+                children = m_nodes.size();
+                m_nodes.resize(m_nodes.size() + 4);
+            }
+
+            // Calculate the children's boundaries (the boundary is normalised, so top() is the lowest latitude/south).
+            const Node node(m_nodes[node_index]);
+            const QSizeF half_size(node.boundary.size() / 2.0);
+            const qreal left(node.boundary.left());
+            const qreal south(node.boundary.top());
+            const std::array<QRectF, 4> boundaries = {{ QRectF(QPointF(left + half_size.width(), south + half_size.height()), half_size),
+                                                        QRectF(QPointF(left, south + half_size.height()), half_size),
+                                                        QRectF(QPointF(left + half_size.width(), south), half_size),
+                                                        QRectF(QPointF(left, south), half_size) }};
+
+            // Construct the north east, north west, south east and south west children.
+            for(size_t i = 0; i < boundaries.size(); ++i)
+            {
+                m_nodes[children + i] = Node{ boundaries[i], node_index, invalidIndex(), node.depth_maximum - 1, 0, 0, invalidIndex() };
+            }
+            m_nodes[node_index].children = children;
+        }
+
+        /*!
+         * Moves down any of a node's entries that fit entirely within one of its children.
+         * @param node_index The node to redistribute.
+         */
+        void redistributeEntries(const size_t& node_index)
+        {
+            // Loop through each entry.
+            size_t entry_index(m_nodes[node_index].entry_first);
+            while(entry_index != invalidIndex())
+            {
+                // Fetch the next entry before we move this one.
+                const size_t entry_next(m_entries[entry_index].next);
+
+                // Does a child fully contain the entry?
+                const size_t child_index(childContaining(node_index, m_entries[entry_index].bounding_box));
+                if(child_index != invalidIndex())
+                {
+                    // Move the entry to the child (the node's size is unchanged).
+                    unlinkEntry(entry_index);
+                    linkEntry(child_index, entry_index);
+                    ++m_nodes[child_index].size;
+                }
+
+                // Move on to the next entry.
+                entry_index = entry_next;
+            }
+
+            // Loop through each child.
+            const size_t children(m_nodes[node_index].children);
+            for(size_t child_index = children; child_index < children + 4; ++child_index)
+            {
+                // Has the child exceeded its capacity and is it still allowed to create child nodes?
+                if(m_nodes[child_index].entry_count > m_capacity && m_nodes[child_index].depth_maximum > 0)
+                {
+                    // Create the child's quad tree nodes and push down its entries.
+                    subdivide(child_index);
+                    redistributeEntries(child_index);
+                }
+            }
+        }
 
         /*!
-         * Creates the child nodes.
+         * Builds an (empty) node and its children from a range of entries.
+         * The entries are partitioned (by index) into those that straddle the children and one range per child, and
+         * are then moved to the end of the entry buffer, so each node's entries are packed together.
+         * @param node_index The node to build.
+         * @param entries_source The entries to move into the tree.
+         * @param indices The entry indices, of which [index_begin, index_end) belong to the node.
+         * @param indices_scratch Scratch space the same size as indices.
+         * @param index_begin The first index that belongs to the node.
+         * @param index_end One past the last index that belongs to the node.
          */
-        void subdivide()
+        void buildEntries(const size_t& node_index, std::vector<Entry>& entries_source, std::vector<size_t>& indices, std::vector<size_t>& indices_scratch, const size_t& index_begin, const size_t& index_end)
         {
-            // Calculate half the size of the boundary.
-            const QSizeF half_size = m_boundary_coord.rawRect().size() / 2.0;
+            // Keep track of the number of entries in the node and its children.
+            m_nodes[node_index].size = index_end - index_begin;
+
+            // Do the entries fit within the capacity, or are we unable to create child nodes?
+            if(m_nodes[node_index].size <= m_capacity || m_nodes[node_index].depth_maximum == 0)
+            {
+                // Move the entries into the node.
+                for(size_t i = index_begin; i < index_end; ++i)
+                {
+                    appendEntry(node_index, std::move(entries_source[indices[i]]));
+                }
+            }
+            else
+            {
+                // Create the (empty) child quad tree nodes.
+                subdivide(node_index);
+                const size_t children(m_nodes[node_index].children);
+
+                // Calculate which child each entry belongs to (0 = the node, 1-4 = child), and count them.
+                std::array<size_t, 5> counts = {{ 0, 0, 0, 0, 0 }};
+                for(size_t i = index_begin; i < index_end; ++i)
+                {
+                    // Find the child that contains the entry.
+                    const size_t child_index(childContaining(node_index, entries_source[indices[i]].bounding_box));
+                    const size_t group(child_index == invalidIndex() ? 0 : child_index - children + 1);
+
+                    // Store the group in the scratch space for now.
+                    indices_scratch[i] = group;
+                    ++counts[group];
+                }
 
-            // Construct the north east child.
-            const RectWorldCoord north_east(PointWorldCoord(m_boundary_coord.rawRect().left() + half_size.width(), m_boundary_coord.rawRect().top()), half_size);
-            m_child_north_east.reset(new QuadTreeContainer<T>(m_capacity, north_east));
+                // Calculate where each group starts.
+                std::array<size_t, 6> group_begin = {{ index_begin, 0, 0, 0, 0, 0 }};
+                for(size_t group = 0; group < counts.size(); ++group)
+                {
+                    group_begin[group + 1] = group_begin[group] + counts[group];
+                }
 
-            // Construct the north west child.
-            const RectWorldCoord north_west(PointWorldCoord(m_boundary_coord.rawRect().left(), m_boundary_coord.rawRect().top()), half_size);
-            m_child_north_west.reset(new QuadTreeContainer<T>(m_capacity, north_west));
+                // Scatter the indices into their groups (via a copy of the group starts).
+                std::array<size_t, 6> group_next(group_begin);
+                std::vector<size_t> indices_grouped(index_end - index_begin);
+                for(size_t i = index_begin; i < index_end; ++i)
+                {
+                    indices_grouped[group_next[indices_scratch[i]]++ - index_begin] = indices[i];
+                }
+                std::copy(indices_grouped.begin(), indices_grouped.end(), indices.begin() + index_begin);
 
-            // Construct the south east child.
-            const RectWorldCoord south_east(PointWorldCoord(m_boundary_coord.rawRect().left() + half_size.width(), m_boundary_coord.rawRect().top() + half_size.height()), half_size);
-            m_child_south_east.reset(new QuadTreeContainer<T>(m_capacity, south_east));
+                // Move the entries that straddle the children into the node.
+                for(size_t i = group_begin[0]; i < group_begin[1]; ++i)
+                {
+                    appendEntry(node_index, std::move(entries_source[indices[i]]));
+                }
 
-            // Construct the south west child.
-            const RectWorldCoord south_west(PointWorldCoord(m_boundary_coord.rawRect().left(), m_boundary_coord.rawRect().top() + half_size.height()), half_size);
-            m_child_south_west.reset(new QuadTreeContainer<T>(m_capacity, south_west));
+                // Build each child from its group.
+                for(size_t group = 1; group < group_begin.size() - 1; ++group)
+                {
+                    buildEntries(children + group - 1, entries_source, indices, indices_scratch, group_begin[group], group_begin[group + 1]);
+                }
+            }
         }
 
     private:
         /// Quad tree node capacity.
         const size_t m_capacity;
 
-        /// Boundary of this quad tree node.
+        /// Boundary of the root quad tree node (normalised).
         const RectWorldCoord m_boundary_coord;
 
-        /// Points in this quad tree node.
-        std::vector<std::pair<PointWorldCoord, T>> m_points;
+        /// The maximum number of levels that can be created beneath the root quad tree node.
+        const size_t m_depth_maximum;
+
+        /// The quad tree nodes (the root is the first node, and each node's children are four consecutive nodes).
+        std::vector<Node> m_nodes;
+
+        /// The first node of each released block of four nodes, which can be reused.
+        std::vector<size_t> m_node_blocks_free;
+
+        /// The packed entry buffer (packed in tree order whenever the tree is rebuilt).
+        std::vector<Entry> m_entries;
 
-        /// Child: north east quad tree node.
-        std::unique_ptr<QuadTreeContainer> m_child_north_east;
+        /// The index of the first free slot in the entry buffer, or invalid.
+        size_t m_entries_free_first;
 
-        /// Child: north west quad tree node.
-        std::unique_ptr<QuadTreeContainer> m_child_north_west;
+        /// The number of entries added to the tree since the entry buffer was last packed.
+        size_t m_entries_unpacked;
 
-        /// Child: south east quad tree node.
-        std::unique_ptr<QuadTreeContainer> m_child_south_east;
+        /// The entry buffer index of each handle's object (invalid for released handles).
+        std::vector<size_t> m_handle_entries;
 
-        /// Child: south west quad tree node.
-        std::unique_ptr<QuadTreeContainer> m_child_south_west;
+        /// Handles that have been released and can be reused.
+        std::vector<Handle> m_handles_free;
     };
 }
@@ -0,0 +1,304 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ShapeCache.h"
+
+// Qt includes.
+#include <QtCore/QMutexLocker>
+#include <QtGui/QImage>
+#include <QtGui/QTransform>
+
+// STL includes.
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The largest shape (width or height, once rotated) that is cached (pixels).
+        const int shape_size_maximum_px(512);
+
+        /*!
+         * Calculates the size of the image a shape is rasterised into.
+         * @param key The shape style.
+         * @return the size of the rotated shape (pixels).
+         */
+        QSize canvasSizePx(const ShapeCache::Key& key)
+        {
+            // Rotate the shape's rect about its centre.
+            QTransform transform;
+            transform.rotate(key.rotation);
+            const QRectF rotated_rect_px(transform.mapRect(QRectF(-key.width_px / 2.0, -key.height_px / 2.0, key.width_px, key.height_px)));
+
+            // Round up to whole pixels (ignoring rounding errors, so an unrotated shape keeps its size).
+            return QSize(int(std::ceil(rotated_rect_px.width() - 1e-6)), int(std::ceil(rotated_rect_px.height() - 1e-6)));
+        }
+    }
+
+    ShapeCache& ShapeCache::get()
+    {
+        // The singleton instance (created when a shape geometry is first drawn, on whichever thread draws it).
+        static ShapeCache instance;
+
+        // Return the reference to the instance object.
+        return instance;
+    }
+
+    bool ShapeCache::Key::operator<(const Key& other) const
+    {
+        // Compare each field in turn.
+        return std::tie(shape, shape_data, pen_colour, pen_width, pen_style, pen_cap_style, pen_join_style, brush_colour, brush_style, width_px, height_px, scale, rotation)
+                < std::tie(other.shape, other.shape_data, other.pen_colour, other.pen_width, other.pen_style, other.pen_cap_style, other.pen_join_style, other.brush_colour, other.brush_style, other.width_px, other.height_px, other.scale, other.rotation);
+    }
+
+    ShapeCache::ShapeCache()
+        : m_memory_bytes(0),
+          m_memory_limit_bytes(32 * 1024 * 1024),
+          m_rotation_step(5.0)
+    {
+
+    }
+
+    std::size_t ShapeCache::memoryLimitBytes() const
+    {
+        // Gain a lock to protect the cache.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the memory limit.
+        return m_memory_limit_bytes;
+    }
+
+    void ShapeCache::setMemoryLimitBytes(const std::size_t& memory_limit_bytes)
+    {
+        // Gain a lock to protect the cache.
+        QMutexLocker locker(&m_mutex);
+
+        // Set the memory limit.
+        m_memory_limit_bytes = memory_limit_bytes;
+
+        // Evict any shapes over the new limit.
+        evict();
+    }
+
+    qreal ShapeCache::rotationStep() const
+    {
+        // Return the rotation step.
+        return m_rotation_step;
+    }
+
+    void ShapeCache::setRotationStep(const qreal& rotation_step)
+    {
+        // Set the rotation step (keys already created keep their rotation).
+        m_rotation_step = std::max(rotation_step, qreal(0.01));
+    }
+
+    bool ShapeCache::key(Key& return_key, const std::string& shape, const qint64& shape_data, const QPen& pen, const QBrush& brush, const QSizeF& size_px, const qreal& scale, const qreal& rotation) const
+    {
+        // Round the rotation to the rotation step (within 0 to 360 degrees).
+        const qreal rotation_step(rotationStep());
+        qreal rotation_rounded(std::fmod(std::round(rotation / rotation_step) * rotation_step, 360.0));
+        if(rotation_rounded < 0.0)
+        {
+            // Wrap negative rotations.
+            rotation_rounded += 360.0;
+        }
+
+        // Fill in the key.
+        return_key.shape = shape;
+        return_key.shape_data = shape_data;
+        return_key.pen_colour = pen.color().rgba();
+        return_key.pen_width = pen.widthF();
+        return_key.pen_style = int(pen.style());
+        return_key.pen_cap_style = int(pen.capStyle());
+        return_key.pen_join_style = int(pen.joinStyle());
+        return_key.brush_colour = brush.color().rgba();
+        return_key.brush_style = int(brush.style());
+        return_key.width_px = size_px.toSize().width();
+        return_key.height_px = size_px.toSize().height();
+        return_key.scale = scale;
+        return_key.rotation = rotation_rounded;
+
+        // Gradients, textures and custom dashes are not captured by the key.
+        if(brush.gradient() != nullptr || brush.style() == Qt::TexturePattern || pen.brush().gradient() != nullptr || pen.brush().style() == Qt::TexturePattern || pen.style() == Qt::CustomDashLine)
+        {
+            // The shape must be drawn directly.
+            return false;
+        }
+
+        // Is the shape too large to cache?
+        const QSize canvas_size_px(canvasSizePx(return_key));
+        if(canvas_size_px.width() > shape_size_maximum_px || canvas_size_px.height() > shape_size_maximum_px)
+        {
+            // The shape must be drawn directly.
+            return false;
+        }
+
+        // The shape can be cached.
+        return true;
+    }
+
+    std::shared_ptr<const QImage> ShapeCache::image(const Key& key, const std::function<void(QPainter&)>& draw_shape)
+    {
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the cache.
+            QMutexLocker locker(&m_mutex);
+
+            // Is the shape already cached?
+            const auto itr_find = m_entries.find(key);
+            if(itr_find != m_entries.end())
+            {
+                // Mark it as the most recently used.
+                m_lru.splice(m_lru.begin(), m_lru, itr_find->second.lru_itr);
+
+                // Return the cached image.
+                return itr_find->second.image;
+            }
+        }
+
+        // Rasterise the shape (outside of the lock, so other shapes can still be fetched).
+        const std::shared_ptr<const QImage> shape_image(std::make_shared<QImage>(render(key, draw_shape)));
+
+        // Gain a lock to protect the cache.
+        QMutexLocker locker(&m_mutex);
+
+        // Has the shape been cached since we checked (by another thread)?
+        const auto itr_find = m_entries.find(key);
+        if(itr_find != m_entries.end())
+        {
+            // Return the cached image instead (so the shape is only shared once).
+            return itr_find->second.image;
+        }
+
+        // Cache the image as the most recently used.
+        m_lru.push_front(key);
+        Entry entry;
+        entry.image = shape_image;
+        entry.bytes = std::size_t(shape_image->byteCount());
+        entry.lru_itr = m_lru.begin();
+        m_entries.emplace(key, entry);
+        m_memory_bytes += entry.bytes;
+
+        // Evict any shapes over the limit.
+        evict();
+
+        // Return the image.
+        return shape_image;
+    }
+
+    std::shared_ptr<QPixmap> ShapeCache::pixmap(const Key& key, const std::function<void(QPainter&)>& draw_shape)
+    {
+        // Fetch the rasterised shape (caching it).
+        const std::shared_ptr<const QImage> shape_image(image(key, draw_shape));
+
+        // Gain a lock to protect the cache.
+        QMutexLocker locker(&m_mutex);
+
+        // Has the shape been evicted since it was fetched (by another thread)?
+        const auto itr_find = m_entries.find(key);
+        if(itr_find == m_entries.end() || itr_find->second.image != shape_image)
+        {
+            // Return an image pixmap just for this geometry.
+            return std::make_shared<QPixmap>(QPixmap::fromImage(*shape_image));
+        }
+
+        // Has the shape already been converted to an image pixmap?
+        const std::shared_ptr<QPixmap> shape_pixmap(itr_find->second.pixmap);
+        if(shape_pixmap != nullptr)
+        {
+            // Return the cached image pixmap.
+            return shape_pixmap;
+        }
+
+        // Convert the shape to an image pixmap, shared by every geometry that holds it.
+        itr_find->second.pixmap = std::make_shared<QPixmap>(QPixmap::fromImage(*shape_image));
+        const std::size_t pixmap_bytes(std::size_t(shape_image->byteCount()));
+        itr_find->second.bytes += pixmap_bytes;
+        m_memory_bytes += pixmap_bytes;
+
+        // Keep the image pixmap to return (evicting may release the entry).
+        const std::shared_ptr<QPixmap> return_pixmap(itr_find->second.pixmap);
+
+        // Evict any shapes over the limit.
+        evict();
+
+        // Return the image pixmap.
+        return return_pixmap;
+    }
+
+    QImage ShapeCache::render(const Key& key, const std::function<void(QPainter&)>& draw_shape)
+    {
+        // Is there anything to draw?
+        const QSize canvas_size_px(canvasSizePx(key));
+        if(canvas_size_px.isEmpty())
+        {
+            // Return an empty image.
+            return QImage();
+        }
+
+        // Create a transparent image of the rotated size.
+        QImage image(canvas_size_px, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+
+        // Create a painter for the image, with antialiasing enabled.
+        QPainter painter(&image);
+        painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform, true);
+
+        // Translate to the centre with the required rotation and scale.
+        painter.translate(canvas_size_px.width() / 2.0, canvas_size_px.height() / 2.0);
+        painter.rotate(key.rotation);
+        painter.scale(key.scale, key.scale);
+
+        // Draw the shape.
+        draw_shape(painter);
+        painter.end();
+
+        // Return the image.
+        return image;
+    }
+
+    void ShapeCache::clear()
+    {
+        // Gain a lock to protect the cache.
+        QMutexLocker locker(&m_mutex);
+
+        // Release every shape.
+        m_entries.clear();
+        m_lru.clear();
+        m_memory_bytes = 0;
+    }
+
+    void ShapeCache::evict()
+    {
+        // Evict the least recently used shapes (always keeping the most recent, even if it is over the limit).
+        while(m_memory_bytes > m_memory_limit_bytes && m_lru.size() > 1)
+        {
+            // Remove the least recently used shape.
+            const auto itr_find = m_entries.find(m_lru.back());
+            m_memory_bytes -= itr_find->second.bytes;
+            m_entries.erase(itr_find);
+            m_lru.pop_back();
+        }
+    }
+}
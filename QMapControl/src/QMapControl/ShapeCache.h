@@ -0,0 +1,249 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QMutex>
+#include <QtCore/QSizeF>
+#include <QtGui/QBrush>
+#include <QtGui/QImage>
+#include <QtGui/QPainter>
+#include <QtGui/QPen>
+#include <QtGui/QPixmap>
+
+// STL includes.
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+
+namespace qmapcontrol
+{
+    //! Caches shapes rasterised into images.
+    /*!
+     * Point shapes (circles, arrows, scaled shapes) are drawn once for each style they are used with, and
+     * then drawn as plain images. A style is identified by the shape type, pen, brush, pixel size, scale and
+     * rotation (rounded to the rotation step), so identically styled shapes share a single image, and a
+     * single atlas sprite. The shapes are kept as QImage (rather than QPixmap), so they can be rasterised
+     * and drawn from any render thread; an image pixmap is only created for geometries that hold their
+     * shape as their image pixmap (which are styled on the thread that owns them).
+     *
+     * The cache is bounded by its memory limit, and evicts the least recently used shapes first (geometries
+     * keep any images they already hold).
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT ShapeCache
+    {
+    public:
+        /*!
+         * Get the singleton instance of the Shape Cache.
+         * @return the singleton instance.
+         */
+        static ShapeCache& get();
+
+        /// The style a shape is rasterised with.
+        struct Key
+        {
+            /// The shape type.
+            std::string shape;
+
+            /// Any extra data the shape is drawn with (ie: the cache key of an image pixmap).
+            qint64 shape_data;
+
+            /// The pen colour (ARGB).
+            QRgb pen_colour;
+
+            /// The pen width.
+            qreal pen_width;
+
+            /// The pen style.
+            int pen_style;
+
+            /// The pen cap style.
+            int pen_cap_style;
+
+            /// The pen join style.
+            int pen_join_style;
+
+            /// The brush colour (ARGB).
+            QRgb brush_colour;
+
+            /// The brush style.
+            int brush_style;
+
+            /// The width of the shape before it is rotated (pixels).
+            int width_px;
+
+            /// The height of the shape before it is rotated (pixels).
+            int height_px;
+
+            /// The scale the shape is drawn with.
+            qreal scale;
+
+            /// The rotation the shape is drawn with, rounded to the rotation step (degrees).
+            qreal rotation;
+
+            /*!
+             * Orders keys, so they can be stored in a map.
+             * @param other The key to compare against.
+             * @return whether this key is ordered before the other key.
+             */
+            bool operator<(const Key& other) const;
+        };
+
+    public:
+        //! Disable copy constructor.
+        ///ShapeCache(const ShapeCache&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///ShapeCache& operator=(const ShapeCache&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~ShapeCache() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Fetches the memory the cached shapes may use before the least recently used are evicted.
+         * @return the memory limit in bytes.
+         */
+        std::size_t memoryLimitBytes() const;
+
+        /*!
+         * Sets the memory the cached shapes may use before the least recently used are evicted.
+         * @param memory_limit_bytes The memory limit in bytes.
+         */
+        void setMemoryLimitBytes(const std::size_t& memory_limit_bytes);
+
+        /*!
+         * Fetches the step that rotations are rounded to.
+         * @return the rotation step (degrees).
+         */
+        qreal rotationStep() const;
+
+        /*!
+         * Sets the step that rotations are rounded to (larger steps share more images, smaller steps draw more accurately).
+         * @param rotation_step The rotation step (degrees).
+         */
+        void setRotationStep(const qreal& rotation_step);
+
+        /*!
+         * Creates the key for a shape style.
+         * @param return_key The key created.
+         * @param shape The shape type.
+         * @param shape_data Any extra data the shape is drawn with (ie: the cache key of an image pixmap).
+         * @param pen The pen the shape is drawn with.
+         * @param brush The brush the shape is drawn with.
+         * @param size_px The size of the shape before it is rotated (pixels).
+         * @param scale The scale the shape is drawn with.
+         * @param rotation The rotation the shape is drawn with (degrees).
+         * @return whether the shape style can be cached (gradient/texture brushes and custom dashes cannot).
+         */
+        bool key(Key& return_key, const std::string& shape, const qint64& shape_data, const QPen& pen, const QBrush& brush, const QSizeF& size_px, const qreal& scale, const qreal& rotation) const;
+
+        /*!
+         * Fetches the image of a shape style, rasterising it if it is not cached (this can be called from any thread).
+         * @param key The shape style.
+         * @param draw_shape The function that draws the shape centred on the painter's origin (called at most once).
+         * @return the shared image.
+         */
+        std::shared_ptr<const QImage> image(const Key& key, const std::function<void(QPainter&)>& draw_shape);
+
+        /*!
+         * Fetches the image pixmap of a shape style, rasterising it if it is not cached (this creates a QPixmap, so must
+         * not be called from a render thread).
+         * @param key The shape style.
+         * @param draw_shape The function that draws the shape centred on the painter's origin (called at most once).
+         * @return the image pixmap, which is shared and so must not be modified.
+         */
+        std::shared_ptr<QPixmap> pixmap(const Key& key, const std::function<void(QPainter&)>& draw_shape);
+
+        /*!
+         * Rasterises a shape style into a new image (without caching it).
+         * @param key The shape style.
+         * @param draw_shape The function that draws the shape centred on the painter's origin.
+         * @return the image.
+         */
+        static QImage render(const Key& key, const std::function<void(QPainter&)>& draw_shape);
+
+        /*!
+         * Releases every cached shape.
+         */
+        void clear();
+
+    private:
+        //! Constructor.
+        ShapeCache();
+
+        //! Disable copy constructor.
+        ShapeCache(const ShapeCache&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ShapeCache& operator=(const ShapeCache&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /*!
+         * Evicts the least recently used shapes until the memory limit is met (the mutex must be held).
+         */
+        void evict();
+
+        /// A cached shape.
+        struct Entry
+        {
+            /// The rasterised shape.
+            std::shared_ptr<const QImage> image;
+
+            /// The rasterised shape as an image pixmap (only created once a geometry holds it as its image pixmap).
+            std::shared_ptr<QPixmap> pixmap;
+
+            /// The memory used by the image and image pixmap (bytes).
+            std::size_t bytes;
+
+            /// The key's position in the least recently used list.
+            std::list<Key>::iterator lru_itr;
+        };
+
+    private:
+        /// The cached shapes.
+        std::map<Key, Entry> m_entries;
+
+        /// The keys of the cached shapes, from the most to the least recently used.
+        std::list<Key> m_lru;
+
+        /// The memory used by the cached shapes (bytes).
+        std::size_t m_memory_bytes;
+
+        /// The memory the cached shapes may use (bytes).
+        std::size_t m_memory_limit_bytes;
+
+        /// The step that rotations are rounded to (degrees), read by every key() call without taking the mutex.
+        std::atomic<qreal> m_rotation_step;
+
+        /// Mutex to protect the cache (shapes are fetched by several render threads at once).
+        mutable QMutex m_mutex;
+    };
+}
@@ -0,0 +1,190 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "StyleRegistry.h"
+
+// Qt includes.
+#include <QtCore/QDataStream>
+#include <QtCore/QMutexLocker>
+
+// Local includes.
+#include "Geometry.h"
+#include "WeakPtrMap.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The number of styles to prune at initially.
+        const std::size_t prune_size_minimum(256);
+
+        /*!
+         * Serialises a style, to key it by its value.
+         * @param style The pen or brush to serialise.
+         * @return the serialised style.
+         */
+        template <class Style>
+        QByteArray serialise(const Style& style)
+        {
+            // Stream the style into a byte array.
+            QByteArray bytes;
+            QDataStream stream(&bytes, QIODevice::WriteOnly);
+            stream << style;
+
+            // Return the serialised style.
+            return bytes;
+        }
+
+        /*!
+         * Fetches the interned instance of a style, interning it if it is not already.
+         * @param styles The interned styles.
+         * @param style The style to intern.
+         * @return the shared style.
+         */
+        template <class Style>
+        std::shared_ptr<const Style> intern(std::map<QByteArray, std::weak_ptr<const Style>>& styles, const Style& style)
+        {
+            // Is the style already interned (and still in use)?
+            std::weak_ptr<const Style>& interned(styles[serialise(style)]);
+            std::shared_ptr<const Style> return_style(interned.lock());
+            if(return_style == nullptr)
+            {
+                // Intern the style.
+                return_style = std::make_shared<const Style>(style);
+                interned = return_style;
+            }
+
+            // Return the shared style.
+            return return_style;
+        }
+
+    }
+
+    StyleRule::StyleRule(const QPen& pen_, const QBrush& brush_, const int& zoom_minimum_, const int& zoom_maximum_, const std::string& metadata_key_, const QVariant& metadata_value_)
+        : pen(StyleRegistry::get().pen(pen_)),
+          brush(StyleRegistry::get().brush(brush_)),
+          zoom_minimum(zoom_minimum_),
+          zoom_maximum(zoom_maximum_),
+          metadata_key(metadata_key_),
+          metadata_value(metadata_value_)
+    {
+
+    }
+
+    bool StyleRule::matches(const Geometry& geometry) const
+    {
+        // Does the rule match every geometry?
+        if(metadata_key.empty())
+        {
+            return true;
+        }
+
+        // Does the geometry have the meta-data (with the value, if one is required)?
+        const QVariant value(geometry.metadata(metadata_key));
+        return value.isNull() == false && (metadata_value.isNull() || value == metadata_value);
+    }
+
+    bool StyleRule::appliesAt(const int& controller_zoom) const
+    {
+        // Is the zoom within the rule's range?
+        return controller_zoom >= zoom_minimum && controller_zoom <= zoom_maximum;
+    }
+
+    StyleRegistry& StyleRegistry::get()
+    {
+        // The singleton instance (styles are interned as geometries and style rules are created, which a loader thread
+        // may do before the GUI thread does).
+        static StyleRegistry instance;
+
+        // Return the reference to the instance object.
+        return instance;
+    }
+
+    StyleRegistry::StyleRegistry()
+        : m_pens_prune_size(prune_size_minimum),
+          m_brushes_prune_size(prune_size_minimum)
+    {
+
+    }
+
+    std::shared_ptr<const QPen> StyleRegistry::pen(const QPen& pen)
+    {
+        // Texture brushes are not worth serialising (the image would be streamed), so just copy the pen.
+        if(pen.brush().style() == Qt::TexturePattern)
+        {
+            return std::make_shared<const QPen>(pen);
+        }
+
+        // Gain a lock to protect the interned styles.
+        QMutexLocker locker(&m_mutex);
+
+        // Fetch the interned pen.
+        const std::shared_ptr<const QPen> return_pen(intern(m_pens, pen));
+
+        // Remove any pens no longer used.
+        pruneExpired(m_pens, m_pens_prune_size, prune_size_minimum);
+
+        // Return the shared pen.
+        return return_pen;
+    }
+
+    std::shared_ptr<const QBrush> StyleRegistry::brush(const QBrush& brush)
+    {
+        // Texture brushes are not worth serialising (the image would be streamed), so just copy the brush.
+        if(brush.style() == Qt::TexturePattern)
+        {
+            return std::make_shared<const QBrush>(brush);
+        }
+
+        // Gain a lock to protect the interned styles.
+        QMutexLocker locker(&m_mutex);
+
+        // Fetch the interned brush.
+        const std::shared_ptr<const QBrush> return_brush(intern(m_brushes, brush));
+
+        // Remove any brushes no longer used.
+        pruneExpired(m_brushes, m_brushes_prune_size, prune_size_minimum);
+
+        // Return the shared brush.
+        return return_brush;
+    }
+
+    std::size_t StyleRegistry::size() const
+    {
+        // Gain a lock to protect the interned styles.
+        QMutexLocker locker(&m_mutex);
+
+        // Count the styles still in use.
+        std::size_t return_size(0);
+        for(const auto& pen : m_pens)
+        {
+            return_size += pen.second.expired() ? 0 : 1;
+        }
+        for(const auto& brush : m_brushes)
+        {
+            return_size += brush.second.expired() ? 0 : 1;
+        }
+
+        // Return the number of styles.
+        return return_size;
+    }
+}
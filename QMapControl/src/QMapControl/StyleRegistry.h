@@ -0,0 +1,174 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QVariant>
+#include <QtGui/QBrush>
+#include <QtGui/QPen>
+
+// STL includes.
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+
+namespace qmapcontrol
+{
+    class Geometry;
+
+    //! A rule that styles the line strings and polygons it matches, by zoom and meta-data.
+    /*!
+     * A layer's style rules are resolved once for each geometry when it is added to the layer: the rules whose
+     * meta-data matches are kept (in order), and when the geometry is drawn the first of those that applies at
+     * the zoom provides the pen/brush. A null pen/brush keeps the geometry's own.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    struct QMAPCONTROL_EXPORT StyleRule
+    {
+        /*!
+         * Constructor.
+         * @param pen The pen to draw the geometries with (interned).
+         * @param brush The brush to draw the geometries with (interned).
+         * @param zoom_minimum The minimum zoom the rule applies at.
+         * @param zoom_maximum The maximum zoom the rule applies at.
+         * @param metadata_key The meta-data key the geometries must have (empty to match every geometry).
+         * @param metadata_value The meta-data value the geometries must have (null to match any value).
+         */
+        StyleRule(const QPen& pen, const QBrush& brush, const int& zoom_minimum = 0, const int& zoom_maximum = 17, const std::string& metadata_key = "", const QVariant& metadata_value = QVariant());
+
+        /*!
+         * Checks whether the rule matches a geometry's meta-data.
+         * @param geometry The geometry to check.
+         * @return whether the rule matches.
+         */
+        bool matches(const Geometry& geometry) const;
+
+        /*!
+         * Checks whether the rule applies at a zoom.
+         * @param controller_zoom The zoom to check.
+         * @return whether the rule applies.
+         */
+        bool appliesAt(const int& controller_zoom) const;
+
+        /// The pen to draw the geometries with (null to keep the geometry's own).
+        std::shared_ptr<const QPen> pen;
+
+        /// The brush to draw the geometries with (null to keep the geometry's own).
+        std::shared_ptr<const QBrush> brush;
+
+        /// The minimum zoom the rule applies at.
+        int zoom_minimum;
+
+        /// The maximum zoom the rule applies at.
+        int zoom_maximum;
+
+        /// The meta-data key the geometries must have (empty to match every geometry).
+        std::string metadata_key;
+
+        /// The meta-data value the geometries must have (null to match any value).
+        QVariant metadata_value;
+    };
+
+    //! Interns the pens and brushes geometries are drawn with.
+    /*!
+     * Equal pens (and brushes) share a single instance, so setting the same style on many geometries does not
+     * allocate a copy for each, and the layer can group geometries by style by comparing pointers (drawing each
+     * group with a single painter state change).
+     *
+     * Interned styles are shared as const, so they cannot be modified. Styles with texture brushes are not interned.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT StyleRegistry
+    {
+    public:
+        /*!
+         * Get the singleton instance of the Style Registry.
+         * @return the singleton instance.
+         */
+        static StyleRegistry& get();
+
+    public:
+        //! Disable copy constructor.
+        ///StyleRegistry(const StyleRegistry&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///StyleRegistry& operator=(const StyleRegistry&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~StyleRegistry() { } /// = default; @todo re-add once MSVC supports default/delete syntax.
+
+        /*!
+         * Fetches the interned instance of a pen.
+         * @param pen The pen to intern.
+         * @return the shared pen.
+         */
+        std::shared_ptr<const QPen> pen(const QPen& pen);
+
+        /*!
+         * Fetches the interned instance of a brush.
+         * @param brush The brush to intern.
+         * @return the shared brush.
+         */
+        std::shared_ptr<const QBrush> brush(const QBrush& brush);
+
+        /*!
+         * Fetches the number of pens and brushes that are interned (and still in use).
+         * @return the number of interned styles.
+         */
+        std::size_t size() const;
+
+    private:
+        //! Constructor.
+        StyleRegistry();
+
+        //! Disable copy constructor.
+        StyleRegistry(const StyleRegistry&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        StyleRegistry& operator=(const StyleRegistry&); /// @todo remove once MSVC supports default/delete syntax.
+
+    private:
+        /// The interned pens, keyed by their serialised value (released once no geometry uses them).
+        std::map<QByteArray, std::weak_ptr<const QPen>> m_pens;
+
+        /// The interned brushes, keyed by their serialised value (released once no geometry uses them).
+        std::map<QByteArray, std::weak_ptr<const QBrush>> m_brushes;
+
+        /// The number of pens to prune the unused ones at.
+        std::size_t m_pens_prune_size;
+
+        /// The number of brushes to prune the unused ones at.
+        std::size_t m_brushes_prune_size;
+
+        /// Mutex to protect the interned styles.
+        mutable QMutex m_mutex;
+    };
+}
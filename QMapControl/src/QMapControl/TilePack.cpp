@@ -0,0 +1,253 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "TilePack.h"
+
+// Qt includes.
+#include <QtCore/QDataStream>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The header at the start of a pack.
+        const QByteArray pack_header("QMCTPAK1");
+
+        /// The footer at the end of a pack (after the index).
+        const QByteArray pack_footer("QMCTIDX1");
+
+        /// The size of an index entry (key, offset and size).
+        const qint64 index_entry_bytes(8 + 8 + 4);
+
+        /// The size of the trailer (index offset, tile count and footer).
+        const qint64 trailer_bytes(8 + 8 + 8);
+    }
+
+    QString TilePack::urlScheme()
+    {
+        // Return the url scheme.
+        return "tilepack";
+    }
+
+    QUrl TilePack::url(const QString& filename)
+    {
+        // Return the pack's path with the tile placeholders as the fragment.
+        QUrl return_url;
+        return_url.setScheme(urlScheme());
+        return_url.setPath(filename);
+        return_url.setFragment("%zoom/%x/%y");
+        return return_url;
+    }
+
+    bool TilePack::parseUrl(const QUrl& url, QString& return_filename, int& return_zoom, int& return_x, int& return_y)
+    {
+        // Is the url of a packed tile?
+        if(url.scheme() != urlScheme())
+        {
+            return false;
+        }
+
+        // Parse the tile from the fragment.
+        const QStringList tile(url.fragment().split('/'));
+        bool zoom_ok(false);
+        bool x_ok(false);
+        bool y_ok(false);
+        if(tile.size() != 3)
+        {
+            return false;
+        }
+        return_zoom = tile.at(0).toInt(&zoom_ok);
+        return_x = tile.at(1).toInt(&x_ok);
+        return_y = tile.at(2).toInt(&y_ok);
+
+        // Return the pack file.
+        return_filename = url.path();
+        return zoom_ok && x_ok && y_ok;
+    }
+
+    TilePack::TilePack(const QString& filename)
+        : m_file(filename),
+          m_writing(false)
+    {
+
+    }
+
+    TilePack::~TilePack()
+    {
+        // Ensure the pack is closed (and its index written).
+        close();
+    }
+
+    bool TilePack::create()
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Create the file (replacing any existing file) and write the header.
+        m_index.clear();
+        m_writing = m_file.open(QIODevice::WriteOnly | QIODevice::Truncate) && m_file.write(pack_header) == pack_header.size();
+
+        // Return whether the pack was created.
+        return m_writing;
+    }
+
+    bool TilePack::write(const int& zoom, const int& x, const int& y, const QByteArray& data)
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Has the pack been created for writing?
+        if(m_writing == false)
+        {
+            return false;
+        }
+
+        // Append the tile, and record where it is stored.
+        const quint64 offset(quint64(m_file.pos()));
+        if(m_file.write(data) != data.size())
+        {
+            return false;
+        }
+        m_index[key(zoom, x, y)] = std::make_pair(offset, quint32(data.size()));
+
+        // Success.
+        return true;
+    }
+
+    bool TilePack::open()
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Open the file, and check it is large enough to hold the header and trailer.
+        m_index.clear();
+        m_writing = false;
+        if(m_file.open(QIODevice::ReadOnly) == false || m_file.size() < pack_header.size() + trailer_bytes || m_file.read(pack_header.size()) != pack_header)
+        {
+            m_file.close();
+            return false;
+        }
+
+        // Read the trailer.
+        m_file.seek(m_file.size() - trailer_bytes);
+        QDataStream stream(&m_file);
+        quint64 index_offset(0);
+        quint64 count(0);
+        stream >> index_offset >> count;
+        if(m_file.read(pack_footer.size()) != pack_footer || index_offset + count * quint64(index_entry_bytes) + quint64(trailer_bytes) != quint64(m_file.size()))
+        {
+            m_file.close();
+            return false;
+        }
+
+        // Read the index.
+        m_file.seek(qint64(index_offset));
+        for(quint64 i = 0; i < count; ++i)
+        {
+            quint64 tile_key(0);
+            quint64 offset(0);
+            quint32 size(0);
+            stream >> tile_key >> offset >> size;
+            m_index[tile_key] = std::make_pair(offset, size);
+        }
+
+        // Return whether the index was read.
+        return stream.status() == QDataStream::Ok;
+    }
+
+    bool TilePack::contains(const int& zoom, const int& x, const int& y) const
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Is the tile in the index?
+        return m_index.find(key(zoom, x, y)) != m_index.end();
+    }
+
+    QByteArray TilePack::read(const int& zoom, const int& x, const int& y) const
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Is the pack opened for reading, and is the tile in the index?
+        const auto itr_find = m_index.find(key(zoom, x, y));
+        if(m_writing || m_file.isOpen() == false || itr_find == m_index.end())
+        {
+            return QByteArray();
+        }
+
+        // Read the tile.
+        m_file.seek(qint64(itr_find->second.first));
+        return m_file.read(qint64(itr_find->second.second));
+    }
+
+    bool TilePack::close()
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Is the pack open?
+        if(m_file.isOpen() == false)
+        {
+            return true;
+        }
+
+        // Was the pack created for writing?
+        bool success(true);
+        if(m_writing)
+        {
+            // Write the index.
+            const quint64 index_offset(quint64(m_file.pos()));
+            QDataStream stream(&m_file);
+            for(const auto& entry : m_index)
+            {
+                stream << entry.first << entry.second.first << entry.second.second;
+            }
+
+            // Write the trailer.
+            stream << index_offset << quint64(m_index.size());
+            success = stream.status() == QDataStream::Ok && m_file.write(pack_footer) == pack_footer.size();
+            m_writing = false;
+        }
+
+        // Close the file.
+        m_file.close();
+        return success;
+    }
+
+    std::size_t TilePack::size() const
+    {
+        // Gain a lock to protect the file and index.
+        QMutexLocker locker(&m_mutex);
+
+        // Return the number of tiles.
+        return m_index.size();
+    }
+
+    quint64 TilePack::key(const int& zoom, const int& x, const int& y)
+    {
+        // Pack the zoom (6 bits), x and y (29 bits each) into the key.
+        return (quint64(zoom) << 58) | (quint64(x) << 29) | quint64(y);
+    }
+}
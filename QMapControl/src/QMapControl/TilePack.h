@@ -0,0 +1,182 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+
+// STL includes.
+#include <map>
+#include <utility>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+
+namespace qmapcontrol
+{
+    //! A single file that holds many encoded z/x/y map tiles.
+    /*!
+     * Tiles are appended one after the other (so several threads can write at once), and an index of where each tile
+     * is stored is written at the end when the pack is closed. A pack is either created and written, or opened and read.
+     *
+     * File layout (big-endian): the header "QMCTPAK1", then each tile's encoded image, then the index (per tile: the key
+     * as a quint64 of zoom << 58 | x << 29 | y, the offset as a quint64, the size as a quint32), then the index offset
+     * (quint64), the tile count (quint64) and the footer "QMCTIDX1".
+     *
+     * A pack can be drawn by a MapAdapterTile using a url of the form "tilepack:/path/to/file.pack#%zoom/%x/%y" (see url()).
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT TilePack
+    {
+    public:
+        /*!
+         * The url scheme that image manager fetches packed tiles with.
+         * @return the url scheme.
+         */
+        static QString urlScheme();
+
+        /*!
+         * Generates the base url to draw a pack with a MapAdapterTile.
+         * @param filename The pack file.
+         * @return the base url (with %zoom, %x and %y placeholders).
+         */
+        static QUrl url(const QString& filename);
+
+        /*!
+         * Parses a tile's url (generated from the base url) into the pack file and the tile.
+         * @param url The tile's url.
+         * @param return_filename The pack file.
+         * @param return_zoom The tile's zoom.
+         * @param return_x The tile's x.
+         * @param return_y The tile's y.
+         * @return whether the url is of a packed tile.
+         */
+        static bool parseUrl(const QUrl& url, QString& return_filename, int& return_zoom, int& return_x, int& return_y);
+
+    public:
+        //! Constructor.
+        /*!
+         * Tile Pack constructor (the file is not accessed until it is created or opened).
+         * @param filename The pack file.
+         */
+        explicit TilePack(const QString& filename);
+
+        //! Disable copy constructor.
+        ///TilePack(const TilePack&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///TilePack& operator=(const TilePack&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        /*!
+         * Closes the pack (writing the index, if it was created).
+         */
+        ~TilePack();
+
+        /*!
+         * Creates the pack for writing (replacing any existing file).
+         * @return whether the pack was created.
+         */
+        bool create();
+
+        /*!
+         * Writes a tile to a created pack (this may be called from several threads at once).
+         * @param zoom The tile's zoom.
+         * @param x The tile's x.
+         * @param y The tile's y.
+         * @param data The tile's encoded image.
+         * @return whether the tile was written.
+         */
+        bool write(const int& zoom, const int& x, const int& y, const QByteArray& data);
+
+        /*!
+         * Opens an existing pack for reading.
+         * @return whether the pack was opened (and its index read).
+         */
+        bool open();
+
+        /*!
+         * Checks whether an opened pack holds a tile.
+         * @param zoom The tile's zoom.
+         * @param x The tile's x.
+         * @param y The tile's y.
+         * @return whether the tile is in the pack.
+         */
+        bool contains(const int& zoom, const int& x, const int& y) const;
+
+        /*!
+         * Reads a tile from an opened pack (this may be called from several threads at once).
+         * @param zoom The tile's zoom.
+         * @param x The tile's x.
+         * @param y The tile's y.
+         * @return the tile's encoded image (empty if the tile is not in the pack).
+         */
+        QByteArray read(const int& zoom, const int& x, const int& y) const;
+
+        /*!
+         * Closes the pack, writing the index if it was created.
+         * @return whether the pack was closed successfully.
+         */
+        bool close();
+
+        /*!
+         * Fetches the number of tiles in the pack.
+         * @return the number of tiles.
+         */
+        std::size_t size() const;
+
+    private:
+        //! Disable copy constructor.
+        TilePack(const TilePack&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        TilePack& operator=(const TilePack&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /*!
+         * Generates the key a tile is indexed by.
+         * @param zoom The tile's zoom.
+         * @param x The tile's x.
+         * @param y The tile's y.
+         * @return the key.
+         */
+        static quint64 key(const int& zoom, const int& x, const int& y);
+
+    private:
+        /// The pack file.
+        mutable QFile m_file;
+
+        /// Whether the pack was created for writing (otherwise it was opened for reading).
+        bool m_writing;
+
+        /// Where each tile is stored (offset and size), keyed by the tile's key.
+        std::map<quint64, std::pair<quint64, quint32>> m_index;
+
+        /// Mutex to protect the file and index.
+        mutable QMutex m_mutex;
+    };
+}
@@ -0,0 +1,395 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "TileSeeder.h"
+
+// Qt includes.
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtCore/QBuffer>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtGui/QImage>
+
+// STL includes.
+#include <algorithm>
+#include <cmath>
+
+// Local includes.
+#include "ImageManager.h"
+#include "TilePack.h"
+
+namespace qmapcontrol
+{
+    namespace
+    {
+        /// The minimum time between progress signals (milliseconds).
+        const qint64 progress_interval_ms(250);
+
+        /// Runs a function on a thread pool.
+        class FunctionRunnable : public QRunnable
+        {
+        public:
+            /*!
+             * Function Runnable constructor.
+             * @param function The function to run.
+             */
+            explicit FunctionRunnable(const std::function<void()>& function)
+                : m_function(function)
+            {
+
+            }
+
+            /*!
+             * Runs the function (on a pool thread).
+             */
+            void run() override
+            {
+                m_function();
+            }
+
+        private:
+            /// The function to run.
+            std::function<void()> m_function;
+        };
+    }
+
+    QUrl TileSeeder::directoryUrl(const QString& directory)
+    {
+        // Return the directory's tiles as a local file url (QUrl converts % into %25, as MapAdapterTile expects).
+        return QUrl::fromLocalFile(QDir(directory).absoluteFilePath("%zoom/%x/%y.png"));
+    }
+
+    TileSeeder::TileSeeder(const std::vector<std::shared_ptr<Layer>>& layers, const RectWorldCoord& bounding_box_coord, const int& zoom_minimum, const int& zoom_maximum, const projection::EPSG& epsg, QObject* parent)
+        : QObject(parent),
+          m_renderer(epsg),
+          m_bounding_box_coord(bounding_box_coord),
+          m_zoom_minimum(std::max(zoom_minimum, 0)),
+          m_zoom_maximum(zoom_maximum),
+          m_thread_pool(),
+          m_skip_empty_tiles(false),
+          m_cancelled(false),
+          m_progress_emitted_ms(0)
+    {
+        // Render the layers antialiased by default (seeded tiles are kept, so quality matters more than speed).
+        m_renderer.setLayers(layers);
+        m_renderer.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+
+        // Render on as many threads as there are cores.
+        m_thread_pool.setMaxThreadCount(QThread::idealThreadCount());
+    }
+
+    TileSeeder::~TileSeeder()
+    {
+        // Cancel and wait for any seeding still running on a worker thread (the worker uses this seeder).
+        cancel();
+        m_seed_future.waitForFinished();
+    }
+
+    MapRenderer& TileSeeder::renderer()
+    {
+        // Return the renderer.
+        return m_renderer;
+    }
+
+    int TileSeeder::threadCount() const
+    {
+        // Return the number of threads.
+        return m_thread_pool.maxThreadCount();
+    }
+
+    void TileSeeder::setThreadCount(const int& thread_count)
+    {
+        // Set the number of threads (at least one).
+        m_thread_pool.setMaxThreadCount(std::max(thread_count, 1));
+    }
+
+    bool TileSeeder::skipEmptyTiles() const
+    {
+        // Return whether empty tiles are skipped.
+        return m_skip_empty_tiles;
+    }
+
+    void TileSeeder::setSkipEmptyTiles(const bool& skip_empty_tiles)
+    {
+        // Set whether empty tiles are skipped.
+        m_skip_empty_tiles = skip_empty_tiles;
+    }
+
+    qint64 TileSeeder::tileCount() const
+    {
+        // Sum the number of tiles at each zoom.
+        qint64 return_count(0);
+        for(const auto& tile_range : tileRanges())
+        {
+            return_count += tile_range.count();
+        }
+
+        // Return the number of tiles.
+        return return_count;
+    }
+
+    bool TileSeeder::seedDirectory(const QString& directory)
+    {
+        // Reset the cancellation, and seed the tiles.
+        m_cancelled = false;
+        return seedDirectoryTiles(directory);
+    }
+
+    bool TileSeeder::seedPack(const QString& filename)
+    {
+        // Reset the cancellation, and seed the tiles.
+        m_cancelled = false;
+        return seedPackTiles(filename);
+    }
+
+    QFuture<bool> TileSeeder::seedDirectoryConcurrently(const QString& directory)
+    {
+        // Wait for any previous seeding to finish.
+        m_seed_future.waitForFinished();
+
+        // Reset the cancellation (before the worker starts, so a cancel straight after this call is kept).
+        m_cancelled = false;
+
+        // Seed the tiles on a worker thread.
+        m_seed_future = QtConcurrent::run(this, &TileSeeder::seedDirectoryTiles, directory);
+        return m_seed_future;
+    }
+
+    QFuture<bool> TileSeeder::seedPackConcurrently(const QString& filename)
+    {
+        // Wait for any previous seeding to finish.
+        m_seed_future.waitForFinished();
+
+        // Reset the cancellation (before the worker starts, so a cancel straight after this call is kept).
+        m_cancelled = false;
+
+        // Seed the tiles on a worker thread.
+        m_seed_future = QtConcurrent::run(this, &TileSeeder::seedPackTiles, filename);
+        return m_seed_future;
+    }
+
+    void TileSeeder::cancel()
+    {
+        // Cancel the seeding in progress.
+        m_cancelled = true;
+    }
+
+    bool TileSeeder::seedDirectoryTiles(const QString& directory)
+    {
+        // Seed each tile to directory/zoom/x/y.png.
+        const QDir root_directory(directory);
+        return seed([&](const Tile& tile, const QByteArray& data) -> bool
+        {
+            // Ensure the x directory exists (several threads may create it at once, which mkpath allows).
+            const QString x_path(root_directory.absoluteFilePath(QString("%1/%2").arg(tile.zoom).arg(tile.x)));
+            if(QDir().mkpath(x_path) == false)
+            {
+                return false;
+            }
+
+            // Write the tile.
+            QFile file(QDir(x_path).absoluteFilePath(QString("%1.png").arg(tile.y)));
+            return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(data) == data.size();
+        });
+    }
+
+    bool TileSeeder::seedPackTiles(const QString& filename)
+    {
+        // Create the tile pack.
+        TilePack tile_pack(filename);
+        if(tile_pack.create() == false)
+        {
+            return false;
+        }
+
+        // Seed each tile to the pack.
+        const bool success(seed([&](const Tile& tile, const QByteArray& data) -> bool
+        {
+            // Write the tile.
+            return tile_pack.write(tile.zoom, tile.x, tile.y, data);
+        }));
+
+        // Close the pack (writing its index, even if the seeding failed, so the tiles seeded can be read).
+        return tile_pack.close() && success;
+    }
+
+    std::vector<TileSeeder::TileRange> TileSeeder::tileRanges() const
+    {
+        // Tile ranges to return.
+        std::vector<TileRange> return_tile_ranges;
+
+        // Override the projection for this thread while converting.
+        const projection::ThreadOverride projection_override(m_renderer.projection());
+        const qreal tile_size_px(ImageManager::get().tileSizePx());
+
+        // Loop through each zoom.
+        for(int zoom = m_zoom_minimum; zoom <= m_zoom_maximum; ++zoom)
+        {
+            // Calculate the bounding box in world pixels at this zoom (from each corner, as the y-axis may be flipped).
+            RectWorldCoord bounding_box_coord(m_bounding_box_coord);
+            const std::vector<PointWorldCoord> corners_coord(bounding_box_coord.toStdVector());
+            QPointF minimum_px(projection::get().toPointWorldPx(corners_coord.front(), zoom).rawPoint());
+            QPointF maximum_px(minimum_px);
+            for(const auto& point_coord : corners_coord)
+            {
+                const QPointF point_px(projection::get().toPointWorldPx(point_coord, zoom).rawPoint());
+                minimum_px = QPointF(std::min(minimum_px.x(), point_px.x()), std::min(minimum_px.y(), point_px.y()));
+                maximum_px = QPointF(std::max(maximum_px.x(), point_px.x()), std::max(maximum_px.y(), point_px.y()));
+            }
+
+            // Calculate the tiles the bounding box overlaps (clamped to the tiles that exist at this zoom, and at least the
+            // one containing the bounding box, if it is a point or a line).
+            TileRange tile_range;
+            tile_range.zoom = zoom;
+            tile_range.x_minimum = std::max(int(std::floor(minimum_px.x() / tile_size_px)), 0);
+            tile_range.x_maximum = std::max(std::min(int(std::ceil(maximum_px.x() / tile_size_px)) - 1, projection::get().tilesX(zoom) - 1), tile_range.x_minimum);
+            tile_range.y_minimum = std::max(int(std::floor(minimum_px.y() / tile_size_px)), 0);
+            tile_range.y_maximum = std::max(std::min(int(std::ceil(maximum_px.y() / tile_size_px)) - 1, projection::get().tilesY(zoom) - 1), tile_range.y_minimum);
+            return_tile_ranges.push_back(tile_range);
+        }
+
+        // Return the tile ranges.
+        return return_tile_ranges;
+    }
+
+    TileSeeder::Tile TileSeeder::tileAt(const std::vector<TileRange>& tile_ranges, qint64 index)
+    {
+        // Find the zoom the tile is at.
+        auto itr_tile_range = tile_ranges.begin();
+        while(index >= itr_tile_range->count())
+        {
+            index -= itr_tile_range->count();
+            ++itr_tile_range;
+        }
+
+        // Return the tile within the zoom's tiles (columns first).
+        const qint64 height(itr_tile_range->y_maximum - itr_tile_range->y_minimum + 1);
+        Tile return_tile;
+        return_tile.zoom = itr_tile_range->zoom;
+        return_tile.x = itr_tile_range->x_minimum + int(index / height);
+        return_tile.y = itr_tile_range->y_minimum + int(index % height);
+        return return_tile;
+    }
+
+    bool TileSeeder::seed(const std::function<bool(const Tile&, const QByteArray&)>& write_tile)
+    {
+        // Fetch the tiles to seed (each tile is only calculated as it is taken, so even a large seed needs no list of tiles).
+        const std::vector<TileRange> tile_ranges(tileRanges());
+        qint64 tiles_total(0);
+        for(const auto& tile_range : tile_ranges)
+        {
+            tiles_total += tile_range.count();
+        }
+        const int tile_size_px(ImageManager::get().tileSizePx());
+
+        // Create an empty tile to compare rendered tiles against (shared read-only by each render thread).
+        QImage empty_image(tile_size_px, tile_size_px, QImage::Format_ARGB32_Premultiplied);
+        empty_image.fill(m_renderer.backgroundColour());
+        const bool skip_empty_tiles(m_skip_empty_tiles);
+
+        // Reset the progress.
+        m_progress_timer.start();
+        m_progress_emitted_ms = 0;
+        emit progress(0, tiles_total, 0.0);
+
+        // Keep track of the next tile to seed, how many are seeded, and whether any failed.
+        std::atomic<qint64> next_tile(0);
+        std::atomic<qint64> tiles_seeded(0);
+        std::atomic<bool> success(true);
+
+        // Start a worker on each pool thread, which each take the next tile until there are none left (so a slow tile
+        // does not hold up a batch of others).
+        for(int i = 0; i < m_thread_pool.maxThreadCount(); ++i)
+        {
+            m_thread_pool.start(new FunctionRunnable([&]()
+            {
+                // Each worker renders into its own image.
+                QImage image(tile_size_px, tile_size_px, QImage::Format_ARGB32_Premultiplied);
+
+                // Loop until there are no tiles left (or the seeding is cancelled).
+                for(qint64 index = next_tile++; index < tiles_total && m_cancelled == false; index = next_tile++)
+                {
+                    // Render the tile (its position in world pixels exceeds an int at high zooms).
+                    const Tile tile(tileAt(tile_ranges, index));
+                    m_renderer.render(image, RectWorldPx(PointWorldPx(qreal(qint64(tile.x) * tile_size_px), qreal(qint64(tile.y) * tile_size_px)), QSizeF(tile_size_px, tile_size_px)), tile.zoom);
+
+                    // Is the tile empty (and should be skipped)?
+                    if(skip_empty_tiles == false || image != empty_image)
+                    {
+                        // Encode the tile as a PNG.
+                        QByteArray data;
+                        QBuffer buffer(&data);
+                        buffer.open(QIODevice::WriteOnly);
+
+                        // Write the tile.
+                        if(image.save(&buffer, "PNG") == false || write_tile(tile, data) == false)
+                        {
+                            // Keep seeding the other tiles, but report the failure.
+                            success = false;
+                        }
+                    }
+
+                    // Update the progress.
+                    emitProgress(++tiles_seeded, tiles_total);
+                }
+            }));
+        }
+
+        // Wait for every worker to finish.
+        m_thread_pool.waitForDone();
+
+        // Emit the final progress.
+        const qint64 elapsed_ms(m_progress_timer.elapsed());
+        emit progress(tiles_seeded, tiles_total, elapsed_ms > 0 ? tiles_seeded * 1000.0 / elapsed_ms : 0.0);
+
+        // Emit that the seeding has finished, and return whether every tile was seeded.
+        const bool return_success(success && tiles_seeded == tiles_total);
+        emit finished(return_success);
+        return return_success;
+    }
+
+    void TileSeeder::emitProgress(const qint64& tiles_seeded, const qint64& tiles_total)
+    {
+        // Calculate the throughput.
+        qint64 elapsed_ms(0);
+
+        // Scope the locker to ensure the mutex is release as soon as possible.
+        {
+            // Gain a lock to protect the progress timing.
+            QMutexLocker locker(&m_progress_mutex);
+
+            // Has the progress been emitted recently?
+            elapsed_ms = m_progress_timer.elapsed();
+            if(elapsed_ms - m_progress_emitted_ms < progress_interval_ms)
+            {
+                return;
+            }
+            m_progress_emitted_ms = elapsed_ms;
+        }
+
+        // Emit the progress (outside of the lock, so a direct connection can call back into the seeder).
+        emit progress(tiles_seeded, tiles_total, elapsed_ms > 0 ? tiles_seeded * 1000.0 / elapsed_ms : 0.0);
+    }
+}
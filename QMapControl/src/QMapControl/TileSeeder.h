@@ -0,0 +1,311 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// Qt includes.
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFuture>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QThreadPool>
+#include <QtCore/QUrl>
+
+// STL includes.
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Local includes.
+#include "qmapcontrol_global.h"
+#include "Layer.h"
+#include "MapRenderer.h"
+#include "Point.h"
+#include "Projection.h"
+
+namespace qmapcontrol
+{
+    //! Seeds XYZ map tiles by rendering layers, on several threads.
+    /*!
+     * Every tile (of the image manager's tile size) that overlaps a bounding box, at each zoom in a range, is rendered
+     * from the layers (ie: LayerGeometry or LayerESRIShapefile) with a MapRenderer and encoded as a PNG. Tiles are
+     * rendered concurrently on the seeder's own thread pool, and are written either to a directory tree
+     * (directory/zoom/x/y.png) or to a single TilePack file.
+     *
+     * Seeding can take a long time, so from the GUI thread use seedDirectoryConcurrently() or seedPackConcurrently(),
+     * which return straight away and emit finished() once done; seedDirectory() and seedPack() block the calling thread.
+     *
+     * The seeded tiles can then be drawn (without rendering the layers again) by a LayerMapAdapter with a MapAdapterTile,
+     * using directoryUrl() or TilePack::url() as the base url.
+     *
+     * @author Chris Stylianou <chris5287@gmail.com>
+     */
+    class QMAPCONTROL_EXPORT TileSeeder : public QObject
+    {
+        Q_OBJECT
+    public:
+        /*!
+         * Generates the base url to draw tiles seeded to a directory with a MapAdapterTile.
+         * @param directory The directory the tiles were seeded to.
+         * @return the base url (with %zoom, %x and %y placeholders).
+         */
+        static QUrl directoryUrl(const QString& directory);
+
+    public:
+        //! Constructor.
+        /*!
+         * Tile Seeder constructor.
+         * @param layers The layers to render (bottom first).
+         * @param bounding_box_coord The area to seed tiles for (coordinates).
+         * @param zoom_minimum The minimum zoom to seed tiles for.
+         * @param zoom_maximum The maximum zoom to seed tiles for.
+         * @param epsg The projection to render with (the tiles are in this projection).
+         * @param parent QObject parent ownership.
+         */
+        TileSeeder(const std::vector<std::shared_ptr<Layer>>& layers,
+                   const RectWorldCoord& bounding_box_coord,
+                   const int& zoom_minimum,
+                   const int& zoom_maximum,
+                   const projection::EPSG& epsg = projection::EPSG::SphericalMercator,
+                   QObject* parent = 0);
+
+        //! Disable copy constructor.
+        ///TileSeeder(const TileSeeder&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        ///TileSeeder& operator=(const TileSeeder&) = delete; @todo re-add once MSVC supports default/delete syntax.
+
+        //! Destructor.
+        ~TileSeeder();
+
+        /*!
+         * Fetches the renderer the tiles are rendered with (to change its background colour or render hints).
+         * @return the renderer.
+         */
+        MapRenderer& renderer();
+
+        /*!
+         * Fetches the number of threads the tiles are rendered on.
+         * @return the number of threads.
+         */
+        int threadCount() const;
+
+        /*!
+         * Sets the number of threads to render the tiles on (the ideal thread count by default).
+         * @param thread_count The number of threads.
+         */
+        void setThreadCount(const int& thread_count);
+
+        /*!
+         * Fetches whether tiles that have nothing rendered on them are skipped.
+         * @return whether empty tiles are skipped.
+         */
+        bool skipEmptyTiles() const;
+
+        /*!
+         * Sets whether tiles that have nothing rendered on them (only the background colour) are skipped (not by default).
+         * @note A tile pack draws a skipped tile as transparent, but a directory does not have the file for it.
+         * @param skip_empty_tiles Whether empty tiles are skipped.
+         */
+        void setSkipEmptyTiles(const bool& skip_empty_tiles);
+
+        /*!
+         * Fetches the number of tiles that overlap the bounding box within the zoom range.
+         * @return the number of tiles.
+         */
+        qint64 tileCount() const;
+
+        /*!
+         * Seeds the tiles to a directory tree (directory/zoom/x/y.png), blocking until they are seeded or cancelled.
+         * @note Only call this from a worker thread, use seedDirectoryConcurrently() from the GUI thread.
+         * @param directory The directory to seed the tiles to (created if required).
+         * @return whether every tile was seeded.
+         */
+        bool seedDirectory(const QString& directory);
+
+        /*!
+         * Seeds the tiles to a tile pack, blocking until they are seeded or cancelled (the pack holds any tiles seeded).
+         * @note Only call this from a worker thread, use seedPackConcurrently() from the GUI thread.
+         * @param filename The tile pack file to create (replacing any existing file).
+         * @return whether every tile was seeded.
+         */
+        bool seedPack(const QString& filename);
+
+        /*!
+         * Seeds the tiles to a directory tree (directory/zoom/x/y.png) on a worker thread, without blocking.
+         * @param directory The directory to seed the tiles to (created if required).
+         * @return a future that finishes once the tiles are seeded or cancelled, with whether every tile was seeded.
+         */
+        QFuture<bool> seedDirectoryConcurrently(const QString& directory);
+
+        /*!
+         * Seeds the tiles to a tile pack on a worker thread, without blocking.
+         * @param filename The tile pack file to create (replacing any existing file).
+         * @return a future that finishes once the tiles are seeded or cancelled, with whether every tile was seeded.
+         */
+        QFuture<bool> seedPackConcurrently(const QString& filename);
+
+    public slots:
+        /*!
+         * Cancels the seeding in progress (tiles already being rendered are still written).
+         */
+        void cancel();
+
+    signals:
+        /*!
+         * Signal emitted periodically while tiles are seeded (from a render thread), and once they are all seeded.
+         * @param tiles_seeded The number of tiles seeded (or skipped) so far.
+         * @param tiles_total The number of tiles to seed.
+         * @param tiles_per_second The throughput so far (tiles per second).
+         */
+        void progress(const qint64& tiles_seeded, const qint64& tiles_total, const qreal& tiles_per_second) const;
+
+        /*!
+         * Signal emitted once the tiles are seeded or cancelled (from the thread that seeded them).
+         * @param success Whether every tile was seeded.
+         */
+        void finished(const bool& success) const;
+
+    private:
+        //! Disable copy constructor.
+        TileSeeder(const TileSeeder&); /// @todo remove once MSVC supports default/delete syntax.
+
+        //! Disable copy assignment.
+        TileSeeder& operator=(const TileSeeder&); /// @todo remove once MSVC supports default/delete syntax.
+
+        /// A tile to seed.
+        struct Tile
+        {
+            /// The controller zoom.
+            int zoom;
+
+            /// The x tile.
+            int x;
+
+            /// The y tile.
+            int y;
+        };
+
+        /// The range of tiles to seed at a zoom.
+        struct TileRange
+        {
+            /// The controller zoom.
+            int zoom;
+
+            /// The minimum x tile.
+            int x_minimum;
+
+            /// The maximum x tile.
+            int x_maximum;
+
+            /// The minimum y tile.
+            int y_minimum;
+
+            /// The maximum y tile.
+            int y_maximum;
+
+            /*!
+             * Fetches the number of tiles in the range (which can exceed an int at high zooms).
+             * @return the number of tiles.
+             */
+            qint64 count() const { return qint64(x_maximum - x_minimum + 1) * qint64(y_maximum - y_minimum + 1); }
+        };
+
+        /*!
+         * Seeds the tiles to a directory tree (directory/zoom/x/y.png).
+         * @param directory The directory to seed the tiles to (created if required).
+         * @return whether every tile was seeded.
+         */
+        bool seedDirectoryTiles(const QString& directory);
+
+        /*!
+         * Seeds the tiles to a tile pack.
+         * @param filename The tile pack file to create (replacing any existing file).
+         * @return whether every tile was seeded.
+         */
+        bool seedPackTiles(const QString& filename);
+
+        /*!
+         * Fetches the range of tiles that overlap the bounding box at each zoom in the zoom range (rather than each tile,
+         * which at high zooms can be far too many to hold).
+         * @return the tile ranges to seed (lowest zoom first).
+         */
+        std::vector<TileRange> tileRanges() const;
+
+        /*!
+         * Fetches a tile by its index across the tile ranges.
+         * @param tile_ranges The tile ranges.
+         * @param index The index of the tile (less than the total tile count).
+         * @return the tile.
+         */
+        static Tile tileAt(const std::vector<TileRange>& tile_ranges, qint64 index);
+
+        /*!
+         * Renders and encodes each tile on the thread pool, and writes it.
+         * @param write_tile The callback to write an encoded tile (called from several threads at once).
+         * @return whether every tile was seeded.
+         */
+        bool seed(const std::function<bool(const Tile&, const QByteArray&)>& write_tile);
+
+        /*!
+         * Emits the progress, if it has not been emitted recently.
+         * @param tiles_seeded The number of tiles seeded so far.
+         * @param tiles_total The number of tiles to seed.
+         */
+        void emitProgress(const qint64& tiles_seeded, const qint64& tiles_total);
+
+    private:
+        /// The renderer the tiles are rendered with.
+        MapRenderer m_renderer;
+
+        /// The area to seed tiles for (coordinates).
+        const RectWorldCoord m_bounding_box_coord;
+
+        /// The minimum zoom to seed tiles for.
+        const int m_zoom_minimum;
+
+        /// The maximum zoom to seed tiles for.
+        const int m_zoom_maximum;
+
+        /// The thread pool the tiles are rendered on.
+        QThreadPool m_thread_pool;
+
+        /// Whether tiles that have nothing rendered on them are skipped.
+        std::atomic<bool> m_skip_empty_tiles;
+
+        /// Whether the seeding in progress has been cancelled.
+        std::atomic<bool> m_cancelled;
+
+        /// The future of the seeding running on a worker thread (if any).
+        QFuture<bool> m_seed_future;
+
+        /// Timer started when the seeding began (for the throughput).
+        QElapsedTimer m_progress_timer;
+
+        /// When the progress was last emitted (milliseconds since the seeding began).
+        qint64 m_progress_emitted_ms;
+
+        /// Mutex to protect the progress timing.
+        QMutex m_progress_mutex;
+    };
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ * This file is part of QMapControl,
+ * an open-source cross-platform map widget
+ *
+ * Copyright (C) 2014 Chris Stylianou
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with QMapControl. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+// STL includes.
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+
+namespace qmapcontrol
+{
+    /*!
+     * Removes the entries whose objects have been released from a map of weak pointers, once it has grown to a size.
+     * The size to prune at next is then twice the entries left (at least the minimum), so each insert pays for a bounded
+     * number of entry checks on average, however the map is used.
+     * @param map The map to prune.
+     * @param prune_size The size to prune the map at (updated once it is pruned).
+     * @param prune_size_minimum The smallest size to prune the map at.
+     */
+    template <class Key, class T>
+    void pruneExpired(std::map<Key, std::weak_ptr<T>>& map, std::size_t& prune_size, const std::size_t& prune_size_minimum)
+    {
+        // Has the map grown enough to be worth pruning?
+        if(map.size() >= prune_size)
+        {
+            // Loop through each entry.
+            for(auto itr = map.begin(); itr != map.end(); )
+            {
+                // Is the object still used?
+                if(itr->second.expired())
+                {
+                    itr = map.erase(itr);
+                }
+                else
+                {
+                    ++itr;
+                }
+            }
+
+            // Set the size to prune at next.
+            prune_size = std::max(prune_size_minimum, map.size() * 2);
+        }
+    }
+}